@@ -7,6 +7,7 @@
 
 #include <locale>
 #include <codecvt>
+#include <cstdio>
 #include <map>
 #include "error.h"
 #include "sys.h"
@@ -16,6 +17,7 @@
 #include <memory>
 #include "model_define.h"
 #include "vega_time_pnt.h"
+#include "vega_option_store.h"
 
 namespace vega{
 
@@ -100,8 +102,20 @@ const StreamId INVALID_STREAM_ID = 0xFFFFFFFF;
 
     };
 
+    /**
+     * One plane of an image, rows may be padded
+     */
+    typedef struct {
+        DG_U8 * ptr     = nullptr;
+        DG_U32  stride_ = 0;    ///<! bytes of a row, including padding
+        cv::Size size_;         ///<! size in elements, e.g. UV plane of NV12 is (w/2, h/2) of 2 bytes
+        int     cv_type_ = CV_8UC1; ///<! element type as cv::Mat type
+    } DgPlane;
+
     class DgImage {
     public:
+        static const int MAX_PLANES = 3;
+
         DgImage() : frame_(0), type_(DgImageType::DG_IMAGE_TYPE_INVALID) {
 
         }
@@ -111,12 +125,30 @@ const StreamId INVALID_STREAM_ID = 0xFFFFFFFF;
         }
         virtual ~DgImage() = default;
 
+        /**
+         * Image over data of a mat holding all planes, rows * 3 / 2 of NV12 and I420,
+         * rows * 3 of BGR/RGB planar. Step of mat is kept as stride, no data is copied.
+         */
+        static DgImage fromMat(const cv::Mat &mat, DgImageType type = DgImageType::DG_IMAGE_BGR_PACKAGE) {
+            cv::Size size(mat.cols, mat.rows);
+            if(type == DgImageType::DG_IMAGE_YUV_SP420 || type == DgImageType::DG_IMAGE_YUV_I420) {
+                size.height = mat.rows * 2 / 3;
+            } else if(type == DgImageType::DG_IMAGE_BGR_PLANAR || type == DgImageType::DG_IMAGE_RGB_PLANAR) {
+                size.height = mat.rows / 3;
+            }
+            DgImage img;
+            img.create(mat.data, size, size, type, cv::Size((int)mat.step[0], size.height));
+            return img;
+        }
+
         FrameId         frame_;     ///<! Frame id in video or picture stream
         DgImageType     type_;      ///<! image type
         cv::Rect        roi_;       ///<! Region of interest
         cv::Size        size_;      ///<! current size
         cv::Size        orig_size_; ///<! original size, in case this image is resized, here record the original size
-        MemBlock        blob_;      ///<! image data
+        MemBlock        blob_;      ///<! image data, from first pixel to the end of last plane
+        DgPlane         planes_[MAX_PLANES];    ///<! planes of image, see planeCount()
+        std::shared_ptr<void> owner_;   ///<! optional, keeps data alive, shared by views
 
     public:
         inline DG_U8 *data() {
@@ -154,11 +186,56 @@ const StreamId INVALID_STREAM_ID = 0xFFFFFFFF;
         inline bool hasRoi() {
             return roi_.area() > 0;
         }
-        /** transfer to mat */
+        /** transfer to mat, only for single plane images: BGR/RGB packed or gray */
         virtual cv::Mat mat() {
-            CHECK(type_ == DgImageType::DG_IMAGE_BGR_PACKAGE);
-            return cv::Mat(size_, CV_8UC3, blob_.ptr);
+            CHECK(planeCount(type_) == 1) << "image of " << planeCount(type_) << " planes, use mat(plane)";
+            return mat(0);
         }
+        /**
+         * Mat header of a plane with its stride, no data is copied.
+         * NV12: Y plane of CV_8UC1, UV plane of CV_8UC2
+         * I420: Y, U, V planes of CV_8UC1
+         * BGR/RGB planar: each channel of CV_8UC1
+         */
+        inline cv::Mat mat(int plane) const {
+            CHECK(plane >= 0 && plane < planeCount(type_)) << "invalid plane " << plane << " of type " << int(type_);
+            auto &p = planes_[plane];
+            return cv::Mat(p.size_, p.cv_type_, p.ptr, p.stride_);
+        }
+        inline const DgPlane &plane(int plane) const {
+            CHECK(plane >= 0 && plane < planeCount(type_)) << "invalid plane " << plane << " of type " << int(type_);
+            return planes_[plane];
+        }
+        /**
+         * Image of roi sharing data with this one, roi of YUV 420 images is aligned to 2.
+         * Planes of view are strided in the buffer of this image, blob_ covers them.
+         */
+        DgImage view(const cv::Rect &roi) const {
+            auto r = roi & cv::Rect(cv::Point(0, 0), size_);
+            if(type_ == DgImageType::DG_IMAGE_YUV_SP420 || type_ == DgImageType::DG_IMAGE_YUV_I420) {
+                r = cv::Rect(r.x & ~1, r.y & ~1, r.width & ~1, r.height & ~1);
+            }
+            CHECK(r.area() > 0) << "Roi(" << roi.x << " " << roi.y << " " << roi.width << " " << roi.height
+                                << ") out of range, sz(" << size_.width << " " << size_.height << ")";
+
+            DgImage img(*this);
+            img.roi_ = cv::Rect();
+            img.size_ = r.size();
+            img.orig_size_ = r.size();
+            auto yuv420 = type_ == DgImageType::DG_IMAGE_YUV_SP420 || type_ == DgImageType::DG_IMAGE_YUV_I420;
+            DG_U8 *end = nullptr;
+            for(auto i = 0; i < planeCount(type_); i++) {
+                auto &p = img.planes_[i];
+                auto sub = (yuv420 && i > 0) ? 2 : 1;
+                p.ptr = planes_[i].ptr + (size_t)(r.y / sub) * p.stride_ + (size_t)(r.x / sub) * CV_ELEM_SIZE(p.cv_type_);
+                p.size_ = cv::Size(r.width / sub, r.height / sub);
+                end = std::max(end, p.ptr + (size_t)(p.size_.height - 1) * p.stride_ + (size_t)p.size_.width * CV_ELEM_SIZE(p.cv_type_));
+            }
+            img.blob_.ptr = img.planes_[0].ptr;
+            img.blob_.size_ = DG_U32(end - img.blob_.ptr);
+            return img;
+        }
+
         void clear() {
             frame_ = 0;
             type_ = DgImageType ::DG_IMAGE_TYPE_INVALID;
@@ -167,30 +244,110 @@ const StreamId INVALID_STREAM_ID = 0xFFFFFFFF;
             orig_size_ = size_;
             blob_.size_ = 0;
             blob_.ptr = nullptr;
+            for(auto &p : planes_) p = DgPlane();
+            owner_.reset();
         }
         void create(void *data, const cv::Size &size, DgImageType type) {
             create(data, size, size, type);
         }
-        void create(void *data, const cv::Size &origSize, const cv::Size &size, DgImageType type) {
+        /**
+         * @param stride padded size of first plane, width in bytes and height in rows, like
+         *        SdkTaskBase::stride_. Empty for compact data. Planes of YUV 420 are padded
+         *        alike, chroma rows of I420 are half of stride width.
+         */
+        void create(void *data, const cv::Size &origSize, const cv::Size &size, DgImageType type,
+                    cv::Size stride = cv::Size()) {
+            auto count = planeCount(type);
+            CHECK(count > 0) << "image not support " << int(type);
+            if(stride.width <= 0) stride.width = size.width * pixelBytes(type);
+            if(stride.height <= 0) stride.height = size.height;
+            CHECK(stride.width >= size.width * pixelBytes(type) && stride.height >= size.height)
+                    << "stride(" << stride.width << " " << stride.height << ") less than size("
+                    << size.width << " " << size.height << ")";
+
             type_ = type;
             blob_.ptr = (DG_U8 *)data;
+            for(auto &p : planes_) p = DgPlane();
+            auto *ptr = (DG_U8 *)data;
+            auto planeBytes = (size_t)stride.width * stride.height;
             switch(type) {
                 case DgImageType::DG_IMAGE_YUV_SP420:
-                    blob_.size_ = DG_U32(3 * size.area()/2);
+                    planes_[0] = makePlane(ptr, stride.width, size, CV_8UC1);
+                    planes_[1] = makePlane(ptr + planeBytes, stride.width, size / 2, CV_8UC2);
+                    blob_.size_ = DG_U32(planeBytes * 3 / 2);
+                    break;
+                case DgImageType::DG_IMAGE_YUV_I420:
+                    planes_[0] = makePlane(ptr, stride.width, size, CV_8UC1);
+                    planes_[1] = makePlane(ptr + planeBytes, stride.width / 2, size / 2, CV_8UC1);
+                    planes_[2] = makePlane(ptr + planeBytes * 5 / 4, stride.width / 2, size / 2, CV_8UC1);
+                    blob_.size_ = DG_U32(planeBytes * 3 / 2);
                     break;
                 case DgImageType::DG_IMAGE_BGR_PACKAGE:
-                case DgImageType::DG_IMAGE_BGR_PLANAR:
                 case DgImageType::DG_IMAGE_RGB_PACKAGE:
+                    planes_[0] = makePlane(ptr, stride.width, size, CV_8UC3);
+                    blob_.size_ = DG_U32(planeBytes);
+                    break;
+                case DgImageType::DG_IMAGE_BGR_PLANAR:
                 case DgImageType::DG_IMAGE_RGB_PLANAR:
-                    blob_.size_ = DG_U32(3 * size.area());
+                    for(auto i = 0; i < 3; i++) {
+                        planes_[i] = makePlane(ptr + planeBytes * i, stride.width, size, CV_8UC1);
+                    }
+                    blob_.size_ = DG_U32(planeBytes * 3);
                     break;
-                default:
-                    CHECK(false) << "image not support " << int(type);
+                default:    // DG_IMAGE_YUV_GRAY
+                    planes_[0] = makePlane(ptr, stride.width, size, CV_8UC1);
+                    blob_.size_ = DG_U32(planeBytes);
                     break;
             }
             size_ = size;
             orig_size_ = origSize;
         }
+
+        /**
+         * Number of planes of type, 0 for invalid type
+         */
+        static int planeCount(DgImageType type) {
+            switch(type) {
+                case DgImageType::DG_IMAGE_YUV_SP420:
+                    return 2;
+                case DgImageType::DG_IMAGE_YUV_I420:
+                case DgImageType::DG_IMAGE_BGR_PLANAR:
+                case DgImageType::DG_IMAGE_RGB_PLANAR:
+                    return 3;
+                case DgImageType::DG_IMAGE_BGR_PACKAGE:
+                case DgImageType::DG_IMAGE_RGB_PACKAGE:
+                case DgImageType::DG_IMAGE_YUV_GRAY:
+                    return 1;
+                default:
+                    return 0;
+            }
+        }
+        /**
+         * Stride of an image padded as devices require, for HIAI width is aligned to 16 bytes
+         * and height to 2 rows
+         */
+        static cv::Size alignedStride(DgImageType type, const cv::Size &size, int widthAlign = 16, int heightAlign = 2) {
+            auto w = size.width * pixelBytes(type);
+            return cv::Size((w + widthAlign - 1) / widthAlign * widthAlign,
+                            (size.height + heightAlign - 1) / heightAlign * heightAlign);
+        }
+
+        /**
+         * Bytes of a pixel in first plane
+         */
+        static inline int pixelBytes(DgImageType type) {
+            return (type == DgImageType::DG_IMAGE_BGR_PACKAGE || type == DgImageType::DG_IMAGE_RGB_PACKAGE) ? 3 : 1;
+        }
+
+    protected:
+        static DgPlane makePlane(DG_U8 *ptr, int stride, const cv::Size &size, int cvType) {
+            DgPlane p;
+            p.ptr = ptr;
+            p.stride_ = DG_U32(stride);
+            p.size_ = size;
+            p.cv_type_ = cvType;
+            return p;
+        }
     } ;
 
     /**
@@ -680,6 +837,33 @@ const StreamId INVALID_STREAM_ID = 0xFFFFFFFF;
             vf_values_[key] = value;
         }
 
+        /**
+         * Put value by OptionKey, same as put by its name. Value is formatted in place into the
+         * map, so putting again into a task reuses the string held for the option.
+         */
+        void put(const OptionKey &key, bool value) {
+            assign(key, value ? "1" : "0", 1);
+        }
+        void put(const OptionKey &key, int value) {
+            assignInt(key, value);
+        }
+        void put(const OptionKey &key, long int value) {
+            assignInt(key, value);
+        }
+        void put(const OptionKey &key, float value) {
+            char buf[64];
+            assign(key, buf, snprintf(buf, sizeof(buf), "%f", (double)value));
+        }
+        void put(const OptionKey &key, StreamId value) {
+            assignInt(key, value);
+        }
+        void put(const OptionKey &key, wchar_t value) {
+            put(key.name(), value);
+        }
+        void put(const OptionKey &key, const std::string &value) {
+            assign(key, value.data(), value.size());
+        }
+
         /**
          * Get property with default value if not exist
          */
@@ -726,7 +910,50 @@ const StreamId INVALID_STREAM_ID = 0xFFFFFFFF;
             return wstr[0];
         }
 
-
+        /**
+         * Get property by OptionKey with default value if not exist,
+         * value is parsed in place without copying it out
+         */
+        bool getBool(const OptionKey &key, bool def) {
+            auto str = lookup(key.name());
+            if(str == nullptr || str->empty()) return def;
+            if(*str == "1") return true;
+            if(*str == "0") return false;
+            CHECK(false) << "invalid bool key " << key.name() << " value " << *str;
+            return false;
+        }
+        std::string getString(const OptionKey &key, const std::string &def) {
+            auto str = lookup(key.name());
+            if(str == nullptr || str->empty()) return def;
+            return *str;
+        }
+        int getInteger(const OptionKey &key, int def) {
+            auto str = lookup(key.name());
+            if(str == nullptr || str->empty()) return def;
+            return atoi(str->c_str());
+        }
+        long int getLongInt(const OptionKey &key, long int def) {
+            auto str = lookup(key.name());
+            if(str == nullptr || str->empty()) return def;
+            return atol(str->c_str());
+        }
+        long long getLLInt(const OptionKey &key, long long def) {
+            auto str = lookup(key.name());
+            if(str == nullptr || str->empty()) return def;
+            return atoll(str->c_str());
+        }
+        float getFloat(const OptionKey &key, float def) {
+            auto str = lookup(key.name());
+            if(str == nullptr || str->empty()) return def;
+            return atof(str->c_str());
+        }
+        wchar_t getWChar(const OptionKey &key, wchar_t def) {
+            auto str = lookup(key.name());
+            if(str == nullptr || str->empty()) return def;
+            auto wstr = s2ws(*str);
+            CHECK(wstr.size() == 1) << "invalid wchar " << *str;
+            return wstr[0];
+        }
 
         /**
          * Get property without default value
@@ -770,6 +997,19 @@ const StreamId INVALID_STREAM_ID = 0xFFFFFFFF;
             values_ = mapOut;
         }
 
+        void erase(const std::string &key) {
+            values_.erase(key);
+        }
+        /**
+         * Put options not set in this task yet, see BatchOptions
+         * @param added keys of options put, pointing into options, are appended if not nullptr
+         */
+        void merge(const std::map<std::string, std::string> &options, std::vector<const std::string *> *added = nullptr) {
+            for(auto &kv : options) {
+                if(values_.insert(kv).second && added) added->push_back(&kv.first);
+            }
+        }
+
     protected:
         std::string &get(const std::string &key) {
             auto it = values_.find(key);
@@ -781,6 +1021,36 @@ const StreamId INVALID_STREAM_ID = 0xFFFFFFFF;
             if(it != values_.end()) return it->second;
             return "";
         }
+        /**
+         * @return nullptr if key is not set
+         */
+        const std::string *lookup(const std::string &key) const {
+            auto it = values_.find(key);
+            return it == values_.end() ? nullptr : &it->second;
+        }
+        /**
+         * Set value of key to n chars of str, string of an option already set is reused
+         */
+        inline void assign(const OptionKey &key, const char *str, size_t n) {
+            values_[key.name()].assign(str, n);
+        }
+        /**
+         * Set value of key to decimal of an integer, as std::to_string does
+         */
+        template <typename _Int>
+        void assignInt(const OptionKey &key, _Int value) {
+            char buf[24];
+            auto end = buf + sizeof(buf);
+            auto p = end;
+            auto negative = value < 0;
+            auto v = negative ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+            do {
+                *--p = char('0' + v % 10);
+                v /= 10;
+            } while(v != 0);
+            if(negative) *--p = '-';
+            assign(key, p, size_t(end - p));
+        }
 
         using convert_typeX = std::codecvt_utf8<wchar_t>;
 
@@ -85,6 +85,17 @@ namespace vega {
          */
         using AsyncCallback = std::function<void(std::vector<std::shared_ptr<_Task>> &tasks, DgError error)> ;
         using TaskType = _Task;
+        /**
+         * Interface creator bound with all arguments except callback. It's used by wrappers
+         * which own the callback of interface they wrap, for example:
+         *
+         * \code{.cpp}
+         * Executable<DetectTask>::Creator creator = [&](Executable<DetectTask>::AsyncCallback cb) {
+         *     return createDetectInterface(deviceId, cfgPath, "", nullptr, cb);
+         * };
+         * \endcode
+         */
+        using Creator = std::function<std::shared_ptr<Executable<_Task>>(AsyncCallback callback)>;
     public:
         /**
          * Get maximum batch size
@@ -182,13 +193,37 @@ namespace vega {
      *
      *        If type_ is set to SdkImage::JPEG, roi_ can be set to crop target
      *        image and encode to jpeg. Cropping on other image is still not
-     *        supported.
+     *        supported by HIAI, CpuBackend crops all types.
+     *
+     * Option(header-only interfaces, like CpuBackend):
+     *     - OptionKeys::fetch_width_, fetch_height_: resize output in fetching, so only
+     *       output pixels are converted and copied out. Device interfaces ignore them,
+     *       MultiFetchExecutable over a device interface refuses them
+     *     - OptionKeys::fetch_interpolation_: cv::InterpolationFlags of resizing
      *
      * Output: FrameData, type_
      */
     using FetchFrameTask = SdkTask<FrameData>;
     using FetchFrameInterface = Executable<FetchFrameTask>;
 
+    /**
+     * Input: stream_id_, frame_id_, type_, rois_
+     *
+     *        Fetch many regions of one frame in one task, e.g. snapshots of all objects
+     *        detected in a frame. Frame is read and converted once for all regions.
+     *
+     *        type_ can be SdkImage::JPEG, or BGR/GRAY for raw crops. Whole frame is
+     *        fetched if rois_ is empty. roi_ is ignored.
+     *
+     * Output: one FrameData for each of rois_ in the same order, type_.
+     *         Task fails if any roi is out of frame.
+     */
+    class MultiFetchFrameTask : public SdkTask<std::vector<FrameData>> {
+    public:
+        std::vector<cv::Rect> rois_;    ///<! regions to fetch
+    };
+    using MultiFetchFrameInterface = Executable<MultiFetchFrameTask>;
+
     typedef struct {
         std::shared_ptr<uint8_t> data_; ///<! frame data
         int data_len_;  ///<! length of data_ in bytes
@@ -333,6 +368,7 @@ namespace vega {
      *           task->put(Option::face_align_, true);
      *           task->put(Option::face_transform_, true);
      *           task->put(Option::face_store_stream_id_, 1100);
+     *        or set them once into a BatchOptions and call executeWithOptions(iface, tasks, options).
      *
      *        If alignment is disabled and transform is enabled, you must set a landmark to each task,
      *        otherwise set the face box is enough.
@@ -0,0 +1,300 @@
+#ifndef VEGA_ANNEXB_H
+#define VEGA_ANNEXB_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "interface_base.h"
+#include "vega_option_store.h"
+#include "vega_task_refs.h"
+
+#if defined(__aarch64__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define VEGA_ANNEXB_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define VEGA_ANNEXB_SSE2 1
+#endif
+
+namespace vega {
+
+    /**
+     * An access unit of an Annex-B elementary stream, a packet of DecodeTask
+     */
+    struct AccessUnit {
+        const uint8_t *data_ = nullptr;     ///<! NALs with start codes
+        size_t len_ = 0;
+        std::shared_ptr<const void> owner_; ///<! keeps data_ alive
+        long index_ = 0;                    ///<! packet index in stream, from 0
+        bool key_ = false;                  ///<! has IDR, or IRAP of H.265
+        bool params_ = false;               ///<! has SPS or PPS, or VPS of H.265
+
+        /**
+         * Set packet of task without copy, caller keeps this unit until task is done
+         */
+        void bind(DecodeTask &task, SdkImage type) const {
+            task.type_ = type;
+            task.data_ = const_cast<uint8_t *>(data_);
+            task.data_len_ = (int)len_;
+            task.put(OptionKeys::packet_index_(), index_);
+        }
+        /**
+         * Set packet of task without copy, and hold data in refs until task is dropped
+         */
+        void bind(DecodeTask &task, SdkImage type, TaskRefs &refs) const {
+            bind(task, type);
+            refs.hold(task, owner_);
+        }
+    };
+
+    /**
+     * Splitter of H.264/H.265 Annex-B byte stream into access units.
+     *
+     * Start codes are searched 16 bytes at a time by SSE2 or NEON. A new access unit begins
+     * at AUD, parameter sets or SEI after a slice, or at the first slice of a picture
+     * (first_mb_in_slice 0, first_slice_segment_in_pic_flag 1), as in H.264 7.4.1.2.3 and
+     * H.265 7.4.2.4.4. Bytes before the first start code are dropped.
+     *
+     * Parser holds no data. parse() returns bytes consumed, caller keeps the rest and
+     * presents it again with more data appended, see AnnexBStream. The last access unit
+     * is returned when eos is set.
+     */
+    class AnnexBParser {
+    public:
+        explicit AnnexBParser(SdkImage codec) : h265_(codec == SdkImage::H265) {
+            CHECK(codec == SdkImage::H264 || codec == SdkImage::H265) << "Not Annex-B codec " << (int)codec;
+        }
+
+    public:
+        /**
+         * Split access units from data, which starts at the first byte not consumed by last call
+         * @param owner set to owner_ of units
+         * @return bytes consumed, units returned all end before it
+         */
+        size_t parse(const uint8_t *data, size_t len, bool eos, std::vector<AccessUnit> &units,
+                     const std::shared_ptr<const void> &owner = nullptr) {
+            auto header = (size_t)(h265_ ? 3 : 2);     // NAL header and first byte of slice
+            while(true) {
+                auto *sc = findStartCode(data + scan_, data + len);
+                auto pos = (size_t)(sc - data);
+                if(pos == len || (!eos && pos + 3 + header > len)) {
+                    // no complete start code, the last 2 bytes may begin one
+                    scan_ = pos == len ? std::max(scan_, len >= 2 ? len - 2 : 0) : pos;
+                    break;
+                }
+                auto nal = (pos > 0 && data[pos - 1] == 0) ? pos - 1 : pos;
+                auto *hdr = data + pos + 3;
+                auto avail = len - pos - 3;
+                if(begin_ >= 0 && boundary(hdr, avail)) {
+                    emit(data, (size_t)begin_, nal, units, owner);
+                    begin_ = -1;
+                }
+                if(begin_ < 0) {
+                    begin_ = (long)nal;
+                    vcl_ = false;
+                    au_ = AccessUnit();
+                }
+                classify(hdr, avail);
+                scan_ = pos + 3;
+            }
+
+            if(eos) {
+                if(begin_ >= 0 && vcl_) emit(data, (size_t)begin_, len, units, owner);
+                reset();
+                return len;
+            }
+            // keep a byte before the next start code, it may be zero_byte of a 4 bytes start code
+            auto consumed = begin_ >= 0 ? (size_t)begin_ : (scan_ > 0 ? scan_ - 1 : 0);
+            if(begin_ >= 0) begin_ = 0;
+            scan_ -= consumed;
+            return consumed;
+        }
+
+        /**
+         * Forget the access unit in progress, packet index goes on
+         */
+        void reset() {
+            scan_ = 0;
+            begin_ = -1;
+            vcl_ = false;
+        }
+
+        /**
+         * First 00 00 01 in [p, end), end if not found
+         */
+        static const uint8_t *findStartCode(const uint8_t *p, const uint8_t *end) {
+#if VEGA_ANNEXB_SSE2
+            const auto zero = _mm_setzero_si128(), one = _mm_set1_epi8(1);
+            for(; p + 18 <= end; p += 16) {
+                auto a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), zero);
+                auto b = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 1)), zero);
+                auto c = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 2)), one);
+                auto mask = _mm_movemask_epi8(_mm_and_si128(_mm_and_si128(a, b), c));
+                if(mask) return p + __builtin_ctz((unsigned)mask);
+            }
+#elif VEGA_ANNEXB_NEON
+            const auto zero = vdupq_n_u8(0), one = vdupq_n_u8(1);
+            for(; p + 18 <= end; p += 16) {
+                auto a = vceqq_u8(vld1q_u8(p), zero);
+                auto b = vceqq_u8(vld1q_u8(p + 1), zero);
+                auto c = vceqq_u8(vld1q_u8(p + 2), one);
+                auto hit = vandq_u8(vandq_u8(a, b), c);
+                // 4 bits of each byte
+                auto bits = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(hit), 4)), 0);
+                if(bits) return p + (__builtin_ctzll(bits) >> 2);
+            }
+#endif
+            for(; p + 3 <= end; p++) {
+                if(p[2] > 1) {
+                    p += 2;
+                } else if(p[0] == 0 && p[1] == 0 && p[2] == 1) {
+                    return p;
+                }
+            }
+            return end;
+        }
+
+    protected:
+        inline int nalType(const uint8_t *hdr) const {
+            return h265_ ? (hdr[0] >> 1) & 0x3F : hdr[0] & 0x1F;
+        }
+        inline bool isVcl(int type) const {
+            return h265_ ? type < 32 : (type >= 1 && type <= 5);
+        }
+
+        /**
+         * NAL begins a new access unit after a slice
+         */
+        bool boundary(const uint8_t *hdr, size_t avail) const {
+            if(!vcl_ || avail < 1) return false;
+            auto type = nalType(hdr);
+            if(isVcl(type)) {
+                // first_mb_in_slice is ue(v) 0, or first_slice_segment_in_pic_flag is 1
+                auto slice = (size_t)(h265_ ? 2 : 1);
+                return avail > slice && (hdr[slice] & 0x80);
+            }
+            if(h265_) {
+                return (type >= 32 && type <= 35) || type == 39 || (type >= 41 && type <= 44) || (type >= 48 && type <= 55);
+            }
+            return (type >= 6 && type <= 9) || (type >= 14 && type <= 18);
+        }
+
+        void classify(const uint8_t *hdr, size_t avail) {
+            if(avail < 1) return;
+            auto type = nalType(hdr);
+            if(isVcl(type)) {
+                vcl_ = true;
+                if(h265_ ? (type >= 16 && type <= 23) : type == 5) au_.key_ = true;
+            } else if(h265_ ? (type >= 32 && type <= 34) : (type == 7 || type == 8)) {
+                au_.params_ = true;
+            }
+        }
+
+        void emit(const uint8_t *data, size_t begin, size_t end, std::vector<AccessUnit> &units,
+                  const std::shared_ptr<const void> &owner) {
+            au_.data_ = data + begin;
+            au_.len_ = end - begin;
+            au_.owner_ = owner;
+            au_.index_ = index_++;
+            units.push_back(au_);
+        }
+
+    protected:
+        bool h265_;
+        size_t scan_ = 0;       ///<! next byte to search start code from
+        long begin_ = -1;       ///<! start of access unit in progress, -1 for none
+        bool vcl_ = false;      ///<! access unit in progress has a slice
+        AccessUnit au_;
+        long index_ = 0;
+    };
+
+    /**
+     * Annex-B stream arriving in pieces, e.g. from network.
+     *
+     * Data is appended into a chunk, access units point into it and keep it alive. When
+     * a chunk is full, only the unfinished access unit is copied to a new chunk, so units
+     * returned earlier stay valid.
+     */
+    class AnnexBStream {
+    public:
+        explicit AnnexBStream(SdkImage codec, size_t chunkSize = 4 << 20)
+                : parser_(codec), chunk_size_(chunkSize) {
+        }
+
+    public:
+        void append(const uint8_t *data, size_t len, std::vector<AccessUnit> &units) {
+            reserve(len);
+            buf_->insert(buf_->end(), data, data + len);
+            parse(false, units);
+        }
+        /**
+         * Return the last access unit
+         */
+        void finish(std::vector<AccessUnit> &units) {
+            if(buf_) parse(true, units);
+            buf_.reset();
+            begin_ = 0;
+        }
+
+    protected:
+        void reserve(size_t len) {
+            auto tail = buf_ ? buf_->size() - begin_ : 0;
+            if(buf_ && buf_->size() + len <= buf_->capacity()) return;
+            auto chunk = std::make_shared<std::vector<uint8_t>>();
+            chunk->reserve(std::max(chunk_size_, (tail + len) * 2));
+            if(buf_) chunk->insert(chunk->end(), buf_->begin() + begin_, buf_->end());
+            buf_ = chunk;
+            begin_ = 0;
+        }
+
+        void parse(bool eos, std::vector<AccessUnit> &units) {
+            begin_ += parser_.parse(buf_->data() + begin_, buf_->size() - begin_, eos, units, buf_);
+        }
+
+    protected:
+        AnnexBParser parser_;
+        size_t chunk_size_;
+        std::shared_ptr<std::vector<uint8_t>> buf_;
+        size_t begin_ = 0;      ///<! first byte not consumed by parser
+    };
+
+    /**
+     * Split a memory mapped Annex-B file, units keep mapping alive
+     * @return DG_ERR_NOT_EXIST if file can't be mapped
+     */
+    inline DgError splitAnnexBFile(const std::string &path, SdkImage codec, std::vector<AccessUnit> &units) {
+        auto fd = open(path.c_str(), O_RDONLY);
+        if(fd < 0) {
+            LOG(ERROR) << "Open " << path << " fail: " << strerror(errno);
+            return DG_ERR_NOT_EXIST;
+        }
+        struct stat st;
+        void *addr = MAP_FAILED;
+        if(fstat(fd, &st) == 0 && st.st_size > 0) {
+            addr = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        close(fd);
+        if(addr == MAP_FAILED) {
+            LOG(ERROR) << "Map " << path << " fail: " << strerror(errno);
+            return DG_ERR_NOT_EXIST;
+        }
+        auto len = (size_t)st.st_size;
+        madvise(addr, len, MADV_SEQUENTIAL);
+        std::shared_ptr<const void> owner(addr, [len](const void *p) {
+            munmap(const_cast<void *>(p), len);
+        });
+        AnnexBParser parser(codec);
+        parser.parse((const uint8_t *)addr, len, true, units, owner);
+        return DG_OK;
+    }
+}
+
+#endif //VEGA_ANNEXB_H
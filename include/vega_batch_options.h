@@ -0,0 +1,105 @@
+#ifndef VEGA_BATCH_OPTIONS_H
+#define VEGA_BATCH_OPTIONS_H
+
+#include <vector>
+#include "interface_base.h"
+
+namespace vega {
+
+    /**
+     * Options shared by all tasks of a batch.
+     *
+     * Options are formatted once when put, executeWithOptions() then copies them into
+     * each task, options already put into a task take precedence. Interfaces of SDK read
+     * options of each task, so only the formatting is shared, not the copies:
+     *
+     * \code{.cpp}
+     * BatchOptions options;
+     * options.put(Option::face_align_, true);
+     * options.put(Option::face_store_stream_id_, (StreamId)1100);
+     * executeWithOptions(*iface, tasks, options);
+     * \endcode
+     *
+     * Merged options are ordinary options of the task afterwards. applyTo() tells which
+     * ones it put, give that to removeFrom() before reusing the task with another batch.
+     * Options the task had put itself are kept.
+     */
+    class BatchOptions {
+    public:
+        /**
+         * Options put into one task by applyTo(), keys are those of BatchOptions, so it's
+         * valid as long as BatchOptions is. Empty if task had all options already.
+         */
+        class Applied {
+        public:
+            inline bool empty() const { return keys_.empty(); }
+
+        protected:
+            friend class BatchOptions;
+            std::vector<const std::string *> keys_;
+        };
+
+    public:
+        /**
+         * Same overloads as SdkTaskBase::put, values are formatted alike
+         */
+        template <typename _Key, typename _Value>
+        void put(const _Key &key, _Value value) {
+            options_.put(key, value);
+        }
+
+        inline const std::map<std::string, std::string> &values() {
+            return options_.options();
+        }
+        inline bool empty() {
+            return options_.options().empty();
+        }
+
+        /**
+         * Put options not set in task yet
+         * @return options put, for removeFrom()
+         */
+        Applied applyTo(SdkTaskBase &task) {
+            Applied applied;
+            task.merge(options_.options(), &applied.keys_);
+            return applied;
+        }
+        /**
+         * Remove options put into task by applyTo(), options of task's own are kept
+         */
+        void removeFrom(SdkTaskBase &task, const Applied &applied) {
+            for(auto key : applied.keys_) {
+                task.erase(*key);
+            }
+        }
+
+    protected:
+        SdkTaskBase options_;
+    };
+
+    /**
+     * Execute tasks with options shared by the batch, see BatchOptions.
+     * Options are copied into tasks before execute(), so interfaces created by SDK
+     * read them as options of each task.
+     *
+     * @param applied options put into each task, in the order of tasks, if not nullptr
+     * @return result of iface.execute(tasks)
+     */
+    template <typename _Task>
+    DgError executeWithOptions(Executable<_Task> &iface, std::vector<std::shared_ptr<_Task>> &tasks,
+                               BatchOptions &options, std::vector<BatchOptions::Applied> *applied = nullptr) {
+        if(applied) {
+            applied->clear();
+            applied->resize(tasks.size());
+        }
+        if(!options.empty()) {
+            for(auto i = 0u; i < tasks.size(); i++) {
+                auto added = options.applyTo(*tasks[i]);
+                if(applied) (*applied)[i] = std::move(added);
+            }
+        }
+        return iface.execute(tasks);
+    }
+}
+
+#endif //VEGA_BATCH_OPTIONS_H
@@ -0,0 +1,246 @@
+#ifndef VEGA_BATCHING_H
+#define VEGA_BATCHING_H
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "interface_base.h"
+#include "vega_router.h"
+#include "queue/blockingconcurrentqueue.h"
+
+namespace vega {
+
+    /**
+     * Auto batching front-end of an interface.
+     *
+     * Single tasks submitted from any thread are gathered into batches of getBatchSize(),
+     * a batch is sent once it's full or its oldest task has waited for max wait time.
+     * Each task returns to callback of its own submission.
+     *
+     * Submitting is lock free, tasks are queued in a concurrent queue and gathered by
+     * an internal thread.
+     *
+     * \code{.cpp}
+     * auto detector = std::make_shared<BatchingExecutable<DetectTask>>(
+     *     [&](DetectInterface::AsyncCallback cb) {
+     *         return createDetectInterface(0, cfgPath, "", nullptr, cb);
+     *     }, nullptr, 2000);
+     * detector->submit(task, [](std::shared_ptr<DetectTask> &task, DgError error) {
+     *     // deal with one task
+     * });
+     * \endcode
+     *
+     * BatchingExecutable is an Executable itself. Tasks sent by execute() are batched
+     * as well, and callback given on construction is called when all of them end.
+     * Once the batcher is ending, execute() and submit() return DG_ERR_SERVICE_NOT_AVAILABLE.
+     */
+    template <typename _Task>
+    class BatchingExecutable : public Executable<_Task> {
+    public:
+        using Base = Executable<_Task>;
+        using Tasks = std::vector<std::shared_ptr<_Task>>;
+        /**
+         * Callback of a single task, error is the result of this task
+         */
+        using TaskCallback = std::function<void(std::shared_ptr<_Task> &task, DgError error)>;
+
+        struct Stats {
+            long batches_ = 0;      ///<! batches sent
+            long tasks_ = 0;        ///<! tasks sent
+            long full_batches_ = 0; ///<! batches sent with getBatchSize() tasks
+            double fill_rate_ = 0;  ///<! tasks / (batches * batch size)
+        };
+
+    public:
+        /**
+         * @param creator creates the wrapped interface
+         * @param callback callback of tasks sent by execute(), can be nullptr if only submit() is used
+         * @param maxWaitUs max time in microsecond a task waits for batch to be filled
+         * @param batchSize batch size, 0 to use getBatchSize() of wrapped interface
+         */
+        BatchingExecutable(typename Base::Creator creator, typename Base::AsyncCallback callback,
+                           int maxWaitUs = 2000, int batchSize = 0)
+                : callback_(callback), max_wait_(maxWaitUs) {
+            inner_ = creator(router_.callback());
+            CHECK(inner_) << "Create interface fail";
+
+            batch_size_ = batchSize > 0 ? batchSize : inner_->getBatchSize();
+            if(batch_size_ <= 0) {
+                LOG(ERROR) << "Invalid batch size " << batch_size_ << ", use 1";
+                batch_size_ = 1;
+            }
+
+            end_ = false;
+            thread_ = std::make_shared<std::thread>(&BatchingExecutable::gather, this);
+        }
+        ~BatchingExecutable() override {
+            end_ = true;
+            thread_->join();
+            inner_.reset();
+        }
+
+    public:
+        int getBatchSize() override {
+            return batch_size_;
+        }
+        DgError sendCommand(const std::string &cmd, const std::string &param, std::map<std::string, std::string> &result) override {
+            return inner_->sendCommand(cmd, param, result);
+        }
+
+        using Base::execute;
+        DgError execute(Tasks &tasks) override {
+            if(tasks.empty()) {
+                return DG_ERR_INVALID_PARAM;
+            }
+            CHECK(callback_) << "Callback is required by execute()";
+            if(end_) {
+                return DG_ERR_SERVICE_NOT_AVAILABLE;
+            }
+
+            auto join = std::make_shared<Join>();
+            join->tasks_ = tasks;
+            join->left_ = (int)tasks.size();
+            auto callback = callback_;
+            for(auto i = 0u; i < tasks.size(); i++) {
+                auto err = submit(tasks[i], [join, callback](std::shared_ptr<_Task> &, DgError error) {
+                    if(error != DG_OK) {
+                        join->error_ = error;
+                    }
+                    if(--join->left_ == 0) {
+                        callback(join->tasks_, (DgError)join->error_.load());
+                    }
+                });
+                if(err == DG_OK) {
+                    continue;
+                }
+                if(i == 0) {
+                    // nothing submitted, callback is not called
+                    return err;
+                }
+                // batcher ended after part of tasks was submitted, remaining tasks end with err
+                for(auto j = i; j < tasks.size(); j++) {
+                    tasks[j]->error_ = err;
+                }
+                join->error_ = err;
+                if((join->left_ -= (int)(tasks.size() - i)) == 0) {
+                    callback(join->tasks_, err);
+                }
+                break;
+            }
+            return DG_OK;
+        }
+
+        /**
+         * Submit a single task, callback is called when task ends
+         */
+        DgError submit(const std::shared_ptr<_Task> &task, TaskCallback callback) {
+            if(end_) {
+                return DG_ERR_SERVICE_NOT_AVAILABLE;
+            }
+            Pending pending;
+            pending.task_ = task;
+            pending.callback_ = std::move(callback);
+            pending.enqueued_ = std::chrono::steady_clock::now();
+            if(!q_.enqueue(std::move(pending))) {
+                LOG(ERROR) << "Enqueue fail";
+                return DG_ERR_SERVICE_NOT_AVAILABLE;
+            }
+            return DG_OK;
+        }
+
+        Stats stats() {
+            Stats st;
+            st.batches_ = batches_;
+            st.tasks_ = tasks_;
+            st.full_batches_ = full_batches_;
+            st.fill_rate_ = st.batches_ == 0 ? 0 : (double)st.tasks_ / ((double)st.batches_ * batch_size_);
+            return st;
+        }
+
+    protected:
+        struct Pending {
+            std::shared_ptr<_Task> task_;
+            TaskCallback callback_;
+            std::chrono::steady_clock::time_point enqueued_;
+        };
+        struct Join {
+            Tasks tasks_;
+            std::atomic<int> left_{0};
+            std::atomic<int> error_{DG_OK};
+        };
+
+        void gather() {
+            std::vector<Pending> items(batch_size_);
+            while(true) {
+                bool ending = end_;
+                auto n = q_.wait_dequeue_bulk_timed(items.begin(), batch_size_, ending ? 0 : 50000);
+                if(n == 0) {
+                    if(ending) break;
+                    continue;
+                }
+
+                auto oldest = items[0].enqueued_;
+                for(auto i = 1u; i < n; i++) {
+                    if(items[i].enqueued_ < oldest) oldest = items[i].enqueued_;
+                }
+                auto deadline = oldest + max_wait_;
+                while((int)n < batch_size_ && !ending) {
+                    auto now = std::chrono::steady_clock::now();
+                    if(now >= deadline) break;
+                    auto us = std::chrono::duration_cast<std::chrono::microseconds>(deadline - now).count();
+                    n += q_.wait_dequeue_bulk_timed(items.begin() + n, batch_size_ - n, us);
+                }
+
+                dispatch(items, (int)n);
+            }
+        }
+
+        void dispatch(std::vector<Pending> &items, int n) {
+            Tasks tasks;
+            tasks.reserve(n);
+            auto callbacks = std::make_shared<std::vector<TaskCallback>>();
+            callbacks->reserve(n);
+            for(auto i = 0; i < n; i++) {
+                tasks.push_back(std::move(items[i].task_));
+                callbacks->push_back(std::move(items[i].callback_));
+                items[i] = Pending();
+            }
+
+            ++batches_;
+            tasks_ += n;
+            if(n == batch_size_) ++full_batches_;
+
+            auto error = router_.execute(*inner_, tasks, [callbacks](Tasks &done, DgError err) {
+                for(auto i = 0u; i < done.size() && i < callbacks->size(); i++) {
+                    auto taskError = err == DG_OK ? DG_OK :
+                            (done[i]->error_ == DG_ON_GOING ? err : done[i]->error_);
+                    (*callbacks)[i](done[i], taskError);
+                }
+            });
+            if(error != DG_OK) {
+                LOG(ERROR) << "Execute batch of " << n << " fail: " << error;
+                for(auto i = 0; i < n; i++) {
+                    tasks[i]->error_ = error;
+                    (*callbacks)[i](tasks[i], error);
+                }
+            }
+        }
+
+    protected:
+        CallbackRouter<_Task> router_;      ///<! must be destroyed after inner_
+        std::shared_ptr<Base> inner_;
+        typename Base::AsyncCallback callback_;
+        int batch_size_ = 0;
+        std::chrono::microseconds max_wait_;
+
+        moodycamel::BlockingConcurrentQueue<Pending> q_;
+        std::atomic<bool> end_{true};
+        std::shared_ptr<std::thread> thread_;
+
+        std::atomic<long> batches_{0};
+        std::atomic<long> tasks_{0};
+        std::atomic<long> full_batches_{0};
+    };
+}
+
+#endif //VEGA_BATCHING_H
@@ -0,0 +1,171 @@
+#ifndef VEGA_BUFFER_POOL_H
+#define VEGA_BUFFER_POOL_H
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <glog/logging.h>
+
+namespace vega {
+
+    /**
+     * Size classed pool of output buffers, like FrameData::data_ and VideoData::data_.
+     *
+     * get() returns a shared_ptr whose deleter puts the buffer back to pool, so results
+     * handed to users return buffers by themselves when dropped. Buffer of a class is
+     * reused by any request of the same class, classes grow by 1/4 of power of 2, so at
+     * most 1/4 of a buffer is wasted.
+     *
+     * Free buffers are kept up to maxRetained bytes, buffers larger than the biggest class
+     * are never kept. Buffers can outlive pool, they are deleted then.
+     *
+     * \code{.cpp}
+     * auto buffers = std::make_shared<BufferPool>(64 << 20);
+     * result.data_ = buffers->copy(jpeg.data(), jpeg.size());
+     * \endcode
+     */
+    class BufferPool : public std::enable_shared_from_this<BufferPool> {
+    public:
+        struct Stats {
+            long hits_ = 0;             ///<! gets served by a free buffer
+            long misses_ = 0;           ///<! gets allocating a new buffer
+            long dropped_ = 0;          ///<! buffers deleted on return, pool is full or buffer is too large
+            size_t retained_bytes_ = 0; ///<! bytes of free buffers
+            int outstanding_ = 0;       ///<! buffers in use
+            double hit_rate_ = 0;       ///<! hits / (hits + misses)
+        };
+
+    public:
+        /**
+         * @param maxRetained max bytes of free buffers kept
+         * @param minSize size of the smallest class
+         * @param maxSize buffers larger than the biggest class covering maxSize are not pooled
+         */
+        explicit BufferPool(size_t maxRetained = 64 << 20, size_t minSize = 4096, size_t maxSize = 32 << 20)
+                : max_retained_(maxRetained) {
+            CHECK(minSize > 0 && maxSize >= minSize) << "Invalid size " << minSize << " - " << maxSize;
+            for(auto base = minSize; classes_.empty() || classes_.back() < maxSize; base *= 2) {
+                for(auto i = 0; i < 4; i++) {
+                    classes_.push_back(base + base / 4 * i);
+                }
+            }
+            free_.resize(classes_.size());
+        }
+        ~BufferPool() {
+            for(auto &list : free_) {
+                for(auto *buf : list) delete [] buf;
+            }
+        }
+
+    public:
+        /**
+         * Buffer of at least len bytes, content is not initialized
+         */
+        std::shared_ptr<uint8_t> get(size_t len) {
+            auto cls = classOf(len);
+            uint8_t *buf = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                ++outstanding_;
+                if(cls >= 0 && !free_[cls].empty()) {
+                    buf = free_[cls].back();
+                    free_[cls].pop_back();
+                    retained_ -= classes_[cls];
+                    ++hits_;
+                } else {
+                    ++misses_;
+                }
+            }
+            if(!buf) {
+                buf = new uint8_t[cls >= 0 ? classes_[cls] : len];
+            }
+
+            std::weak_ptr<BufferPool> owner = shared_from_this();
+            return std::shared_ptr<uint8_t>(buf, [owner, cls](uint8_t *p) {
+                auto pool = owner.lock();
+                if(pool) {
+                    pool->put(p, cls);
+                } else {
+                    delete [] p;
+                }
+            });
+        }
+
+        /**
+         * Pooled copy of data
+         */
+        std::shared_ptr<uint8_t> copy(const uint8_t *data, size_t len) {
+            auto buf = get(len);
+            memcpy(buf.get(), data, len);
+            return buf;
+        }
+
+        /**
+         * Delete all free buffers
+         */
+        void trim() {
+            std::vector<std::vector<uint8_t *>> lists(classes_.size());
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                lists.swap(free_);
+                retained_ = 0;
+            }
+            for(auto &list : lists) {
+                for(auto *buf : list) delete [] buf;
+            }
+        }
+
+        Stats stats() {
+            std::lock_guard<std::mutex> lock(mtx_);
+            Stats st;
+            st.hits_ = hits_;
+            st.misses_ = misses_;
+            st.dropped_ = dropped_;
+            st.retained_bytes_ = retained_;
+            st.outstanding_ = outstanding_;
+            st.hit_rate_ = hits_ + misses_ == 0 ? 0 : (double)hits_ / (double)(hits_ + misses_);
+            return st;
+        }
+
+    protected:
+        /**
+         * Index of the smallest class holding len, -1 if len is larger than all
+         */
+        int classOf(size_t len) const {
+            auto it = std::lower_bound(classes_.begin(), classes_.end(), len);
+            return it == classes_.end() ? -1 : (int)(it - classes_.begin());
+        }
+
+        void put(uint8_t *buf, int cls) {
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                --outstanding_;
+                if(cls >= 0 && retained_ + classes_[cls] <= max_retained_) {
+                    free_[cls].push_back(buf);
+                    retained_ += classes_[cls];
+                    return;
+                }
+                ++dropped_;
+            }
+            delete [] buf;
+        }
+
+    protected:
+        size_t max_retained_;
+        std::vector<size_t> classes_;           ///<! ascending sizes of classes
+
+        std::mutex mtx_;
+        std::vector<std::vector<uint8_t *>> free_;  ///<! free buffers of each class
+        size_t retained_ = 0;
+        long hits_ = 0;
+        long misses_ = 0;
+        long dropped_ = 0;
+        int outstanding_ = 0;
+    };
+
+    using BufferPoolSP = std::shared_ptr<BufferPool>;
+}
+
+#endif //VEGA_BUFFER_POOL_H
@@ -0,0 +1,820 @@
+#ifndef VEGA_COLOR_H
+#define VEGA_COLOR_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <vector>
+#include "dg_types.h"
+
+#if defined(__aarch64__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define VEGA_COLOR_NEON 1
+#elif (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define VEGA_COLOR_AVX2 1
+#define VEGA_COLOR_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace vega {
+
+    /**
+     * Instruction set of colour conversion kernels
+     */
+    enum class ColorIsa {
+        SCALAR = 0,
+        AVX2 = 1,   ///<! x86, chosen at runtime if cpu supports it
+        NEON = 2,   ///<! arm, always available on aarch64
+    };
+
+    struct ColorOptions {
+        int threads_ = 0;       ///<! bands of rows converted in parallel, 0 for OpenMP default on large images, 1 for none
+        bool src_vu_ = false;   ///<! chroma of DG_IMAGE_YUV_SP420 source is V first(NV21)
+        bool dst_vu_ = false;   ///<! chroma of DG_IMAGE_YUV_SP420 destination is V first(NV21)
+    };
+
+    /**
+     * Conversion between any two DgImageType, on images described by DgImage planes, so
+     * padded device frames and roi views are converted in place without repacking.
+     *
+     * YUV is BT.601 limited range, same as cv::COLOR_YUV2BGR_NV12 and cv::COLOR_BGR2YUV_I420
+     * within 2 levels. DG_IMAGE_YUV_GRAY is the Y plane, it's converted from and to colour
+     * images as YUV with neutral chroma. Chroma of YUV 420 is the average of 2x2 pixels.
+     *
+     * YUV to BGR/RGB, BGR/RGB to YUV and gray, BGR/RGB packed/planar shuffling and chroma
+     * (de)interleaving have AVX2 and NEON kernels, chosen at runtime by cpu, see isa(). They
+     * give the same output as scalar kernels. Large images are split into bands of rows
+     * converted by OpenMP threads.
+     *
+     * \code{.cpp}
+     * DgImage nv12, bgr;
+     * nv12.create(data, size, size, DgImageType::DG_IMAGE_YUV_SP420, stride);
+     * bgr.create(mat.data, size, DgImageType::DG_IMAGE_BGR_PACKAGE);
+     * ColorConvert::convert(nv12, bgr);
+     * \endcode
+     */
+    class ColorConvert {
+    public:
+        /**
+         * Convert src into dst of the same size, both images must be created.
+         * @return DG_ERR_INVALID_PARAM if sizes differ or YUV 420 size is odd,
+         *         DG_ERR_NOT_SUPPORTED for invalid types
+         */
+        static DgError convert(const DgImage &src, DgImage &dst, const ColorOptions &options = ColorOptions()) {
+            auto st = src.type_, dt = dst.type_;
+            if(DgImage::planeCount(st) == 0 || DgImage::planeCount(dt) == 0) {
+                return DG_ERR_NOT_SUPPORTED;
+            }
+            auto size = src.size_;
+            if(size != dst.size_ || size.area() <= 0) {
+                LOG(ERROR) << "Size differs (" << size.width << " " << size.height << ") vs ("
+                           << dst.size_.width << " " << dst.size_.height << ")";
+                return DG_ERR_INVALID_PARAM;
+            }
+            if((isYuv420(st) || isYuv420(dt)) && (size.width % 2 || size.height % 2)) {
+                LOG(ERROR) << "Odd size of YUV 420 (" << size.width << " " << size.height << ")";
+                return DG_ERR_INVALID_PARAM;
+            }
+
+            auto isa = ColorConvert::isa();
+            auto w = size.width;
+            std::vector<uint8_t> neutral;
+            if(st == DgImageType::DG_IMAGE_YUV_GRAY && isRgb(dt)) {
+                neutral.assign((size_t)(w + 1) / 2, 128);
+            }
+
+            forRows(size.height, options.threads_, (size_t)size.area(), [&](int r0, int r1) {
+                if(isYuv420(st) || st == DgImageType::DG_IMAGE_YUV_GRAY) {
+                    auto &yp = src.planes_[0];
+                    if(isRgb(dt)) {
+                        for(auto r = r0; r < r1; r++) {
+                            const uint8_t *u, *v;
+                            int uvStep;
+                            if(st == DgImageType::DG_IMAGE_YUV_GRAY) {
+                                u = v = neutral.data();
+                                uvStep = 1;
+                            } else {
+                                chroma(src, r / 2, options.src_vu_, u, v, uvStep);
+                            }
+                            uint8_t *c[3];
+                            int step;
+                            channels(dst, r, c, step);
+                            yuvRow(isa, yp.ptr + (size_t)r * yp.stride_, u, v, uvStep, c, step, w);
+                        }
+                        return;
+                    }
+                    // Y is kept to YUV and gray
+                    auto &dp = dst.planes_[0];
+                    for(auto r = r0; r < r1; r++) {
+                        memcpy(dp.ptr + (size_t)r * dp.stride_, yp.ptr + (size_t)r * yp.stride_, (size_t)w);
+                    }
+                    if(!isYuv420(dt)) return;
+                    for(auto cr = r0 / 2; cr < (r1 + 1) / 2; cr++) {
+                        uint8_t *du, *dv;
+                        int dStep;
+                        chroma(dst, cr, options.dst_vu_, du, dv, dStep);
+                        if(st == DgImageType::DG_IMAGE_YUV_GRAY) {
+                            for(auto x = 0; x < w / 2; x++) {
+                                du[x * dStep] = 128;
+                                dv[x * dStep] = 128;
+                            }
+                            continue;
+                        }
+                        const uint8_t *su, *sv;
+                        int sStep;
+                        chroma(src, cr, options.src_vu_, su, sv, sStep);
+                        uvRow(isa, su, sv, sStep, du, dv, dStep, w / 2);
+                    }
+                    return;
+                }
+
+                // from BGR/RGB
+                if(isRgb(dt)) {
+                    for(auto r = r0; r < r1; r++) {
+                        uint8_t *s[3], *d[3];
+                        int sStep, dStep;
+                        channels(src, r, s, sStep);
+                        channels(dst, r, d, dStep);
+                        shuffle3Row(isa, s, sStep, d, dStep, w);
+                    }
+                } else if(dt == DgImageType::DG_IMAGE_YUV_GRAY) {
+                    auto &dp = dst.planes_[0];
+                    for(auto r = r0; r < r1; r++) {
+                        uint8_t *s[3];
+                        int sStep;
+                        channels(src, r, s, sStep);
+                        rgbToYRow(isa, s, sStep, dp.ptr + (size_t)r * dp.stride_, w);
+                    }
+                } else {
+                    auto &dp = dst.planes_[0];
+                    for(auto r = r0; r < r1; r += 2) {
+                        uint8_t *s0[3], *s1[3], *du, *dv;
+                        int sStep, dStep;
+                        channels(src, r, s0, sStep);
+                        channels(src, r + 1, s1, sStep);
+                        chroma(dst, r / 2, options.dst_vu_, du, dv, dStep);
+                        rgbToYuvRows(isa, s0, s1, sStep, dp.ptr + (size_t)r * dp.stride_,
+                                     dp.ptr + (size_t)(r + 1) * dp.stride_, du, dv, dStep, w);
+                    }
+                }
+            });
+            return DG_OK;
+        }
+
+        /**
+         * Kernels in use
+         */
+        static ColorIsa isa() {
+            return (ColorIsa)isaRef().load(std::memory_order_relaxed);
+        }
+        /**
+         * Best kernels cpu supports
+         */
+        static ColorIsa bestIsa() {
+#if VEGA_COLOR_NEON
+            return ColorIsa::NEON;
+#elif VEGA_COLOR_AVX2
+            return __builtin_cpu_supports("avx2") ? ColorIsa::AVX2 : ColorIsa::SCALAR;
+#else
+            return ColorIsa::SCALAR;
+#endif
+        }
+        /**
+         * Force kernels, e.g. SCALAR for comparison, isa must be SCALAR or bestIsa()
+         */
+        static void setIsa(ColorIsa isa) {
+            CHECK(isa == ColorIsa::SCALAR || isa == bestIsa()) << "Isa " << (int)isa << " not supported";
+            isaRef() = (int)isa;
+        }
+
+    protected:
+        static std::atomic<int> &isaRef() {
+            static std::atomic<int> isa{(int)bestIsa()};
+            return isa;
+        }
+
+        static inline bool isYuv420(DgImageType type) {
+            return type == DgImageType::DG_IMAGE_YUV_SP420 || type == DgImageType::DG_IMAGE_YUV_I420;
+        }
+        static inline bool isRgb(DgImageType type) {
+            return type == DgImageType::DG_IMAGE_BGR_PACKAGE || type == DgImageType::DG_IMAGE_RGB_PACKAGE ||
+                   type == DgImageType::DG_IMAGE_BGR_PLANAR || type == DgImageType::DG_IMAGE_RGB_PLANAR;
+        }
+
+        /**
+         * Split rows into bands of even rows, run fn(r0, r1) of each band in parallel on large images
+         */
+        template <typename _Fn>
+        static void forRows(int rows, int threads, size_t pixels, const _Fn &fn) {
+            int bands = 1;
+#ifdef _OPENMP
+            if(threads != 1 && pixels >= (size_t)(640 * 480)) {
+                bands = threads > 0 ? threads : omp_get_max_threads();
+            }
+#else
+            VEGA_UNUSED(threads);
+            VEGA_UNUSED(pixels);
+#endif
+            bands = std::max(1, std::min(bands, rows / 16));
+            auto band = ((rows + bands - 1) / bands + 1) & ~1;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(bands) schedule(static) if(bands > 1)
+#endif
+            for(auto b = 0; b < bands; b++) {
+                auto r0 = b * band, r1 = std::min(rows, r0 + band);
+                if(r0 < r1) fn(r0, r1);
+            }
+        }
+
+        /**
+         * B, G, R channels of row r of a BGR/RGB image, step is 3 for packed, 1 for planar
+         */
+        static void channels(const DgImage &img, int r, uint8_t *c[3], int &step) {
+            auto row = [&](int plane) {
+                return img.planes_[plane].ptr + (size_t)r * img.planes_[plane].stride_;
+            };
+            switch(img.type_) {
+                case DgImageType::DG_IMAGE_BGR_PACKAGE:
+                    c[0] = row(0); c[1] = c[0] + 1; c[2] = c[0] + 2; step = 3;
+                    break;
+                case DgImageType::DG_IMAGE_RGB_PACKAGE:
+                    c[2] = row(0); c[1] = c[2] + 1; c[0] = c[2] + 2; step = 3;
+                    break;
+                case DgImageType::DG_IMAGE_BGR_PLANAR:
+                    c[0] = row(0); c[1] = row(1); c[2] = row(2); step = 1;
+                    break;
+                default:    // DG_IMAGE_RGB_PLANAR
+                    c[2] = row(0); c[1] = row(1); c[0] = row(2); step = 1;
+                    break;
+            }
+        }
+
+        /**
+         * U and V of chroma row cr of a YUV 420 image, step is 2 for semi-planar, 1 for planar
+         */
+        template <typename _Ptr>
+        static void chroma(const DgImage &img, int cr, bool vu, _Ptr &u, _Ptr &v, int &step) {
+            auto &p1 = img.planes_[1];
+            if(img.type_ == DgImageType::DG_IMAGE_YUV_SP420) {
+                auto *uv = p1.ptr + (size_t)cr * p1.stride_;
+                u = vu ? uv + 1 : uv;
+                v = vu ? uv : uv + 1;
+                step = 2;
+            } else {
+                auto &p2 = img.planes_[2];
+                u = p1.ptr + (size_t)cr * p1.stride_;
+                v = p2.ptr + (size_t)cr * p2.stride_;
+                step = 1;
+            }
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        ////////////                  Scalar kernels                       /////////////
+        ////////////////////////////////////////////////////////////////////////////////
+        // YUV -> RGB in Q6, same in all kernels:
+        //   y' = (y - 16) * 74 + 32
+        //   b = (y' + 129 * (u - 128)) >> 6
+        //   g = (y' - 25 * (u - 128) - 52 * (v - 128)) >> 6
+        //   r = (y' + 102 * (v - 128)) >> 6
+        static inline uint8_t clamp8(int v) {
+            return (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+        }
+
+        static void yuvRowScalar(const uint8_t *y, const uint8_t *u, const uint8_t *v, int uvStep,
+                                 uint8_t *c[3], int step, int from, int width) {
+            for(auto x = from; x < width; x++) {
+                auto yy = (y[x] - 16) * 74 + 32;
+                auto cu = u[x / 2 * uvStep] - 128, cv = v[x / 2 * uvStep] - 128;
+                c[0][x * step] = clamp8((yy + 129 * cu) >> 6);
+                c[1][x * step] = clamp8((yy - (25 * cu + 52 * cv)) >> 6);
+                c[2][x * step] = clamp8((yy + 102 * cv) >> 6);
+            }
+        }
+
+        static void shuffle3RowScalar(uint8_t *s[3], int sStep, uint8_t *d[3], int dStep, int from, int width) {
+            for(auto x = from; x < width; x++) {
+                auto b = s[0][x * sStep], g = s[1][x * sStep], r = s[2][x * sStep];
+                d[0][x * dStep] = b;
+                d[1][x * dStep] = g;
+                d[2][x * dStep] = r;
+            }
+        }
+
+        static void uvRowScalar(const uint8_t *su, const uint8_t *sv, int sStep,
+                                uint8_t *du, uint8_t *dv, int dStep, int from, int n) {
+            for(auto x = from; x < n; x++) {
+                auto u = su[x * sStep], v = sv[x * sStep];
+                du[x * dStep] = u;
+                dv[x * dStep] = v;
+            }
+        }
+
+        // BGR -> YUV in Q8, chroma of the sum of 2x2 pixels in Q10, same in all kernels
+        static inline uint8_t rgbToY(int b, int g, int r) {
+            return (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+        }
+
+        static void rgbToYRowScalar(uint8_t *s[3], int step, uint8_t *y, int from, int width) {
+            for(auto x = from; x < width; x++) {
+                y[x] = rgbToY(s[0][x * step], s[1][x * step], s[2][x * step]);
+            }
+        }
+
+        static void rgbToYuvRowsScalar(uint8_t *s0[3], uint8_t *s1[3], int step, uint8_t *y0, uint8_t *y1,
+                                       uint8_t *u, uint8_t *v, int uvStep, int from, int width) {
+            for(auto x = from; x < width; x += 2) {
+                auto i = x * step, j = i + step;
+                int b = 0, g = 0, r = 0;
+                y0[x] = rgbToY(s0[0][i], s0[1][i], s0[2][i]);
+                y0[x + 1] = rgbToY(s0[0][j], s0[1][j], s0[2][j]);
+                y1[x] = rgbToY(s1[0][i], s1[1][i], s1[2][i]);
+                y1[x + 1] = rgbToY(s1[0][j], s1[1][j], s1[2][j]);
+                b = s0[0][i] + s0[0][j] + s1[0][i] + s1[0][j];
+                g = s0[1][i] + s0[1][j] + s1[1][i] + s1[1][j];
+                r = s0[2][i] + s0[2][j] + s1[2][i] + s1[2][j];
+                u[x / 2 * uvStep] = clamp8(((-38 * r - 74 * g + 112 * b + 512) >> 10) + 128);
+                v[x / 2 * uvStep] = clamp8(((112 * r - 94 * g - 18 * b + 512) >> 10) + 128);
+            }
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        ////////////                   AVX2 kernels                        /////////////
+        ////////////////////////////////////////////////////////////////////////////////
+#if VEGA_COLOR_AVX2
+        /**
+         * Byte offset of each channel in packed pixel, and the pixel base
+         */
+        static inline uint8_t *packedOrder(uint8_t *c[3], int order[3]) {
+            auto *base = std::min(c[0], std::min(c[1], c[2]));
+            for(auto k = 0; k < 3; k++) order[k] = (int)(c[k] - base);
+            return base;
+        }
+
+        /**
+         * 16 pixels of 3 bytes from 3 vectors in byte order
+         */
+        VEGA_COLOR_TARGET_AVX2
+        static inline void interleave3(uint8_t *dst, __m128i x0, __m128i x1, __m128i x2) {
+            const __m128i m00 = _mm_setr_epi8(0, -128, -128, 1, -128, -128, 2, -128, -128, 3, -128, -128, 4, -128, -128, 5);
+            const __m128i m01 = _mm_setr_epi8(-128, 0, -128, -128, 1, -128, -128, 2, -128, -128, 3, -128, -128, 4, -128, -128);
+            const __m128i m02 = _mm_setr_epi8(-128, -128, 0, -128, -128, 1, -128, -128, 2, -128, -128, 3, -128, -128, 4, -128);
+            const __m128i m10 = _mm_setr_epi8(-128, -128, 6, -128, -128, 7, -128, -128, 8, -128, -128, 9, -128, -128, 10, -128);
+            const __m128i m11 = _mm_setr_epi8(5, -128, -128, 6, -128, -128, 7, -128, -128, 8, -128, -128, 9, -128, -128, 10);
+            const __m128i m12 = _mm_setr_epi8(-128, 5, -128, -128, 6, -128, -128, 7, -128, -128, 8, -128, -128, 9, -128, -128);
+            const __m128i m20 = _mm_setr_epi8(-128, 11, -128, -128, 12, -128, -128, 13, -128, -128, 14, -128, -128, 15, -128, -128);
+            const __m128i m21 = _mm_setr_epi8(-128, -128, 11, -128, -128, 12, -128, -128, 13, -128, -128, 14, -128, -128, 15, -128);
+            const __m128i m22 = _mm_setr_epi8(10, -128, -128, 11, -128, -128, 12, -128, -128, 13, -128, -128, 14, -128, -128, 15);
+            auto o0 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(x0, m00), _mm_shuffle_epi8(x1, m01)), _mm_shuffle_epi8(x2, m02));
+            auto o1 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(x0, m10), _mm_shuffle_epi8(x1, m11)), _mm_shuffle_epi8(x2, m12));
+            auto o2 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(x0, m20), _mm_shuffle_epi8(x1, m21)), _mm_shuffle_epi8(x2, m22));
+            _mm_storeu_si128((__m128i *)dst, o0);
+            _mm_storeu_si128((__m128i *)(dst + 16), o1);
+            _mm_storeu_si128((__m128i *)(dst + 32), o2);
+        }
+
+        /**
+         * 16 pixels of 3 bytes into 3 vectors in byte order
+         */
+        VEGA_COLOR_TARGET_AVX2
+        static inline void deinterleave3(const uint8_t *src, __m128i &x0, __m128i &x1, __m128i &x2) {
+            const __m128i m00 = _mm_setr_epi8(0, 3, 6, 9, 12, 15, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128);
+            const __m128i m01 = _mm_setr_epi8(-128, -128, -128, -128, -128, -128, 2, 5, 8, 11, 14, -128, -128, -128, -128, -128);
+            const __m128i m02 = _mm_setr_epi8(-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, 1, 4, 7, 10, 13);
+            const __m128i m10 = _mm_setr_epi8(1, 4, 7, 10, 13, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128);
+            const __m128i m11 = _mm_setr_epi8(-128, -128, -128, -128, -128, 0, 3, 6, 9, 12, 15, -128, -128, -128, -128, -128);
+            const __m128i m12 = _mm_setr_epi8(-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, 2, 5, 8, 11, 14);
+            const __m128i m20 = _mm_setr_epi8(2, 5, 8, 11, 14, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128);
+            const __m128i m21 = _mm_setr_epi8(-128, -128, -128, -128, -128, 1, 4, 7, 10, 13, -128, -128, -128, -128, -128, -128);
+            const __m128i m22 = _mm_setr_epi8(-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, 0, 3, 6, 9, 12, 15);
+            auto i0 = _mm_loadu_si128((const __m128i *)src);
+            auto i1 = _mm_loadu_si128((const __m128i *)(src + 16));
+            auto i2 = _mm_loadu_si128((const __m128i *)(src + 32));
+            x0 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(i0, m00), _mm_shuffle_epi8(i1, m01)), _mm_shuffle_epi8(i2, m02));
+            x1 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(i0, m10), _mm_shuffle_epi8(i1, m11)), _mm_shuffle_epi8(i2, m12));
+            x2 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(i0, m20), _mm_shuffle_epi8(i1, m21)), _mm_shuffle_epi8(i2, m22));
+        }
+
+        VEGA_COLOR_TARGET_AVX2
+        static inline void store3(uint8_t *c[3], int step, int x, const __m128i ch[3]) {
+            if(step == 1) {
+                for(auto k = 0; k < 3; k++) _mm_storeu_si128((__m128i *)(c[k] + x), ch[k]);
+                return;
+            }
+            int order[3];
+            auto *base = packedOrder(c, order);
+            __m128i bytes[3];
+            for(auto k = 0; k < 3; k++) bytes[order[k]] = ch[k];
+            interleave3(base + x * 3, bytes[0], bytes[1], bytes[2]);
+        }
+
+        VEGA_COLOR_TARGET_AVX2
+        static inline void load3(uint8_t *c[3], int step, int x, __m128i ch[3]) {
+            if(step == 1) {
+                for(auto k = 0; k < 3; k++) ch[k] = _mm_loadu_si128((const __m128i *)(c[k] + x));
+                return;
+            }
+            int order[3];
+            auto *base = packedOrder(c, order);
+            __m128i bytes[3];
+            deinterleave3(base + x * 3, bytes[0], bytes[1], bytes[2]);
+            for(auto k = 0; k < 3; k++) ch[k] = bytes[order[k]];
+        }
+
+        VEGA_COLOR_TARGET_AVX2
+        static inline __m128i pack16(__m256i x) {
+            return _mm_packus_epi16(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1));
+        }
+
+        VEGA_COLOR_TARGET_AVX2
+        static void yuvRowAvx2(const uint8_t *y, const uint8_t *u, const uint8_t *v, int uvStep,
+                               uint8_t *c[3], int step, int width) {
+            const auto c16 = _mm256_set1_epi16(16), c128 = _mm256_set1_epi16(128), c32 = _mm256_set1_epi16(32);
+            const auto cy = _mm256_set1_epi16(74), cub = _mm256_set1_epi16(129), cug = _mm256_set1_epi16(25);
+            const auto cvg = _mm256_set1_epi16(52), cvr = _mm256_set1_epi16(102);
+            const auto dupEven = _mm_setr_epi8(0, 0, 2, 2, 4, 4, 6, 6, 8, 8, 10, 10, 12, 12, 14, 14);
+            const auto dupOdd = _mm_setr_epi8(1, 1, 3, 3, 5, 5, 7, 7, 9, 9, 11, 11, 13, 13, 15, 15);
+            const uint8_t *uvBase = std::min(u, v);
+            auto x = 0;
+            for(; x + 16 <= width; x += 16) {
+                __m128i uu, vv;
+                if(uvStep == 2) {
+                    auto uv = _mm_loadu_si128((const __m128i *)(uvBase + x));
+                    uu = _mm_shuffle_epi8(uv, u < v ? dupEven : dupOdd);
+                    vv = _mm_shuffle_epi8(uv, u < v ? dupOdd : dupEven);
+                } else {
+                    auto u8 = _mm_loadl_epi64((const __m128i *)(u + x / 2));
+                    auto v8 = _mm_loadl_epi64((const __m128i *)(v + x / 2));
+                    uu = _mm_unpacklo_epi8(u8, u8);
+                    vv = _mm_unpacklo_epi8(v8, v8);
+                }
+                auto cu = _mm256_sub_epi16(_mm256_cvtepu8_epi16(uu), c128);
+                auto cv = _mm256_sub_epi16(_mm256_cvtepu8_epi16(vv), c128);
+                auto yy = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(y + x)));
+                yy = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_sub_epi16(yy, c16), cy), c32);
+
+                auto b = _mm256_srai_epi16(_mm256_adds_epi16(yy, _mm256_mullo_epi16(cu, cub)), 6);
+                auto g = _mm256_srai_epi16(_mm256_subs_epi16(yy, _mm256_add_epi16(_mm256_mullo_epi16(cu, cug),
+                                                                                  _mm256_mullo_epi16(cv, cvg))), 6);
+                auto r = _mm256_srai_epi16(_mm256_adds_epi16(yy, _mm256_mullo_epi16(cv, cvr)), 6);
+                __m128i ch[3] = {pack16(b), pack16(g), pack16(r)};
+                store3(c, step, x, ch);
+            }
+            yuvRowScalar(y, u, v, uvStep, c, step, x, width);
+        }
+
+        VEGA_COLOR_TARGET_AVX2
+        static void shuffle3RowAvx2(uint8_t *s[3], int sStep, uint8_t *d[3], int dStep, int width) {
+            auto x = 0;
+            for(; x + 16 <= width; x += 16) {
+                __m128i ch[3];
+                load3(s, sStep, x, ch);
+                store3(d, dStep, x, ch);
+            }
+            shuffle3RowScalar(s, sStep, d, dStep, x, width);
+        }
+
+        VEGA_COLOR_TARGET_AVX2
+        static void uvRowAvx2(const uint8_t *su, const uint8_t *sv, int sStep,
+                              uint8_t *du, uint8_t *dv, int dStep, int n) {
+            const auto split = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+            const uint8_t *sBase = std::min(su, sv);
+            uint8_t *dBase = std::min(du, dv);
+            auto x = 0;
+            for(; x + 16 <= n; x += 16) {
+                __m128i u, v;
+                if(sStep == 2) {
+                    auto a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(sBase + x * 2)), split);
+                    auto b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(sBase + x * 2 + 16)), split);
+                    auto lo = _mm_unpacklo_epi64(a, b), hi = _mm_unpackhi_epi64(a, b);
+                    u = su < sv ? lo : hi;
+                    v = su < sv ? hi : lo;
+                } else {
+                    u = _mm_loadu_si128((const __m128i *)(su + x));
+                    v = _mm_loadu_si128((const __m128i *)(sv + x));
+                }
+                if(dStep == 2) {
+                    auto first = du < dv ? u : v, second = du < dv ? v : u;
+                    _mm_storeu_si128((__m128i *)(dBase + x * 2), _mm_unpacklo_epi8(first, second));
+                    _mm_storeu_si128((__m128i *)(dBase + x * 2 + 16), _mm_unpackhi_epi8(first, second));
+                } else {
+                    _mm_storeu_si128((__m128i *)(du + x), u);
+                    _mm_storeu_si128((__m128i *)(dv + x), v);
+                }
+            }
+            uvRowScalar(su, sv, sStep, du, dv, dStep, x, n);
+        }
+
+        /**
+         * Y of 16 pixels, sums fit in unsigned 16 bits
+         */
+        VEGA_COLOR_TARGET_AVX2
+        static inline __m128i rgbToY16(const __m128i ch[3]) {
+            auto b = _mm256_cvtepu8_epi16(ch[0]), g = _mm256_cvtepu8_epi16(ch[1]), r = _mm256_cvtepu8_epi16(ch[2]);
+            auto y = _mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(66)), _mm256_mullo_epi16(g, _mm256_set1_epi16(129)));
+            y = _mm256_add_epi16(_mm256_add_epi16(y, _mm256_mullo_epi16(b, _mm256_set1_epi16(25))), _mm256_set1_epi16(128));
+            return pack16(_mm256_add_epi16(_mm256_srli_epi16(y, 8), _mm256_set1_epi16(16)));
+        }
+
+        /**
+         * U or V of 8 sums of 2x2 pixels, in the low 8 bytes
+         */
+        VEGA_COLOR_TARGET_AVX2
+        static inline __m128i sumToChroma8(__m256i b, __m256i g, __m256i r, int kb, int kg, int kr) {
+            auto c = _mm256_add_epi32(_mm256_mullo_epi32(r, _mm256_set1_epi32(kr)), _mm256_mullo_epi32(g, _mm256_set1_epi32(kg)));
+            c = _mm256_add_epi32(_mm256_add_epi32(c, _mm256_mullo_epi32(b, _mm256_set1_epi32(kb))), _mm256_set1_epi32(512));
+            c = _mm256_add_epi32(_mm256_srai_epi32(c, 10), _mm256_set1_epi32(128));
+            auto c16 = _mm_packs_epi32(_mm256_castsi256_si128(c), _mm256_extracti128_si256(c, 1));
+            return _mm_packus_epi16(c16, c16);
+        }
+
+        VEGA_COLOR_TARGET_AVX2
+        static void rgbToYRowAvx2(uint8_t *s[3], int step, uint8_t *y, int width) {
+            auto x = 0;
+            for(; x + 16 <= width; x += 16) {
+                __m128i ch[3];
+                load3(s, step, x, ch);
+                _mm_storeu_si128((__m128i *)(y + x), rgbToY16(ch));
+            }
+            rgbToYRowScalar(s, step, y, x, width);
+        }
+
+        VEGA_COLOR_TARGET_AVX2
+        static void rgbToYuvRowsAvx2(uint8_t *s0[3], uint8_t *s1[3], int step, uint8_t *y0, uint8_t *y1,
+                                     uint8_t *u, uint8_t *v, int uvStep, int width) {
+            const auto ones = _mm_set1_epi8(1);
+            uint8_t *uvBase = std::min(u, v);
+            auto x = 0;
+            for(; x + 16 <= width; x += 16) {
+                __m128i c0[3], c1[3];
+                load3(s0, step, x, c0);
+                load3(s1, step, x, c1);
+                _mm_storeu_si128((__m128i *)(y0 + x), rgbToY16(c0));
+                _mm_storeu_si128((__m128i *)(y1 + x), rgbToY16(c1));
+
+                // sums of 2x2 pixels as 32 bits
+                __m256i sum[3];
+                for(auto k = 0; k < 3; k++) {
+                    auto pairs = _mm_add_epi16(_mm_maddubs_epi16(c0[k], ones), _mm_maddubs_epi16(c1[k], ones));
+                    sum[k] = _mm256_cvtepi16_epi32(pairs);
+                }
+                auto uu = sumToChroma8(sum[0], sum[1], sum[2], 112, -74, -38);
+                auto vv = sumToChroma8(sum[0], sum[1], sum[2], -18, -94, 112);
+                if(uvStep == 2) {
+                    _mm_storeu_si128((__m128i *)(uvBase + x), u < v ? _mm_unpacklo_epi8(uu, vv) : _mm_unpacklo_epi8(vv, uu));
+                } else {
+                    _mm_storel_epi64((__m128i *)(u + x / 2), uu);
+                    _mm_storel_epi64((__m128i *)(v + x / 2), vv);
+                }
+            }
+            rgbToYuvRowsScalar(s0, s1, step, y0, y1, u, v, uvStep, x, width);
+        }
+#endif
+
+        ////////////////////////////////////////////////////////////////////////////////
+        ////////////                   NEON kernels                        /////////////
+        ////////////////////////////////////////////////////////////////////////////////
+#if VEGA_COLOR_NEON
+        static inline uint8_t *packedOrder(uint8_t *c[3], int order[3]) {
+            auto *base = std::min(c[0], std::min(c[1], c[2]));
+            for(auto k = 0; k < 3; k++) order[k] = (int)(c[k] - base);
+            return base;
+        }
+
+        static inline void store3(uint8_t *c[3], int step, int x, const uint8x16_t ch[3]) {
+            if(step == 1) {
+                for(auto k = 0; k < 3; k++) vst1q_u8(c[k] + x, ch[k]);
+                return;
+            }
+            int order[3];
+            auto *base = packedOrder(c, order);
+            uint8x16x3_t bytes;
+            for(auto k = 0; k < 3; k++) bytes.val[order[k]] = ch[k];
+            vst3q_u8(base + x * 3, bytes);
+        }
+
+        static inline void load3(uint8_t *c[3], int step, int x, uint8x16_t ch[3]) {
+            if(step == 1) {
+                for(auto k = 0; k < 3; k++) ch[k] = vld1q_u8(c[k] + x);
+                return;
+            }
+            int order[3];
+            auto *base = packedOrder(c, order);
+            auto bytes = vld3q_u8(base + x * 3);
+            for(auto k = 0; k < 3; k++) ch[k] = bytes.val[order[k]];
+        }
+
+        static void yuvRowNeon(const uint8_t *y, const uint8_t *u, const uint8_t *v, int uvStep,
+                               uint8_t *c[3], int step, int width) {
+            const auto c16 = vdupq_n_s16(16), c128 = vdupq_n_s16(128), c32 = vdupq_n_s16(32);
+            const uint8_t *uvBase = std::min(u, v);
+            auto x = 0;
+            for(; x + 16 <= width; x += 16) {
+                uint8x8_t u8, v8;
+                if(uvStep == 2) {
+                    auto uv = vld2_u8(uvBase + x);
+                    u8 = u < v ? uv.val[0] : uv.val[1];
+                    v8 = u < v ? uv.val[1] : uv.val[0];
+                } else {
+                    u8 = vld1_u8(u + x / 2);
+                    v8 = vld1_u8(v + x / 2);
+                }
+                auto cu = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(u8)), c128);
+                auto cv = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(v8)), c128);
+                // chroma terms of 8 pairs, duplicated to 16 pixels
+                auto bd = vzipq_s16(vmulq_n_s16(cu, 129), vmulq_n_s16(cu, 129));
+                auto gc = vaddq_s16(vmulq_n_s16(cu, 25), vmulq_n_s16(cv, 52));
+                auto gd = vzipq_s16(gc, gc);
+                auto rd = vzipq_s16(vmulq_n_s16(cv, 102), vmulq_n_s16(cv, 102));
+
+                auto y8 = vld1q_u8(y + x);
+                int16x8_t yy[2] = {vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(y8))),
+                                   vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(y8)))};
+                uint8x8_t b[2], g[2], r[2];
+                for(auto h = 0; h < 2; h++) {
+                    auto yh = vaddq_s16(vmulq_n_s16(vsubq_s16(yy[h], c16), 74), c32);
+                    b[h] = vqshrun_n_s16(vqaddq_s16(yh, bd.val[h]), 6);
+                    g[h] = vqshrun_n_s16(vqsubq_s16(yh, gd.val[h]), 6);
+                    r[h] = vqshrun_n_s16(vqaddq_s16(yh, rd.val[h]), 6);
+                }
+                uint8x16_t ch[3] = {vcombine_u8(b[0], b[1]), vcombine_u8(g[0], g[1]), vcombine_u8(r[0], r[1])};
+                store3(c, step, x, ch);
+            }
+            yuvRowScalar(y, u, v, uvStep, c, step, x, width);
+        }
+
+        static void shuffle3RowNeon(uint8_t *s[3], int sStep, uint8_t *d[3], int dStep, int width) {
+            auto x = 0;
+            for(; x + 16 <= width; x += 16) {
+                uint8x16_t ch[3];
+                load3(s, sStep, x, ch);
+                store3(d, dStep, x, ch);
+            }
+            shuffle3RowScalar(s, sStep, d, dStep, x, width);
+        }
+
+        static void uvRowNeon(const uint8_t *su, const uint8_t *sv, int sStep,
+                              uint8_t *du, uint8_t *dv, int dStep, int n) {
+            const uint8_t *sBase = std::min(su, sv);
+            uint8_t *dBase = std::min(du, dv);
+            auto x = 0;
+            for(; x + 16 <= n; x += 16) {
+                uint8x16_t u, v;
+                if(sStep == 2) {
+                    auto uv = vld2q_u8(sBase + x * 2);
+                    u = su < sv ? uv.val[0] : uv.val[1];
+                    v = su < sv ? uv.val[1] : uv.val[0];
+                } else {
+                    u = vld1q_u8(su + x);
+                    v = vld1q_u8(sv + x);
+                }
+                if(dStep == 2) {
+                    uint8x16x2_t uv;
+                    uv.val[0] = du < dv ? u : v;
+                    uv.val[1] = du < dv ? v : u;
+                    vst2q_u8(dBase + x * 2, uv);
+                } else {
+                    vst1q_u8(du + x, u);
+                    vst1q_u8(dv + x, v);
+                }
+            }
+            uvRowScalar(su, sv, sStep, du, dv, dStep, x, n);
+        }
+
+        static inline uint8x16_t rgbToY16(const uint8x16_t ch[3]) {
+            uint8x8_t y[2];
+            for(auto h = 0; h < 2; h++) {
+                auto b = vmovl_u8(h ? vget_high_u8(ch[0]) : vget_low_u8(ch[0]));
+                auto g = vmovl_u8(h ? vget_high_u8(ch[1]) : vget_low_u8(ch[1]));
+                auto r = vmovl_u8(h ? vget_high_u8(ch[2]) : vget_low_u8(ch[2]));
+                auto yy = vmlaq_n_u16(vmlaq_n_u16(vmulq_n_u16(r, 66), g, 129), b, 25);
+                y[h] = vmovn_u16(vaddq_u16(vshrq_n_u16(vaddq_u16(yy, vdupq_n_u16(128)), 8), vdupq_n_u16(16)));
+            }
+            return vcombine_u8(y[0], y[1]);
+        }
+
+        static inline uint8x8_t sumToChroma8(const int16x8_t &b, const int16x8_t &g, const int16x8_t &r, int kb, int kg, int kr) {
+            int16x4_t c[2];
+            for(auto h = 0; h < 2; h++) {
+                auto bb = vmovl_s16(h ? vget_high_s16(b) : vget_low_s16(b));
+                auto gg = vmovl_s16(h ? vget_high_s16(g) : vget_low_s16(g));
+                auto rr = vmovl_s16(h ? vget_high_s16(r) : vget_low_s16(r));
+                auto cc = vmlaq_n_s32(vmlaq_n_s32(vmlaq_n_s32(vdupq_n_s32(512), rr, kr), gg, kg), bb, kb);
+                c[h] = vmovn_s32(vaddq_s32(vshrq_n_s32(cc, 10), vdupq_n_s32(128)));
+            }
+            return vqmovun_s16(vcombine_s16(c[0], c[1]));
+        }
+
+        static void rgbToYRowNeon(uint8_t *s[3], int step, uint8_t *y, int width) {
+            auto x = 0;
+            for(; x + 16 <= width; x += 16) {
+                uint8x16_t ch[3];
+                load3(s, step, x, ch);
+                vst1q_u8(y + x, rgbToY16(ch));
+            }
+            rgbToYRowScalar(s, step, y, x, width);
+        }
+
+        static void rgbToYuvRowsNeon(uint8_t *s0[3], uint8_t *s1[3], int step, uint8_t *y0, uint8_t *y1,
+                                     uint8_t *u, uint8_t *v, int uvStep, int width) {
+            uint8_t *uvBase = std::min(u, v);
+            auto x = 0;
+            for(; x + 16 <= width; x += 16) {
+                uint8x16_t c0[3], c1[3];
+                load3(s0, step, x, c0);
+                load3(s1, step, x, c1);
+                vst1q_u8(y0 + x, rgbToY16(c0));
+                vst1q_u8(y1 + x, rgbToY16(c1));
+
+                // sums of 2x2 pixels
+                int16x8_t sum[3];
+                for(auto k = 0; k < 3; k++) {
+                    sum[k] = vreinterpretq_s16_u16(vaddq_u16(vpaddlq_u8(c0[k]), vpaddlq_u8(c1[k])));
+                }
+                auto uu = sumToChroma8(sum[0], sum[1], sum[2], 112, -74, -38);
+                auto vv = sumToChroma8(sum[0], sum[1], sum[2], -18, -94, 112);
+                if(uvStep == 2) {
+                    uint8x8x2_t uv;
+                    uv.val[0] = u < v ? uu : vv;
+                    uv.val[1] = u < v ? vv : uu;
+                    vst2_u8(uvBase + x, uv);
+                } else {
+                    vst1_u8(u + x / 2, uu);
+                    vst1_u8(v + x / 2, vv);
+                }
+            }
+            rgbToYuvRowsScalar(s0, s1, step, y0, y1, u, v, uvStep, x, width);
+        }
+#endif
+
+        ////////////////////////////////////////////////////////////////////////////////
+        ////////////                     Dispatch                          /////////////
+        ////////////////////////////////////////////////////////////////////////////////
+        static void yuvRow(ColorIsa isa, const uint8_t *y, const uint8_t *u, const uint8_t *v, int uvStep,
+                           uint8_t *c[3], int step, int width) {
+#if VEGA_COLOR_AVX2
+            if(isa == ColorIsa::AVX2) return yuvRowAvx2(y, u, v, uvStep, c, step, width);
+#elif VEGA_COLOR_NEON
+            if(isa == ColorIsa::NEON) return yuvRowNeon(y, u, v, uvStep, c, step, width);
+#endif
+            VEGA_UNUSED(isa);
+            yuvRowScalar(y, u, v, uvStep, c, step, 0, width);
+        }
+
+        static void shuffle3Row(ColorIsa isa, uint8_t *s[3], int sStep, uint8_t *d[3], int dStep, int width) {
+#if VEGA_COLOR_AVX2
+            if(isa == ColorIsa::AVX2) return shuffle3RowAvx2(s, sStep, d, dStep, width);
+#elif VEGA_COLOR_NEON
+            if(isa == ColorIsa::NEON) return shuffle3RowNeon(s, sStep, d, dStep, width);
+#endif
+            VEGA_UNUSED(isa);
+            shuffle3RowScalar(s, sStep, d, dStep, 0, width);
+        }
+
+        static void uvRow(ColorIsa isa, const uint8_t *su, const uint8_t *sv, int sStep,
+                          uint8_t *du, uint8_t *dv, int dStep, int n) {
+            if(sStep == 1 && dStep == 1) {
+                memcpy(du, su, (size_t)n);
+                memcpy(dv, sv, (size_t)n);
+                return;
+            }
+            if(sStep == 2 && dStep == 2 && (su < sv) == (du < dv)) {
+                memcpy(std::min(du, dv), std::min(su, sv), (size_t)n * 2);
+                return;
+            }
+#if VEGA_COLOR_AVX2
+            if(isa == ColorIsa::AVX2) return uvRowAvx2(su, sv, sStep, du, dv, dStep, n);
+#elif VEGA_COLOR_NEON
+            if(isa == ColorIsa::NEON) return uvRowNeon(su, sv, sStep, du, dv, dStep, n);
+#endif
+            VEGA_UNUSED(isa);
+            uvRowScalar(su, sv, sStep, du, dv, dStep, 0, n);
+        }
+
+        static void rgbToYRow(ColorIsa isa, uint8_t *s[3], int step, uint8_t *y, int width) {
+#if VEGA_COLOR_AVX2
+            if(isa == ColorIsa::AVX2) return rgbToYRowAvx2(s, step, y, width);
+#elif VEGA_COLOR_NEON
+            if(isa == ColorIsa::NEON) return rgbToYRowNeon(s, step, y, width);
+#endif
+            VEGA_UNUSED(isa);
+            rgbToYRowScalar(s, step, y, 0, width);
+        }
+
+        static void rgbToYuvRows(ColorIsa isa, uint8_t *s0[3], uint8_t *s1[3], int step, uint8_t *y0, uint8_t *y1,
+                                 uint8_t *u, uint8_t *v, int uvStep, int width) {
+#if VEGA_COLOR_AVX2
+            if(isa == ColorIsa::AVX2) return rgbToYuvRowsAvx2(s0, s1, step, y0, y1, u, v, uvStep, width);
+#elif VEGA_COLOR_NEON
+            if(isa == ColorIsa::NEON) return rgbToYuvRowsNeon(s0, s1, step, y0, y1, u, v, uvStep, width);
+#endif
+            VEGA_UNUSED(isa);
+            rgbToYuvRowsScalar(s0, s1, step, y0, y1, u, v, uvStep, 0, width);
+        }
+    };
+}
+
+#endif //VEGA_COLOR_H
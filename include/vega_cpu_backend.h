@@ -0,0 +1,796 @@
+#ifndef VEGA_CPU_BACKEND_H
+#define VEGA_CPU_BACKEND_H
+
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include "interface_base.h"
+#include "vega_buffer_pool.h"
+#include "vega_option_store.h"
+#include "station/thread_pool.h"
+
+namespace vega {
+
+    /**
+     * Decoded frame kept in CpuFramePool
+     */
+    typedef struct {
+        SdkImage type_ = SdkImage::BGR;     ///<! BGR, NV12 or GRAY
+        cv::Size size_;                     ///<! size of frame in pixel
+        cv::Mat mat_;                       ///<! compact data, NV12 has size_.height * 3 / 2 rows
+    } CpuFrame;
+
+    using CpuFrameSP = std::shared_ptr<const CpuFrame>;
+
+    /**
+     * In-process matrix pool of CPU backend, frames are identified by stream id + frame id.
+     *
+     * Frame ids of a stream start from 1 and increase, they restart after stream is removed.
+     * A frame taken by get() stays valid after it's freed.
+     */
+    class CpuFramePool {
+    public:
+        CpuFramePool() = default;
+        CpuFramePool(const CpuFramePool &) = delete;
+        CpuFramePool &operator = (const CpuFramePool &) = delete;
+
+        FrameId add(StreamId sid, CpuFrameSP frame) {
+            std::lock_guard<std::mutex> lock(mtx_);
+            auto &stream = streams_[sid];
+            auto fid = stream.next_++;
+            stream.frames_.emplace(fid, std::move(frame));
+            return fid;
+        }
+        CpuFrameSP get(StreamId sid, FrameId fid) {
+            std::lock_guard<std::mutex> lock(mtx_);
+            auto it = streams_.find(sid);
+            if(it == streams_.end()) return nullptr;
+            auto frame = it->second.frames_.find(fid);
+            return frame == it->second.frames_.end() ? nullptr : frame->second;
+        }
+        /**
+         * @return false if frame does not exist
+         */
+        bool free(StreamId sid, FrameId fid) {
+            std::lock_guard<std::mutex> lock(mtx_);
+            auto it = streams_.find(sid);
+            return it != streams_.end() && it->second.frames_.erase(fid) > 0;
+        }
+        /**
+         * Remove stream and all its frames
+         * @return frames removed
+         */
+        int removeStream(StreamId sid) {
+            std::lock_guard<std::mutex> lock(mtx_);
+            auto it = streams_.find(sid);
+            if(it == streams_.end()) return 0;
+            auto n = (int)it->second.frames_.size();
+            streams_.erase(it);
+            return n;
+        }
+        /**
+         * Frames in pool
+         */
+        size_t size() {
+            std::lock_guard<std::mutex> lock(mtx_);
+            size_t n = 0;
+            for(auto &it : streams_) n += it.second.frames_.size();
+            return n;
+        }
+
+    protected:
+        struct Stream {
+            FrameId next_ = 1;
+            std::unordered_map<FrameId, CpuFrameSP> frames_;
+        };
+
+        std::mutex mtx_;
+        std::unordered_map<StreamId, Stream> streams_;
+    };
+
+    using CpuFramePoolSP = std::shared_ptr<CpuFramePool>;
+
+    /**
+     * Interface on CPU, tasks of a batch are processed in parallel on a thread pool by a
+     * process function, and callback is called by the thread finishing last task.
+     * Batches are not kept in order.
+     */
+    template <typename _Task>
+    class CpuExecutable : public Executable<_Task> {
+    public:
+        using Base = Executable<_Task>;
+        using Tasks = std::vector<std::shared_ptr<_Task>>;
+        /**
+         * Process one task, returns error of task
+         */
+        using Process = std::function<DgError(_Task &task)>;
+
+        CpuExecutable(std::shared_ptr<ThreadPool> threads, int batchSize, Process process,
+                      typename Base::AsyncCallback callback)
+                : threads_(threads), batch_size_(batchSize), process_(process), callback_(callback) {
+            CHECK(threads_) << "Thread pool is required";
+            CHECK(batch_size_ > 0) << "Invalid batch size " << batch_size_;
+            CHECK(process_) << "Process is required";
+        }
+        /**
+         * Waits for tasks in execution and their callbacks. If destroyed inside its own callback,
+         * waits for the other tasks only, the calling one leaves the interface untouched.
+         */
+        ~CpuExecutable() override {
+            auto self = 0;
+            for(auto frame = calling(); frame != nullptr; frame = frame->outer_) {
+                if(frame->iface_ != this) continue;
+                frame->destroyed_ = true;
+                ++self;
+            }
+            std::unique_lock<std::mutex> lock(mtx_);
+            cv_.wait(lock, [this, self]() { return running_ == self; });
+        }
+
+    public:
+        int getBatchSize() override {
+            return batch_size_;
+        }
+        DgError sendCommand(const std::string &cmd, const std::string &param, std::map<std::string, std::string> &result) override {
+            VEGA_UNUSED(cmd);
+            VEGA_UNUSED(param);
+            VEGA_UNUSED(result);
+            return DG_ERR_NOT_SUPPORTED;
+        }
+
+        using Base::execute;
+        DgError execute(Tasks &tasks) override {
+            if(tasks.empty() || (int)tasks.size() > batch_size_) {
+                LOG(ERROR) << "Invalid batch size " << tasks.size() << ", max " << batch_size_;
+                return DG_ERR_INVALID_PARAM;
+            }
+
+            auto join = std::make_shared<Join>();
+            join->tasks_ = tasks;
+            join->left_ = (int)tasks.size();
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                running_ += (int)tasks.size();
+            }
+            for(auto i = 0u; i < tasks.size(); i++) {
+                auto doable = std::make_shared<CallbackDoable>();
+                doable->setCallback([this, join, i]() {
+                    run(join, i);
+                });
+                auto error = threads_->put(doable);
+                if(error != DG_OK) {
+                    LOG(ERROR) << "Thread pool rejects task: " << error;
+                    tasks[i]->error_ = error;
+                    join->error_ = error;
+                    done(join);
+                }
+            }
+            return DG_OK;
+        }
+
+    protected:
+        struct Join {
+            Tasks tasks_;
+            std::atomic<int> left_{0};
+            std::atomic<int> error_{DG_OK};
+        };
+
+        /**
+         * Callback being called on this thread, innermost first
+         */
+        struct Calling {
+            const CpuExecutable *iface_;
+            bool destroyed_;
+            Calling *outer_;
+        };
+        static Calling *&calling() {
+            static thread_local Calling *current = nullptr;
+            return current;
+        }
+
+        void run(const std::shared_ptr<Join> &join, size_t idx) {
+            auto &task = join->tasks_[idx];
+            auto error = process_(*task);
+            task->error_ = error;
+            if(error != DG_OK) {
+                join->error_ = error;
+            }
+            done(join);
+        }
+
+        /**
+         * Task ends, it's counted as running until callback of its batch returns
+         */
+        void done(const std::shared_ptr<Join> &join) {
+            if(--join->left_ == 0) {
+                auto callback = callback_;
+                auto &current = calling();
+                Calling frame{this, false, current};
+                current = &frame;
+                callback(join->tasks_, (DgError)join->error_.load());
+                current = frame.outer_;
+                // interface is destroyed inside callback, nothing of it is touched any more
+                if(frame.destroyed_) return;
+            }
+            std::lock_guard<std::mutex> lock(mtx_);
+            --running_;
+            cv_.notify_all();
+        }
+
+    protected:
+        std::shared_ptr<ThreadPool> threads_;
+        int batch_size_;
+        Process process_;
+        typename Base::AsyncCallback callback_;
+
+        std::mutex mtx_;
+        std::condition_variable cv_;
+        int running_ = 0;
+    };
+
+    /**
+     * Image conversion of CPU backend
+     */
+    class CpuImage {
+    public:
+        /**
+         * Copy raw BGR/NV12/GRAY data with stride into a compact frame
+         */
+        static DgError fromRaw(SdkImage type, const uint8_t *data, int len, cv::Size size, cv::Size stride, CpuFrame &frame) {
+            if(size.width <= 0 || size.height <= 0) {
+                return DG_ERR_INVALID_PARAM;
+            }
+            auto rowBytes = size.width * (type == SdkImage::BGR ? 3 : 1);
+            if(stride.width <= 0) stride.width = rowBytes;
+            if(stride.height <= 0) stride.height = size.height;
+            if(stride.width < rowBytes || stride.height < size.height) {
+                return DG_ERR_INVALID_PARAM;
+            }
+
+            auto *src = const_cast<uint8_t *>(data);
+            switch(type) {
+                case SdkImage::BGR:
+                case SdkImage::GRAY: {
+                    if(len < stride.width * (size.height - 1) + rowBytes) return DG_ERR_INVALID_PARAM;
+                    auto cvType = type == SdkImage::BGR ? CV_8UC3 : CV_8UC1;
+                    frame.mat_ = cv::Mat(size, cvType, src, stride.width).clone();
+                    break;
+                }
+                case SdkImage::NV12: {
+                    if(size.width % 2 || size.height % 2) return DG_ERR_INVALID_PARAM;
+                    auto uvOffset = stride.width * stride.height;
+                    if(len < uvOffset + stride.width * (size.height / 2 - 1) + rowBytes) return DG_ERR_INVALID_PARAM;
+                    frame.mat_.create(size.height * 3 / 2, size.width, CV_8UC1);
+                    cv::Mat(size.height, size.width, CV_8UC1, src, stride.width)
+                            .copyTo(frame.mat_.rowRange(0, size.height));
+                    cv::Mat(size.height / 2, size.width, CV_8UC1, src + uvOffset, stride.width)
+                            .copyTo(frame.mat_.rowRange(size.height, frame.mat_.rows));
+                    break;
+                }
+                default:
+                    return DG_ERR_NOT_SUPPORTED;
+            }
+            frame.type_ = type;
+            frame.size_ = size;
+            return DG_OK;
+        }
+
+        /**
+         * Convert frame to BGR, GRAY or NV12. NV12 of odd sized frame is cropped to even size.
+         */
+        static DgError convert(const CpuFrame &frame, SdkImage type, cv::Mat &out) {
+            if(type == frame.type_) {
+                out = frame.mat_;
+                return DG_OK;
+            }
+            switch(type) {
+                case SdkImage::BGR:
+                    if(frame.type_ == SdkImage::NV12) {
+                        cv::cvtColor(frame.mat_, out, cv::COLOR_YUV2BGR_NV12);
+                    } else {
+                        cv::cvtColor(frame.mat_, out, cv::COLOR_GRAY2BGR);
+                    }
+                    return DG_OK;
+                case SdkImage::GRAY:
+                    if(frame.type_ == SdkImage::NV12) {
+                        out = frame.mat_.rowRange(0, frame.size_.height);
+                    } else {
+                        cv::cvtColor(frame.mat_, out, cv::COLOR_BGR2GRAY);
+                    }
+                    return DG_OK;
+                case SdkImage::NV12: {
+                    cv::Mat bgr = frame.mat_;
+                    if(frame.type_ == SdkImage::GRAY) {
+                        cv::cvtColor(frame.mat_, bgr, cv::COLOR_GRAY2BGR);
+                    }
+                    bgrToNv12(bgr(cv::Rect(0, 0, bgr.cols & ~1, bgr.rows & ~1)), out);
+                    return DG_OK;
+                }
+                default:
+                    return DG_ERR_NOT_SUPPORTED;
+            }
+        }
+
+        /**
+         * Crop roi of frame and resize it to size in the type of frame, before any conversion.
+         * Whole frame if roi is empty, not resized if size is empty. NV12 roi and size are
+         * aligned to 2.
+         * @param interp cv::InterpolationFlags, negative for INTER_AREA on downscaling or INTER_LINEAR
+         */
+        static DgError cropResize(const CpuFrame &frame, cv::Rect roi, cv::Size size, int interp, CpuFrame &out) {
+            cv::Rect full(cv::Point(), frame.size_);
+            roi = roi.area() > 0 ? roi & full : full;
+            if(frame.type_ == SdkImage::NV12) {
+                roi = cv::Rect(roi.x & ~1, roi.y & ~1, roi.width & ~1, roi.height & ~1);
+                size = cv::Size(size.width & ~1, size.height & ~1);
+            }
+            if(roi.area() <= 0) {
+                return DG_ERR_INVALID_PARAM;
+            }
+            if(size.area() <= 0) size = roi.size();
+            if(interp < 0) interp = size.area() < roi.area() ? cv::INTER_AREA : cv::INTER_LINEAR;
+
+            out.type_ = frame.type_;
+            out.size_ = size;
+            switch(frame.type_) {
+                case SdkImage::BGR:
+                case SdkImage::GRAY:
+                    if(size == roi.size()) {
+                        out.mat_ = frame.mat_(roi);
+                    } else {
+                        cv::resize(frame.mat_(roi), out.mat_, size, 0, 0, interp);
+                    }
+                    return DG_OK;
+                case SdkImage::NV12: {
+                    auto h = frame.size_.height;
+                    cv::Mat uv(h / 2, frame.size_.width / 2, CV_8UC2, const_cast<uint8_t *>(frame.mat_.ptr(h)), frame.mat_.step[0]);
+                    cv::Rect uvRoi(roi.x / 2, roi.y / 2, roi.width / 2, roi.height / 2);
+                    out.mat_.create(size.height * 3 / 2, size.width, CV_8UC1);
+                    cv::Mat outY = out.mat_.rowRange(0, size.height);
+                    cv::Mat outUv(size.height / 2, size.width / 2, CV_8UC2, out.mat_.ptr(size.height), out.mat_.step[0]);
+                    cv::resize(frame.mat_.rowRange(0, h)(roi), outY, size, 0, 0, interp);
+                    cv::resize(uv(uvRoi), outUv, outUv.size(), 0, 0, interp);
+                    return DG_OK;
+                }
+                default:
+                    return DG_ERR_NOT_SUPPORTED;
+            }
+        }
+
+        /**
+         * Output size by fetch_width_ and fetch_height_ of task for an image of size, empty if not resized
+         * or image is empty
+         */
+        static cv::Size fetchSize(SdkTaskBase &task, cv::Size size) {
+            auto w = task.getInteger(OptionKeys::fetch_width_(), 0);
+            auto h = task.getInteger(OptionKeys::fetch_height_(), 0);
+            if((w <= 0 && h <= 0) || size.area() <= 0) return cv::Size();
+            if(w <= 0) w = std::max(1, (int)std::lround((double)h * size.width / size.height));
+            if(h <= 0) h = std::max(1, (int)std::lround((double)w * size.height / size.width));
+            return cv::Size(w, h);
+        }
+
+        /**
+         * Encode frame or its roi to JPEG, NV12 is converted in scratch().bgr_
+         */
+        static DgError toJpeg(const CpuFrame &frame, const cv::Rect &roi, int quality, std::vector<uint8_t> &out) {
+            return toJpeg(jpegSource(frame, scratch().bgr_), roi, quality, out);
+        }
+        /**
+         * Encode roi of a BGR or GRAY image from jpegSource() to JPEG
+         */
+        static DgError toJpeg(const cv::Mat &src, const cv::Rect &roi, int quality, std::vector<uint8_t> &out) {
+            cv::Mat img = src;
+            if(roi.area() > 0) {
+                auto r = roi & cv::Rect(0, 0, img.cols, img.rows);
+                if(r.area() <= 0) return DG_ERR_INVALID_PARAM;
+                img = img(r);
+            }
+            std::vector<int> params{cv::IMWRITE_JPEG_QUALITY, quality};
+            return cv::imencode(".jpg", img, out, params) ? DG_OK : DG_ERR_VENC_FAIL;
+        }
+        /**
+         * Image JPEG is encoded from, NV12 is converted to BGR in bgr
+         */
+        static cv::Mat jpegSource(const CpuFrame &frame, cv::Mat &bgr) {
+            if(frame.type_ != SdkImage::NV12) {
+                return frame.mat_;
+            }
+            cv::cvtColor(frame.mat_, bgr, cv::COLOR_YUV2BGR_NV12);
+            return bgr;
+        }
+
+        /**
+         * Convert frame like convert() into a buffer of buffers, out is a compact header over data
+         */
+        static DgError convert(const CpuFrame &frame, SdkImage type, BufferPool &buffers,
+                               std::shared_ptr<uint8_t> &data, cv::Mat &out) {
+            auto size = frame.size_;
+            auto rows = size.height;
+            auto cvType = CV_8UC1;
+            switch(type) {
+                case SdkImage::BGR:
+                    cvType = CV_8UC3;
+                    break;
+                case SdkImage::GRAY:
+                    break;
+                case SdkImage::NV12:
+                    if(frame.type_ != SdkImage::NV12) size = cv::Size(size.width & ~1, size.height & ~1);
+                    rows = size.height * 3 / 2;
+                    break;
+                default:
+                    return DG_ERR_NOT_SUPPORTED;
+            }
+            data = buffers.get((size_t)size.width * rows * CV_ELEM_SIZE(cvType));
+            cv::Mat dst(rows, size.width, cvType, data.get());
+            out = dst;
+            auto error = convert(frame, type, out);
+            if(error != DG_OK) return error;
+            if(out.data != dst.data) {
+                out.copyTo(dst);
+                out = dst;
+            }
+            return DG_OK;
+        }
+
+        /**
+         * Buffers of calling thread reused by conversion and encoding, so that only
+         * results are copied into BufferPool
+         */
+        struct Scratch {
+            cv::Mat bgr_;                   ///<! NV12 converted for JPEG
+            cv::Mat scaled_;                ///<! crop resized for fetching
+            std::vector<uint8_t> jpeg_;     ///<! encoded JPEG
+        };
+        static Scratch &scratch() {
+            static thread_local Scratch s;
+            return s;
+        }
+
+        /**
+         * Copy into a buffer owned by shared_ptr
+         */
+        static std::shared_ptr<uint8_t> copy(const uint8_t *data, size_t len) {
+            std::shared_ptr<uint8_t> buf(new uint8_t[len], std::default_delete<uint8_t[]>());
+            memcpy(buf.get(), data, len);
+            return buf;
+        }
+
+    protected:
+        static void bgrToNv12(const cv::Mat &bgr, cv::Mat &nv12) {
+            cv::Mat i420;
+            cv::cvtColor(bgr, i420, cv::COLOR_BGR2YUV_I420);
+            auto w = bgr.cols, h = bgr.rows;
+            nv12.create(h * 3 / 2, w, CV_8UC1);
+            memcpy(nv12.data, i420.data, (size_t)w * h);
+            auto *u = i420.data + w * h;
+            auto *v = u + w * h / 4;
+            auto *uv = nv12.data + w * h;
+            for(auto i = 0; i < w * h / 4; i++) {
+                uv[2 * i] = u[i];
+                uv[2 * i + 1] = v[i];
+            }
+        }
+    };
+
+    /**
+     * Software backend of Decode/FetchFrame/MultiFetchFrame/FreeFrame/RemoveStream/Encode interfaces,
+     * built on OpenCV. Used to run and profile host side of pipeline without accelerator.
+     *
+     * All interfaces created by one backend share its frame pool and thread pool.
+     * Results of FetchFrame and Encode are allocated from its BufferPool. Raw results are
+     * converted straight into pooled buffers, JPEG is encoded into a buffer of the thread
+     * and copied once.
+     *
+     * Decode: JPEG, PNG and other images OpenCV can read are decoded into BGR, decoded BGR,
+     *     NV12 or GRAY input is copied. Video is not supported.
+     *     OptionKeys::jpeg_scale_ of 2, 4 or 8 decodes JPEG at that fraction by DCT scaling.
+     * FetchFrame: type_ can be BGR, NV12, GRAY, JPEG, or IMAGE for frame as it's kept.
+     *     roi_ crops all types, OptionKeys::fetch_width_/fetch_height_ resize the output,
+     *     both are done before conversion.
+     *     stride_ of output is bytes of a row and rows of first plane, not set for JPEG.
+     *     type_ is set to the output type as interface requires, so for IMAGE it's the type
+     *     frame is kept in. Reset type_ before fetching again by a task.
+     * MultiFetchFrame: type_ can be JPEG, BGR or GRAY, frame is converted once for all rois,
+     *     each crop is resized by fetch_width_/fetch_height_.
+     * FreeFrame: DG_ERR_NOT_EXIST if frame does not exist.
+     * RemoveStream: removing an unknown stream succeeds.
+     * Encode: only JPEG(motion JPEG) is supported, H264/H265 returns DG_ERR_NOT_SUPPORTED.
+     *
+     * \code{.cpp}
+     * auto backend = std::make_shared<CpuBackend>(4);
+     * auto decoder = backend->createDecodeInterface(onDecode);
+     * auto fetcher = backend->createFetchFrameInterface(onFetch);
+     * \endcode
+     */
+    class CpuBackend {
+    public:
+        /**
+         * @param threads threads of batch execution, 0 for hardware concurrency
+         * @param batchSize batch size of interfaces
+         * @param maxRetained max bytes of free result buffers kept
+         */
+        explicit CpuBackend(int threads = 0, int batchSize = 8, size_t maxRetained = 64 << 20)
+                : batch_size_(batchSize) {
+            if(threads <= 0) threads = std::max(1, (int)std::thread::hardware_concurrency());
+            threads_ = std::make_shared<ThreadPool>("cpu_backend");
+            threads_->create(threads);
+            pool_ = std::make_shared<CpuFramePool>();
+            buffers_ = std::make_shared<BufferPool>(maxRetained);
+        }
+
+    public:
+        std::shared_ptr<DecodeInterface> createDecodeInterface(DecodeInterface::AsyncCallback callback) {
+            auto pool = pool_;
+            return std::make_shared<CpuExecutable<DecodeTask>>(threads_, batch_size_, [pool](DecodeTask &task) {
+                return decode(*pool, task);
+            }, callback);
+        }
+        std::shared_ptr<FetchFrameInterface> createFetchFrameInterface(FetchFrameInterface::AsyncCallback callback) {
+            auto pool = pool_;
+            auto buffers = buffers_;
+            return std::make_shared<CpuExecutable<FetchFrameTask>>(threads_, batch_size_, [pool, buffers](FetchFrameTask &task) {
+                return fetch(*pool, *buffers, task);
+            }, callback);
+        }
+        std::shared_ptr<MultiFetchFrameInterface> createMultiFetchFrameInterface(MultiFetchFrameInterface::AsyncCallback callback) {
+            auto pool = pool_;
+            auto buffers = buffers_;
+            return std::make_shared<CpuExecutable<MultiFetchFrameTask>>(threads_, batch_size_, [pool, buffers](MultiFetchFrameTask &task) {
+                return fetchMulti(*pool, *buffers, task);
+            }, callback);
+        }
+        std::shared_ptr<FreeFrameInterface> createFreeFrameInterface(FreeFrameInterface::AsyncCallback callback) {
+            auto pool = pool_;
+            return std::make_shared<CpuExecutable<FreeFrameTask>>(threads_, batch_size_, [pool](FreeFrameTask &task) {
+                return pool->free(task.stream_id_, task.frame_id_) ? DG_OK : DG_ERR_NOT_EXIST;
+            }, callback);
+        }
+        std::shared_ptr<RemoveStreamInterface> createRemoveStreamInterface(RemoveStreamInterface::AsyncCallback callback) {
+            auto pool = pool_;
+            return std::make_shared<CpuExecutable<RemoveStreamTask>>(threads_, batch_size_, [pool](RemoveStreamTask &task) {
+                pool->removeStream(task.stream_id_);
+                return DG_OK;
+            }, callback);
+        }
+        std::shared_ptr<EncodeInterface> createEncodeInterface(EncodeInterface::AsyncCallback callback) {
+            auto pool = pool_;
+            auto buffers = buffers_;
+            return std::make_shared<CpuExecutable<EncodeTask>>(threads_, batch_size_, [pool, buffers](EncodeTask &task) {
+                return encode(*pool, *buffers, task);
+            }, callback);
+        }
+
+        inline CpuFramePool &pool() { return *pool_; }
+        inline BufferPool &buffers() { return *buffers_; }
+
+    protected:
+        static DgError decode(CpuFramePool &pool, DecodeTask &task) {
+            if(task.getBool(OptionKeys::video_eos_(), false) && task.data_ == nullptr) {
+                return DG_OK;
+            }
+            if(task.data_ == nullptr || task.data_len_ <= 0) {
+                return DG_ERR_INVALID_PARAM;
+            }
+
+            auto frame = std::make_shared<CpuFrame>();
+            switch(task.type_) {
+                case SdkImage::JPEG:
+                case SdkImage::PNG:
+                case SdkImage::IMAGE: {
+                    cv::Mat buf(1, task.data_len_, CV_8UC1, task.data_);
+                    frame->mat_ = cv::imdecode(buf, decodeFlags(task));
+                    if(frame->mat_.empty()) {
+                        return DG_ERR_DECODE_FAIL;
+                    }
+                    frame->type_ = SdkImage::BGR;
+                    frame->size_ = frame->mat_.size();
+                    break;
+                }
+                case SdkImage::BGR:
+                case SdkImage::NV12:
+                case SdkImage::GRAY: {
+                    auto error = CpuImage::fromRaw(task.type_, task.data_, task.data_len_, task.size_, task.stride_, *frame);
+                    if(error != DG_OK) return error;
+                    break;
+                }
+                default:
+                    return DG_ERR_NOT_SUPPORTED;
+            }
+
+            if(task.getBool(OptionKeys::discard_frame_(), false)) {
+                return DG_OK;
+            }
+            task.frame_id_ = pool.add(task.stream_id_, frame);
+            return DG_OK;
+        }
+
+        /**
+         * cv::imdecode flags of a decode task, reduced by jpeg_scale_, which libjpeg does
+         * by DCT scaling, other formats are resized after decoding
+         */
+        static int decodeFlags(DecodeTask &task) {
+            switch(task.getInteger(OptionKeys::jpeg_scale_(), 1)) {
+                case 2:
+                    return cv::IMREAD_REDUCED_COLOR_2;
+                case 4:
+                    return cv::IMREAD_REDUCED_COLOR_4;
+                case 8:
+                    return cv::IMREAD_REDUCED_COLOR_8;
+                default:
+                    return cv::IMREAD_COLOR;
+            }
+        }
+
+        static DgError fetch(CpuFramePool &pool, BufferPool &buffers, FetchFrameTask &task) {
+            auto frame = pool.get(task.stream_id_, task.frame_id_);
+            if(!frame) {
+                return DG_ERR_NOT_EXIST;
+            }
+
+            auto &result = task.result_;
+            cv::Rect full(cv::Point(), frame->size_);
+            if(task.roi_.area() > 0 && (task.roi_ & full).area() <= 0) {
+                return DG_ERR_INVALID_PARAM;
+            }
+            auto size = CpuImage::fetchSize(task, task.roi_.area() > 0 ? (task.roi_ & full).size() : full.size());
+            auto &jpeg = CpuImage::scratch().jpeg_;
+            if(task.type_ == SdkImage::JPEG && size.area() <= 0) {
+                auto error = CpuImage::toJpeg(*frame, task.roi_, task.getInteger(OptionKeys::jpeg_quality_(), 90), jpeg);
+                if(error != DG_OK) return error;
+                result.data_ = buffers.copy(jpeg.data(), jpeg.size());
+                result.data_len_ = (int)jpeg.size();
+                result.size_ = task.roi_.area() > 0 ? (task.roi_ & full).size() : frame->size_;
+                result.stride_ = cv::Size();
+                return DG_OK;
+            }
+
+            // crop and scale before conversion, so only output pixels are converted,
+            // scaled into a buffer of the thread, which is reused while output size is the same
+            auto src = frame;
+            if(task.roi_.area() > 0 || size.area() > 0) {
+                auto &reused = CpuImage::scratch().scaled_;
+                auto scaled = std::make_shared<CpuFrame>();
+                scaled->mat_ = reused;
+                auto error = CpuImage::cropResize(*frame, task.roi_, size,
+                                                  task.getInteger(OptionKeys::fetch_interpolation_(), -1), *scaled);
+                if(error != DG_OK) return error;
+                if(scaled->mat_.datastart != frame->mat_.datastart) reused = scaled->mat_;
+                src = scaled;
+            }
+
+            if(task.type_ == SdkImage::JPEG) {
+                auto error = CpuImage::toJpeg(*src, cv::Rect(), task.getInteger(OptionKeys::jpeg_quality_(), 90), jpeg);
+                if(error != DG_OK) return error;
+                result.data_ = buffers.copy(jpeg.data(), jpeg.size());
+                result.data_len_ = (int)jpeg.size();
+                result.size_ = src->size_;
+                result.stride_ = cv::Size();
+                return DG_OK;
+            }
+
+            auto type = task.type_ == SdkImage::IMAGE ? src->type_ : task.type_;
+            cv::Mat out;
+            auto error = CpuImage::convert(*src, type, buffers, result.data_, out);
+            if(error != DG_OK) {
+                result.data_.reset();
+                return error;
+            }
+
+            task.type_ = type;
+            result.data_len_ = (int)(out.total() * out.elemSize());
+            result.size_ = cv::Size(out.cols, type == SdkImage::NV12 ? out.rows * 2 / 3 : out.rows);
+            result.stride_ = cv::Size((int)out.step[0], result.size_.height);
+            return DG_OK;
+        }
+
+        static DgError fetchMulti(CpuFramePool &pool, BufferPool &buffers, MultiFetchFrameTask &task) {
+            auto frame = pool.get(task.stream_id_, task.frame_id_);
+            if(!frame) {
+                return DG_ERR_NOT_EXIST;
+            }
+
+            // read and convert once
+            cv::Mat src;
+            switch(task.type_) {
+                case SdkImage::JPEG:
+                    src = CpuImage::jpegSource(*frame, CpuImage::scratch().bgr_);
+                    break;
+                case SdkImage::BGR:
+                case SdkImage::GRAY: {
+                    auto error = CpuImage::convert(*frame, task.type_, src);
+                    if(error != DG_OK) return error;
+                    break;
+                }
+                default:
+                    return DG_ERR_NOT_SUPPORTED;
+            }
+
+            cv::Rect full(cv::Point(), frame->size_);
+            std::vector<cv::Rect> rois = task.rois_.empty() ? std::vector<cv::Rect>{full} : task.rois_;
+            auto quality = task.getInteger(OptionKeys::jpeg_quality_(), 90);
+            auto interpOption = task.getInteger(OptionKeys::fetch_interpolation_(), -1);
+            auto &results = task.result_;
+            results.resize(rois.size());
+            auto &jpeg = CpuImage::scratch().jpeg_;
+            for(auto i = 0u; i < rois.size(); i++) {
+                auto r = rois[i] & full;
+                if(r.area() <= 0) {
+                    results.clear();
+                    return DG_ERR_INVALID_PARAM;
+                }
+
+                auto &result = results[i];
+                cv::Mat crop = src(r);
+                auto size = CpuImage::fetchSize(task, r.size());
+                auto interp = interpOption >= 0 ? interpOption :
+                        (size.area() < r.area() ? cv::INTER_AREA : cv::INTER_LINEAR);
+                result.size_ = size.area() > 0 ? size : crop.size();
+                if(task.type_ == SdkImage::JPEG) {
+                    if(size.area() > 0) {
+                        auto &scaled = CpuImage::scratch().scaled_;
+                        cv::resize(crop, scaled, size, 0, 0, interp);
+                        crop = scaled;
+                    }
+                    auto error = CpuImage::toJpeg(crop, cv::Rect(), quality, jpeg);
+                    if(error != DG_OK) {
+                        results.clear();
+                        return error;
+                    }
+                    result.data_ = buffers.copy(jpeg.data(), jpeg.size());
+                    result.data_len_ = (int)jpeg.size();
+                    result.stride_ = cv::Size();
+                    continue;
+                }
+
+                // crop or resize straight into result
+                auto rowBytes = (size_t)result.size_.width * crop.elemSize();
+                result.data_len_ = (int)(rowBytes * result.size_.height);
+                result.data_ = buffers.get(result.data_len_);
+                cv::Mat dst(result.size_, crop.type(), result.data_.get());
+                if(size.area() > 0) {
+                    cv::resize(crop, dst, size, 0, 0, interp);
+                } else {
+                    crop.copyTo(dst);
+                }
+                result.stride_ = cv::Size((int)rowBytes, result.size_.height);
+            }
+            return DG_OK;
+        }
+
+        static DgError encode(CpuFramePool &pool, BufferPool &buffers, EncodeTask &task) {
+            auto eos = task.getBool(OptionKeys::video_eos_(), false);
+            if(task.type_ != SdkImage::JPEG) {
+                return DG_ERR_NOT_SUPPORTED;
+            }
+            auto frame = pool.get(task.stream_id_, task.frame_id_);
+            if(!frame) {
+                return eos ? DG_OK : DG_ERR_NOT_EXIST;
+            }
+
+            auto &jpeg = CpuImage::scratch().jpeg_;
+            auto error = CpuImage::toJpeg(*frame, cv::Rect(), task.getInteger(OptionKeys::jpeg_quality_(), 90), jpeg);
+            if(error != DG_OK) return error;
+            auto &result = task.result_;
+            result.data_ = buffers.copy(jpeg.data(), jpeg.size());
+            result.data_len_ = (int)jpeg.size();
+            result.size_ = frame->size_;
+            result.stride_ = cv::Size();
+            return DG_OK;
+        }
+
+    protected:
+        int batch_size_;
+        std::shared_ptr<ThreadPool> threads_;
+        CpuFramePoolSP pool_;
+        BufferPoolSP buffers_;
+    };
+}
+
+#endif //VEGA_CPU_BACKEND_H
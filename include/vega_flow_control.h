@@ -0,0 +1,270 @@
+#ifndef VEGA_FLOW_CONTROL_H
+#define VEGA_FLOW_CONTROL_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include "interface_base.h"
+#include "vega_router.h"
+
+namespace vega {
+
+    /**
+     * What execute() does while all credits are in use
+     */
+    enum class CreditPolicy {
+        BLOCK = 0,      ///<! wait until a batch ends, or timeout(DG_ERR_TIME_OUT)
+        FAIL_FAST = 1,  ///<! return DG_ERR_FULL at once
+        QUEUE = 2,      ///<! keep batch and send it when a batch ends, DG_ERR_FULL if queue is full
+    };
+
+    /**
+     * Flow control of an interface by credits.
+     *
+     * Each batch in execution holds a credit, which is returned when its callback
+     * is called. With 1 credit, this enforces "DO NOT send next batch tasks until
+     * previous ends" without waiting on events in caller, and more credits can be
+     * given to interfaces which pipeline batches.
+     *
+     * Credit is returned before callback is called, so next batch can be sent
+     * inside callback even in BLOCK policy.
+     *
+     * Queued batches are sent in order, new batches queue behind them while any is
+     * queued. Batches still queued on destruction are called back with DG_ERR_CANCELLED.
+     *
+     * \code{.cpp}
+     * auto encoder = std::make_shared<FlowControlExecutable<EncodeTask>>(
+     *     [&](EncodeInterface::AsyncCallback cb) {
+     *         return createEncodeInterface(0, "", Model::encode_video, nullptr, cb);
+     *     }, onEncode, 1, CreditPolicy::QUEUE);
+     * encoder->execute(tasks); // returns at once, sent after previous batch ends
+     * \endcode
+     */
+    template <typename _Task>
+    class FlowControlExecutable : public Executable<_Task> {
+    public:
+        using Base = Executable<_Task>;
+        using Tasks = std::vector<std::shared_ptr<_Task>>;
+
+        struct Stats {
+            long batches_ = 0;          ///<! batches sent to interface
+            long waits_ = 0;            ///<! times execute() waited for credit(BLOCK) or was queued(QUEUE)
+            double wait_ms_ = 0;        ///<! total time batches waited for credit
+            double max_wait_ms_ = 0;    ///<! longest time a batch waited for credit
+            long rejected_ = 0;         ///<! batches rejected by DG_ERR_FULL or DG_ERR_TIME_OUT
+            int in_flight_ = 0;         ///<! current batches in execution
+            int queued_ = 0;            ///<! current batches in queue
+            int peak_queued_ = 0;       ///<! max batches in queue
+        };
+
+    public:
+        /**
+         * @param creator creates the wrapped interface
+         * @param callback callback of batches
+         * @param credits max batches in execution
+         * @param policy see CreditPolicy
+         * @param timeoutMs timeout of BLOCK policy, negative to wait forever
+         * @param maxQueued max batches kept by QUEUE policy, negative for unlimited
+         */
+        FlowControlExecutable(typename Base::Creator creator, typename Base::AsyncCallback callback,
+                              int credits = 1, CreditPolicy policy = CreditPolicy::BLOCK,
+                              int timeoutMs = -1, int maxQueued = -1)
+                : callback_(callback), credits_(credits), policy_(policy),
+                  timeout_ms_(timeoutMs), max_queued_(maxQueued) {
+            CHECK(credits_ > 0) << "Invalid credits " << credits_;
+            CHECK(callback_) << "Callback is required";
+            inner_ = creator(router_.callback());
+            CHECK(inner_) << "Create interface fail";
+        }
+        ~FlowControlExecutable() override {
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                closing_ = true;
+            }
+            inner_.reset();
+            std::deque<Queued> left;
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                left.swap(queue_);
+            }
+            for(auto &queued : left) {
+                fail(queued.tasks_, DG_ERR_CANCELLED);
+            }
+        }
+
+    public:
+        int getBatchSize() override {
+            return inner_->getBatchSize();
+        }
+        DgError sendCommand(const std::string &cmd, const std::string &param, std::map<std::string, std::string> &result) override {
+            return inner_->sendCommand(cmd, param, result);
+        }
+
+        using Base::execute;
+        DgError execute(Tasks &tasks) override {
+            if(tasks.empty()) {
+                return DG_ERR_INVALID_PARAM;
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            std::unique_lock<std::mutex> lock(mtx_);
+            // queued batches go first, including the one being sent by drain()
+            if(available() <= 0 || !queue_.empty() || draining_) {
+                switch(policy_) {
+                    case CreditPolicy::FAIL_FAST:
+                        ++stats_.rejected_;
+                        return DG_ERR_FULL;
+                    case CreditPolicy::QUEUE:
+                        if(max_queued_ >= 0 && (int)queue_.size() >= max_queued_) {
+                            ++stats_.rejected_;
+                            return DG_ERR_FULL;
+                        }
+                        ++stats_.waits_;
+                        queue_.push_back(Queued{tasks, start});
+                        stats_.peak_queued_ = std::max(stats_.peak_queued_, (int)queue_.size());
+                        return DG_OK;
+                    default: {
+                        ++stats_.waits_;
+                        auto ready = [this]() { return available() > 0; };
+                        if(timeout_ms_ < 0) {
+                            cv_.wait(lock, ready);
+                        } else if(!cv_.wait_for(lock, std::chrono::milliseconds(timeout_ms_), ready)) {
+                            ++stats_.rejected_;
+                            accountWait(start);
+                            return DG_ERR_TIME_OUT;
+                        }
+                        accountWait(start);
+                        break;
+                    }
+                }
+            }
+            ++in_flight_;
+            lock.unlock();
+
+            auto error = send(tasks);
+            if(error != DG_OK) {
+                drain();
+            }
+            return error;
+        }
+
+        /**
+         * Change credits, queued batches are sent at once if credits are added
+         */
+        void setCredits(int credits) {
+            CHECK(credits > 0) << "Invalid credits " << credits;
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                credits_ = credits;
+                cv_.notify_all();
+            }
+            drain();
+        }
+
+        Stats stats() {
+            std::lock_guard<std::mutex> lock(mtx_);
+            auto st = stats_;
+            st.in_flight_ = in_flight_;
+            st.queued_ = (int)queue_.size();
+            return st;
+        }
+
+    protected:
+        struct Queued {
+            Tasks tasks_;
+            std::chrono::steady_clock::time_point since_;
+        };
+
+        inline int available() { return credits_ - in_flight_; }
+
+        void accountWait(const std::chrono::steady_clock::time_point &since) {
+            auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+            stats_.wait_ms_ += ms;
+            if(ms > stats_.max_wait_ms_) stats_.max_wait_ms_ = ms;
+        }
+
+        /**
+         * Send batch holding a credit, credit is returned if it fails
+         */
+        DgError send(Tasks &tasks) {
+            auto error = router_.execute(*inner_, tasks, [this](Tasks &done, DgError err) {
+                release();
+                callback_(done, err);
+            });
+
+            std::lock_guard<std::mutex> lock(mtx_);
+            if(error == DG_OK) {
+                ++stats_.batches_;
+            } else {
+                --in_flight_;
+                cv_.notify_one();
+            }
+            return error;
+        }
+
+        /**
+         * Return a credit, and hand it to queued batches if there are
+         */
+        void release() {
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                --in_flight_;
+                cv_.notify_one();
+            }
+            drain();
+        }
+
+        /**
+         * Send queued batches while credits are available. One thread drains at a time so
+         * batches are sent in order, others return and leave theirs to it.
+         */
+        void drain() {
+            std::unique_lock<std::mutex> lock(mtx_);
+            if(draining_) return;
+            draining_ = true;
+            while(!closing_ && !queue_.empty() && available() > 0) {
+                auto next = std::move(queue_.front());
+                queue_.pop_front();
+                ++in_flight_;
+                accountWait(next.since_);
+                lock.unlock();
+
+                auto error = send(next.tasks_);
+                if(error != DG_OK) {
+                    LOG(ERROR) << "Send queued batch fail: " << error;
+                    fail(next.tasks_, error);
+                }
+                lock.lock();
+            }
+            draining_ = false;
+        }
+
+        void fail(Tasks &tasks, DgError error) {
+            for(auto &task : tasks) {
+                task->error_ = error;
+            }
+            callback_(tasks, error);
+        }
+
+    protected:
+        CallbackRouter<_Task> router_;      ///<! must be destroyed after inner_
+        std::shared_ptr<Base> inner_;
+        typename Base::AsyncCallback callback_;
+
+        std::mutex mtx_;
+        std::condition_variable cv_;
+        int credits_;
+        int in_flight_ = 0;
+        CreditPolicy policy_;
+        int timeout_ms_;
+        int max_queued_;
+        std::deque<Queued> queue_;
+        bool draining_ = false;             ///<! a thread is sending queued batches
+        bool closing_ = false;              ///<! queued batches are no longer sent
+        Stats stats_;
+    };
+}
+
+#endif //VEGA_FLOW_CONTROL_H
@@ -0,0 +1,373 @@
+#ifndef VEGA_FRAME_BUDGET_H
+#define VEGA_FRAME_BUDGET_H
+
+#include <algorithm>
+#include <list>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include "interface_base.h"
+#include "vega_frame_handle.h"
+#include "vega_option_store.h"
+#include "vega_router.h"
+
+namespace vega {
+
+    /**
+     * What to do when decoded frames exceed the budget
+     */
+    enum class BudgetPolicy {
+        EVICT_OLDEST = 0,   ///<! free oldest frames not in use, skip decoding if all frames are in use
+        SKIP_DECODE = 1,    ///<! decode new packets with Option::discard_frame_ until frames are freed,
+                            ///<! the option is cleared after callback
+    };
+
+    /**
+     * Memory budget of frames kept in matrix pool by a decoder.
+     *
+     * Every frame decoded through this interface is owned by a FrameHandle of the budget
+     * and counted by stream until its last handle is gone, so occupancy is visible before
+     * pool runs out with DG_ERR_FULL or DG_ERR_MEMORY_SHORTAGE. Consumers take handles of
+     * frames they go on using by handle(), e.g. bound to tasks by TaskRefs, and give
+     * frames up by release().
+     *
+     * Once frames or bytes exceed the budget, BudgetPolicy decides which frames to give up.
+     * Only frames no consumer holds a handle of are evicted, and never those of the batch
+     * being called back: eviction runs after callback returns, which may take handles.
+     *
+     * Bytes of a frame are counted as NV12 of stride_ (or size_) of decode task, or
+     * frameBytes given on construction if task has no size.
+     *
+     * \code{.cpp}
+     * auto releaser = std::make_shared<FrameReleaser>(freeCreator, removeCreator);
+     * auto decoder = std::make_shared<FrameBudgetExecutable>(
+     *     [&](DecodeInterface::AsyncCallback cb) {
+     *         return createDecodeInterface(0, "", Model::decode_video, nullptr, cb);
+     *     }, releaser, onDecode, 256 << 20);
+     * // in onDecode
+     * decoder->handle(sid, fid).bind(*fetchTask, fetcher->refs());    // in use until fetched
+     * decoder->release(sid, fid);                                     // instead of FreeFrameTask
+     * \endcode
+     *
+     * Counters are returned by stats(), or by sendCommand() with command "frame_budget".
+     */
+    class FrameBudgetExecutable : public Executable<DecodeTask> {
+    public:
+        using Base = Executable<DecodeTask>;
+        using Tasks = std::vector<std::shared_ptr<DecodeTask>>;
+
+        struct Stats {
+            int frames_ = 0;        ///<! frames in pool
+            size_t bytes_ = 0;      ///<! bytes in pool
+            int peak_frames_ = 0;   ///<! max of frames_
+            size_t peak_bytes_ = 0; ///<! max of bytes_
+            int in_use_ = 0;        ///<! frames consumers hold handles of
+            long evicted_ = 0;      ///<! frames freed by budget
+            long skipped_ = 0;      ///<! packets decoded with discard_frame_ by budget
+        };
+        struct StreamUsage {
+            int frames_ = 0;
+            size_t bytes_ = 0;
+        };
+
+    public:
+        /**
+         * @param creator creates the decode interface
+         * @param releaser frees evicted and released frames
+         * @param callback callback of decode tasks
+         * @param maxBytes budget in bytes, 0 for no limit
+         * @param maxFrames budget in frames, 0 for no limit
+         * @param policy see BudgetPolicy
+         * @param frameBytes bytes of a frame decoded without size
+         */
+        FrameBudgetExecutable(typename Base::Creator creator, std::shared_ptr<FrameReleaser> releaser,
+                              typename Base::AsyncCallback callback, size_t maxBytes, int maxFrames = 0,
+                              BudgetPolicy policy = BudgetPolicy::EVICT_OLDEST, size_t frameBytes = 1920 * 1088 * 3 / 2)
+                : releaser_(std::move(releaser)), callback_(callback), max_bytes_(maxBytes),
+                  max_frames_(maxFrames), policy_(policy), frame_bytes_(frameBytes) {
+            CHECK(releaser_) << "Releaser is required";
+            CHECK(callback_) << "Callback is required";
+            inner_ = creator(router_.callback());
+            CHECK(inner_) << "Create interface fail";
+        }
+        /**
+         * Frames not released yet are freed
+         */
+        ~FrameBudgetExecutable() override {
+            inner_.reset();
+            std::vector<FrameHandle> dropped;
+            std::lock_guard<std::mutex> lock(mtx_);
+            for(auto &it : frames_) {
+                dropped.push_back(std::move(it.second.own_));
+            }
+        }
+
+    public:
+        int getBatchSize() override {
+            return inner_->getBatchSize();
+        }
+        DgError sendCommand(const std::string &cmd, const std::string &param, std::map<std::string, std::string> &result) override {
+            if(cmd != "frame_budget") {
+                return inner_->sendCommand(cmd, param, result);
+            }
+            auto st = stats();
+            result["frames"] = std::to_string(st.frames_);
+            result["bytes"] = std::to_string(st.bytes_);
+            result["peak_frames"] = std::to_string(st.peak_frames_);
+            result["peak_bytes"] = std::to_string(st.peak_bytes_);
+            result["in_use"] = std::to_string(st.in_use_);
+            result["evicted"] = std::to_string(st.evicted_);
+            result["skipped"] = std::to_string(st.skipped_);
+            return DG_OK;
+        }
+
+        using Base::execute;
+        DgError execute(Tasks &tasks) override {
+            if(tasks.empty()) {
+                return DG_ERR_INVALID_PARAM;
+            }
+            std::vector<DecodeTask *> skipped;
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                if(skip_) {
+                    for(auto &task : tasks) {
+                        if(task->getBool(OptionKeys::video_eos_(), false) ||
+                           task->getBool(OptionKeys::discard_frame_(), false)) continue;
+                        task->put(OptionKeys::discard_frame_(), true);
+                        skipped.push_back(task.get());
+                    }
+                    stats_.skipped_ += (long)skipped.size();
+                }
+            }
+            auto callback = callback_;
+            auto error = router_.execute(*inner_, tasks, [this, callback, skipped](Tasks &done, DgError error) {
+                std::vector<Key> batch;
+                onDecoded(done, batch);
+                callback(done, error);
+                unskip(skipped);
+                enforce(batch);
+            });
+            if(error != DG_OK && !skipped.empty()) {
+                unskip(skipped);
+                std::lock_guard<std::mutex> lock(mtx_);
+                stats_.skipped_ -= (long)skipped.size();
+            }
+            return error;
+        }
+
+        /**
+         * Handle of a frame in pool, frame is in use and not evicted while a copy of it lives
+         * @return empty handle if frame is not owned by budget, e.g. released or evicted
+         */
+        FrameHandle handle(StreamId sid, FrameId fid) {
+            std::lock_guard<std::mutex> lock(mtx_);
+            auto it = frames_.find(Key(sid, fid));
+            return it == frames_.end() ? FrameHandle() : it->second.own_;
+        }
+
+        /**
+         * Give up a frame, it's freed when handles taken by handle() are gone too
+         * @return DG_ERR_NOT_EXIST if frame is not owned by budget, e.g. evicted
+         */
+        DgError release(StreamId sid, FrameId fid) {
+            FrameHandle dropped;
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                auto it = frames_.find(Key(sid, fid));
+                if(it == frames_.end() || !it->second.own_) return DG_ERR_NOT_EXIST;
+                dropped = std::move(it->second.own_);
+                if(dropped.useCount() == 1) erase(it);
+                update();
+            }
+            return DG_OK;
+        }
+
+        /**
+         * Give up frames of sid, and remove the stream by releaser when they are freed.
+         * Handles of the stream must be dropped before.
+         */
+        DgError removeStream(StreamId sid, int timeoutMs = -1) {
+            std::vector<FrameHandle> dropped;
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                int inUse = 0;
+                for(auto it = frames_.begin(); it != frames_.end();) {
+                    auto cur = it++;
+                    if(cur->first.first != sid) continue;
+                    if(cur->second.own_.useCount() > 1 || (!cur->second.own_ && !cur->second.alive_.expired())) ++inUse;
+                    dropped.push_back(std::move(cur->second.own_));
+                    erase(cur);
+                }
+                streams_.erase(sid);
+                update();
+                LOG_IF(WARNING, inUse > 0) << inUse << " frames of stream " << sid << " are in use on removing";
+            }
+            dropped.clear();
+            return releaser_->removeStream(sid, timeoutMs);
+        }
+
+        /**
+         * @return false if frame is not in pool, e.g. evicted
+         */
+        bool contains(StreamId sid, FrameId fid) {
+            std::lock_guard<std::mutex> lock(mtx_);
+            purge();
+            return frames_.find(Key(sid, fid)) != frames_.end();
+        }
+
+        Stats stats() {
+            std::lock_guard<std::mutex> lock(mtx_);
+            purge();
+            auto st = stats_;
+            for(auto &it : frames_) {
+                if(inUse(it.second)) ++st.in_use_;
+            }
+            return st;
+        }
+        StreamUsage usage(StreamId sid) {
+            std::lock_guard<std::mutex> lock(mtx_);
+            purge();
+            auto it = streams_.find(sid);
+            return it == streams_.end() ? StreamUsage() : it->second;
+        }
+
+    protected:
+        using Key = std::pair<StreamId, FrameId>;
+        struct Frame {
+            FrameHandle own_;                   ///<! empty once released or evicted
+            std::weak_ptr<const void> alive_;   ///<! expires when all handles are gone
+            size_t bytes_ = 0;
+            std::list<Key>::iterator pos_;
+        };
+        using Frames = std::map<Key, Frame>;
+
+        size_t bytesOf(const DecodeTask &task) const {
+            auto size = task.stride_.area() > 0 ? task.stride_ : task.size_;
+            return size.area() > 0 ? (size_t)size.area() * 3 / 2 : frame_bytes_;
+        }
+
+        static inline bool inUse(const Frame &frame) {
+            return frame.own_ ? frame.own_.useCount() > 1 : !frame.alive_.expired();
+        }
+
+        /**
+         * Own frames decoded by tasks before callback, keys of them are returned in batch.
+         * Frames of tasks decoded in a batch failed in part are owned too.
+         */
+        void onDecoded(Tasks &tasks, std::vector<Key> &batch) {
+            std::lock_guard<std::mutex> lock(mtx_);
+            for(auto &task : tasks) {
+                if(task->error_ != DG_OK && task->error_ != DG_ON_GOING) continue;
+                if(task->getBool(OptionKeys::discard_frame_(), false)) continue;
+                if(task->getBool(OptionKeys::video_eos_(), false) && task->data_ == nullptr) continue;
+
+                Key key(task->stream_id_, task->frame_id_);
+                if(frames_.find(key) != frames_.end()) {
+                    LOG(ERROR) << "Frame " << key.first << ":" << key.second << " decoded twice";
+                    continue;
+                }
+                auto &frame = frames_[key];
+                frame.own_ = releaser_->handle(key.first, key.second);
+                frame.alive_ = frame.own_.weak();
+                frame.bytes_ = bytesOf(*task);
+                frame.pos_ = order_.insert(order_.end(), key);
+                auto &usage = streams_[key.first];
+                ++usage.frames_;
+                usage.bytes_ += frame.bytes_;
+                ++stats_.frames_;
+                stats_.bytes_ += frame.bytes_;
+                batch.push_back(key);
+            }
+            stats_.peak_frames_ = std::max(stats_.peak_frames_, stats_.frames_);
+            stats_.peak_bytes_ = std::max(stats_.peak_bytes_, stats_.bytes_);
+        }
+
+        /**
+         * Clear discard_frame_ put by SKIP_DECODE, so tasks reused later are decoded
+         */
+        static void unskip(const std::vector<DecodeTask *> &skipped) {
+            for(auto task : skipped) {
+                task->erase(OptionKeys::discard_frame_().name());
+            }
+        }
+
+        inline bool over() const {
+            return (max_bytes_ > 0 && stats_.bytes_ > max_bytes_) ||
+                   (max_frames_ > 0 && stats_.frames_ > max_frames_);
+        }
+
+        /**
+         * Evict oldest frames not in use until frames are within budget, frames of batch
+         * just called back are kept. Frames are freed out of lock.
+         */
+        void enforce(const std::vector<Key> &batch) {
+            std::vector<FrameHandle> victims;
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                purge();
+                if(policy_ == BudgetPolicy::EVICT_OLDEST) {
+                    for(auto it = order_.begin(); it != order_.end() && over();) {
+                        auto cur = frames_.find(*it++);
+                        if(!cur->second.own_ || cur->second.own_.useCount() > 1) continue;
+                        if(std::find(batch.begin(), batch.end(), cur->first) != batch.end()) continue;
+                        victims.push_back(std::move(cur->second.own_));
+                        erase(cur);
+                    }
+                    stats_.evicted_ += (long)victims.size();
+                }
+                update();
+            }
+        }
+
+        /**
+         * Forget frames whose handles are all gone, they are freed by releaser, lock held
+         */
+        void purge() {
+            for(auto it = order_.begin(); it != order_.end();) {
+                auto cur = frames_.find(*it++);
+                if(!cur->second.own_ && cur->second.alive_.expired()) erase(cur);
+            }
+        }
+
+        /**
+         * Skip decoding while over budget, lock held
+         */
+        inline void update() {
+            skip_ = over();
+        }
+
+        /**
+         * Remove a frame from accounting, lock held
+         */
+        void erase(typename Frames::iterator it) {
+            auto &frame = it->second;
+            auto &usage = streams_[it->first.first];
+            --usage.frames_;
+            usage.bytes_ -= frame.bytes_;
+            if(usage.frames_ == 0) streams_.erase(it->first.first);
+            --stats_.frames_;
+            stats_.bytes_ -= frame.bytes_;
+            order_.erase(frame.pos_);
+            frames_.erase(it);
+        }
+
+    protected:
+        CallbackRouter<DecodeTask> router_;     ///<! must be destroyed after inner_
+        std::shared_ptr<Base> inner_;
+        std::shared_ptr<FrameReleaser> releaser_;
+        typename Base::AsyncCallback callback_;
+        size_t max_bytes_;
+        int max_frames_;
+        BudgetPolicy policy_;
+        size_t frame_bytes_;
+
+        std::mutex mtx_;
+        Frames frames_;
+        std::list<Key> order_;                  ///<! frames in decoding order
+        std::unordered_map<StreamId, StreamUsage> streams_;
+        bool skip_ = false;
+        Stats stats_;
+    };
+}
+
+#endif //VEGA_FRAME_BUDGET_H
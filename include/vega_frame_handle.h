@@ -0,0 +1,363 @@
+#ifndef VEGA_FRAME_HANDLE_H
+#define VEGA_FRAME_HANDLE_H
+
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "interface_base.h"
+#include "vega_router.h"
+#include "vega_task_refs.h"
+
+namespace vega {
+
+    class FrameReleaser;
+
+    /**
+     * Reference counted frame in matrix pool, identified by stream id + frame id.
+     *
+     * Copies of a handle share one reference. When the last copy is gone, frame is
+     * freed by the FrameReleaser creating it, no FreeFrameTask is needed.
+     *
+     * Tasks reading the frame can hold it in TaskRefs, so frame lives until every
+     * consumer is called back, whichever ends last:
+     * \code{.cpp}
+     * auto frame = releaser->handle(decodeTask->stream_id_, decodeTask->frame_id_);
+     * frame.bind(*detectTask, detector->refs());
+     * frame.bind(*fetchTask, fetcher->refs());
+     * \endcode
+     */
+    class FrameHandle {
+    public:
+        FrameHandle() = default;
+
+        inline StreamId streamId() const { return ref_ ? ref_->stream_id_ : INVALID_STREAM_ID; }
+        inline FrameId frameId() const { return ref_ ? ref_->frame_id_ : 0; }
+        inline explicit operator bool() const { return (bool)ref_; }
+        /**
+         * Handles and tasks holding this frame
+         */
+        inline long useCount() const { return ref_.use_count(); }
+        /**
+         * Drop this reference
+         */
+        inline void reset() { ref_.reset(); }
+        /**
+         * Weak reference of frame, expires when all handles are gone
+         */
+        inline std::weak_ptr<const void> weak() const { return ref_; }
+
+        /**
+         * Set stream_id_ and frame_id_ of task, caller keeps a handle until task is done
+         */
+        void bind(SdkTaskBase &task) const {
+            CHECK(ref_) << "Bind empty frame handle";
+            task.stream_id_ = ref_->stream_id_;
+            task.frame_id_ = ref_->frame_id_;
+        }
+        /**
+         * Set stream_id_ and frame_id_ of task, and hold the frame in refs until task is dropped
+         */
+        void bind(SdkTaskBase &task, TaskRefs &refs) const {
+            bind(task);
+            refs.hold(task, ref_);
+        }
+
+    protected:
+        friend class FrameReleaser;
+
+        struct Ref {
+            StreamId stream_id_;
+            FrameId frame_id_;
+        };
+
+        explicit FrameHandle(std::shared_ptr<const Ref> ref) : ref_(std::move(ref)) {}
+
+        std::shared_ptr<const Ref> ref_;
+    };
+
+    /**
+     * Frees frames of FrameHandle, or released by release(), by a FreeFrameInterface.
+     *
+     * Released frames are gathered from all threads and sent by a thread of the releaser,
+     * one batch in execution at a time. A batch is sent when maxBatch frames are pending,
+     * or when the oldest pending frame has waited maxDelayMs, whichever comes first. So
+     * under load each execute() frees a full batch, and an idle stream waits no longer
+     * than maxDelayMs. Interface callbacks never send, so a FreeFrameInterface calling
+     * back inside execute() does not recurse.
+     *
+     * Stream teardown must not overtake frees of the stream, removeStream() flushes frames
+     * of the stream released before it at once without waiting for thresholds, waits for
+     * them, then removes the stream.
+     *
+     * Releaser must be created by std::make_shared. Handles keep it alive, so frames of
+     * handles dropped after the last owner of releaser are still freed.
+     *
+     * \code{.cpp}
+     * auto releaser = std::make_shared<FrameReleaser>(
+     *     [&](FreeFrameInterface::AsyncCallback cb) {
+     *         return createFreeFrameInterface(0, "", Model::delete_frame, nullptr, cb);
+     *     },
+     *     [&](RemoveStreamInterface::AsyncCallback cb) {
+     *         return createRemoveStreamInterface(0, "", Model::delete_stream, nullptr, cb);
+     *     });
+     * auto frame = releaser->handle(*decodeTask);     // or releaser->release(sid, fid)
+     * releaser->removeStream(sid);                    // on stream end
+     * \endcode
+     */
+    class FrameReleaser : public std::enable_shared_from_this<FrameReleaser> {
+    public:
+        using Tasks = std::vector<std::shared_ptr<FreeFrameTask>>;
+
+        struct Stats {
+            long handles_ = 0;      ///<! handles created
+            long released_ = 0;     ///<! frames released, by handles or release()
+            long freed_ = 0;        ///<! frames freed by interface
+            long failed_ = 0;       ///<! frames failed to free
+            long batches_ = 0;      ///<! free batches sent
+            long flushes_ = 0;      ///<! flushes, including those of removeStream()
+            int pending_ = 0;       ///<! frames waiting for a batch
+            int outstanding_ = 0;   ///<! frames released but not freed yet
+        };
+
+    public:
+        /**
+         * @param freeCreator creates the FreeFrameInterface
+         * @param removeCreator creates the RemoveStreamInterface, can be nullptr if removeStream() is not used
+         * @param maxBatch frames sending a batch at once, 0 or larger than batch size of interface for batch size
+         * @param maxDelayMs max time in millisecond a released frame waits for a batch to be filled,
+         *        0 to send as soon as the previous batch ends
+         */
+        explicit FrameReleaser(FreeFrameInterface::Creator freeCreator,
+                               RemoveStreamInterface::Creator removeCreator = nullptr,
+                               int maxBatch = 0, int maxDelayMs = 2)
+                : max_delay_(std::max(0, maxDelayMs)) {
+            inner_ = freeCreator(router_.callback());
+            CHECK(inner_) << "Create interface fail";
+            auto batchSize = std::max(1, inner_->getBatchSize());
+            max_batch_ = maxBatch > 0 ? std::min(maxBatch, batchSize) : batchSize;
+            if(removeCreator) {
+                remover_ = removeCreator(remove_router_.callback());
+                CHECK(remover_) << "Create interface fail";
+            }
+            thread_ = std::make_shared<std::thread>(&FrameReleaser::work, this);
+        }
+        /**
+         * Sends released frames at once, and waits for them if interface waits on destruction
+         */
+        ~FrameReleaser() {
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                stop_ = true;
+                cv_.notify_all();
+            }
+            thread_->join();
+            inner_.reset();
+            remover_.reset();
+        }
+
+    public:
+        /**
+         * Take ownership of a decoded frame
+         */
+        FrameHandle handle(StreamId sid, FrameId fid) {
+            auto owner = shared_from_this();
+            auto *ref = new FrameHandle::Ref{sid, fid};
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                ++stats_.handles_;
+            }
+            return FrameHandle(std::shared_ptr<const FrameHandle::Ref>(ref, [owner](const FrameHandle::Ref *r) {
+                owner->release(r->stream_id_, r->frame_id_);
+                delete r;
+            }));
+        }
+        /**
+         * Take ownership of frame decoded by task
+         */
+        inline FrameHandle handle(const DecodeTask &task) {
+            return handle(task.stream_id_, task.frame_id_);
+        }
+
+        /**
+         * Free a frame not owned by a handle, it is sent with other frames in a batch
+         */
+        void release(StreamId sid, FrameId fid) {
+            auto task = std::make_shared<FreeFrameTask>();
+            task->stream_id_ = sid;
+            task->frame_id_ = fid;
+            std::lock_guard<std::mutex> lock(mtx_);
+            pending_.push_back(Pending{task, Clock::now()});
+            last_seq_[sid] = ++released_seq_;
+            // sender waits without timeout while nothing is pending, and until oldest frame is due
+            if(pending_.size() == 1 || (int)pending_.size() >= max_batch_) {
+                cv_.notify_all();
+            }
+        }
+
+        /**
+         * Wait until frames of sid released before this call are freed, frames released
+         * after it are not waited for.
+         * @param timeoutMs timeout in millisecond, negative to wait forever
+         * @return DG_ERR_TIME_OUT on timeout
+         */
+        DgError flush(StreamId sid, int timeoutMs = -1) {
+            std::unique_lock<std::mutex> lock(mtx_);
+            ++stats_.flushes_;
+            auto it = last_seq_.find(sid);
+            if(it == last_seq_.end()) {
+                return DG_OK;
+            }
+            auto target = it->second;
+            if(target > sent_seq_ && target > flush_seq_) {
+                // send at once, without waiting for batch to be filled
+                flush_seq_ = target;
+                cv_.notify_all();
+            }
+            auto ready = [&]() { return done_seq_ >= target; };
+            if(timeoutMs < 0) {
+                cv_.wait(lock, ready);
+            } else if(!cv_.wait_for(lock, std::chrono::milliseconds(timeoutMs), ready)) {
+                LOG(ERROR) << "Flush stream " << sid << " timeout, " << target - done_seq_ << " frames to free before it";
+                return DG_ERR_TIME_OUT;
+            }
+            it = last_seq_.find(sid);
+            if(it != last_seq_.end() && it->second == target) {
+                last_seq_.erase(it);
+            }
+            return DG_OK;
+        }
+
+        /**
+         * Flush frames of sid, then remove the stream and wait for it.
+         * Stream is not removed if flush fails.
+         */
+        DgError removeStream(StreamId sid, int timeoutMs = -1) {
+            CHECK(remover_) << "Remove stream interface is not created";
+            auto error = flush(sid, timeoutMs);
+            if(error != DG_OK) {
+                return error;
+            }
+
+            std::vector<std::shared_ptr<RemoveStreamTask>> tasks{std::make_shared<RemoveStreamTask>()};
+            tasks[0]->stream_id_ = sid;
+            auto promise = std::make_shared<std::promise<DgError>>();
+            auto result = promise->get_future();
+            error = remove_router_.execute(*remover_, tasks, [promise](std::vector<std::shared_ptr<RemoveStreamTask>> &, DgError err) {
+                promise->set_value(err);
+            });
+            if(error != DG_OK) {
+                LOG(ERROR) << "Remove stream " << sid << " fail: " << error;
+                return error;
+            }
+            return result.get();
+        }
+
+        Stats stats() {
+            std::lock_guard<std::mutex> lock(mtx_);
+            auto st = stats_;
+            st.released_ = released_seq_;
+            st.pending_ = (int)pending_.size();
+            st.outstanding_ = (int)(released_seq_ - done_seq_);
+            return st;
+        }
+
+    protected:
+        using Clock = std::chrono::steady_clock;
+
+        struct Pending {
+            std::shared_ptr<FreeFrameTask> task_;
+            Clock::time_point released_;
+        };
+
+        /**
+         * Sender thread, sends pending frames batch by batch, next batch is sent when previous
+         * ends and maxBatch frames are pending, oldest frame is due, a flush waits for them, or
+         * releaser is destroyed. Exits when nothing is pending or in execution after destroyed.
+         */
+        void work() {
+            std::unique_lock<std::mutex> lock(mtx_);
+            while(true) {
+                if(in_flight_ || pending_.empty()) {
+                    if(stop_ && !in_flight_) break;
+                    cv_.wait(lock);
+                    continue;
+                }
+                if(!stop_ && flush_seq_ <= sent_seq_ && (int)pending_.size() < max_batch_) {
+                    auto due = pending_.front().released_ + max_delay_;
+                    if(Clock::now() < due) {
+                        cv_.wait_until(lock, due);
+                        continue;
+                    }
+                }
+
+                auto n = std::min((size_t)max_batch_, pending_.size());
+                Tasks batch;
+                batch.reserve(n);
+                for(auto i = 0u; i < n; i++) {
+                    batch.push_back(std::move(pending_[i].task_));
+                }
+                pending_.erase(pending_.begin(), pending_.begin() + n);
+                sent_seq_ += (long)n;
+                in_flight_ = true;
+                ++stats_.batches_;
+                lock.unlock();
+
+                auto error = router_.execute(*inner_, batch, [this](Tasks &done, DgError err) {
+                    onFreed(done, err);
+                });
+                if(error != DG_OK) {
+                    for(auto &task : batch) {
+                        task->error_ = error;
+                    }
+                    onFreed(batch, error);
+                }
+                lock.lock();
+            }
+        }
+
+        /**
+         * Batches end in order they are sent, so done_seq_ covers frames released before
+         */
+        void onFreed(Tasks &tasks, DgError error) {
+            long failed = 0;
+            for(auto &task : tasks) {
+                if(error == DG_OK || task->error_ == DG_OK) continue;
+                ++failed;
+                LOG(ERROR) << "Free frame " << task->stream_id_ << ":" << task->frame_id_ << " fail: " << error;
+            }
+            std::lock_guard<std::mutex> lock(mtx_);
+            stats_.failed_ += failed;
+            stats_.freed_ += (long)tasks.size() - failed;
+            done_seq_ += (long)tasks.size();
+            in_flight_ = false;
+            cv_.notify_all();
+        }
+
+    protected:
+        CallbackRouter<FreeFrameTask> router_;  ///<! must be destroyed after inner_
+        std::shared_ptr<FreeFrameInterface> inner_;
+        CallbackRouter<RemoveStreamTask> remove_router_;    ///<! must be destroyed after remover_
+        std::shared_ptr<RemoveStreamInterface> remover_;
+        int max_batch_ = 1;
+        std::chrono::milliseconds max_delay_;
+
+        std::mutex mtx_;
+        std::condition_variable cv_;                        ///<! wakes sender and flushes
+        std::deque<Pending> pending_;
+        bool in_flight_ = false;
+        bool stop_ = false;
+        long released_seq_ = 0;                             ///<! frames released
+        long sent_seq_ = 0;                                 ///<! frames sent in batches, in release order
+        long flush_seq_ = 0;                                ///<! frames up to it are sent at once
+        long done_seq_ = 0;                                 ///<! frames freed or failed, in release order
+        std::unordered_map<StreamId, long> last_seq_;       ///<! released_seq_ of last frame of stream
+        Stats stats_;
+        std::shared_ptr<std::thread> thread_;
+    };
+}
+
+#endif //VEGA_FRAME_HANDLE_H
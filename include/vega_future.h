@@ -0,0 +1,193 @@
+#ifndef VEGA_FUTURE_H
+#define VEGA_FUTURE_H
+
+#include <future>
+#include "interface_base.h"
+#include "vega_router.h"
+#include "station/thread_pool.h"
+
+#if defined(__cpp_impl_coroutine) && __cplusplus >= 202002L
+#include <coroutine>
+#define VEGA_HAS_COROUTINE 1
+#endif
+
+namespace vega {
+
+    /**
+     * Runs a job, where completions and coroutines are resumed
+     */
+    using Executor = std::function<void(std::function<void()> job)>;
+
+    /**
+     * Run jobs on threads of pool
+     */
+    inline Executor poolExecutor(const std::shared_ptr<ThreadPool> &pool) {
+        return [pool](std::function<void()> job) {
+            auto doable = std::make_shared<CallbackDoable>();
+            doable->setCallback(std::move(job));
+            if(pool->put(doable) != DG_OK) {
+                LOG(ERROR) << "Thread pool rejects job, run in place";
+                doable->start();
+            }
+        };
+    }
+
+    /**
+     * Run jobs one by one on the thread of station
+     */
+    inline Executor stationExecutor(const std::shared_ptr<DoableStation> &station) {
+        return [station](std::function<void()> job) {
+            auto doable = std::make_shared<CallbackDoable>();
+            doable->setCallback(std::move(job));
+            station->put(doable);
+        };
+    }
+
+    /**
+     * Interface returning completion of each execute call, by a completion function,
+     * a std::future, or a C++20 awaitable.
+     *
+     * Completions run on the executor given on construction, or on interface callback
+     * thread if executor is nullptr. With a DoableStation executor, one thread drives any
+     * number of batches in flight, nothing waits per batch.
+     *
+     * \code{.cpp}
+     * auto detector = std::make_shared<FutureExecutable<DetectTask>>(
+     *     [&](DetectInterface::AsyncCallback cb) {
+     *         return createDetectInterface(0, cfgPath, "", nullptr, cb);
+     *     }, stationExecutor(station));
+     *
+     * // C++11
+     * auto error = detector->executeFuture(tasks).get();
+     *
+     * // C++20, inside a coroutine
+     * auto error = co_await detector->co_execute(tasks);
+     * \endcode
+     *
+     * co_execute() is only declared when coroutines are supported, C++11 builds use
+     * completions or futures.
+     *
+     * Plain execute(tasks) calls the callback given on construction.
+     */
+    template <typename _Task>
+    class FutureExecutable : public Executable<_Task> {
+    public:
+        using Base = Executable<_Task>;
+        using Tasks = std::vector<std::shared_ptr<_Task>>;
+        using Completion = typename CallbackRouter<_Task>::Completion;
+
+    public:
+        /**
+         * @param creator creates the wrapped interface
+         * @param executor runs completions, nullptr to run them in interface callback
+         * @param callback callback of plain execute(tasks), can be nullptr if not used
+         */
+        FutureExecutable(typename Base::Creator creator, Executor executor = nullptr,
+                         typename Base::AsyncCallback callback = nullptr)
+                : executor_(executor), callback_(callback) {
+            inner_ = creator(router_.callback());
+            CHECK(inner_) << "Create interface fail";
+        }
+        ~FutureExecutable() override {
+            inner_.reset();
+        }
+
+    public:
+        int getBatchSize() override {
+            return inner_->getBatchSize();
+        }
+        DgError sendCommand(const std::string &cmd, const std::string &param, std::map<std::string, std::string> &result) override {
+            return inner_->sendCommand(cmd, param, result);
+        }
+
+        using Base::execute;
+        DgError execute(Tasks &tasks) override {
+            CHECK(callback_) << "Callback is required by execute()";
+            return execute(tasks, callback_);
+        }
+
+        /**
+         * Execute tasks, done is called on executor when batch ends.
+         * done is not called if execute fails.
+         */
+        DgError execute(Tasks &tasks, Completion done) {
+            if(tasks.empty()) {
+                return DG_ERR_INVALID_PARAM;
+            }
+            if(!executor_) {
+                return router_.execute(*inner_, tasks, std::move(done));
+            }
+            auto executor = executor_;
+            return router_.execute(*inner_, tasks, [executor, done](Tasks &finished, DgError error) {
+                auto batch = finished;
+                executor([done, batch, error]() mutable {
+                    done(batch, error);
+                });
+            });
+        }
+
+        /**
+         * Execute tasks, future is ready with error of batch when batch ends,
+         * or at once if execute fails
+         */
+        std::future<DgError> executeFuture(Tasks &tasks) {
+            auto promise = std::make_shared<std::promise<DgError>>();
+            auto future = promise->get_future();
+            auto error = execute(tasks, [promise](Tasks &, DgError err) {
+                promise->set_value(err);
+            });
+            if(error != DG_OK) {
+                promise->set_value(error);
+            }
+            return future;
+        }
+
+#ifdef VEGA_HAS_COROUTINE
+        /**
+         * Awaitable of one batch, co_await returns error of batch
+         */
+        class ExecuteAwaiter {
+        public:
+            ExecuteAwaiter(FutureExecutable &iface, Tasks tasks) : iface_(iface), tasks_(std::move(tasks)) {}
+
+            bool await_ready() const noexcept { return false; }
+            bool await_suspend(std::coroutine_handle<> handle) {
+                // coroutine may be resumed on executor before execute returns, this awaiter
+                // must not be touched once execute succeeds, so execute works on a local vector
+                auto tasks = std::move(tasks_);
+                auto error = iface_.execute(tasks, [this, handle](Tasks &, DgError err) {
+                    error_ = err;
+                    handle.resume();
+                });
+                if(error != DG_OK) {
+                    error_ = error;
+                    return false;
+                }
+                return true;
+            }
+            DgError await_resume() const noexcept { return error_; }
+
+        protected:
+            FutureExecutable &iface_;
+            Tasks tasks_;
+            DgError error_ = DG_OK;
+        };
+
+        /**
+         * Execute tasks, coroutine resumes on executor with error of batch when batch ends,
+         * or at once if execute fails
+         */
+        ExecuteAwaiter co_execute(Tasks tasks) {
+            return ExecuteAwaiter(*this, std::move(tasks));
+        }
+#endif
+
+    protected:
+        CallbackRouter<_Task> router_;      ///<! must be destroyed after inner_
+        std::shared_ptr<Base> inner_;
+        Executor executor_;
+        typename Base::AsyncCallback callback_;
+    };
+}
+
+#endif //VEGA_FUTURE_H
@@ -0,0 +1,177 @@
+#ifndef VEGA_IMAGE_ALLOCATOR_H
+#define VEGA_IMAGE_ALLOCATOR_H
+
+#include <memory>
+#include <string>
+#include "dg_types.h"
+#include "vega_buffer_pool.h"
+#include "vega_interface.h"
+#include "vega_task_refs.h"
+
+namespace vega {
+
+    /**
+     * Padding a device requires of user images, see data_ of DetectTask, ClassifierTask...
+     */
+    struct StrideRule {
+        int width_align_ = 16;      ///<! bytes of a row are multiple of it
+        int height_align_ = 2;      ///<! rows are multiple of it
+
+        StrideRule() = default;
+        StrideRule(int widthAlign, int heightAlign) : width_align_(widthAlign), height_align_(heightAlign) {
+            CHECK(width_align_ > 0 && height_align_ > 0) << "Invalid align " << widthAlign << " " << heightAlign;
+        }
+
+        /**
+         * Rule of an arch string returned by SDKQuery() of SysAttribute::arch_
+         */
+        static StrideRule forArch(const std::string &arch) {
+            if(arch == "pascal" || arch == "turing") {
+                return StrideRule(1, 1);
+            }
+            // hiai and HISI chips, also the safe default
+            return StrideRule(16, 2);
+        }
+        /**
+         * Rule of device, queried by SDKQuery(), the hiai rule if query fails
+         */
+        static StrideRule query(int device) {
+            std::string arch;
+            auto error = SDKQuery(device, SysAttribute::arch_, arch);
+            if(error != DG_OK) {
+                LOG(WARNING) << "Query arch of device " << device << " fail: " << error << ", use hiai stride";
+            }
+            return forArch(arch);
+        }
+    };
+
+    /**
+     * A pooled image buffer padded as device requires
+     */
+    struct DeviceImage {
+        std::shared_ptr<uint8_t> data_;
+        SdkImage type_ = SdkImage::NV12;
+        cv::Size size_;             ///<! in pixel
+        cv::Size stride_;           ///<! padded size, width in bytes, like SdkTaskBase::stride_
+        size_t bytes_ = 0;
+
+        explicit operator bool() const {
+            return data_ != nullptr;
+        }
+
+        /**
+         * Planes of image to write into, e.g. by ColorConvert or a camera SDK.
+         * Chroma of NV21 is V first, see ColorOptions::dst_vu_.
+         */
+        DgImage image() const {
+            DgImage img;
+            img.create(data_.get(), size_, size_, dgImageType(type_), stride_);
+            return img;
+        }
+
+        /**
+         * Set image of task, caller keeps this image until task is done
+         */
+        void bind(SdkTaskBase &task) const {
+            task.type_ = type_;
+            task.data_ = data_.get();
+            task.data_len_ = (int)bytes_;
+            task.size_ = size_;
+            task.stride_ = stride_;
+        }
+        /**
+         * Set image of task, and hold buffer in refs until task is dropped
+         */
+        void bind(SdkTaskBase &task, TaskRefs &refs) const {
+            bind(task);
+            refs.hold(task, data_);
+        }
+
+        /**
+         * DgImageType of planes of type, DG_IMAGE_TYPE_INVALID if not supported, like ARGB
+         */
+        static DgImageType dgImageType(SdkImage type) {
+            switch(type) {
+                case SdkImage::NV12:
+                case SdkImage::NV21:
+                    return DgImageType::DG_IMAGE_YUV_SP420;
+                case SdkImage::YUV420P:
+                    return DgImageType::DG_IMAGE_YUV_I420;
+                case SdkImage::BGR:
+                    return DgImageType::DG_IMAGE_BGR_PACKAGE;
+                case SdkImage::GRAY:
+                    return DgImageType::DG_IMAGE_YUV_GRAY;
+                default:
+                    return DgImageType::DG_IMAGE_TYPE_INVALID;
+            }
+        }
+    };
+
+    /**
+     * Allocator of user images already padded by StrideRule of the target device.
+     *
+     * Producers write decoded pixels straight into DeviceImage::image() and bind it to
+     * tasks, instead of copying into a padded buffer before execute(). Buffers come from
+     * a BufferPool and return to it when image and all TaskRefs holding it drop it.
+     *
+     * \code{.cpp}
+     * ImageAllocator allocator(StrideRule::query(0));
+     * DeviceImage img;
+     * allocator.allocate(SdkImage::NV12, cv::Size(1920, 1080), img);
+     * auto planes = img.image();                  // camera SDK may decode into planes_
+     * ColorConvert::convert(bgr, planes);
+     * img.bind(*task, detector->refs());          // see TaskRefExecutable
+     * \endcode
+     */
+    class ImageAllocator {
+    public:
+        explicit ImageAllocator(const StrideRule &rule = StrideRule(), BufferPoolSP pool = nullptr)
+                : rule_(rule), pool_(pool ? std::move(pool) : std::make_shared<BufferPool>()) {
+        }
+
+    public:
+        /**
+         * Padded stride of an image, empty for types not supported by allocate()
+         */
+        cv::Size stride(SdkImage type, const cv::Size &size) const {
+            auto dgType = DeviceImage::dgImageType(type);
+            if(dgType == DgImageType::DG_IMAGE_TYPE_INVALID) {
+                return cv::Size();
+            }
+            return DgImage::alignedStride(dgType, size, rule_.width_align_, rule_.height_align_);
+        }
+
+        /**
+         * @return DG_ERR_NOT_SUPPORTED for compressed types and ARGB, which have no planes
+         *         of DgImage, DG_ERR_INVALID_PARAM for empty size
+         */
+        DgError allocate(SdkImage type, const cv::Size &size, DeviceImage &image) {
+            if(DeviceImage::dgImageType(type) == DgImageType::DG_IMAGE_TYPE_INVALID) {
+                return DG_ERR_NOT_SUPPORTED;
+            }
+            if(size.area() <= 0) {
+                return DG_ERR_INVALID_PARAM;
+            }
+            image.type_ = type;
+            image.size_ = size;
+            image.stride_ = stride(type, size);
+            auto area = (size_t)image.stride_.area();
+            image.bytes_ = (type == SdkImage::NV12 || type == SdkImage::NV21 || type == SdkImage::YUV420P) ? area * 3 / 2 : area;
+            image.data_ = pool_->get(image.bytes_);
+            return DG_OK;
+        }
+
+        inline const StrideRule &rule() const {
+            return rule_;
+        }
+        inline const BufferPoolSP &pool() const {
+            return pool_;
+        }
+
+    protected:
+        StrideRule rule_;
+        BufferPoolSP pool_;
+    };
+}
+
+#endif //VEGA_IMAGE_ALLOCATOR_H
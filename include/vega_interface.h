@@ -22,6 +22,9 @@
  *  of how to fill in the task although some rules are shared in common. You need to review
  *  the task definition comments for more details.
  *
+ *  Options common to every task of a batch can be put once into a BatchOptions and passed
+ *  by executeWithOptions(iface, tasks, options), see vega_batch_options.h.
+ *
  *  @see SdkTaskBase and SdkTask for detailed information.
  *
  *  All interfaces can be created by a group of functions provided by Vega SDK, which shares
@@ -0,0 +1,473 @@
+#ifndef VEGA_JPEG_HEADER_H
+#define VEGA_JPEG_HEADER_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include "interface_base.h"
+#include "vega_option_store.h"
+#include "vega_router.h"
+
+namespace vega {
+
+    /**
+     * Chroma subsampling of a JPEG, by sampling factors of Y over Cb and Cr
+     */
+    enum class JpegSampling {
+        OTHER = 0,      ///<! CMYK, 2 components, or factors not listed
+        GRAY = 1,
+        YUV444 = 2,
+        YUV422 = 3,     ///<! chroma halved horizontally
+        YUV420 = 4,
+        YUV440 = 5,     ///<! chroma halved vertically
+        YUV411 = 6,
+    };
+
+    /**
+     * What a JPEG is, read from its markers without decoding
+     */
+    struct JpegInfo {
+        cv::Size size_;             ///<! as coded, before EXIF orientation
+        int components_ = 0;
+        int precision_ = 0;         ///<! bits of a sample, 8 for baseline
+        JpegSampling sampling_ = JpegSampling::OTHER;
+        bool progressive_ = false;
+        bool arithmetic_ = false;   ///<! arithmetic coding instead of Huffman
+        bool lossless_ = false;     ///<! lossless or hierarchical process
+        int orientation_ = 1;       ///<! EXIF orientation 1-8, 1 if none
+
+        /**
+         * Size as displayed, width and height swapped by orientations 5-8
+         */
+        cv::Size orientedSize() const {
+            return orientation_ >= 5 ? cv::Size(size_.height, size_.width) : size_;
+        }
+        /**
+         * Size decoded at 1/scale by DCT scaling, each side rounded up as libjpeg does
+         */
+        cv::Size scaledSize(int scale) const {
+            return cv::Size((size_.width + scale - 1) / scale, (size_.height + scale - 1) / scale);
+        }
+        /**
+         * Sequential Huffman of 8 bits in YUV or gray, what JPEG engines decode
+         */
+        bool baseline() const {
+            return precision_ == 8 && !progressive_ && !arithmetic_ && !lossless_ && sampling_ != JpegSampling::OTHER;
+        }
+    };
+
+    /**
+     * Scanner of JPEG markers up to the frame header (SOF), and EXIF orientation of APP1
+     * before it. Segments are skipped by their length, so a header is read in
+     * microseconds whatever the size of image.
+     */
+    class JpegHeader {
+    public:
+        /**
+         * @return DG_ERR_INVALID_IMAGE if data is not JPEG, or ends before frame header
+         */
+        static DgError parse(const uint8_t *data, size_t len, JpegInfo &info) {
+            info = JpegInfo();
+            if(data == nullptr || len < 4 || data[0] != 0xFF || data[1] != 0xD8) {
+                return DG_ERR_INVALID_IMAGE;
+            }
+            size_t pos = 2;
+            while(pos + 4 <= len) {
+                if(data[pos] != 0xFF) {
+                    // garbage between segments, some writers pad them
+                    pos++;
+                    continue;
+                }
+                auto marker = data[pos + 1];
+                if(marker == 0xFF) {
+                    pos++;      // fill byte
+                    continue;
+                }
+                pos += 2;
+                if(marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+                    continue;   // no length
+                }
+                if(marker == 0xD9 || marker == 0xDA) {
+                    break;      // EOI or SOS before frame header
+                }
+                auto seg = (size_t)(data[pos] << 8 | data[pos + 1]);
+                if(seg < 2 || pos + seg > len) {
+                    break;
+                }
+                auto *p = data + pos + 2;
+                auto n = seg - 2;
+                if(isSof(marker)) {
+                    return parseSof(marker, p, n, info);
+                }
+                if(marker == 0xE1) {
+                    parseExif(p, n, info);
+                }
+                pos += seg;
+            }
+            return DG_ERR_INVALID_IMAGE;
+        }
+
+    protected:
+        /**
+         * SOF0-SOF15, except DHT, JPG and DAC
+         */
+        static inline bool isSof(uint8_t marker) {
+            return marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+        }
+
+        static DgError parseSof(uint8_t marker, const uint8_t *p, size_t n, JpegInfo &info) {
+            if(n < 6) return DG_ERR_INVALID_IMAGE;
+            info.precision_ = p[0];
+            info.size_ = cv::Size(p[3] << 8 | p[4], p[1] << 8 | p[2]);
+            info.components_ = p[5];
+            auto type = marker & 0x0F;
+            info.progressive_ = type == 2 || type == 6 || type == 10 || type == 14;
+            // lossless 3, 7, 11, 15 and hierarchical 5, 6, 7, 13, 14, 15
+            info.lossless_ = type % 4 == 3 || type == 5 || type == 6 || type == 13 || type == 14;
+            info.arithmetic_ = type >= 9;
+            // height 0 is defined later by DNL, not supported
+            if(info.size_.area() <= 0 || info.components_ == 0 || n < 6 + 3 * (size_t)info.components_) {
+                return DG_ERR_INVALID_IMAGE;
+            }
+            info.sampling_ = sampling(p + 6, info.components_);
+            return DG_OK;
+        }
+
+        /**
+         * @param comp components of SOF, 3 bytes each: id, H << 4 | V, table
+         */
+        static JpegSampling sampling(const uint8_t *comp, int components) {
+            if(components == 1) return JpegSampling::GRAY;
+            if(components != 3 || comp[4] != comp[7]) return JpegSampling::OTHER;
+            auto yh = comp[1] >> 4, yv = comp[1] & 0x0F;
+            auto ch = comp[4] >> 4, cw = comp[4] & 0x0F;
+            if(ch == 0 || cw == 0 || yh % ch != 0 || yv % cw != 0) return JpegSampling::OTHER;
+            auto h = yh / ch, v = yv / cw;
+            if(h == 1 && v == 1) return JpegSampling::YUV444;
+            if(h == 2 && v == 1) return JpegSampling::YUV422;
+            if(h == 2 && v == 2) return JpegSampling::YUV420;
+            if(h == 1 && v == 2) return JpegSampling::YUV440;
+            if(h == 4 && v == 1) return JpegSampling::YUV411;
+            return JpegSampling::OTHER;
+        }
+
+        /**
+         * Orientation tag of IFD0 of an APP1 Exif segment, left unchanged if not found
+         */
+        static void parseExif(const uint8_t *p, size_t n, JpegInfo &info) {
+            static const uint8_t exif[] = {'E', 'x', 'i', 'f', 0, 0};
+            if(n < 14 || memcmp(p, exif, sizeof(exif)) != 0) return;
+            auto *tiff = p + 6;
+            auto len = n - 6;
+            bool le;
+            if(tiff[0] == 'I' && tiff[1] == 'I') le = true;
+            else if(tiff[0] == 'M' && tiff[1] == 'M') le = false;
+            else return;
+            auto u16 = [&](size_t off) {
+                return le ? (uint32_t)(tiff[off] | tiff[off + 1] << 8) : (uint32_t)(tiff[off] << 8 | tiff[off + 1]);
+            };
+            auto u32 = [&](size_t off) {
+                return le ? u16(off) | u16(off + 2) << 16 : u16(off) << 16 | u16(off + 2);
+            };
+            if(u16(2) != 42) return;
+            auto ifd = (size_t)u32(4);
+            if(ifd + 2 > len) return;
+            auto entries = (size_t)u16(ifd);
+            for(size_t i = 0; i < entries && ifd + 2 + 12 * (i + 1) <= len; i++) {
+                auto e = ifd + 2 + 12 * i;
+                // SHORT orientation, value in the first 2 bytes of value field
+                if(u16(e) == 0x0112 && u16(e + 2) == 3) {
+                    auto orientation = (int)u16(e + 8);
+                    if(orientation >= 1 && orientation <= 8) info.orientation_ = orientation;
+                    return;
+                }
+            }
+        }
+    };
+
+    /**
+     * Where a JPEG goes before decoding
+     */
+    enum class JpegRoute {
+        DEVICE = 0,     ///<! decoder of device
+        CPU = 1,        ///<! CPU decoder, for what JPEG engines don't decode
+        REJECT = 2,     ///<! not decoded, called back with error
+    };
+
+    /**
+     * What the JPEG engine of device takes, and the size decoding needs
+     */
+    struct JpegLimits {
+        cv::Size max_size_ = cv::Size(8192, 8192);  ///<! larger decoded images are rejected
+        bool cpu_non_baseline_ = true;              ///<! progressive, arithmetic, 12 bits or CMYK go to CPU
+        /**
+         * Size the model takes, JPEG is decoded at the smallest of 1/2, 1/4, 1/8 which still
+         * covers it, empty to decode at full size. Larger images are also scaled to fit max_size_.
+         * Scaling to it needs device_scale_ or cpu_scale_.
+         */
+        cv::Size target_size_;
+        bool device_scale_ = false;                 ///<! device decoder supports OptionKeys::jpeg_scale_
+        /**
+         * Offload images scaled to target_size_ to CPU while device can't scale. Off by default,
+         * they are decoded at full size by device, only images over max_size_ or non-baseline
+         * go to CPU.
+         */
+        bool cpu_scale_ = false;
+
+        /**
+         * Limits with max size of env VEGA_MAX_TEST_IMAGE_WIDTH/VEGA_MAX_TEST_IMAGE_HEIGHT if set
+         */
+        static JpegLimits fromEnv() {
+            JpegLimits limits;
+            auto *w = getenv("VEGA_MAX_TEST_IMAGE_WIDTH");
+            auto *h = getenv("VEGA_MAX_TEST_IMAGE_HEIGHT");
+            if(w && atoi(w) > 0) limits.max_size_.width = atoi(w);
+            if(h && atoi(h) > 0) limits.max_size_.height = atoi(h);
+            return limits;
+        }
+
+        /**
+         * @param scale set to DCT scale of decoding, 1, 2, 4 or 8
+         * @param cpu a CPU decoder is available
+         */
+        JpegRoute route(const JpegInfo &info, int &scale, bool cpu = true) const {
+            auto scalable = cpu || device_scale_;
+            scale = 1;
+            if((device_scale_ || (cpu && cpu_scale_)) && target_size_.area() > 0) {
+                while(scale < 8) {
+                    auto half = info.scaledSize(scale * 2);
+                    if(half.width < target_size_.width || half.height < target_size_.height) break;
+                    scale *= 2;
+                }
+            }
+            while(scalable && scale < 8 && !fits(info.scaledSize(scale))) scale *= 2;
+            if(!fits(info.scaledSize(scale))) {
+                return JpegRoute::REJECT;
+            }
+            if(cpu && ((cpu_non_baseline_ && !info.baseline()) || (scale > 1 && !device_scale_))) {
+                return JpegRoute::CPU;
+            }
+            return JpegRoute::DEVICE;
+        }
+
+    protected:
+        inline bool fits(const cv::Size &size) const {
+            return size.width <= max_size_.width && size.height <= max_size_.height;
+        }
+    };
+
+    /**
+     * Admission control of JPEG decoding by headers.
+     *
+     * Headers of JPEG tasks are read by JpegHeader before anything is sent. Images which
+     * are not JPEG, or too large for JpegLimits even scaled, are not sent, they are called
+     * back in execute() as a batch of error DG_ERR_INVALID_IMAGE or DG_ERR_IMAGE_EXCEEDS_CAPABILITY,
+     * after the tasks sent.
+     * Non-baseline images, e.g. progressive, go to the CPU interface if it's given.
+     *
+     * Images larger than max size are decoded at 1/2, 1/4 or 1/8 by DCT scaling, as
+     * OptionKeys::jpeg_scale_ set on them, by the CPU interface unless JpegLimits::device_scale_
+     * is set. Only CpuBackend handles jpeg_scale_ yet, so images larger than
+     * JpegLimits::target_size_ are scaled only with device_scale_, or cpu_scale_ which offloads
+     * them to CPU. Otherwise they stay on device at full size.
+     *
+     * Tasks sent to an interface are grouped by decoded size and subsampling, each group is
+     * a batch of its own, so the JPEG engine gets batches of same sized images. Tasks of
+     * other types are sent as they are. Route of each JPEG is set in OptionKeys::jpeg_route_.
+     *
+     * \code{.cpp}
+     * auto backend = std::make_shared<CpuBackend>(2);
+     * auto limits = JpegLimits::fromEnv();
+     * limits.target_size_ = cv::Size(1280, 720);     // detector input
+     * limits.cpu_scale_ = true;                       // larger images decoded scaled on CPU
+     * auto decoder = std::make_shared<JpegAdmissionExecutable>(
+     *     [&](DecodeInterface::AsyncCallback cb) {
+     *         return createDecodeInterface(0, "", Model::decode_frame, nullptr, cb);
+     *     }, onDecode, limits,
+     *     [&](DecodeInterface::AsyncCallback cb) { return backend->createDecodeInterface(cb); });
+     * \endcode
+     *
+     * All groups are sent even if one fails to execute, tasks of a failed group are called
+     * back in execute() with its error. Only when nothing is sent or rejected, execute()
+     * returns the error and no task is called back.
+     *
+     * Counters are returned by stats(), or by sendCommand() with command "jpeg_admission".
+     */
+    class JpegAdmissionExecutable : public Executable<DecodeTask> {
+    public:
+        using Base = Executable<DecodeTask>;
+        using Tasks = std::vector<std::shared_ptr<DecodeTask>>;
+
+        struct Stats {
+            long images_ = 0;       ///<! JPEG tasks
+            long invalid_ = 0;      ///<! rejected as not JPEG
+            long rejected_ = 0;     ///<! rejected by JpegLimits
+            long cpu_ = 0;          ///<! sent to CPU interface
+            long scaled_ = 0;       ///<! decoded with jpeg_scale_ over 1
+            long batches_ = 0;      ///<! batches sent to interfaces
+        };
+
+    public:
+        /**
+         * @param creator creates the decode interface of device
+         * @param callback callback of decode tasks
+         * @param limits what device decodes
+         * @param cpuCreator creates the CPU decode interface, nullptr to send all to device
+         */
+        JpegAdmissionExecutable(typename Base::Creator creator, typename Base::AsyncCallback callback,
+                                const JpegLimits &limits = JpegLimits(), typename Base::Creator cpuCreator = nullptr)
+                : callback_(callback), limits_(limits) {
+            CHECK(callback_) << "Callback is required";
+            inner_ = creator(router_.callback());
+            CHECK(inner_) << "Create interface fail";
+            if(cpuCreator) {
+                cpu_ = cpuCreator(cpu_router_.callback());
+                CHECK(cpu_) << "Create CPU interface fail";
+            }
+        }
+        ~JpegAdmissionExecutable() override {
+            inner_.reset();
+            cpu_.reset();
+        }
+
+    public:
+        int getBatchSize() override {
+            return inner_->getBatchSize();
+        }
+        DgError sendCommand(const std::string &cmd, const std::string &param, std::map<std::string, std::string> &result) override {
+            if(cmd != "jpeg_admission") {
+                return inner_->sendCommand(cmd, param, result);
+            }
+            auto st = stats();
+            result["images"] = std::to_string(st.images_);
+            result["invalid"] = std::to_string(st.invalid_);
+            result["rejected"] = std::to_string(st.rejected_);
+            result["cpu"] = std::to_string(st.cpu_);
+            result["scaled"] = std::to_string(st.scaled_);
+            result["batches"] = std::to_string(st.batches_);
+            return DG_OK;
+        }
+
+        using Base::execute;
+        DgError execute(Tasks &tasks) override {
+            if(tasks.empty()) {
+                return DG_ERR_INVALID_PARAM;
+            }
+            // groups by route, size and subsampling, in order of first task
+            using Key = std::tuple<int, int, int, int>;
+            std::map<Key, size_t> index;
+            std::vector<Tasks> groups;
+            std::vector<bool> onCpu;
+            Tasks rejected;
+            Stats st;
+            for(auto &task : tasks) {
+                Key key(-1, 0, 0, 0);
+                if(task->type_ == SdkImage::JPEG) {
+                    ++st.images_;
+                    JpegInfo info;
+                    auto route = JpegRoute::REJECT;
+                    auto scale = 1;
+                    if(JpegHeader::parse(task->data_, task->data_len_ > 0 ? (size_t)task->data_len_ : 0, info) != DG_OK) {
+                        task->error_ = DG_ERR_INVALID_IMAGE;
+                        ++st.invalid_;
+                    } else {
+                        route = limits_.route(info, scale, cpu_ != nullptr);
+                        if(route == JpegRoute::REJECT) {
+                            task->error_ = DG_ERR_IMAGE_EXCEEDS_CAPABILITY;
+                            ++st.rejected_;
+                        }
+                    }
+                    task->put(OptionKeys::jpeg_route_(), (int)route);
+                    if(route == JpegRoute::REJECT) {
+                        rejected.push_back(task);
+                        continue;
+                    }
+                    task->put(OptionKeys::jpeg_scale_(), scale);
+                    if(route == JpegRoute::CPU) ++st.cpu_;
+                    if(scale > 1) ++st.scaled_;
+                    auto size = info.scaledSize(scale);
+                    key = Key((int)route, size.width, size.height, (int)info.sampling_);
+                }
+                auto it = index.find(key);
+                if(it == index.end()) {
+                    it = index.emplace(key, groups.size()).first;
+                    groups.push_back(Tasks());
+                    onCpu.push_back(std::get<0>(key) == (int)JpegRoute::CPU);
+                }
+                groups[it->second].push_back(task);
+            }
+            st.batches_ = (long)groups.size();
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                stats_.images_ += st.images_;
+                stats_.invalid_ += st.invalid_;
+                stats_.rejected_ += st.rejected_;
+                stats_.cpu_ += st.cpu_;
+                stats_.scaled_ += st.scaled_;
+                stats_.batches_ += st.batches_;
+            }
+
+            // every group is sent even if one fails, so each task is called back once
+            auto callback = callback_;
+            std::vector<DgError> errors(groups.size(), DG_OK);
+            size_t failed = 0;
+            for(size_t i = 0; i < groups.size(); i++) {
+                errors[i] = onCpu[i] ? cpu_router_.execute(*cpu_, groups[i], callback)
+                                     : router_.execute(*inner_, groups[i], callback);
+                if(errors[i] != DG_OK) ++failed;
+            }
+            if(failed > 0 && failed == groups.size() && rejected.empty()) {
+                return errors[0];
+            }
+            for(size_t i = 0; i < groups.size(); i++) {
+                if(errors[i] != DG_OK) fail(groups[i], errors[i]);
+            }
+            reject(rejected, DG_ERR_INVALID_IMAGE);
+            reject(rejected, DG_ERR_IMAGE_EXCEEDS_CAPABILITY);
+            return DG_OK;
+        }
+
+        Stats stats() {
+            std::lock_guard<std::mutex> lock(mtx_);
+            return stats_;
+        }
+
+    protected:
+        void fail(Tasks &tasks, DgError error) {
+            LOG(ERROR) << "Send " << tasks.size() << " JPEG tasks fail: " << error;
+            for(auto &task : tasks) {
+                task->error_ = error;
+            }
+            callback_(tasks, error);
+        }
+
+        /**
+         * Call back rejected tasks of an error as a batch of it
+         */
+        void reject(const Tasks &rejected, DgError error) {
+            Tasks tasks;
+            for(auto &task : rejected) {
+                if(task->error_ == error) tasks.push_back(task);
+            }
+            if(!tasks.empty()) {
+                callback_(tasks, error);
+            }
+        }
+
+    protected:
+        CallbackRouter<DecodeTask> router_;     ///<! must be destroyed after inner_
+        CallbackRouter<DecodeTask> cpu_router_; ///<! must be destroyed after cpu_
+        std::shared_ptr<Base> inner_;
+        std::shared_ptr<Base> cpu_;
+        typename Base::AsyncCallback callback_;
+        JpegLimits limits_;
+
+        std::mutex mtx_;
+        Stats stats_;
+    };
+}
+
+#endif //VEGA_JPEG_HEADER_H
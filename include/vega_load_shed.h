@@ -0,0 +1,498 @@
+#ifndef VEGA_LOAD_SHED_H
+#define VEGA_LOAD_SHED_H
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include "interface_base.h"
+#include "vega_annexb.h"
+#include "vega_option_store.h"
+#include "vega_router.h"
+
+namespace vega {
+
+    /**
+     * Bits of a NAL payload, emulation prevention bytes 00 00 03 are skipped.
+     * Reading past end gives 0 bits and ok() false.
+     */
+    class RbspReader {
+    public:
+        RbspReader(const uint8_t *p, const uint8_t *end) : p_(p), end_(end) {}
+
+        inline bool ok() const { return ok_; }
+
+        uint32_t bit() {
+            if(left_ == 0) {
+                if(zeros_ >= 2 && p_ < end_ && *p_ == 3) {
+                    ++p_;
+                    zeros_ = 0;
+                }
+                if(p_ >= end_) {
+                    ok_ = false;
+                    return 0;
+                }
+                cur_ = *p_++;
+                zeros_ = cur_ == 0 ? zeros_ + 1 : 0;
+                left_ = 8;
+            }
+            return (cur_ >> --left_) & 1;
+        }
+        uint32_t bits(int n) {
+            uint32_t v = 0;
+            while(n-- > 0) v = (v << 1) | bit();
+            return v;
+        }
+        /**
+         * Exp-Golomb ue(v)
+         */
+        uint32_t ue() {
+            auto zeros = 0;
+            while(ok_ && bit() == 0) {
+                if(++zeros > 31) ok_ = false;
+            }
+            return ok_ && zeros > 0 ? (1u << zeros) - 1 + bits(zeros) : 0;
+        }
+
+    protected:
+        const uint8_t *p_;
+        const uint8_t *end_;
+        uint8_t cur_ = 0;
+        int left_ = 0;      ///<! bits left in cur_
+        int zeros_ = 0;     ///<! zero bytes before p_
+        bool ok_ = true;
+    };
+
+    /**
+     * What a packet of H.264/H.265 is to its stream, read from NAL headers, slice_type of
+     * slice headers, and payload type of SEI
+     */
+    struct PacketInfo {
+        bool slice_ = false;        ///<! has a slice, false for parameter sets only or non Annex-B data
+        bool key_ = false;          ///<! IDR, or IRAP of H.265
+        bool intra_ = false;        ///<! all slices read are I or SI, key pictures of open GOP too
+        bool recovery_ = false;     ///<! has recovery point SEI
+        bool reference_ = false;    ///<! referred by other pictures, nal_ref_idc != 0 or not a sub-layer non-reference picture
+        int temporal_id_ = 0;       ///<! TemporalId of H.265, 0 for H.264
+        int nal_type_ = -1;         ///<! NAL type of first slice
+        int extra_slice_header_bits_ = -1;  ///<! num_extra_slice_header_bits of last H.265 PPS, -1 if no PPS
+
+        /**
+         * @param extraBits num_extra_slice_header_bits of H.265 PPS in effect, PPS in packet overrides it
+         */
+        static PacketInfo inspect(const uint8_t *data, size_t len, SdkImage codec, int extraBits = 0) {
+            PacketInfo info;
+            auto h265 = codec == SdkImage::H265;
+            auto *end = data + len;
+            auto intra = true, parsed = false;
+            for(auto *p = AnnexBParser::findStartCode(data, end); p + 3 < end;) {
+                auto *hdr = p + 3;
+                auto *next = AnnexBParser::findStartCode(hdr, end);
+                p = next;
+                if(h265) {
+                    auto type = (hdr[0] >> 1) & 0x3F;
+                    if(hdr + 1 >= end) continue;
+                    if(type == 34) {
+                        RbspReader r(hdr + 2, next);
+                        r.ue();     // pps_pic_parameter_set_id
+                        r.ue();     // pps_seq_parameter_set_id
+                        r.bits(2);  // dependent_slice_segments_enabled_flag, output_flag_present_flag
+                        auto bits = (int)r.bits(3);
+                        if(r.ok()) extraBits = info.extra_slice_header_bits_ = bits;
+                        continue;
+                    }
+                    if(type == 39) {
+                        info.recovery_ |= seiPayloadType(hdr + 2, next) == 6;
+                        continue;
+                    }
+                    if(type >= 32) continue;
+                    info.slice_ = true;
+                    info.key_ |= type >= 16 && type <= 23;
+                    // TRAIL_N, TSA_N, STSA_N, RADL_N, RASL_N and reserved even types below 16
+                    info.reference_ |= type >= 16 || type % 2 == 1;
+                    info.temporal_id_ = std::max(info.temporal_id_, (hdr[1] & 0x7) - 1);
+                    if(info.nal_type_ < 0) info.nal_type_ = type;
+                    RbspReader r(hdr + 2, next);
+                    // slice_type of other segments is behind fields sized by SPS, they're of the same picture
+                    if(!r.bit()) continue;
+                    if(type >= 16 && type <= 23) r.bit();   // no_output_of_prior_pics_flag
+                    r.ue();                                 // slice_pic_parameter_set_id
+                    r.bits(extraBits);                      // slice_reserved_flag
+                    auto sliceType = r.ue();
+                    if(!r.ok()) continue;
+                    parsed = true;
+                    intra &= sliceType == 2;
+                } else {
+                    auto type = hdr[0] & 0x1F;
+                    if(type == 6) {
+                        info.recovery_ |= seiPayloadType(hdr + 1, next) == 6;
+                        continue;
+                    }
+                    if(type < 1 || type > 5) continue;
+                    info.slice_ = true;
+                    info.key_ |= type == 5;
+                    info.reference_ |= (hdr[0] & 0x60) != 0;
+                    if(info.nal_type_ < 0) info.nal_type_ = type;
+                    RbspReader r(hdr + 1, next);
+                    r.ue();     // first_mb_in_slice
+                    auto sliceType = r.ue();
+                    if(!r.ok()) continue;
+                    parsed = true;
+                    intra &= sliceType % 5 == 2 || sliceType % 5 == 4;
+                }
+            }
+            info.intra_ = parsed && intra;
+            return info;
+        }
+
+        /**
+         * payloadType of first SEI message, -1 if truncated
+         */
+        static int seiPayloadType(const uint8_t *p, const uint8_t *end) {
+            RbspReader r(p, end);
+            auto type = 0;
+            uint32_t byte;
+            while((byte = r.bits(8)) == 0xFF && r.ok()) type += 255;
+            return r.ok() ? type + (int)byte : -1;
+        }
+    };
+
+    /**
+     * How much decoding is given up
+     */
+    enum class ShedLevel {
+        NONE = 0,       ///<! decode all packets
+        NON_REF = 1,    ///<! drop packets no other picture refers to, and temporal layers above 0
+        KEY_ONLY = 2,   ///<! decode key packets only, like video_dec_mode_e_ I
+    };
+
+    struct ShedWatermarks {
+        double non_ref_ = 0.7;      ///<! load to enter NON_REF
+        double key_only_ = 0.9;     ///<! load to enter KEY_ONLY
+        double hysteresis_ = 0.1;   ///<! level is left when load is below its watermark by it
+        int recover_ms_ = 1000;     ///<! load must stay low this long before level goes down
+    };
+
+    /**
+     * Adaptive load shedding of a decoder, by dropping packets before they are decoded.
+     *
+     * Load is the max of probes, each returns a ratio of a resource in use, like bytes of
+     * FrameBudgetExecutable over its budget or queued batches of a downstream interface,
+     * and of packets in decoding over maxInFlight. Load over a watermark raises ShedLevel
+     * at once, level goes down one step after load stays below watermark for recover_ms_.
+     *
+     * Packets are inspected by NAL and slice headers, so only packets no decoded picture
+     * depends on are dropped. Key packets are IDR, IRAP of H.265 and pictures of I slices,
+     * KEY_ONLY decodes them only. After KEY_ONLY, a stream keeps dropping until a key packet
+     * or recovery point SEI, and RASL pictures of H.265 are dropped until trailing pictures
+     * unless it resumed at IDR. Temporal layers of H.265 given up are resumed at TSA, STSA
+     * or IRAP only. num_extra_slice_header_bits is taken from PPS of inspected packets,
+     * 0 before any. Packets of other types and packets with video_eos_ are never dropped.
+     *
+     * Dropped tasks are not sent to decoder, they are called back with DG_OK along with the
+     * tasks decoded of the same batch, and with discard_frame_ and load_shed_ set. A batch
+     * of dropped tasks only is called back in execute().
+     *
+     * \code{.cpp}
+     * auto decoder = std::make_shared<LoadSheddingExecutable>(
+     *     [&](DecodeInterface::AsyncCallback cb) {
+     *         return createDecodeInterface(0, "", Model::decode_video, nullptr, cb);
+     *     }, onDecode, 64);
+     * decoder->addProbe([budget, maxBytes]() { return (double)budget->stats().bytes_ / maxBytes; });
+     * decoder->addProbe([encoder]() { return encoder->stats().queued_ / 8.0; });
+     * \endcode
+     *
+     * Level and per stream drop rates are returned by stats(), streamStats(), or by
+     * sendCommand() with command "load_shed".
+     */
+    class LoadSheddingExecutable : public Executable<DecodeTask> {
+    public:
+        using Base = Executable<DecodeTask>;
+        using Tasks = std::vector<std::shared_ptr<DecodeTask>>;
+        using LoadProbe = std::function<double()>;
+
+        struct Stats {
+            ShedLevel level_ = ShedLevel::NONE;
+            double load_ = 0;           ///<! load at last execute()
+            long changes_ = 0;          ///<! times level changed
+            long packets_ = 0;
+            long dropped_ = 0;
+        };
+        struct StreamStats {
+            long packets_ = 0;
+            long dropped_non_ref_ = 0;  ///<! dropped in NON_REF
+            long dropped_non_key_ = 0;  ///<! dropped in KEY_ONLY or waiting for key packet
+            bool waiting_key_ = false;
+            double rate_ = 0;           ///<! dropped / packets
+        };
+
+    public:
+        /**
+         * @param creator creates the decode interface
+         * @param callback callback of decode tasks
+         * @param maxInFlight packets in decoding counted as full load, 0 to not count
+         * @param marks see ShedWatermarks
+         */
+        LoadSheddingExecutable(typename Base::Creator creator, typename Base::AsyncCallback callback,
+                               int maxInFlight = 0, const ShedWatermarks &marks = ShedWatermarks())
+                : callback_(callback), max_in_flight_(maxInFlight), marks_(marks) {
+            CHECK(callback_) << "Callback is required";
+            CHECK(marks_.non_ref_ <= marks_.key_only_) << "Watermark of non_ref over key_only";
+            inner_ = creator(router_.callback());
+            CHECK(inner_) << "Create interface fail";
+        }
+        ~LoadSheddingExecutable() override {
+            inner_.reset();
+        }
+
+    public:
+        int getBatchSize() override {
+            return inner_->getBatchSize();
+        }
+        DgError sendCommand(const std::string &cmd, const std::string &param, std::map<std::string, std::string> &result) override {
+            if(cmd != "load_shed") {
+                return inner_->sendCommand(cmd, param, result);
+            }
+            std::lock_guard<std::mutex> lock(mtx_);
+            result["level"] = std::to_string((int)stats_.level_);
+            result["load"] = std::to_string(stats_.load_);
+            result["changes"] = std::to_string(stats_.changes_);
+            result["packets"] = std::to_string(stats_.packets_);
+            result["dropped"] = std::to_string(stats_.dropped_);
+            for(auto &it : streams_) {
+                result["stream." + std::to_string(it.first) + ".rate"] = std::to_string(rateOf(it.second));
+            }
+            return DG_OK;
+        }
+
+        /**
+         * Add a source of load, probe returns ratio in use, 1 or more for full
+         */
+        void addProbe(LoadProbe probe) {
+            std::lock_guard<std::mutex> lock(mtx_);
+            probes_.push_back(std::move(probe));
+        }
+
+        using Base::execute;
+        DgError execute(Tasks &tasks) override {
+            if(tasks.empty()) {
+                return DG_ERR_INVALID_PARAM;
+            }
+            // probes may lock other interfaces, call them out of lock
+            std::vector<LoadProbe> probes;
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                probes = probes_;
+            }
+            double load = 0;
+            for(auto &probe : probes) load = std::max(load, probe());
+
+            Tasks sent, dropped;
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                if(max_in_flight_ > 0) load = std::max(load, (double)in_flight_ / max_in_flight_);
+                update(load);
+                for(auto &task : tasks) {
+                    (shed(*task) ? dropped : sent).push_back(task);
+                }
+                in_flight_ += (int)sent.size();
+            }
+            for(auto &task : dropped) {
+                task->put(OptionKeys::discard_frame_(), true);
+                task->put(OptionKeys::load_shed_(), true);
+                task->error_ = DG_OK;
+            }
+            if(sent.empty()) {
+                callback_(dropped, DG_OK);
+                return DG_OK;
+            }
+
+            auto callback = callback_;
+            auto count = (int)sent.size();
+            auto error = router_.execute(*inner_, sent, [this, callback, dropped, count](Tasks &done, DgError err) {
+                {
+                    std::lock_guard<std::mutex> lock(mtx_);
+                    in_flight_ -= count;
+                }
+                if(dropped.empty()) {
+                    callback(done, err);
+                    return;
+                }
+                auto all = done;
+                all.insert(all.end(), dropped.begin(), dropped.end());
+                callback(all, err);
+            });
+            if(error != DG_OK) {
+                std::lock_guard<std::mutex> lock(mtx_);
+                in_flight_ -= count;
+            }
+            return error;
+        }
+
+        Stats stats() {
+            std::lock_guard<std::mutex> lock(mtx_);
+            return stats_;
+        }
+        StreamStats streamStats(StreamId sid) {
+            std::lock_guard<std::mutex> lock(mtx_);
+            auto it = streams_.find(sid);
+            if(it == streams_.end()) return StreamStats();
+            StreamStats st = it->second;
+            st.rate_ = rateOf(st);
+            return st;
+        }
+        /**
+         * Forget a removed stream
+         */
+        void removeStream(StreamId sid) {
+            std::lock_guard<std::mutex> lock(mtx_);
+            streams_.erase(sid);
+        }
+
+    protected:
+        static const int MAX_TEMPORAL_ID = 6;
+
+        /**
+         * State of a stream to resume decoding by
+         */
+        struct Stream : StreamStats {
+            bool skip_leading_ = false;             ///<! drop RASL pictures of H.265 until trailing pictures
+            int max_temporal_id_ = MAX_TEMPORAL_ID; ///<! highest temporal layer of H.265 decodable
+            int extra_slice_header_bits_ = 0;       ///<! of last PPS of H.265
+        };
+
+        static double rateOf(const StreamStats &st) {
+            return st.packets_ == 0 ? 0 : (double)(st.dropped_non_ref_ + st.dropped_non_key_) / (double)st.packets_;
+        }
+
+        static double watermark(const ShedWatermarks &marks, ShedLevel level) {
+            return level == ShedLevel::KEY_ONLY ? marks.key_only_ : marks.non_ref_;
+        }
+
+        /**
+         * Raise level at once, lower it a step after load stays low for recover_ms_, lock held
+         */
+        void update(double load) {
+            auto now = std::chrono::steady_clock::now();
+            stats_.load_ = load;
+            auto target = load >= marks_.key_only_ ? ShedLevel::KEY_ONLY
+                          : (load >= marks_.non_ref_ ? ShedLevel::NON_REF : ShedLevel::NONE);
+            auto level = stats_.level_;
+            if(target > level) {
+                setLevel(target);
+            } else if(level != ShedLevel::NONE && load < watermark(marks_, level) - marks_.hysteresis_) {
+                if(!low_) {
+                    low_ = true;
+                    low_since_ = now;
+                } else if(now - low_since_ >= std::chrono::milliseconds(marks_.recover_ms_)) {
+                    setLevel((ShedLevel)((int)level - 1));
+                }
+                return;
+            }
+            low_ = false;
+        }
+
+        void setLevel(ShedLevel level) {
+            if(level == stats_.level_) return;
+            LOG(WARNING) << "Load shedding level " << (int)stats_.level_ << " -> " << (int)level
+                         << ", load " << stats_.load_;
+            stats_.level_ = level;
+            ++stats_.changes_;
+            low_ = false;
+        }
+
+        /**
+         * Whether to drop task, lock held
+         */
+        bool shed(DecodeTask &task) {
+            if(task.getBool(OptionKeys::video_eos_(), false) || task.data_ == nullptr ||
+               (task.type_ != SdkImage::H264 && task.type_ != SdkImage::H265)) {
+                return false;
+            }
+            auto h265 = task.type_ == SdkImage::H265;
+            auto &st = streams_[task.stream_id_];
+            ++st.packets_;
+            ++stats_.packets_;
+            auto level = stats_.level_;
+            if(level == ShedLevel::NONE && !st.waiting_key_ && !st.skip_leading_ && st.max_temporal_id_ == MAX_TEMPORAL_ID) {
+                return false;
+            }
+
+            auto info = PacketInfo::inspect(task.data_, (size_t)task.data_len_, task.type_, st.extra_slice_header_bits_);
+            if(info.extra_slice_header_bits_ >= 0) st.extra_slice_header_bits_ = info.extra_slice_header_bits_;
+            if(!info.slice_) return false;
+            if(level == ShedLevel::KEY_ONLY) st.waiting_key_ = true;
+            if(st.waiting_key_) {
+                if(info.key_ || info.intra_ || (level != ShedLevel::KEY_ONLY && info.recovery_)) {
+                    st.waiting_key_ = level == ShedLevel::KEY_ONLY;
+                    // leading pictures of CRA and BLA, and higher layers after non IRAP, may refer to dropped pictures
+                    st.skip_leading_ = h265 && info.nal_type_ != 19 && info.nal_type_ != 20;
+                    st.max_temporal_id_ = h265 && !info.key_ ? 0 : MAX_TEMPORAL_ID;
+                    return false;
+                }
+                return drop(st, info, false, st.dropped_non_key_);
+            }
+            if(st.skip_leading_) {
+                if(info.nal_type_ == 8 || info.nal_type_ == 9) {
+                    return drop(st, info, false, st.dropped_non_key_);
+                }
+                // RADL may still be followed by RASL, other pictures end leading ones
+                st.skip_leading_ = info.nal_type_ == 6 || info.nal_type_ == 7;
+            }
+            if(info.key_ && st.max_temporal_id_ != MAX_TEMPORAL_ID) {
+                // IRAP refers to no picture, all layers resume, RASL of CRA and BLA may refer to dropped ones
+                st.max_temporal_id_ = MAX_TEMPORAL_ID;
+                st.skip_leading_ = h265 && info.nal_type_ != 19 && info.nal_type_ != 20;
+            }
+            if(h265 && info.temporal_id_ > st.max_temporal_id_) {
+                auto tsa = info.nal_type_ == 2 || info.nal_type_ == 3;
+                auto stsa = info.nal_type_ == 4 || info.nal_type_ == 5;
+                if(level == ShedLevel::NONE && info.temporal_id_ == st.max_temporal_id_ + 1 && (tsa || stsa)) {
+                    // TSA switches up to all layers above, STSA to its own
+                    st.max_temporal_id_ = tsa ? MAX_TEMPORAL_ID : info.temporal_id_;
+                    return false;
+                }
+                return drop(st, info, h265, st.dropped_non_ref_);
+            }
+            if(level == ShedLevel::NON_REF && (!info.reference_ || info.temporal_id_ > 0)) {
+                return drop(st, info, h265, st.dropped_non_ref_);
+            }
+            return false;
+        }
+
+        /**
+         * Count a dropped packet, lock held
+         * @param layers give up temporal layers of H.265 from which pictures may refer to it,
+         *        not needed for packets dropped until a key or of leading pictures
+         */
+        bool drop(Stream &st, const PacketInfo &info, bool layers, long &counter) {
+            ++counter;
+            ++stats_.dropped_;
+            if(layers) {
+                // sub-layer non-reference pictures are referred by higher layers only
+                auto limit = info.reference_ ? info.temporal_id_ - 1 : info.temporal_id_;
+                st.max_temporal_id_ = std::max(0, std::min(st.max_temporal_id_, limit));
+            }
+            return true;
+        }
+
+    protected:
+        CallbackRouter<DecodeTask> router_;     ///<! must be destroyed after inner_
+        std::shared_ptr<Base> inner_;
+        typename Base::AsyncCallback callback_;
+        int max_in_flight_;
+        ShedWatermarks marks_;
+
+        std::mutex mtx_;
+        std::vector<LoadProbe> probes_;
+        int in_flight_ = 0;
+        bool low_ = false;                      ///<! load is below watermark of level
+        std::chrono::steady_clock::time_point low_since_;
+        std::unordered_map<StreamId, Stream> streams_;
+        Stats stats_;
+    };
+}
+
+#endif //VEGA_LOAD_SHED_H
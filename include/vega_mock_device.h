@@ -0,0 +1,353 @@
+#ifndef VEGA_MOCK_DEVICE_H
+#define VEGA_MOCK_DEVICE_H
+
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <thread>
+#include "interface_base.h"
+#include "station/block_queue.h"
+#include "station/thread_pool.h"
+
+namespace vega {
+
+    /**
+     * Latency of a mock batch: fixed_us_ + per_task_us_ * tasks, plus a uniform random
+     * jitter in [-jitter_us_, jitter_us_]. Latency is never negative.
+     */
+    typedef struct {
+        int fixed_us_ = 0;      ///<! cost of each batch
+        int per_task_us_ = 0;   ///<! cost of each task in batch
+        int jitter_us_ = 0;     ///<! max deviation of each batch
+    } MockLatency;
+
+    /**
+     * CPU mock of a device interface, used to run and benchmark host side code
+     * without accelerator.
+     *
+     * Like a device, batches are processed one by one in order. Each batch takes
+     * simulated latency, then fill is called on each task to produce synthetic result_,
+     * all tasks are set to DG_OK and callback is called. result_ is left untouched
+     * without fill.
+     *
+     * Callback is called on the device thread, or on a thread pool of the mock if
+     * completion threads are given, so slow callbacks do not stall the device.
+     *
+     * See createMockXXXInterface for mocks of each interface with synthetic results.
+     */
+    template <typename _Task>
+    class MockExecutable : public Executable<_Task> {
+    public:
+        using Base = Executable<_Task>;
+        using Tasks = std::vector<std::shared_ptr<_Task>>;
+        /**
+         * Fill synthetic result_ of a task
+         */
+        using Fill = std::function<void(_Task &task, std::mt19937 &rng)>;
+
+        /**
+         * @param batchSize max tasks of a batch
+         * @param latency simulated latency
+         * @param callback callback of batches
+         * @param fill fills result_ of tasks, nullptr to leave them untouched
+         * @param completionThreads threads calling callback, 0 to call on device thread
+         */
+        MockExecutable(int batchSize, const MockLatency &latency, typename Base::AsyncCallback callback,
+                       Fill fill = nullptr, int completionThreads = 0)
+                : batch_size_(batchSize), latency_(latency), callback_(callback), fill_(fill),
+                  rng_(std::random_device()()) {
+            CHECK(batch_size_ > 0) << "Invalid batch size " << batch_size_;
+            if(completionThreads > 0) {
+                completion_ = std::make_shared<ThreadPool>("mock_completion");
+                completion_->create(completionThreads);
+            }
+            thread_ = std::make_shared<std::thread>(&MockExecutable::work, this);
+        }
+        /**
+         * Waits for batches in execution and their callbacks
+         */
+        ~MockExecutable() override {
+            q_.push(nullptr);
+            thread_->join();
+            while(completing_ > 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+
+    public:
+        int getBatchSize() override {
+            return batch_size_;
+        }
+        DgError sendCommand(const std::string &cmd, const std::string &param, std::map<std::string, std::string> &result) override {
+            VEGA_UNUSED(cmd);
+            VEGA_UNUSED(param);
+            VEGA_UNUSED(result);
+            return DG_ERR_NOT_SUPPORTED;
+        }
+
+        using Base::execute;
+        DgError execute(Tasks &tasks) override {
+            if(tasks.empty() || (int)tasks.size() > batch_size_) {
+                LOG(ERROR) << "Invalid batch size " << tasks.size() << ", max " << batch_size_;
+                return DG_ERR_INVALID_PARAM;
+            }
+            q_.push(std::make_shared<Tasks>(tasks));
+            ++batches_;
+            return DG_OK;
+        }
+
+        inline long batches() { return batches_; }
+        /**
+         * Batches waiting for device
+         */
+        inline size_t queued() { return q_.size(); }
+
+    protected:
+        int latencyUs(int tasks) {
+            auto us = latency_.fixed_us_ + latency_.per_task_us_ * tasks;
+            if(latency_.jitter_us_ > 0) {
+                std::uniform_int_distribution<int> jitter(-latency_.jitter_us_, latency_.jitter_us_);
+                us += jitter(rng_);
+            }
+            return std::max(us, 0);
+        }
+
+        void work() {
+            while(true) {
+                auto batch = q_.pop();
+                if(!batch) break;
+
+                std::this_thread::sleep_for(std::chrono::microseconds(latencyUs((int)batch->size())));
+                for(auto &task : *batch) {
+                    if(fill_) fill_(*task, rng_);
+                    task->error_ = DG_OK;
+                }
+
+                if(!completion_) {
+                    callback_(*batch, DG_OK);
+                    continue;
+                }
+                ++completing_;
+                auto doable = std::make_shared<CallbackDoable>();
+                doable->setCallback([this, batch]() {
+                    callback_(*batch, DG_OK);
+                    --completing_;
+                });
+                if(completion_->put(doable) != DG_OK) {
+                    doable->start();
+                }
+            }
+        }
+
+    protected:
+        int batch_size_;
+        MockLatency latency_;
+        typename Base::AsyncCallback callback_;
+        Fill fill_;
+        std::mt19937 rng_;  ///<! used by device thread only
+
+        BlockQueue<std::shared_ptr<Tasks>> q_;
+        std::shared_ptr<std::thread> thread_;
+        std::shared_ptr<ThreadPool> completion_;
+        std::atomic<int> completing_{0};
+        std::atomic<long> batches_{0};
+    };
+
+    /**
+     * Synthetic results of mock interfaces
+     */
+    class MockResult {
+    public:
+        /**
+         * Up to 4 boxes inside roi_, or size_, or 1920x1080
+         */
+        static void detect(DetectTask &task, std::mt19937 &rng) {
+            auto area = bounds(task);
+            std::uniform_int_distribution<int> count(0, 4);
+            std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+            task.result_.clear();
+            for(auto n = count(rng); n > 0; n--) {
+                BBox box;
+                box.rect_.width = std::max(1, (int)(area.width * (0.1f + 0.3f * unit(rng))));
+                box.rect_.height = std::max(1, (int)(area.height * (0.1f + 0.3f * unit(rng))));
+                box.rect_.x = area.x + (int)((area.width - box.rect_.width) * unit(rng));
+                box.rect_.y = area.y + (int)((area.height - box.rect_.height) * unit(rng));
+                box.type_ = unit(rng) < 0.5f ? decltype(box.type_)(DetectType::DETECT_TYPE_VEHICLE)
+                                             : decltype(box.type_)(DetectType::DETECT_TYPE_FACE);
+                box.confidence_ = 0.5f + 0.5f * unit(rng);
+                task.result_.push_back(box);
+            }
+        }
+
+        /**
+         * Up to 3 attributes
+         */
+        static void classify(ClassifierTask &task, std::mt19937 &rng) {
+            std::uniform_int_distribution<int> count(1, 3), idx(0, 31);
+            std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+            task.result_.clear();
+            for(auto n = count(rng); n > 0; n--) {
+                ClassifyAttribute attr;
+                attr.idx = idx(rng);
+                attr.name = "attr" + std::to_string(attr.idx);
+                attr.confidence = unit(rng);
+                attr.mappingId = (TagId)(attr.idx + 1);
+                attr.trueValue = attr.confidence > 0.5f;
+                task.result_.push_back(attr);
+            }
+        }
+
+        /**
+         * A normalized feature of dim floats
+         */
+        static void feature(std::vector<float> &feature, int dim, std::mt19937 &rng) {
+            std::normal_distribution<float> normal(0.0f, 1.0f);
+            feature.resize(dim);
+            float norm = 0;
+            for(auto &v : feature) {
+                v = normal(rng);
+                norm += v * v;
+            }
+            norm = norm > 0 ? 1.0f / std::sqrt(norm) : 0;
+            for(auto &v : feature) v *= norm;
+        }
+
+        /**
+         * A single line plate of 7 chars
+         */
+        static void plate(PlateRecogTask &task, std::mt19937 &rng) {
+            static const wchar_t chars[] = L"0123456789ABCDEFGHJKLMNPQRSTUVWXYZ";
+            std::uniform_int_distribution<int> ch(0, (int)(sizeof(chars) / sizeof(wchar_t)) - 2);
+            std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+            auto &plate = task.result_;
+            plate.category = 0;
+            plate.color.idx = 0;
+            plate.color.name = "blue";
+            plate.color.confidence = 0.5f + 0.5f * unit(rng);
+            plate.color.mappingId = 1;
+            plate.color.trueValue = true;
+            plate.wide_literal.clear();
+            plate.literal_confidence.clear();
+            for(auto i = 0; i < 7; i++) {
+                plate.wide_literal.push_back(chars[ch(rng)]);
+                plate.literal_confidence.push_back(0.5f + 0.5f * unit(rng));
+            }
+            plate.is_double_line_plate = false;
+            plate.box.rect_ = task.roi_.area() > 0 ? task.roi_ : bounds(task);
+            plate.box.type_ = decltype(plate.box.type_)(DetectType::DETECT_TYPE_PLATE);
+            plate.box.confidence_ = 0.5f + 0.5f * unit(rng);
+        }
+
+    protected:
+        static cv::Rect bounds(SdkTaskBase &task) {
+            if(task.roi_.area() > 0) return task.roi_;
+            if(task.size_.area() > 0) return cv::Rect(cv::Point(), task.size_);
+            return cv::Rect(0, 0, 1920, 1080);
+        }
+    };
+
+    /**
+     * Output item of mock model interface
+     */
+    class MockTagItem : public AbstractTagItem {
+    public:
+        TagId               getTagNameID() override { return tag_; }
+        std::bitset<16>    &getValidType() override { return valid_; }
+        FrameId             getFrameId() override { return frame_id_; }
+        StreamId            getStreamId() override { return stream_id_; }
+        float               getConfidence() override { return confidence_; }
+        std::vector<float> &getConfidences() override { return confidences_; }
+        bool                getJudgment() override { return confidence_ > 0.5f; }
+        BBoxf              &getBbox() override { return box_; }
+        std::vector<float> &getKeypoints() override { return keypoints_; }
+        std::vector<int>   &getIndexs() override { return indexs_; }
+        std::vector<float> &getFeature() override { return feature_; }
+        std::vector<float> &getRawData() override { return raw_; }
+
+    public:
+        TagId tag_ = INVALID_TAG_ID;
+        std::bitset<16> valid_;
+        FrameId frame_id_ = 0;
+        StreamId stream_id_ = INVALID_STREAM_ID;
+        float confidence_ = 0;
+        std::vector<float> confidences_;
+        BBoxf box_;
+        std::vector<float> keypoints_;
+        std::vector<int> indexs_;
+        std::vector<float> feature_;
+        std::vector<float> raw_;
+    };
+
+    /**
+     * Mock detector, tasks get up to 4 boxes
+     */
+    inline std::shared_ptr<DetectInterface>
+    createMockDetectInterface(int batchSize, const MockLatency &latency, DetectInterface::AsyncCallback callback,
+                              int completionThreads = 0) {
+        return std::make_shared<MockExecutable<DetectTask>>(batchSize, latency, callback,
+                &MockResult::detect, completionThreads);
+    }
+
+    /**
+     * Mock classifier, tasks get up to 3 attributes
+     */
+    inline std::shared_ptr<ClassifierInterface>
+    createMockClassifierInterface(int batchSize, const MockLatency &latency, ClassifierInterface::AsyncCallback callback,
+                                  int completionThreads = 0) {
+        return std::make_shared<MockExecutable<ClassifierTask>>(batchSize, latency, callback,
+                &MockResult::classify, completionThreads);
+    }
+
+    /**
+     * Mock data flow, tasks get a normalized feature of dim floats
+     */
+    inline std::shared_ptr<DataFlowInterface>
+    createMockDataFlowInterface(int batchSize, const MockLatency &latency, DataFlowInterface::AsyncCallback callback,
+                                int completionThreads = 0, int dim = 256) {
+        return std::make_shared<MockExecutable<DataFlowTask>>(batchSize, latency, callback,
+                [dim](DataFlowTask &task, std::mt19937 &rng) {
+                    MockResult::feature(task.result_, dim, rng);
+                }, completionThreads);
+    }
+
+    /**
+     * Mock plate recognition, tasks get a single line plate
+     */
+    inline std::shared_ptr<PlateRecogInterface>
+    createMockPlateRecogInterface(int batchSize, const MockLatency &latency, PlateRecogInterface::AsyncCallback callback,
+                                  int completionThreads = 0) {
+        return std::make_shared<MockExecutable<PlateRecogTask>>(batchSize, latency, callback,
+                &MockResult::plate, completionThreads);
+    }
+
+    /**
+     * Mock model, tasks get one MockTagItem with confidence, box and a feature of dim floats
+     */
+    inline std::shared_ptr<ModelInterface>
+    createMockModelInterface(int batchSize, const MockLatency &latency, ModelInterface::AsyncCallback callback,
+                             int completionThreads = 0, int dim = 256) {
+        return std::make_shared<MockExecutable<ModelTask>>(batchSize, latency, callback,
+                [dim](ModelTask &task, std::mt19937 &rng) {
+                    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+                    auto item = std::make_shared<MockTagItem>();
+                    item->tag_ = 1;
+                    item->frame_id_ = task.frame_id_;
+                    item->stream_id_ = task.stream_id_;
+                    item->confidence_ = unit(rng);
+                    item->confidences_.push_back(item->confidence_);
+                    item->box_.rect_ = cv::Rect2f(task.roi_);
+                    item->box_.confidence_ = item->confidence_;
+                    MockResult::feature(item->feature_, dim, rng);
+                    item->valid_.set((int)AbstractTagItem::Type::CONFIDENCE);
+                    item->valid_.set((int)AbstractTagItem::Type::BBOX);
+                    item->valid_.set((int)AbstractTagItem::Type::FEATURE);
+                    task.result_.clear();
+                    task.result_.push_back(item);
+                }, completionThreads);
+    }
+}
+
+#endif //VEGA_MOCK_DEVICE_H
@@ -0,0 +1,146 @@
+#ifndef VEGA_MULTI_FETCH_H
+#define VEGA_MULTI_FETCH_H
+
+#include <atomic>
+#include "interface_base.h"
+#include "vega_option_store.h"
+#include "vega_router.h"
+
+namespace vega {
+
+    /**
+     * MultiFetchFrameInterface over a FetchFrameInterface without native multi-roi support.
+     *
+     * Each roi of a MultiFetchFrameTask is fetched by a FetchFrameTask, sent in batches of
+     * getBatchSize() of fetch interface, and callback is called once when all of them end.
+     * Frame is still read once per roi by the fetch interface, use a native interface
+     * like CpuBackend::createMultiFetchFrameInterface() where it is available.
+     *
+     * Fetch interface crops JPEG only, so BGR/GRAY tasks with rois_ are not supported and
+     * execute() returns DG_ERR_NOT_SUPPORTED, they can only fetch the whole frame.
+     * Nor does it resize, tasks with OptionKeys::fetch_width_ or fetch_height_ are not supported.
+     *
+     * \code{.cpp}
+     * auto fetcher = std::make_shared<MultiFetchExecutable>(
+     *     [&](FetchFrameInterface::AsyncCallback cb) {
+     *         return createFetchFrameInterface(0, "", Model::fetch_frame, nullptr, cb);
+     *     }, onSnapshots);
+     * \endcode
+     */
+    class MultiFetchExecutable : public Executable<MultiFetchFrameTask> {
+    public:
+        using Base = Executable<MultiFetchFrameTask>;
+        using Tasks = std::vector<std::shared_ptr<MultiFetchFrameTask>>;
+        using FetchTasks = std::vector<std::shared_ptr<FetchFrameTask>>;
+
+    public:
+        MultiFetchExecutable(FetchFrameInterface::Creator creator, typename Base::AsyncCallback callback)
+                : callback_(callback) {
+            CHECK(callback_) << "Callback is required";
+            inner_ = creator(router_.callback());
+            CHECK(inner_) << "Create interface fail";
+            batch_size_ = std::max(1, inner_->getBatchSize());
+        }
+        ~MultiFetchExecutable() override {
+            inner_.reset();
+        }
+
+    public:
+        int getBatchSize() override {
+            return (int)batch_size_;
+        }
+        DgError sendCommand(const std::string &cmd, const std::string &param, std::map<std::string, std::string> &result) override {
+            return inner_->sendCommand(cmd, param, result);
+        }
+
+        using Base::execute;
+        DgError execute(Tasks &tasks) override {
+            if(tasks.empty()) {
+                return DG_ERR_INVALID_PARAM;
+            }
+
+            auto join = std::make_shared<Join>();
+            join->tasks_ = tasks;
+            FetchTasks fetches;
+            for(auto i = 0u; i < tasks.size(); i++) {
+                auto &task = *tasks[i];
+                if(task.type_ != SdkImage::JPEG && task.type_ != SdkImage::BGR && task.type_ != SdkImage::GRAY) {
+                    return DG_ERR_NOT_SUPPORTED;
+                }
+                if(task.type_ != SdkImage::JPEG && !task.rois_.empty()) {
+                    LOG(ERROR) << "Crop of type " << (int)task.type_ << " is not supported by fetch interface";
+                    return DG_ERR_NOT_SUPPORTED;
+                }
+                if(task.getInteger(OptionKeys::fetch_width_(), 0) > 0 || task.getInteger(OptionKeys::fetch_height_(), 0) > 0) {
+                    LOG(ERROR) << "Resize is not supported by fetch interface";
+                    return DG_ERR_NOT_SUPPORTED;
+                }
+                auto quality = task.getInteger(OptionKeys::jpeg_quality_(), -1);
+                auto rois = task.rois_.empty() ? std::vector<cv::Rect>{cv::Rect()} : task.rois_;
+                task.result_.assign(rois.size(), FrameData());
+                for(auto r = 0u; r < rois.size(); r++) {
+                    auto fetch = std::make_shared<FetchFrameTask>();
+                    fetch->stream_id_ = task.stream_id_;
+                    fetch->frame_id_ = task.frame_id_;
+                    fetch->type_ = task.type_;
+                    fetch->roi_ = rois[r];
+                    if(quality >= 0) fetch->put(OptionKeys::jpeg_quality_(), quality);
+                    fetch->user_data_ = (void *)(uintptr_t)(((uint64_t)i << 32) | r);
+                    fetches.push_back(fetch);
+                }
+            }
+
+            std::vector<FetchTasks> batches;
+            for(auto i = 0u; i < fetches.size(); i += batch_size_) {
+                batches.emplace_back(fetches.begin() + i, fetches.begin() + std::min(fetches.size(), i + batch_size_));
+            }
+            join->left_ = (int)batches.size();
+
+            // once a batch is sent, callback is always called and later failures end with their error
+            for(auto b = 0u; b < batches.size(); b++) {
+                auto error = router_.execute(*inner_, batches[b], [this, join](FetchTasks &done, DgError err) {
+                    collect(join, done, err);
+                });
+                if(error != DG_OK) {
+                    if(b == 0) return error;
+                    LOG(ERROR) << "Execute fetch batch fail: " << error;
+                    for(auto &fetch : batches[b]) fetch->error_ = error;
+                    collect(join, batches[b], error);
+                }
+            }
+            return DG_OK;
+        }
+
+    protected:
+        struct Join {
+            Tasks tasks_;
+            std::atomic<int> left_{0};
+            std::atomic<int> error_{DG_OK};
+        };
+
+        void collect(const std::shared_ptr<Join> &join, FetchTasks &done, DgError error) {
+            for(auto &fetch : done) {
+                auto key = (uint64_t)(uintptr_t)fetch->user_data_;
+                auto &task = *join->tasks_[key >> 32];
+                auto failed = error != DG_OK && fetch->error_ != DG_OK;
+                if(failed) {
+                    task.error_ = fetch->error_ == DG_ON_GOING ? error : fetch->error_;
+                    join->error_ = error;
+                } else {
+                    task.result_[key & 0xffffffffu] = fetch->result_;
+                }
+            }
+            if(--join->left_ == 0) {
+                callback_(join->tasks_, (DgError)join->error_.load());
+            }
+        }
+
+    protected:
+        CallbackRouter<FetchFrameTask> router_; ///<! must be destroyed after inner_
+        std::shared_ptr<FetchFrameInterface> inner_;
+        typename Base::AsyncCallback callback_;
+        size_t batch_size_ = 1;
+    };
+}
+
+#endif //VEGA_MULTI_FETCH_H
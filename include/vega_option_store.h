@@ -0,0 +1,141 @@
+#ifndef VEGA_OPTION_STORE_H
+#define VEGA_OPTION_STORE_H
+
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include "vega_option.h"
+
+namespace vega {
+
+    /**
+     * Key of an option by its name.
+     *
+     * SdkTaskBase keeps options by name in values_, which is read by interfaces of SDK
+     * too, values put by key are written there at once. Putting by key formats the value
+     * in place, getting by key parses it in place instead of copying it out, and key of
+     * an option handled by headers only is built once instead of on each call:
+     *
+     * \code{.cpp}
+     * task->put(OptionKeys::video_eos_(), true);
+     * auto eos = task->getBool(OptionKeys::video_eos_(), false);
+     * \endcode
+     *
+     * Names are interned, a key holds the name kept by the process, not the string it is
+     * built from. Keys of all options in vega_option.h are given by OptionKeys.
+     */
+    class OptionKey {
+    public:
+        explicit OptionKey(const std::string &name) : name_(&intern(name)) {}
+        /**
+         * Build keys once from names that outlive them, not from temporaries
+         */
+        explicit OptionKey(std::string &&name) = delete;
+
+        inline const std::string &name() const { return *name_; }
+
+    protected:
+        /**
+         * @return name kept for the life of process, the same one for equal names
+         */
+        static const std::string &intern(const std::string &name) {
+            static std::mutex mtx;
+            static std::unordered_set<std::string> names;
+            std::lock_guard<std::mutex> lock(mtx);
+            return *names.insert(name).first;
+        }
+
+        const std::string *name_;
+    };
+
+#define VEGA_OPTION_KEY(name) \
+        static const OptionKey &name() { static const OptionKey key(Option::name); return key; }
+/**
+ * Key of an option handled by headers only, not declared in Option
+ */
+#define VEGA_HOST_OPTION_KEY(name) \
+        static const OptionKey &name() { static const std::string str(#name); static const OptionKey key(str); return key; }
+
+    /**
+     * Keys of options declared in vega_option.h, use OptionKeys::video_eos_()
+     * instead of Option::video_eos_ to parse values in place.
+     * Options only handled by headers, like CpuBackend, have keys here only.
+     */
+    class OptionKeys {
+    public:
+        VEGA_OPTION_KEY(tp_level_)
+        VEGA_OPTION_KEY(use_opencv_)
+        VEGA_OPTION_KEY(force_roi_)
+        VEGA_OPTION_KEY(box_to_roi_)
+        VEGA_OPTION_KEY(big_image_)
+        VEGA_OPTION_KEY(plate_rectify_store_stream_id_)
+        VEGA_OPTION_KEY(discard_frame_)
+        VEGA_OPTION_KEY(video_eos_)
+        VEGA_OPTION_KEY(key_frame_interval_)
+        VEGA_OPTION_KEY(force_i_frame_)
+        VEGA_OPTION_KEY(video_resize_ratio_)
+        VEGA_OPTION_KEY(jpeg_quality_)
+        VEGA_OPTION_KEY(enc_infps_)
+        VEGA_OPTION_KEY(enc_intype_)
+        VEGA_OPTION_KEY(enc_outtype_)
+        VEGA_OPTION_KEY(enc_src_is_host_)
+        VEGA_OPTION_KEY(packet_index_)
+        VEGA_OPTION_KEY(flush_decoder_)
+        VEGA_OPTION_KEY(decode_output_type_)
+        VEGA_OPTION_KEY(bg_color_)
+        VEGA_OPTION_KEY(ai_image_process_type_)
+        VEGA_OPTION_KEY(face_align_)
+        VEGA_OPTION_KEY(face_align2_)
+        VEGA_OPTION_KEY(face_transform_)
+        VEGA_OPTION_KEY(transform_type_)
+        VEGA_OPTION_KEY(face_store_stream_id_)
+        VEGA_OPTION_KEY(sync_stream_)
+        VEGA_OPTION_KEY(data_type_)
+        VEGA_OPTION_KEY(video_dec_mode_e_)
+
+        ////////////////////////////////////////////////////////////////////////////////
+        ////////////         Options of header-only interfaces             /////////////
+        ////////////////////////////////////////////////////////////////////////////////
+        /**
+         * int, for frame fetching, width of output image, see FetchFrameTask
+         * 0 to keep aspect ratio by fetch_height_
+         * default: 0, not resized if both width and height are 0
+         */
+        VEGA_HOST_OPTION_KEY(fetch_width_)
+        /**
+         * int, for frame fetching, height of output image, see FetchFrameTask
+         * 0 to keep aspect ratio by fetch_width_
+         * default: 0
+         */
+        VEGA_HOST_OPTION_KEY(fetch_height_)
+        /**
+         * int, for frame fetching, interpolation of resizing, cv::InterpolationFlags
+         * default: cv::INTER_AREA for downscaling, cv::INTER_LINEAR for upscaling
+         */
+        VEGA_HOST_OPTION_KEY(fetch_interpolation_)
+        /**
+         * bool, for video decoding, set with discard_frame_ on packets dropped without
+         * decoding by LoadSheddingExecutable
+         * default: false
+         */
+        VEGA_HOST_OPTION_KEY(load_shed_)
+        /**
+         * int, for image decoding, JpegRoute of a JPEG set by JpegAdmissionExecutable,
+         * frames of JpegRoute::CPU are kept in the pool of the CPU interface
+         * default: 0, JpegRoute::DEVICE
+         */
+        VEGA_HOST_OPTION_KEY(jpeg_route_)
+        /**
+         * int, for image decoding, JPEG is decoded at 1/jpeg_scale_ of its size by DCT
+         * scaling, 1, 2, 4 or 8, each side is rounded up. Handled by CpuBackend, device
+         * decoders do not support it yet, see JpegLimits::device_scale_
+         * default: 1
+         */
+        VEGA_HOST_OPTION_KEY(jpeg_scale_)
+    };
+
+#undef VEGA_OPTION_KEY
+#undef VEGA_HOST_OPTION_KEY
+}
+
+#endif //VEGA_OPTION_STORE_H
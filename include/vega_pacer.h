@@ -0,0 +1,368 @@
+#ifndef VEGA_PACER_H
+#define VEGA_PACER_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "glog/logging.h"
+
+namespace vega {
+
+    /**
+     * Lateness of paced calls
+     */
+    struct PaceStats {
+        long calls_ = 0;
+        long behind_ = 0;           ///<! calls later than a frame interval
+        double mean_late_us_ = 0;
+        double max_late_us_ = 0;
+    };
+
+    /**
+     * Timer wheel calling many streams at their own fps, like cameras sending packets.
+     *
+     * Call k of a stream is due at start + k / fps by steady clock, so time taken by calls
+     * or missed wakeups never accumulates into drift, a late call is followed by calls
+     * catching up. Streams are spread over threads, each runs a wheel of slots of tickUs,
+     * so hundreds of streams are driven by a few threads. Calls of a stream are in order
+     * on the same thread, and should return quickly, like Executable::execute().
+     *
+     * Lateness of each call from its due time is counted into PaceStats. A stream ended by
+     * its function or by remove() is dropped by its wheel at its next due time, its calls
+     * are then counted in stats() of all streams only.
+     *
+     * \code{.cpp}
+     * Pacer pacer(2);
+     * auto id = pacer.add(25, [&](long seq) {
+     *     packets[seq].bind(*task, SdkImage::H264);
+     *     decoder->execute(tasks);
+     *     return seq + 1 < (long)packets.size();     // false ends the stream
+     * });
+     * pacer.join(id);
+     * \endcode
+     */
+    class Pacer {
+    public:
+        /**
+         * Send call seq of a stream, return false to end the stream
+         */
+        using PaceFn = std::function<bool(long seq)>;
+        using Clock = std::chrono::steady_clock;
+
+    public:
+        /**
+         * @param threads threads running wheels
+         * @param tickUs time of a slot of wheel
+         * @param slots slots of a wheel, calls later than slots * tickUs wait for rounds of wheel
+         */
+        explicit Pacer(int threads = 1, int tickUs = 1000, int slots = 1024) {
+            CHECK(threads > 0 && tickUs > 0 && slots > 0) << "Invalid pacer " << threads << " " << tickUs << " " << slots;
+            for(auto i = 0; i < threads; i++) {
+                wheels_.emplace_back(new Wheel(std::chrono::microseconds(tickUs), slots,
+                                               [this](const StreamSP &stream) { retire(stream); }));
+            }
+        }
+        /**
+         * Stops all streams, calls in progress are finished
+         */
+        ~Pacer() {
+            for(auto &wheel : wheels_) wheel->stop();
+        }
+
+    public:
+        /**
+         * Add a stream called fps times a second from start
+         * @return id of stream
+         */
+        int add(double fps, PaceFn fn, Clock::time_point start = Clock::now()) {
+            CHECK(fps > 0) << "Invalid fps " << fps;
+            CHECK(fn) << "Pace function is required";
+            auto stream = std::make_shared<Stream>();
+            stream->fn_ = std::move(fn);
+            stream->start_ = start;
+            stream->interval_ = std::chrono::duration<double, std::micro>(1e6 / fps);
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                stream->id_ = next_id_++;
+                streams_[stream->id_] = stream;
+            }
+            wheels_[stream->id_ % wheels_.size()]->schedule(stream);
+            return stream->id_;
+        }
+
+        /**
+         * Stop a stream, a call in progress is finished
+         */
+        void remove(int id) {
+            auto stream = find(id);
+            if(stream) stream->end();
+        }
+
+        /**
+         * Wait until stream ends or is removed
+         * @return false on timeout
+         */
+        bool join(int id, int timeoutMs = -1) {
+            auto stream = find(id);
+            if(!stream) return true;
+            std::unique_lock<std::mutex> lock(stream->mtx_);
+            auto ended = [&]() { return stream->ended_; };
+            if(timeoutMs < 0) {
+                stream->cv_.wait(lock, ended);
+                return true;
+            }
+            return stream->cv_.wait_for(lock, std::chrono::milliseconds(timeoutMs), ended);
+        }
+
+        /**
+         * Lateness of a stream, empty once the stream is dropped
+         */
+        PaceStats stats(int id) {
+            auto stream = find(id);
+            PaceStats st;
+            if(stream) {
+                std::lock_guard<std::mutex> lock(stream->mtx_);
+                st = stream->statsLocked();
+            }
+            return st;
+        }
+        /**
+         * Lateness of all streams
+         */
+        PaceStats stats() {
+            std::lock_guard<std::mutex> lock(mtx_);
+            auto total = retired_;
+            auto sum = retired_sum_late_us_;
+            for(auto &it : streams_) {
+                auto &stream = *it.second;
+                std::lock_guard<std::mutex> streamLock(stream.mtx_);
+                total.calls_ += stream.calls_;
+                total.behind_ += stream.behind_;
+                total.max_late_us_ = std::max(total.max_late_us_, stream.max_late_us_);
+                sum += stream.sum_late_us_;
+            }
+            total.mean_late_us_ = total.calls_ == 0 ? 0 : sum / (double)total.calls_;
+            return total;
+        }
+
+        /**
+         * Streams not dropped yet
+         */
+        size_t size() {
+            std::lock_guard<std::mutex> lock(mtx_);
+            return streams_.size();
+        }
+
+    protected:
+        struct Stream {
+            int id_ = 0;
+            PaceFn fn_;
+            Clock::time_point start_;
+            std::chrono::duration<double, std::micro> interval_;
+            long seq_ = 0;                  ///<! next call, only touched by its wheel
+
+            std::mutex mtx_;
+            std::condition_variable cv_;
+            bool ended_ = false;
+            long calls_ = 0;
+            long behind_ = 0;
+            double sum_late_us_ = 0;
+            double max_late_us_ = 0;
+
+            Clock::time_point due() const {
+                return start_ + std::chrono::duration_cast<Clock::duration>(interval_ * (double)seq_);
+            }
+            bool ended() {
+                std::lock_guard<std::mutex> lock(mtx_);
+                return ended_;
+            }
+            void end() {
+                std::lock_guard<std::mutex> lock(mtx_);
+                ended_ = true;
+                cv_.notify_all();
+            }
+            void account(double lateUs) {
+                std::lock_guard<std::mutex> lock(mtx_);
+                ++calls_;
+                if(lateUs > interval_.count()) ++behind_;
+                sum_late_us_ += lateUs;
+                max_late_us_ = std::max(max_late_us_, lateUs);
+            }
+            PaceStats statsLocked() const {
+                PaceStats st;
+                st.calls_ = calls_;
+                st.behind_ = behind_;
+                st.mean_late_us_ = calls_ == 0 ? 0 : sum_late_us_ / (double)calls_;
+                st.max_late_us_ = max_late_us_;
+                return st;
+            }
+        };
+        using StreamSP = std::shared_ptr<Stream>;
+
+        /**
+         * Slots of calls by due tick, driven by one thread
+         */
+        class Wheel {
+        public:
+            /**
+             * @param retire called with each ended stream once, on thread of wheel
+             */
+            Wheel(Clock::duration tick, int slots, std::function<void(const StreamSP &)> retire)
+                    : tick_(tick), slots_((size_t)slots), epoch_(Clock::now()), retire_(std::move(retire)) {
+                thread_ = std::thread(&Wheel::run, this);
+            }
+            ~Wheel() {
+                stop();
+            }
+
+            void schedule(const StreamSP &stream) {
+                std::lock_guard<std::mutex> lock(mtx_);
+                insert(stream);
+                cv_.notify_one();
+            }
+
+            void stop() {
+                {
+                    std::lock_guard<std::mutex> lock(mtx_);
+                    if(stop_) return;
+                    stop_ = true;
+                    cv_.notify_one();
+                }
+                thread_.join();
+                for(auto &slot : slots_) {
+                    for(auto &entry : slot) entry.stream_->end();
+                }
+            }
+
+        protected:
+            struct Entry {
+                Clock::time_point due_;
+                StreamSP stream_;
+            };
+
+            inline long tickOf(Clock::time_point t) const {
+                return t <= epoch_ ? 0 : (long)((t - epoch_) / tick_);
+            }
+
+            /**
+             * Lock held
+             */
+            void insert(const StreamSP &stream) {
+                auto due = stream->due();
+                auto tick = std::max(tickOf(due), current_);
+                slots_[(size_t)tick % slots_.size()].push_back(Entry{due, stream});
+            }
+
+            void run() {
+                std::vector<Entry> ready;
+                std::unique_lock<std::mutex> lock(mtx_);
+                while(!stop_) {
+                    auto now = Clock::now();
+                    auto nowTick = tickOf(now);
+                    // slots from current_ to now, at most a round of wheel
+                    auto first = std::max(current_, nowTick - (long)slots_.size() + 1);
+                    for(auto t = first; t <= nowTick; t++) {
+                        auto &slot = slots_[(size_t)t % slots_.size()];
+                        for(auto i = 0u; i < slot.size();) {
+                            if(slot[i].due_ <= now) {
+                                ready.push_back(std::move(slot[i]));
+                                slot[i] = std::move(slot.back());
+                                slot.pop_back();
+                            } else {
+                                i++;
+                            }
+                        }
+                    }
+                    current_ = nowTick;
+
+                    if(ready.empty()) {
+                        cv_.wait_until(lock, nextWake());
+                        continue;
+                    }
+
+                    lock.unlock();
+                    std::sort(ready.begin(), ready.end(), [](const Entry &a, const Entry &b) { return a.due_ < b.due_; });
+                    for(auto &entry : ready) {
+                        fire(entry);
+                        if(!entry.stream_->ended()) continue;
+                        retire_(entry.stream_);
+                        entry.stream_.reset();
+                    }
+                    lock.lock();
+                    for(auto &entry : ready) {
+                        if(entry.stream_) insert(entry.stream_);
+                    }
+                    ready.clear();
+                }
+            }
+
+            /**
+             * Earliest due of current and next slots, or start of next slot, lock held
+             */
+            Clock::time_point nextWake() const {
+                auto wake = epoch_ + tick_ * (current_ + 1);
+                for(auto t = current_; t <= current_ + 1; t++) {
+                    for(auto &entry : slots_[(size_t)t % slots_.size()]) {
+                        if(entry.due_ < wake) wake = entry.due_;
+                    }
+                }
+                return wake;
+            }
+
+            void fire(Entry &entry) {
+                auto &stream = *entry.stream_;
+                if(stream.ended()) return;
+                auto late = std::chrono::duration<double, std::micro>(Clock::now() - entry.due_).count();
+                stream.account(std::max(late, 0.0));
+                if(!stream.fn_(stream.seq_++)) stream.end();
+            }
+
+        protected:
+            Clock::duration tick_;
+            std::vector<std::vector<Entry>> slots_;
+            Clock::time_point epoch_;
+            std::function<void(const StreamSP &)> retire_;
+
+            std::mutex mtx_;
+            std::condition_variable cv_;
+            long current_ = 0;      ///<! tick processed last
+            bool stop_ = false;
+            std::thread thread_;
+        };
+
+        /**
+         * Drop an ended stream, its calls are kept in stats of all streams
+         */
+        void retire(const StreamSP &stream) {
+            std::lock_guard<std::mutex> lock(mtx_);
+            streams_.erase(stream->id_);
+            std::lock_guard<std::mutex> streamLock(stream->mtx_);
+            retired_.calls_ += stream->calls_;
+            retired_.behind_ += stream->behind_;
+            retired_.max_late_us_ = std::max(retired_.max_late_us_, stream->max_late_us_);
+            retired_sum_late_us_ += stream->sum_late_us_;
+        }
+
+        StreamSP find(int id) {
+            std::lock_guard<std::mutex> lock(mtx_);
+            auto it = streams_.find(id);
+            return it == streams_.end() ? nullptr : it->second;
+        }
+
+    protected:
+        std::vector<std::unique_ptr<Wheel>> wheels_;
+        std::mutex mtx_;
+        std::unordered_map<int, StreamSP> streams_;
+        int next_id_ = 0;
+        PaceStats retired_;                 ///<! calls of dropped streams, mean_late_us_ not set
+        double retired_sum_late_us_ = 0;
+    };
+}
+
+#endif //VEGA_PACER_H
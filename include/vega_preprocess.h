@@ -0,0 +1,269 @@
+#ifndef VEGA_PREPROCESS_H
+#define VEGA_PREPROCESS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "dg_types.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace vega {
+
+    /**
+     * Layout and normalization of a model input tensor
+     */
+    struct PreprocessParams {
+        cv::Size size_;                 ///<! width and height of model input
+        bool rgb_ = false;              ///<! channels of tensor are R, G, B instead of B, G, R
+        float mean_[3] = {0, 0, 0};     ///<! subtracted from channels, in tensor channel order
+        float scale_[3] = {1, 1, 1};    ///<! multiplied after mean, for int8 it includes quantization scale
+        bool keep_ratio_ = false;       ///<! resize by one scale, pad right and bottom
+        float pad_ = 0;                 ///<! pixel value of padding, normalized like pixels
+        int threads_ = 0;               ///<! rois preprocessed in parallel, 0 for OpenMP default, 1 for none
+    };
+
+    /**
+     * Mapping between a roi of image and its tensor of a batch
+     */
+    struct RoiScale {
+        cv::Point2f origin_;            ///<! top left of roi in image
+        float scale_x_ = 1;             ///<! tensor pixels per image pixel
+        float scale_y_ = 1;
+        cv::Size content_;              ///<! size of roi in tensor, padded to model size if keep_ratio_
+
+        /**
+         * Box on tensor of this roi, e.g. a detection, to image
+         */
+        template <typename _Tp>
+        cv::Rect2f toImage(const cv::Rect_<_Tp> &rect) const {
+            return cv::Rect2f((float)rect.x / scale_x_ + origin_.x, (float)rect.y / scale_y_ + origin_.y,
+                              (float)rect.width / scale_x_, (float)rect.height / scale_y_);
+        }
+        template <typename _Tp>
+        BBoxf toImage(const BBox_<_Tp> &box) const {
+            BBoxf out;
+            out.type_ = box.type_;
+            out.rect_ = toImage(box.rect_);
+            out.confidence_ = box.confidence_;
+            return out;
+        }
+    };
+
+    /**
+     * Crop, resize, colour conversion, normalization and NCHW packing of rois in one pass.
+     *
+     * Each roi of an image is bilinearly resized to the model input, converted to B, G, R
+     * or R, G, B, normalized by (pixel - mean) * scale and written to its slot of a batch
+     * tensor, so every pixel of the tensor is read and written once instead of four times
+     * by cv::resize, cv::cvtColor, subtraction and cv::split. Rois are processed in
+     * parallel, each by one thread.
+     *
+     * Image is DG_IMAGE_YUV_SP420, DG_IMAGE_YUV_I420, DG_IMAGE_BGR_PACKAGE or
+     * DG_IMAGE_RGB_PACKAGE, YUV is BT.601 limited range like ColorConvert. Chroma of YUV is
+     * sampled at nearest.
+     *
+     * \code{.cpp}
+     * PreprocessParams params;
+     * params.size_ = cv::Size(128, 256);
+     * std::vector<float> tensor(Preprocess::tensorSize(params, boxes.size()));
+     * std::vector<RoiScale> scales;
+     * Preprocess::run(frame, rois, params, tensor.data(), tensor.size(), scales);
+     * auto box = scales[i].toImage(detected);
+     * \endcode
+     */
+    class Preprocess {
+    public:
+        /**
+         * Elements of tensor of batch rois
+         */
+        static size_t tensorSize(const PreprocessParams &params, size_t batch) {
+            return batch * 3 * (size_t)params.size_.area();
+        }
+
+        /**
+         * Preprocess rois of img into tensor of capacity elements, an empty roi is the whole image
+         * @param scales mapping of each roi, returned
+         * @return DG_ERR_INVALID_PARAM if a roi is out of image or tensor is too small,
+         *         DG_ERR_NOT_SUPPORTED for other image types
+         */
+        static DgError run(const DgImage &img, const std::vector<cv::Rect> &rois, const PreprocessParams &params,
+                           float *tensor, size_t capacity, std::vector<RoiScale> &scales) {
+            return runAs(img, rois, params, tensor, capacity, scales);
+        }
+        /**
+         * Same as above for int8 models, values are rounded and saturated
+         */
+        static DgError run(const DgImage &img, const std::vector<cv::Rect> &rois, const PreprocessParams &params,
+                           int8_t *tensor, size_t capacity, std::vector<RoiScale> &scales) {
+            return runAs(img, rois, params, tensor, capacity, scales);
+        }
+
+    protected:
+        static inline void store(float v, float *out) {
+            *out = v;
+        }
+        static inline void store(float v, int8_t *out) {
+            auto q = (int)std::floor(v + 0.5f);
+            *out = (int8_t)(q < -128 ? -128 : (q > 127 ? 127 : q));
+        }
+
+        /**
+         * Source index and weight of next pixel for each output pixel
+         */
+        struct Axis {
+            std::vector<int> index_;
+            std::vector<int> next_;
+            std::vector<float> weight_;
+
+            Axis(int start, int len, int outLen, float scale) : index_(outLen), next_(outLen), weight_(outLen) {
+                for(auto o = 0; o < outLen; o++) {
+                    auto f = std::min(std::max(((float)o + 0.5f) / scale - 0.5f, 0.0f), (float)(len - 1));
+                    auto i = std::min((int)f, len - 1);
+                    index_[o] = start + i;
+                    next_[o] = start + std::min(i + 1, len - 1);
+                    weight_[o] = f - (float)i;
+                }
+            }
+        };
+
+        template <typename _Out>
+        static DgError runAs(const DgImage &img, const std::vector<cv::Rect> &rois, const PreprocessParams &params,
+                             _Out *tensor, size_t capacity, std::vector<RoiScale> &scales) {
+            auto type = img.type_;
+            if(type != DgImageType::DG_IMAGE_YUV_SP420 && type != DgImageType::DG_IMAGE_YUV_I420 &&
+               type != DgImageType::DG_IMAGE_BGR_PACKAGE && type != DgImageType::DG_IMAGE_RGB_PACKAGE) {
+                return DG_ERR_NOT_SUPPORTED;
+            }
+            auto batch = std::max<size_t>(rois.size(), 1);
+            if(params.size_.area() <= 0 || tensorSize(params, batch) > capacity) {
+                LOG(ERROR) << "Tensor of " << capacity << " elements less than " << tensorSize(params, batch);
+                return DG_ERR_INVALID_PARAM;
+            }
+            auto bounds = cv::Rect(cv::Point(), img.size_);
+            std::vector<cv::Rect> areas;
+            for(auto &roi : rois) {
+                auto area = roi.area() > 0 ? roi : bounds;
+                if((area & bounds) != area) {
+                    LOG(ERROR) << "Roi " << area << " out of image " << img.size_;
+                    return DG_ERR_INVALID_PARAM;
+                }
+                areas.push_back(area);
+            }
+            if(areas.empty()) areas.push_back(bounds);
+
+            scales.assign(areas.size(), RoiScale());
+            for(auto i = 0u; i < areas.size(); i++) {
+                auto &area = areas[i];
+                auto &s = scales[i];
+                s.origin_ = cv::Point2f((float)area.x, (float)area.y);
+                s.scale_x_ = (float)params.size_.width / (float)area.width;
+                s.scale_y_ = (float)params.size_.height / (float)area.height;
+                s.content_ = params.size_;
+                if(params.keep_ratio_) {
+                    s.scale_x_ = s.scale_y_ = std::min(s.scale_x_, s.scale_y_);
+                    s.content_.width = std::min(params.size_.width, (int)std::lround(area.width * s.scale_x_));
+                    s.content_.height = std::min(params.size_.height, (int)std::lround(area.height * s.scale_y_));
+                }
+            }
+
+            auto count = (int)areas.size();
+            auto threads = 1;
+#ifdef _OPENMP
+            if(params.threads_ != 1) {
+                threads = params.threads_ > 0 ? params.threads_ : omp_get_max_threads();
+            }
+#endif
+            threads = std::min(threads, count);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(dynamic) if(threads > 1)
+#endif
+            for(auto i = 0; i < count; i++) {
+                auto plane = (size_t)params.size_.area();
+                roi(img, areas[i], scales[i], params, tensor + plane * 3 * i);
+            }
+            return DG_OK;
+        }
+
+        template <typename _Out>
+        static void roi(const DgImage &img, const cv::Rect &area, const RoiScale &scale,
+                        const PreprocessParams &params, _Out *tensor) {
+            auto w = params.size_.width, h = params.size_.height;
+            auto plane = (size_t)w * h;
+            // channel of tensor holding B, G, R
+            int ch[3] = {0, 1, 2};
+            if(params.rgb_) std::swap(ch[0], ch[2]);
+            float pads[3];
+            for(auto c = 0; c < 3; c++) pads[c] = (params.pad_ - params.mean_[c]) * params.scale_[c];
+
+            Axis xs(area.x, area.width, scale.content_.width, scale.scale_x_);
+            Axis ys(area.y, area.height, scale.content_.height, scale.scale_y_);
+            auto &p0 = img.planes_[0];
+            auto packed = img.type_ == DgImageType::DG_IMAGE_BGR_PACKAGE || img.type_ == DgImageType::DG_IMAGE_RGB_PACKAGE;
+            auto swapRb = img.type_ == DgImageType::DG_IMAGE_RGB_PACKAGE;
+
+            for(auto oy = 0; oy < h; oy++) {
+                _Out *out[3];
+                for(auto c = 0; c < 3; c++) out[c] = tensor + plane * c + (size_t)oy * w;
+                if(oy >= scale.content_.height) {
+                    for(auto c = 0; c < 3; c++) {
+                        for(auto ox = 0; ox < w; ox++) store(pads[c], out[c] + ox);
+                    }
+                    continue;
+                }
+                auto wy = ys.weight_[oy];
+                auto *r0 = p0.ptr + (size_t)ys.index_[oy] * p0.stride_;
+                auto *r1 = p0.ptr + (size_t)ys.next_[oy] * p0.stride_;
+                const DG_U8 *u = nullptr, *v = nullptr;
+                int uvStep = 1;
+                if(!packed) {
+                    auto cy = (wy < 0.5f ? ys.index_[oy] : ys.next_[oy]) / 2;
+                    auto &p1 = img.planes_[1];
+                    if(img.type_ == DgImageType::DG_IMAGE_YUV_SP420) {
+                        u = p1.ptr + (size_t)cy * p1.stride_;
+                        v = u + 1;
+                        uvStep = 2;
+                    } else {
+                        auto &p2 = img.planes_[2];
+                        u = p1.ptr + (size_t)cy * p1.stride_;
+                        v = p2.ptr + (size_t)cy * p2.stride_;
+                    }
+                }
+
+                for(auto ox = 0; ox < scale.content_.width; ox++) {
+                    auto x0 = xs.index_[ox], x1 = xs.next_[ox];
+                    auto wx = xs.weight_[ox];
+                    auto w00 = (1 - wx) * (1 - wy), w01 = wx * (1 - wy), w10 = (1 - wx) * wy, w11 = wx * wy;
+                    float bgr[3];
+                    if(packed) {
+                        for(auto c = 0; c < 3; c++) {
+                            bgr[c] = w00 * r0[x0 * 3 + c] + w01 * r0[x1 * 3 + c] + w10 * r1[x0 * 3 + c] + w11 * r1[x1 * 3 + c];
+                        }
+                        if(swapRb) std::swap(bgr[0], bgr[2]);
+                    } else {
+                        // same coefficients as ColorConvert
+                        auto yy = (w00 * r0[x0] + w01 * r0[x1] + w10 * r1[x0] + w11 * r1[x1] - 16) * 74;
+                        auto cx = (wx < 0.5f ? x0 : x1) / 2 * uvStep;
+                        auto cu = (float)(u[cx] - 128), cv = (float)(v[cx] - 128);
+                        bgr[0] = (yy + 129 * cu) / 64;
+                        bgr[1] = (yy - 25 * cu - 52 * cv) / 64;
+                        bgr[2] = (yy + 102 * cv) / 64;
+                        for(auto &val : bgr) val = std::min(std::max(val, 0.0f), 255.0f);
+                    }
+                    for(auto c = 0; c < 3; c++) {
+                        auto t = ch[c];
+                        store((bgr[c] - params.mean_[t]) * params.scale_[t], out[t] + ox);
+                    }
+                }
+                for(auto c = 0; c < 3; c++) {
+                    for(auto ox = scale.content_.width; ox < w; ox++) store(pads[c], out[c] + ox);
+                }
+            }
+        }
+    };
+}
+
+#endif //VEGA_PREPROCESS_H
@@ -0,0 +1,349 @@
+#ifndef VEGA_PRIORITY_H
+#define VEGA_PRIORITY_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include "interface_base.h"
+#include "vega_router.h"
+#include "vega_time_pnt.h"
+
+namespace vega {
+
+    /**
+     * Priority lanes over one interface.
+     *
+     * Single tasks are submitted into lanes, lane 0 is the most urgent. Each batch is filled
+     * from lane 0 first, then lane 1 and so on, so real-time tasks skip over queued bulk work.
+     * To keep bulk work moving, a quarter of each batch(at least 1 task) is reserved for tasks
+     * that have waited for starve time, which are taken before all other lanes, oldest first.
+     *
+     * Batches are held here until one of in flight batches ends, so that tasks wait in lanes
+     * where priority applies, instead of the device queue. A batch is sent once it's full or
+     * its oldest task has waited for max wait time.
+     *
+     * If task has tp_grp_, "laneN.queue" is marked on submission and "laneN.sent" when task is
+     * sent, at VEGA_TP_LEVEL_OUTLINE. Queueing delay of each lane is also summarized by stats().
+     *
+     * \code{.cpp}
+     * auto detector = std::make_shared<PriorityExecutable<DetectTask>>(
+     *     [&](DetectInterface::AsyncCallback cb) {
+     *         return createDetectInterface(0, cfgPath, "", nullptr, cb);
+     *     }, nullptr);
+     * detector->submit(liveTask, 0, onLive);
+     * detector->submit(archiveTask, 1, onArchive);
+     * \endcode
+     */
+    template <typename _Task>
+    class PriorityExecutable : public Executable<_Task> {
+    public:
+        using Base = Executable<_Task>;
+        using Tasks = std::vector<std::shared_ptr<_Task>>;
+        /**
+         * Callback of a single task, error is the result of this task
+         */
+        using TaskCallback = std::function<void(std::shared_ptr<_Task> &task, DgError error)>;
+
+        struct LaneStats {
+            long tasks_ = 0;            ///<! tasks sent from this lane
+            long promoted_ = 0;         ///<! tasks sent ahead of other lanes because of starving
+            double wait_ms_ = 0;        ///<! total time tasks waited in lane
+            double max_wait_ms_ = 0;    ///<! longest time a task waited in lane
+            int queued_ = 0;            ///<! current tasks in lane
+        };
+
+    public:
+        /**
+         * @param creator creates the wrapped interface
+         * @param callback callback of tasks sent by execute(), can be nullptr if only submit() is used
+         * @param lanes number of lanes, at least 2
+         * @param maxWaitUs max time in microsecond a task waits for batch to be filled
+         * @param starveMs time in millisecond after which a task may take reserved slots of batch
+         * @param inFlight max batches in execution
+         * @param batchSize batch size, 0 to use getBatchSize() of wrapped interface
+         */
+        PriorityExecutable(typename Base::Creator creator, typename Base::AsyncCallback callback,
+                           int lanes = 2, int maxWaitUs = 2000, int starveMs = 200,
+                           int inFlight = 1, int batchSize = 0)
+                : callback_(callback), max_wait_(maxWaitUs), starve_(std::chrono::milliseconds(starveMs)),
+                  max_in_flight_(inFlight) {
+            CHECK(lanes >= 2) << "Invalid lanes " << lanes;
+            CHECK(max_in_flight_ > 0) << "Invalid in flight " << max_in_flight_;
+            inner_ = creator(router_.callback());
+            CHECK(inner_) << "Create interface fail";
+
+            batch_size_ = batchSize > 0 ? batchSize : inner_->getBatchSize();
+            if(batch_size_ <= 0) {
+                LOG(ERROR) << "Invalid batch size " << batch_size_ << ", use 1";
+                batch_size_ = 1;
+            }
+
+            lanes_.resize(lanes);
+            stats_.resize(lanes);
+            for(auto i = 0; i < lanes; i++) {
+                queue_pnt_.push_back("lane" + std::to_string(i) + ".queue");
+                sent_pnt_.push_back("lane" + std::to_string(i) + ".sent");
+            }
+            thread_ = std::make_shared<std::thread>(&PriorityExecutable::gather, this);
+        }
+        ~PriorityExecutable() override {
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                end_ = true;
+                cv_.notify_all();
+            }
+            thread_->join();
+            inner_.reset();
+        }
+
+    public:
+        int getBatchSize() override {
+            return batch_size_;
+        }
+        DgError sendCommand(const std::string &cmd, const std::string &param, std::map<std::string, std::string> &result) override {
+            return inner_->sendCommand(cmd, param, result);
+        }
+
+        using Base::execute;
+        /**
+         * Tasks go to lane 0
+         */
+        DgError execute(Tasks &tasks) override {
+            return execute(tasks, 0);
+        }
+        /**
+         * Tasks go to given lane, callback given on construction is called when all of them end.
+         * DG_ERR_INVALID_PARAM for an invalid lane, DG_ERR_SERVICE_NOT_AVAILABLE once ending.
+         */
+        DgError execute(Tasks &tasks, int lane) {
+            if(tasks.empty()) {
+                return DG_ERR_INVALID_PARAM;
+            }
+            CHECK(callback_) << "Callback is required by execute()";
+            if(lane < 0 || lane >= (int)lanes_.size()) {
+                LOG(ERROR) << "Invalid lane " << lane;
+                return DG_ERR_INVALID_PARAM;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                if(end_) {
+                    return DG_ERR_SERVICE_NOT_AVAILABLE;
+                }
+            }
+
+            auto join = std::make_shared<Join>();
+            join->tasks_ = tasks;
+            join->left_ = (int)tasks.size();
+            auto callback = callback_;
+            for(auto i = 0u; i < tasks.size(); i++) {
+                auto err = submit(tasks[i], lane, [join, callback](std::shared_ptr<_Task> &, DgError error) {
+                    if(error != DG_OK) {
+                        join->error_ = error;
+                    }
+                    if(--join->left_ == 0) {
+                        callback(join->tasks_, (DgError)join->error_.load());
+                    }
+                });
+                if(err == DG_OK) {
+                    continue;
+                }
+                if(i == 0) {
+                    // nothing submitted, callback is not called
+                    return err;
+                }
+                // ending after part of tasks was submitted, remaining tasks end with err
+                for(auto j = i; j < tasks.size(); j++) {
+                    tasks[j]->error_ = err;
+                }
+                join->error_ = err;
+                if((join->left_ -= (int)(tasks.size() - i)) == 0) {
+                    callback(join->tasks_, err);
+                }
+                break;
+            }
+            return DG_OK;
+        }
+
+        /**
+         * Submit a single task into lane, callback is called when task ends
+         */
+        DgError submit(const std::shared_ptr<_Task> &task, int lane, TaskCallback callback) {
+            if(lane < 0 || lane >= (int)lanes_.size()) {
+                LOG(ERROR) << "Invalid lane " << lane;
+                return DG_ERR_INVALID_PARAM;
+            }
+            if(task->tp_grp_) {
+                task->tp_grp_->append(queue_pnt_[lane], VEGA_TP_LEVEL_OUTLINE);
+            }
+
+            std::lock_guard<std::mutex> lock(mtx_);
+            if(end_) {
+                return DG_ERR_SERVICE_NOT_AVAILABLE;
+            }
+            Pending pending;
+            pending.task_ = task;
+            pending.callback_ = std::move(callback);
+            pending.enqueued_ = std::chrono::steady_clock::now();
+            lanes_[lane].push_back(std::move(pending));
+            ++queued_;
+            cv_.notify_one();
+            return DG_OK;
+        }
+
+        inline int lanes() { return (int)lanes_.size(); }
+
+        LaneStats stats(int lane) {
+            std::lock_guard<std::mutex> lock(mtx_);
+            auto st = stats_[lane];
+            st.queued_ = (int)lanes_[lane].size();
+            return st;
+        }
+
+    protected:
+        using Clock = std::chrono::steady_clock;
+
+        struct Pending {
+            std::shared_ptr<_Task> task_;
+            TaskCallback callback_;
+            Clock::time_point enqueued_;
+        };
+        struct Join {
+            Tasks tasks_;
+            std::atomic<int> left_{0};
+            std::atomic<int> error_{DG_OK};
+        };
+
+        /**
+         * Lane of the oldest front task, -1 if all lanes are empty, lock held
+         */
+        int oldestLane() {
+            int oldest = -1;
+            for(auto i = 0; i < (int)lanes_.size(); i++) {
+                if(lanes_[i].empty()) continue;
+                if(oldest < 0 || lanes_[i].front().enqueued_ < lanes_[oldest].front().enqueued_) oldest = i;
+            }
+            return oldest;
+        }
+
+        /**
+         * Move front task of lane into batch, lock held
+         */
+        void take(int lane, const Clock::time_point &now, std::vector<Pending> &batch, std::vector<int> &from) {
+            auto &p = lanes_[lane].front();
+            auto ms = std::chrono::duration<double, std::milli>(now - p.enqueued_).count();
+            auto &st = stats_[lane];
+            ++st.tasks_;
+            st.wait_ms_ += ms;
+            st.max_wait_ms_ = std::max(st.max_wait_ms_, ms);
+
+            batch.push_back(std::move(p));
+            from.push_back(lane);
+            lanes_[lane].pop_front();
+            --queued_;
+        }
+
+        void gather() {
+            std::unique_lock<std::mutex> lock(mtx_);
+            while(true) {
+                cv_.wait(lock, [this]() { return end_ || (queued_ > 0 && in_flight_ < max_in_flight_); });
+                if(queued_ == 0) {
+                    break;  // ending
+                }
+
+                auto now = Clock::now();
+                auto deadline = lanes_[oldestLane()].front().enqueued_ + max_wait_;
+                if(queued_ < batch_size_ && now < deadline && !end_) {
+                    cv_.wait_until(lock, deadline);
+                    continue;
+                }
+
+                std::vector<Pending> batch;
+                std::vector<int> from;
+                batch.reserve(batch_size_);
+                from.reserve(batch_size_);
+
+                // starving tasks first, oldest first, within reserved slots
+                auto reserved = std::max(1, batch_size_ / 4);
+                while((int)batch.size() < reserved) {
+                    auto lane = oldestLane();
+                    if(lane < 0 || now - lanes_[lane].front().enqueued_ < starve_) break;
+                    if(lane != 0) ++stats_[lane].promoted_;
+                    take(lane, now, batch, from);
+                }
+                for(auto lane = 0; lane < (int)lanes_.size() && (int)batch.size() < batch_size_; lane++) {
+                    while(!lanes_[lane].empty() && (int)batch.size() < batch_size_) {
+                        take(lane, now, batch, from);
+                    }
+                }
+
+                ++in_flight_;
+                lock.unlock();
+                dispatch(batch, from);
+                lock.lock();
+            }
+        }
+
+        void dispatch(std::vector<Pending> &batch, std::vector<int> &from) {
+            Tasks tasks;
+            tasks.reserve(batch.size());
+            auto callbacks = std::make_shared<std::vector<TaskCallback>>();
+            callbacks->reserve(batch.size());
+            for(auto i = 0u; i < batch.size(); i++) {
+                if(batch[i].task_->tp_grp_) {
+                    batch[i].task_->tp_grp_->append(sent_pnt_[from[i]], VEGA_TP_LEVEL_OUTLINE);
+                }
+                tasks.push_back(std::move(batch[i].task_));
+                callbacks->push_back(std::move(batch[i].callback_));
+            }
+
+            auto error = router_.execute(*inner_, tasks, [this, callbacks](Tasks &done, DgError err) {
+                release();
+                for(auto i = 0u; i < done.size() && i < callbacks->size(); i++) {
+                    auto taskError = err == DG_OK ? DG_OK :
+                            (done[i]->error_ == DG_ON_GOING ? err : done[i]->error_);
+                    (*callbacks)[i](done[i], taskError);
+                }
+            });
+            if(error != DG_OK) {
+                LOG(ERROR) << "Execute batch of " << tasks.size() << " fail: " << error;
+                release();
+                for(auto i = 0u; i < tasks.size(); i++) {
+                    tasks[i]->error_ = error;
+                    (*callbacks)[i](tasks[i], error);
+                }
+            }
+        }
+
+        void release() {
+            std::lock_guard<std::mutex> lock(mtx_);
+            --in_flight_;
+            cv_.notify_one();
+        }
+
+    protected:
+        CallbackRouter<_Task> router_;      ///<! must be destroyed after inner_
+        std::shared_ptr<Base> inner_;
+        typename Base::AsyncCallback callback_;
+        int batch_size_ = 0;
+        std::chrono::microseconds max_wait_;
+        Clock::duration starve_;
+        int max_in_flight_;
+
+        std::mutex mtx_;
+        std::condition_variable cv_;
+        std::vector<std::deque<Pending>> lanes_;
+        int queued_ = 0;
+        int in_flight_ = 0;
+        bool end_ = false;
+        std::vector<LaneStats> stats_;
+        std::vector<std::string> queue_pnt_;
+        std::vector<std::string> sent_pnt_;
+        std::shared_ptr<std::thread> thread_;
+    };
+}
+
+#endif //VEGA_PRIORITY_H
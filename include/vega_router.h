@@ -0,0 +1,98 @@
+#ifndef VEGA_ROUTER_H
+#define VEGA_ROUTER_H
+
+#include <mutex>
+#include <unordered_map>
+#include "interface_base.h"
+
+namespace vega {
+
+    /**
+     * Route async callback of an interface to a completion given on each execute call.
+     *
+     * Interface callback is fixed on creation, wrappers over Executable create their
+     * interface with CallbackRouter::callback() and send batches by CallbackRouter::execute,
+     * then each batch returns to its own completion. Batch is identified by its first task.
+     *
+     * Router must outlive the interface created with its callback.
+     */
+    template <typename _Task>
+    class CallbackRouter {
+    public:
+        using Tasks = std::vector<std::shared_ptr<_Task>>;
+        using Completion = std::function<void(Tasks &tasks, DgError error)>;
+
+        CallbackRouter() = default;
+        CallbackRouter(const CallbackRouter &) = delete;
+        CallbackRouter &operator = (const CallbackRouter &) = delete;
+
+        /**
+         * Callback to create interface with
+         */
+        typename Executable<_Task>::AsyncCallback callback() {
+            return [this](Tasks &tasks, DgError error) {
+                route(tasks, error);
+            };
+        }
+
+        /**
+         * Execute tasks on iface, done will be called when batch ends.
+         * done is not called if execute fails, DG_ERR_INVALID_PARAM if first task of tasks is already
+         * in execution.
+         */
+        DgError execute(Executable<_Task> &iface, Tasks &tasks, Completion done) {
+            CHECK(!tasks.empty()) << "Empty batch";
+            auto key = tasks[0].get();
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                if(pending_.find(key) != pending_.end()) {
+                    LOG(ERROR) << "Task is already in execution";
+                    return DG_ERR_INVALID_PARAM;
+                }
+                pending_.emplace(key, std::move(done));
+            }
+
+            auto error = iface.execute(tasks);
+            if(error != DG_OK) {
+                std::lock_guard<std::mutex> lock(mtx_);
+                pending_.erase(key);
+            }
+            return error;
+        }
+
+        /**
+         * Number of batches in execution
+         */
+        inline size_t pending() {
+            std::lock_guard<std::mutex> lock(mtx_);
+            return pending_.size();
+        }
+
+    protected:
+        void route(Tasks &tasks, DgError error) {
+            if(tasks.empty()) {
+                LOG(ERROR) << "Callback with empty batch, error " << error;
+                return;
+            }
+
+            Completion done;
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                auto it = pending_.find(tasks[0].get());
+                if(it == pending_.end()) {
+                    LOG(ERROR) << "Callback of unknown batch, error " << error;
+                    return;
+                }
+                done = std::move(it->second);
+                pending_.erase(it);
+            }
+            done(tasks, error);
+        }
+
+    protected:
+        std::mutex mtx_;
+        std::unordered_map<_Task *, Completion> pending_;
+    };
+}
+
+#endif //VEGA_ROUTER_H
@@ -0,0 +1,287 @@
+#ifndef VEGA_SHARDING_H
+#define VEGA_SHARDING_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <unordered_map>
+#include "interface_base.h"
+#include "vega_option_store.h"
+#include "vega_router.h"
+
+namespace vega {
+
+    /**
+     * How tasks are kept on instances
+     */
+    enum class ShardAffinity {
+        NONE = 0,   ///<! every batch goes to the least loaded instance
+        STREAM = 1, ///<! tasks with valid stream_id_ always go to the instance their stream first went to
+    };
+
+    /**
+     * Multiple instances of one interface behaving as a single interface.
+     *
+     * All instances are created by the same creator. Each batch is routed to the least
+     * loaded instance, load is estimated by batches in flight and moving average latency
+     * of each instance.
+     *
+     * With ShardAffinity::STREAM, a stream sticks to one instance, which is required by
+     * interfaces keeping per-stream state like video decoding. New streams go to the
+     * instance with fewest streams. Stream is released by unpin(), or when a task with
+     * Option::video_eos_ ends. A batch containing streams on different instances is
+     * split, and callback is still called once with the whole batch; error of a part
+     * is set to its tasks and returned by callback instead of execute().
+     *
+     * \code{.cpp}
+     * auto decoder = std::make_shared<ShardedExecutable<DecodeTask>>(
+     *     [&](DecodeInterface::AsyncCallback cb) {
+     *         return createDecodeInterface(0, "", Model::decode_frame, nullptr, cb);
+     *     }, 4, onDecode, ShardAffinity::STREAM);
+     * \endcode
+     */
+    template <typename _Task>
+    class ShardedExecutable : public Executable<_Task> {
+    public:
+        using Base = Executable<_Task>;
+        using Tasks = std::vector<std::shared_ptr<_Task>>;
+
+        struct ShardStats {
+            long batches_ = 0;      ///<! batches sent
+            int in_flight_ = 0;     ///<! batches in execution
+            double latency_ms_ = 0; ///<! moving average of batch latency
+            int streams_ = 0;       ///<! streams pinned
+        };
+
+    public:
+        /**
+         * @param creator creates each instance
+         * @param shards number of instances
+         * @param callback callback of batches
+         * @param affinity see ShardAffinity
+         */
+        ShardedExecutable(typename Base::Creator creator, int shards, typename Base::AsyncCallback callback,
+                          ShardAffinity affinity = ShardAffinity::NONE)
+                : callback_(callback), affinity_(affinity) {
+            CHECK(shards > 0) << "Invalid shards " << shards;
+            CHECK(callback_) << "Callback is required";
+            shards_.resize(shards);
+            for(auto &shard : shards_) {
+                shard.iface_ = creator(router_.callback());
+                CHECK(shard.iface_) << "Create interface fail";
+            }
+        }
+        ~ShardedExecutable() override {
+            for(auto &shard : shards_) {
+                shard.iface_.reset();
+            }
+        }
+
+    public:
+        int getBatchSize() override {
+            return shards_[0].iface_->getBatchSize();
+        }
+        /**
+         * Commands are sent to first instance
+         */
+        DgError sendCommand(const std::string &cmd, const std::string &param, std::map<std::string, std::string> &result) override {
+            return shards_[0].iface_->sendCommand(cmd, param, result);
+        }
+
+        using Base::execute;
+        DgError execute(Tasks &tasks) override {
+            if(tasks.empty()) {
+                return DG_ERR_INVALID_PARAM;
+            }
+
+            std::vector<int> targets(tasks.size());
+            int first = -1;
+            bool split = false;
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                int idle = -1;
+                for(auto i = 0u; i < tasks.size(); i++) {
+                    auto sid = tasks[i]->stream_id_;
+                    if(affinity_ == ShardAffinity::STREAM && sid != INVALID_STREAM_ID) {
+                        targets[i] = pin(sid);
+                    } else {
+                        if(idle < 0) idle = leastLoaded();
+                        targets[i] = idle;
+                    }
+                    if(first < 0) first = targets[i];
+                    split |= targets[i] != first;
+                }
+            }
+
+            if(!split) {
+                return send(first, tasks, nullptr);
+            }
+
+            std::vector<Tasks> groups(shards_.size());
+            for(auto i = 0u; i < tasks.size(); i++) {
+                groups[targets[i]].push_back(tasks[i]);
+            }
+            auto join = std::make_shared<Join>();
+            join->tasks_ = tasks;
+            for(auto &group : groups) {
+                if(!group.empty()) ++join->left_;
+            }
+
+            // once split, callback is always called, failed parts end with their error
+            for(auto s = 0u; s < groups.size(); s++) {
+                if(groups[s].empty()) continue;
+                auto error = send((int)s, groups[s], join);
+                if(error != DG_OK) {
+                    LOG(ERROR) << "Execute on shard " << s << " fail: " << error;
+                    for(auto &task : groups[s]) {
+                        task->error_ = error;
+                    }
+                    join->error_ = error;
+                    finish(join);
+                }
+            }
+            return DG_OK;
+        }
+
+        /**
+         * Release stream affinity, next task of this stream may go to another instance
+         */
+        void unpin(StreamId sid) {
+            std::lock_guard<std::mutex> lock(mtx_);
+            auto it = pinned_.find(sid);
+            if(it != pinned_.end()) {
+                --shards_[it->second].streams_;
+                pinned_.erase(it);
+            }
+        }
+
+        inline int shards() { return (int)shards_.size(); }
+
+        ShardStats stats(int shard) {
+            std::lock_guard<std::mutex> lock(mtx_);
+            auto &s = shards_[shard];
+            ShardStats st;
+            st.batches_ = s.batches_;
+            st.in_flight_ = s.in_flight_;
+            st.latency_ms_ = s.latency_ms_;
+            st.streams_ = s.streams_;
+            return st;
+        }
+
+    protected:
+        struct Shard {
+            std::shared_ptr<Base> iface_;
+            long batches_ = 0;
+            int in_flight_ = 0;
+            double latency_ms_ = 1.0;   ///<! prior before first batch returns
+            int streams_ = 0;
+        };
+        struct Join {
+            Tasks tasks_;
+            std::atomic<int> left_{0};
+            std::atomic<int> error_{DG_OK};
+        };
+
+        /**
+         * Moving average weight of latest batch
+         */
+        static constexpr double LATENCY_ALPHA = 0.2;
+
+        /**
+         * Expected time to finish one more batch, lock held
+         */
+        inline double load(const Shard &s) { return (s.in_flight_ + 1) * s.latency_ms_; }
+
+        int leastLoaded() {
+            int best = 0;
+            for(auto i = 1; i < (int)shards_.size(); i++) {
+                if(load(shards_[i]) < load(shards_[best])) best = i;
+            }
+            return best;
+        }
+
+        int pin(StreamId sid) {
+            auto it = pinned_.find(sid);
+            if(it != pinned_.end()) return it->second;
+
+            int best = 0;
+            for(auto i = 1; i < (int)shards_.size(); i++) {
+                auto &s = shards_[i], &b = shards_[best];
+                if(s.streams_ < b.streams_ || (s.streams_ == b.streams_ && load(s) < load(b))) best = i;
+            }
+            ++shards_[best].streams_;
+            pinned_[sid] = best;
+            return best;
+        }
+
+        DgError send(int shard, Tasks &tasks, std::shared_ptr<Join> join) {
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                ++shards_[shard].in_flight_;
+            }
+            auto start = std::chrono::steady_clock::now();
+            auto error = router_.execute(*shards_[shard].iface_, tasks, [this, shard, start, join](Tasks &done, DgError err) {
+                auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                onDone(shard, ms, done);
+                if(join) {
+                    if(err != DG_OK) join->error_ = err;
+                    finish(join);
+                } else {
+                    callback_(done, err);
+                }
+            });
+
+            std::lock_guard<std::mutex> lock(mtx_);
+            if(error == DG_OK) {
+                ++shards_[shard].batches_;
+            } else {
+                --shards_[shard].in_flight_;
+            }
+            return error;
+        }
+
+        void onDone(int shard, double ms, Tasks &done) {
+            bool eos = false;
+            if(affinity_ == ShardAffinity::STREAM) {
+                for(auto &task : done) {
+                    eos |= task->getBool(OptionKeys::video_eos_(), false);
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(mtx_);
+            auto &s = shards_[shard];
+            --s.in_flight_;
+            s.latency_ms_ = s.latency_ms_ * (1 - LATENCY_ALPHA) + ms * LATENCY_ALPHA;
+            if(eos) {
+                for(auto &task : done) {
+                    if(!task->getBool(OptionKeys::video_eos_(), false)) continue;
+                    auto it = pinned_.find(task->stream_id_);
+                    if(it != pinned_.end()) {
+                        --shards_[it->second].streams_;
+                        pinned_.erase(it);
+                    }
+                }
+            }
+        }
+
+        void finish(const std::shared_ptr<Join> &join) {
+            if(--join->left_ == 0) {
+                callback_(join->tasks_, (DgError)join->error_.load());
+            }
+        }
+
+    protected:
+        CallbackRouter<_Task> router_;      ///<! must be destroyed after instances
+        std::vector<Shard> shards_;
+        typename Base::AsyncCallback callback_;
+        ShardAffinity affinity_;
+
+        std::mutex mtx_;
+        std::unordered_map<StreamId, int> pinned_;
+    };
+
+    template <typename _Task>
+    constexpr double ShardedExecutable<_Task>::LATENCY_ALPHA;
+}
+
+#endif //VEGA_SHARDING_H
@@ -0,0 +1,145 @@
+#ifndef VEGA_TASK_REFS_H
+#define VEGA_TASK_REFS_H
+
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "interface_base.h"
+#include "vega_router.h"
+
+namespace vega {
+
+    /**
+     * References tasks need while they are executed, like FrameHandle of the frame a task
+     * reads or the buffer of its data_, kept by task pointer outside of tasks.
+     *
+     * A task may hold any number of references, they are dropped together when task is
+     * called back. Tasks must be dropped once done, or failed to execute, before they are
+     * destroyed or reused, see TaskRefExecutable which does it.
+     */
+    class TaskRefs {
+    public:
+        using Ref = std::shared_ptr<const void>;
+
+        TaskRefs() = default;
+        TaskRefs(const TaskRefs &) = delete;
+        TaskRefs &operator = (const TaskRefs &) = delete;
+
+    public:
+        void hold(const SdkTaskBase &task, Ref ref) {
+            if(!ref) return;
+            std::lock_guard<std::mutex> lock(mtx_);
+            refs_[&task].push_back(std::move(ref));
+        }
+
+        /**
+         * Drop references of tasks, they are released out of lock, e.g. frames
+         * of FrameHandle are freed
+         */
+        template <typename _Task>
+        void drop(const std::vector<std::shared_ptr<_Task>> &tasks) {
+            std::vector<Ref> dropped;
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                for(auto &task : tasks) {
+                    take(task.get(), dropped);
+                }
+            }
+        }
+        void drop(const SdkTaskBase &task) {
+            std::vector<Ref> dropped;
+            std::lock_guard<std::mutex> lock(mtx_);
+            take(&task, dropped);
+        }
+
+        /**
+         * Tasks holding references
+         */
+        inline size_t size() {
+            std::lock_guard<std::mutex> lock(mtx_);
+            return refs_.size();
+        }
+
+    protected:
+        void take(const SdkTaskBase *task, std::vector<Ref> &dropped) {
+            auto it = refs_.find(task);
+            if(it == refs_.end()) return;
+            for(auto &ref : it->second) {
+                dropped.push_back(std::move(ref));
+            }
+            refs_.erase(it);
+        }
+
+    protected:
+        std::mutex mtx_;
+        std::unordered_map<const SdkTaskBase *, std::vector<Ref>> refs_;
+    };
+
+    /**
+     * Interface keeping references of tasks until their batch is called back, so frames
+     * and buffers bound to tasks live exactly as long as the tasks are in execution:
+     *
+     * \code{.cpp}
+     * auto detector = std::make_shared<TaskRefExecutable<DetectTask>>([&](DetectInterface::AsyncCallback cb) {
+     *     return createDetectInterface(0, cfgPath, "", nullptr, cb);
+     * }, onDetect);
+     * frame.bind(*task, detector->refs());       // frame is freed after onDetect returns
+     * detector->execute(tasks);
+     * \endcode
+     */
+    template <typename _Task>
+    class TaskRefExecutable : public Executable<_Task> {
+    public:
+        using Base = Executable<_Task>;
+        using Tasks = std::vector<std::shared_ptr<_Task>>;
+
+    public:
+        TaskRefExecutable(typename Base::Creator creator, typename Base::AsyncCallback callback)
+                : callback_(callback) {
+            CHECK(callback_) << "Callback is required";
+            inner_ = creator(router_.callback());
+            CHECK(inner_) << "Create interface fail";
+        }
+        ~TaskRefExecutable() override {
+            inner_.reset();
+        }
+
+    public:
+        int getBatchSize() override {
+            return inner_->getBatchSize();
+        }
+        DgError sendCommand(const std::string &cmd, const std::string &param, std::map<std::string, std::string> &result) override {
+            return inner_->sendCommand(cmd, param, result);
+        }
+
+        using Base::execute;
+        /**
+         * References of tasks are dropped after callback, or at once if execute fails
+         */
+        DgError execute(Tasks &tasks) override {
+            if(tasks.empty()) {
+                return DG_ERR_INVALID_PARAM;
+            }
+            auto error = router_.execute(*inner_, tasks, [this](Tasks &done, DgError err) {
+                callback_(done, err);
+                refs_.drop(done);
+            });
+            if(error != DG_OK) {
+                refs_.drop(tasks);
+            }
+            return error;
+        }
+
+        inline TaskRefs &refs() {
+            return refs_;
+        }
+
+    protected:
+        TaskRefs refs_;                     ///<! must be destroyed after inner_, which may still call back
+        CallbackRouter<_Task> router_;      ///<! must be destroyed after inner_
+        std::shared_ptr<Base> inner_;
+        typename Base::AsyncCallback callback_;
+    };
+}
+
+#endif //VEGA_TASK_REFS_H
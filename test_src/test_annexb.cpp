@@ -0,0 +1,63 @@
+//
+// Gbit/s of splitting an Annex-B H.264/H.265 file into access units, memory mapped and streamed in pieces
+//
+
+#include "vega_annexb.h"
+#include "vega_time_pnt.h"
+
+#include <fstream>
+#include <iterator>
+
+using namespace vega;
+
+int main(int argc, char *argv[]) {
+    if(argc < 2) {
+        LOG(ERROR) << "Usage: " << argv[0] << " <h264|h265 file> [h265] [rounds] [piece bytes]";
+        return 2;
+    }
+    auto codec = argc > 2 && atoi(argv[2]) ? SdkImage::H265 : SdkImage::H264;
+    int rounds = argc > 3 ? atoi(argv[3]) : 20;
+    int piece = argc > 4 ? atoi(argv[4]) : 1400;
+    CHECK(rounds > 0 && piece > 0);
+
+    std::vector<AccessUnit> units;
+    CHECK(splitAnnexBFile(argv[1], codec, units) == DG_OK);
+    CHECK(!units.empty()) << "No access unit in " << argv[1];
+    auto bytes = (size_t)(units.back().data_ + units.back().len_ - units.front().data_);
+    long keys = 0, params = 0;
+    for(auto &unit : units) {
+        keys += unit.key_;
+        params += unit.params_;
+    }
+    LOG(ERROR) << argv[1] << ": " << bytes << " bytes, " << units.size() << " access units, "
+               << keys << " key, " << params << " with parameter sets";
+
+    // whole file in memory
+    std::ifstream ifs(argv[1], std::ios::binary);
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    VegaTmPnt start("start");
+    for(auto r = 0; r < rounds; r++) {
+        std::vector<AccessUnit> out;
+        AnnexBParser parser(codec);
+        parser.parse(data.data(), data.size(), true, out);
+        CHECK(out.size() == units.size());
+    }
+    auto whole = (VegaTmPnt("stop") - start) / rounds;
+
+    // pieces like network packets
+    start.mark();
+    for(auto r = 0; r < rounds; r++) {
+        std::vector<AccessUnit> out;
+        AnnexBStream stream(codec);
+        for(size_t i = 0; i < data.size(); i += piece) {
+            stream.append(data.data() + i, std::min(data.size() - i, (size_t)piece), out);
+        }
+        stream.finish(out);
+        CHECK(out.size() == units.size());
+    }
+    auto pieces = (VegaTmPnt("stop") - start) / rounds;
+
+    LOG(ERROR) << "whole:  " << whole << " ms, " << data.size() * 8 / whole / 1e6 << " Gbit/s";
+    LOG(ERROR) << "pieces of " << piece << ": " << pieces << " ms, " << data.size() * 8 / pieces / 1e6 << " Gbit/s";
+    return 0;
+}
@@ -0,0 +1,128 @@
+//
+// Benchmark of BatchingExecutable against direct execute() with single task batches
+//
+
+#include "vega_interface.h"
+#include "vega_batching.h"
+#include "vega_mock_device.h"
+#include "vega_time_pnt.h"
+#include <zfz/zfz_event.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+
+using namespace vega;
+
+struct Result {
+    double seconds = 0;
+    std::vector<double> latency;    // ms
+    double fill_rate = 0;
+};
+
+void report(const std::string &name, Result &r) {
+    std::sort(r.latency.begin(), r.latency.end());
+    auto pct = [&](double p) { return r.latency[(size_t)((r.latency.size() - 1) * p)]; };
+    LOG(ERROR) << name << ": " << r.latency.size() / r.seconds << " tasks/s, fill rate " << r.fill_rate
+               << ", latency p50 " << pct(0.5) << " ms, p99 " << pct(0.99) << " ms, max " << r.latency.back() << " ms";
+}
+
+/**
+ * Each producer sends count single tasks at given fps
+ */
+template <typename _Send>
+void produce(int producers, int count, int fps, _Send send) {
+    std::vector<std::thread> threads;
+    for(auto p = 0; p < producers; p++) {
+        threads.emplace_back([=]() {
+            auto intv = std::chrono::microseconds(1000000 / fps);
+            auto next = std::chrono::steady_clock::now();
+            for(auto i = 0; i < count; i++) {
+                send(p * count + i);
+                next += intv;
+                std::this_thread::sleep_until(next);
+            }
+        });
+    }
+    for(auto &th : threads) th.join();
+}
+
+int main(int argc, char *argv[]) {
+    if(argc < 3) {
+        LOG(ERROR) << "Usage: " << argv[0] << " <producers> <fps> [batch_size] [max_wait_us] [count]";
+        return 2;
+    }
+    int producers = atoi(argv[1]);
+    int fps = atoi(argv[2]);
+    int batchSize = argc > 3 ? atoi(argv[3]) : 16;
+    int maxWaitUs = argc > 4 ? atoi(argv[4]) : 5000;
+    int count = argc > 5 ? atoi(argv[5]) : 250;
+    CHECK(producers > 0 && fps > 0 && batchSize > 0 && count > 0);
+
+    MockLatency latency;
+    latency.fixed_us_ = 4000;
+    latency.per_task_us_ = 200;
+    int total = producers * count;
+
+    // direct execute, one task a batch
+    {
+        Result r;
+        std::vector<VegaTmPnt> sent(total);
+        r.latency.resize(total);
+        std::atomic<int> done{0};
+        zfz::Event evt;
+        auto detector = std::make_shared<MockExecutable<DetectTask>>(batchSize, latency,
+                [&](std::vector<std::shared_ptr<DetectTask>> &tasks, DgError) {
+                    VegaTmPnt now("done");
+                    for(auto &task : tasks) {
+                        auto idx = (long)task->user_data_;
+                        r.latency[idx] = now - sent[idx];
+                    }
+                    if((done += (int)tasks.size()) == total) evt.set();
+                });
+
+        VegaTmPnt start("start");
+        produce(producers, count, fps, [&](int idx) {
+            std::vector<std::shared_ptr<DetectTask>> tasks;
+            auto task = std::make_shared<DetectTask>();
+            task->user_data_ = (void *)(long)idx;
+            tasks.push_back(task);
+            sent[idx].mark();
+            CHECK(detector->execute(tasks) == DG_OK);
+        });
+        evt.wait();
+        r.seconds = (VegaTmPnt("stop") - start) / 1000;
+        r.fill_rate = (double)total / ((double)detector->batches() * batchSize);
+        report("direct", r);
+    }
+
+    // batching front-end
+    {
+        Result r;
+        std::vector<VegaTmPnt> sent(total);
+        r.latency.resize(total);
+        std::atomic<int> done{0};
+        zfz::Event evt;
+        auto detector = std::make_shared<BatchingExecutable<DetectTask>>(
+                [&](DetectInterface::AsyncCallback cb) {
+                    return std::make_shared<MockExecutable<DetectTask>>(batchSize, latency, cb);
+                }, nullptr, maxWaitUs);
+
+        VegaTmPnt start("start");
+        produce(producers, count, fps, [&](int idx) {
+            auto task = std::make_shared<DetectTask>();
+            sent[idx].mark();
+            CHECK(detector->submit(task, [&, idx](std::shared_ptr<DetectTask> &, DgError error) {
+                CHECK(error == DG_OK);
+                r.latency[idx] = VegaTmPnt("done") - sent[idx];
+                if(++done == total) evt.set();
+            }) == DG_OK);
+        });
+        evt.wait();
+        r.seconds = (VegaTmPnt("stop") - start) / 1000;
+        r.fill_rate = detector->stats().fill_rate_;
+        report("batching", r);
+    }
+
+    return 0;
+}
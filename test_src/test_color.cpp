@@ -0,0 +1,177 @@
+//
+// Milliseconds per frame of ColorConvert by scalar, SIMD and SIMD in bands of threads, vs cv::cvtColor at 1080p and 4K.
+// SIMD kernels must give the same bytes as scalar ones between any two types.
+//
+
+#include "vega_color.h"
+#include "vega_time_pnt.h"
+
+#include <functional>
+#include <random>
+#include <sstream>
+
+using namespace vega;
+
+struct Case {
+    std::string name_;
+    DgImageType src_;
+    DgImageType dst_;
+    int cv_code_;                   ///<! -1 for cv::split, -2 for no reference
+};
+
+static cv::Mat allocate(DgImageType type, const cv::Size &size, DgImage &img) {
+    auto yuv = type == DgImageType::DG_IMAGE_YUV_SP420 || type == DgImageType::DG_IMAGE_YUV_I420;
+    auto planes = type == DgImageType::DG_IMAGE_BGR_PLANAR || type == DgImageType::DG_IMAGE_RGB_PLANAR;
+    cv::Mat mat;
+    if(yuv) {
+        mat.create(size.height * 3 / 2, size.width, CV_8UC1);
+    } else if(planes) {
+        mat.create(size.height * 3, size.width, CV_8UC1);
+    } else {
+        mat.create(size, type == DgImageType::DG_IMAGE_YUV_GRAY ? CV_8UC1 : CV_8UC3);
+    }
+    img.create(mat.data, size, type);
+    return mat;
+}
+
+static double timeOf(int iterations, const std::function<void()> &fn) {
+    fn();
+    VegaTmPnt start("start");
+    for(auto i = 0; i < iterations; i++) fn();
+    return (VegaTmPnt("stop") - start) / iterations;
+}
+
+static int maxDiff(const cv::Mat &a, const cv::Mat &b) {
+    cv::Mat diff;
+    cv::absdiff(a.reshape(1, 1), b.reshape(1, 1), diff);
+    double maxVal = 0;
+    cv::minMaxLoc(diff, nullptr, &maxVal);
+    return (int)maxVal;
+}
+
+/**
+ * Convert between every two types by scalar and by best kernels on padded images of size, check
+ * they give the same bytes and leave padding of rows untouched
+ */
+static void checkKernels(const cv::Size &size) {
+    const DgImageType types[] = {DgImageType::DG_IMAGE_YUV_SP420, DgImageType::DG_IMAGE_YUV_I420,
+                                 DgImageType::DG_IMAGE_BGR_PACKAGE, DgImageType::DG_IMAGE_BGR_PLANAR,
+                                 DgImageType::DG_IMAGE_RGB_PACKAGE, DgImageType::DG_IMAGE_RGB_PLANAR,
+                                 DgImageType::DG_IMAGE_YUV_GRAY};
+    const uint8_t fill = 0xa5;
+    std::mt19937 rng(size.area());
+    auto odd = size.width % 2 || size.height % 2;
+    auto yuv420 = [](DgImageType type) {
+        return type == DgImageType::DG_IMAGE_YUV_SP420 || type == DgImageType::DG_IMAGE_YUV_I420;
+    };
+    auto stride = [&](DgImageType type) {
+        auto pixelBytes = type == DgImageType::DG_IMAGE_BGR_PACKAGE || type == DgImageType::DG_IMAGE_RGB_PACKAGE ? 3 : 1;
+        return cv::Size(size.width * pixelBytes + 20, size.height + 2);
+    };
+    for(auto st : types) {
+        for(auto dt : types) {
+            if(odd && (yuv420(st) || yuv420(dt))) continue;
+            // NV12 and NV21 on both sides
+            for(auto vu = 0; vu < 4; vu++) {
+                ColorOptions single;
+                single.threads_ = 1;
+                single.src_vu_ = (vu & 1) != 0;
+                single.dst_vu_ = (vu & 2) != 0;
+                std::vector<uint8_t> srcBuf((size_t)stride(st).area() * 3);
+                for(auto &b : srcBuf) b = (uint8_t)rng();
+                std::vector<uint8_t> scalarBuf((size_t)stride(dt).area() * 3, fill), simdBuf(scalarBuf);
+                DgImage src, scalar, simd;
+                src.create(srcBuf.data(), size, size, st, stride(st));
+                scalar.create(scalarBuf.data(), size, size, dt, stride(dt));
+                simd.create(simdBuf.data(), size, size, dt, stride(dt));
+
+                ColorConvert::setIsa(ColorIsa::SCALAR);
+                CHECK(ColorConvert::convert(src, scalar, single) == DG_OK);
+                ColorConvert::setIsa(ColorConvert::bestIsa());
+                CHECK(ColorConvert::convert(src, simd, single) == DG_OK);
+                for(auto i = 0u; i < scalarBuf.size(); i++) {
+                    CHECK(scalarBuf[i] == simdBuf[i]) << (int)st << " -> " << (int)dt << " of " << size << " differs at byte "
+                                                      << i << ": " << (int)scalarBuf[i] << " vs " << (int)simdBuf[i];
+                }
+                for(auto k = 0; k < DgImage::planeCount(dt); k++) {
+                    auto &p = simd.planes_[k];
+                    auto rowBytes = (size_t)p.size_.width * CV_ELEM_SIZE(p.cv_type_);
+                    for(auto r = 0; r < p.size_.height; r++) {
+                        auto *row = p.ptr + (size_t)r * p.stride_;
+                        CHECK(std::all_of(row + rowBytes, row + p.stride_, [&](uint8_t b) { return b == fill; }))
+                                << (int)st << " -> " << (int)dt << " of " << size << " writes padding of plane " << k << " row " << r;
+                    }
+                }
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 20;
+    int threads = argc > 2 ? atoi(argv[2]) : 0;
+    CHECK(iterations > 0);
+
+    std::vector<Case> cases = {
+            {"NV12 -> BGR       ", DgImageType::DG_IMAGE_YUV_SP420, DgImageType::DG_IMAGE_BGR_PACKAGE, cv::COLOR_YUV2BGR_NV12},
+            {"I420 -> BGR       ", DgImageType::DG_IMAGE_YUV_I420, DgImageType::DG_IMAGE_BGR_PACKAGE, cv::COLOR_YUV2BGR_I420},
+            {"NV12 -> RGB planar", DgImageType::DG_IMAGE_YUV_SP420, DgImageType::DG_IMAGE_RGB_PLANAR, -2},
+            {"BGR -> RGB        ", DgImageType::DG_IMAGE_BGR_PACKAGE, DgImageType::DG_IMAGE_RGB_PACKAGE, cv::COLOR_BGR2RGB},
+            {"BGR -> BGR planar ", DgImageType::DG_IMAGE_BGR_PACKAGE, DgImageType::DG_IMAGE_BGR_PLANAR, -1},
+            {"BGR -> I420       ", DgImageType::DG_IMAGE_BGR_PACKAGE, DgImageType::DG_IMAGE_YUV_I420, cv::COLOR_BGR2YUV_I420},
+            {"NV12 -> I420      ", DgImageType::DG_IMAGE_YUV_SP420, DgImageType::DG_IMAGE_YUV_I420, -2},
+    };
+
+    // SIMD blocks with tails, odd sizes for types other than YUV 420
+    for(auto &size : {cv::Size(70, 34), cv::Size(67, 33), cv::Size(16, 2), cv::Size(1, 1)}) {
+        checkKernels(size);
+    }
+    LOG(ERROR) << "Best isa " << (int)ColorConvert::bestIsa() << ", " << iterations << " iterations";
+    for(auto &size : {cv::Size(1920, 1080), cv::Size(3840, 2160)}) {
+        // smooth synthetic picture, converted to each source type by ColorConvert
+        DgImage bgr;
+        auto bgrMat = allocate(DgImageType::DG_IMAGE_BGR_PACKAGE, size, bgr);
+        for(auto y = 0; y < size.height; y++) {
+            auto *row = bgrMat.ptr<cv::Vec3b>(y);
+            for(auto x = 0; x < size.width; x++) {
+                row[x] = cv::Vec3b((uint8_t)(x * 255 / size.width), (uint8_t)(y * 255 / size.height),
+                                   (uint8_t)((x + y) % 256));
+            }
+        }
+
+        LOG(ERROR) << size.width << "x" << size.height << ":";
+        for(auto &c : cases) {
+            DgImage src, dst;
+            auto srcMat = allocate(c.src_, size, src);
+            auto dstMat = allocate(c.dst_, size, dst);
+            CHECK(ColorConvert::convert(bgr, src) == DG_OK);
+
+            ColorOptions single;
+            single.threads_ = 1;
+            ColorOptions bands;
+            bands.threads_ = threads;
+            ColorConvert::setIsa(ColorIsa::SCALAR);
+            auto scalar = timeOf(iterations, [&]() { ColorConvert::convert(src, dst, single); });
+            ColorConvert::setIsa(ColorConvert::bestIsa());
+            auto simd = timeOf(iterations, [&]() { ColorConvert::convert(src, dst, single); });
+            auto parallel = timeOf(iterations, [&]() { ColorConvert::convert(src, dst, bands); });
+
+            std::stringstream line;
+            line << c.name_ << " scalar " << scalar << " ms, simd " << simd << " ms, simd+threads " << parallel << " ms";
+            if(c.cv_code_ != -2) {
+                cv::Mat ref;
+                std::vector<cv::Mat> planes;
+                double opencv;
+                if(c.cv_code_ == -1) {
+                    opencv = timeOf(iterations, [&]() { cv::split(srcMat, planes); });
+                    cv::vconcat(planes, ref);
+                } else {
+                    opencv = timeOf(iterations, [&]() { cv::cvtColor(srcMat, ref, c.cv_code_); });
+                }
+                line << ", cv " << opencv << " ms, " << opencv / parallel << "x, max diff " << maxDiff(ref, dstMat);
+            }
+            LOG(ERROR) << line.str();
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,113 @@
+//
+// Chain of detect -> classify written as C++20 coroutines over co_execute, resumed on one
+// station thread. Built with -std=c++20 only, see CMakeLists.txt
+//
+
+#include "vega_interface.h"
+#include "vega_future.h"
+#include "vega_mock_device.h"
+#include "vega_time_pnt.h"
+#include <zfz/zfz_event.hpp>
+
+#include <atomic>
+
+#ifndef VEGA_HAS_COROUTINE
+#error "test_coroutine requires C++20 coroutines"
+#endif
+
+using namespace vega;
+
+using DetectTasks = std::vector<std::shared_ptr<DetectTask>>;
+using ClassifierTasks = std::vector<std::shared_ptr<ClassifierTask>>;
+
+/**
+ * Coroutine started at once and not awaited by anyone, frame is freed when it returns
+ */
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+Detached chain(FutureExecutable<DetectTask> &detector, FutureExecutable<ClassifierTask> &classifier,
+               int count, std::thread::id station, std::atomic<int> &done, int frames, zfz::Event &evt) {
+    DetectTasks detects;
+    for(auto i = 0; i < count; i++) {
+        detects.push_back(std::make_shared<DetectTask>());
+    }
+    auto error = co_await detector.co_execute(detects);
+    CHECK(error == DG_OK);
+    CHECK(std::this_thread::get_id() == station) << "Not resumed on executor";
+
+    ClassifierTasks classifies;
+    for(auto i = 0; i < count; i++) {
+        classifies.push_back(std::make_shared<ClassifierTask>());
+    }
+    error = co_await classifier.co_execute(classifies);
+    CHECK(error == DG_OK);
+    if((done += count) == frames) evt.set();
+}
+
+Detached rejected(FutureExecutable<DetectTask> &detector, DgError &result, zfz::Event &evt) {
+    // resumed at once with the error of execute
+    result = co_await detector.co_execute(DetectTasks());
+    evt.set();
+}
+
+int main(int argc, char *argv[]) {
+    int frames = argc > 1 ? atoi(argv[1]) : 2000;
+    int batchSize = argc > 2 ? atoi(argv[2]) : 8;
+    CHECK(frames > 0 && batchSize > 0);
+
+    MockLatency latency;
+    latency.fixed_us_ = 1000;
+    latency.per_task_us_ = 100;
+
+    auto station = std::make_shared<DoableStation>("completion");
+    auto executor = stationExecutor(station);
+    auto detector = std::make_shared<FutureExecutable<DetectTask>>(
+            [&](DetectInterface::AsyncCallback cb) {
+                return std::make_shared<MockExecutable<DetectTask>>(batchSize, latency, cb);
+            }, executor);
+    auto classifier = std::make_shared<FutureExecutable<ClassifierTask>>(
+            [&](ClassifierInterface::AsyncCallback cb) {
+                return std::make_shared<MockExecutable<ClassifierTask>>(batchSize, latency, cb);
+            }, executor);
+
+    std::thread::id stationId;
+    {
+        zfz::Event evt;
+        executor([&]() {
+            stationId = std::this_thread::get_id();
+            evt.set();
+        });
+        evt.wait();
+    }
+
+    {
+        DgError error = DG_OK;
+        zfz::Event evt;
+        rejected(*detector, error, evt);
+        evt.wait();
+        CHECK(error == DG_ERR_INVALID_PARAM) << error;
+    }
+
+    // all frames in flight at once, each batch a coroutine
+    {
+        std::atomic<int> done{0};
+        zfz::Event evt;
+        VegaTmPnt start("start");
+        for(auto i = 0; i < frames; i += batchSize) {
+            chain(*detector, *classifier, std::min(batchSize, frames - i), stationId, done, frames, evt);
+        }
+        evt.wait();
+        auto ms = VegaTmPnt("stop") - start;
+        LOG(ERROR) << "coroutine: " << frames << " frames in " << ms << " ms, " << frames * 1000 / ms << " frames/s";
+    }
+
+    return 0;
+}
@@ -0,0 +1,348 @@
+//
+// Host side cost of decode -> fetch -> free on the CPU backend, no accelerator required.
+// Heap allocations of each step are counted, steady fetching should allocate no large buffer
+//
+
+#include "vega_interface.h"
+#include "vega_cpu_backend.h"
+#include "vega_frame_handle.h"
+#include "vega_time_pnt.h"
+#include <zfz/zfz_event.hpp>
+
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <new>
+#include <thread>
+
+using namespace vega;
+
+/**
+ * Heap allocations by operator new and by cv::Mat, large ones are at least LARGE bytes
+ */
+static const size_t LARGE = 64 << 10;
+static std::atomic<long> g_allocs{0};
+static std::atomic<long> g_large{0};
+
+static inline void countAlloc(size_t sz) {
+    ++g_allocs;
+    if(sz >= LARGE) ++g_large;
+}
+
+void *operator new(size_t sz) {
+    countAlloc(sz);
+    auto p = malloc(sz ? sz : 1);
+    if(!p) throw std::bad_alloc();
+    return p;
+}
+void operator delete(void *p) noexcept {
+    free(p);
+}
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+void *operator new[](size_t sz) {
+    countAlloc(sz);
+    auto p = malloc(sz ? sz : 1);
+    if(!p) throw std::bad_alloc();
+    return p;
+}
+void operator delete[](void *p) noexcept {
+    free(p);
+}
+void operator delete[](void *p, size_t) noexcept {
+    free(p);
+}
+
+/**
+ * Counts data allocated by cv::Mat, the standard allocator does the work
+ */
+class CountingMatAllocator : public cv::MatAllocator {
+public:
+    cv::UMatData *allocate(int dims, const int *sizes, int type, void *data, size_t *step,
+                           cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override {
+        auto u = std_allocator()->allocate(dims, sizes, type, data, step, flags, usageFlags);
+        if(u && !data) countAlloc(u->size);
+        return u;
+    }
+    bool allocate(cv::UMatData *data, cv::AccessFlag accessflags, cv::UMatUsageFlags usageFlags) const override {
+        return std_allocator()->allocate(data, accessflags, usageFlags);
+    }
+    void deallocate(cv::UMatData *data) const override {
+        std_allocator()->deallocate(data);
+    }
+
+protected:
+    static cv::MatAllocator *std_allocator() {
+        return cv::Mat::getStdAllocator();
+    }
+};
+
+/**
+ * Run count tasks in batches on iface, make(i, task) fills the i-th task, returns ms taken.
+ * Callback of iface decreases left and sets evt when it reaches 0.
+ */
+template <typename _Task, typename _Make>
+double run(const std::string &name, std::shared_ptr<Executable<_Task>> &iface, zfz::Event &evt,
+           std::atomic<int> &left, int count, _Make make) {
+    left = count;
+    evt.reset();
+    auto allocs = g_allocs.load();
+    auto large = g_large.load();
+    VegaTmPnt start("start");
+    auto batchSize = iface->getBatchSize();
+    for(auto i = 0; i < count; i += batchSize) {
+        std::vector<std::shared_ptr<_Task>> tasks;
+        for(auto j = i; j < count && j < i + batchSize; j++) {
+            auto task = std::make_shared<_Task>();
+            make(j, *task);
+            tasks.push_back(task);
+        }
+        CHECK(iface->execute(tasks) == DG_OK);
+    }
+    evt.wait();
+    auto ms = VegaTmPnt("stop") - start;
+    LOG(ERROR) << name << ": " << count << " in " << ms << " ms, " << ms * 1000 / count << " us each, "
+               << (double)(g_allocs.load() - allocs) / count << " allocs, "
+               << (double)(g_large.load() - large) / count << " allocs >= " << (LARGE >> 10) << "KB";
+    return ms;
+}
+
+int main(int argc, char *argv[]) {
+    if(argc < 2) {
+        LOG(ERROR) << "Usage: " << argv[0] << " <jpeg> [count] [threads] [batch_size]";
+        return 2;
+    }
+    std::ifstream ifs(argv[1], std::ios::binary);
+    CHECK(ifs.is_open()) << "File not exist: " << argv[1];
+    std::vector<uint8_t> jpeg((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    int count = argc > 2 ? atoi(argv[2]) : 200;
+    int threads = argc > 3 ? atoi(argv[3]) : 0;
+    int batchSize = argc > 4 ? atoi(argv[4]) : 8;
+    CHECK(count > 1 && batchSize > 0);
+
+    static CountingMatAllocator matAllocator;
+    cv::Mat::setDefaultAllocator(&matAllocator);
+
+    const StreamId sid = 1;
+    std::vector<FrameId> frames(count);
+    zfz::Event evt;
+    std::atomic<int> left{0};
+
+    auto backend = std::make_shared<CpuBackend>(threads, batchSize);
+    auto onDone = [&](int n, DgError error) {
+        CHECK(error == DG_OK) << "error " << error;
+        if((left -= n) == 0) evt.set();
+    };
+    auto decoder = backend->createDecodeInterface([&](std::vector<std::shared_ptr<DecodeTask>> &tasks, DgError error) {
+        for(auto &task : tasks) frames[(long)task->user_data_] = task->frame_id_;
+        onDone((int)tasks.size(), error);
+    });
+    std::vector<FrameData> fetched(count);
+    auto fetcher = backend->createFetchFrameInterface([&](std::vector<std::shared_ptr<FetchFrameTask>> &tasks, DgError error) {
+        for(auto &task : tasks) fetched[(long)task->user_data_] = task->result_;
+        onDone((int)tasks.size(), error);
+    });
+    auto freer = backend->createFreeFrameInterface([&](std::vector<std::shared_ptr<FreeFrameTask>> &tasks, DgError error) {
+        onDone((int)tasks.size(), error);
+    });
+    auto remover = backend->createRemoveStreamInterface([&](std::vector<std::shared_ptr<RemoveStreamTask>> &tasks, DgError error) {
+        CHECK(error == DG_OK);
+        VEGA_UNUSED(tasks);
+        evt.set();
+    });
+    auto releaser = std::make_shared<FrameReleaser>(
+            [&](FreeFrameInterface::AsyncCallback cb) {
+                return backend->createFreeFrameInterface(cb);
+            },
+            [&](RemoveStreamInterface::AsyncCallback cb) {
+                return backend->createRemoveStreamInterface(cb);
+            });
+
+    run<DecodeTask>("decode jpeg", decoder, evt, left, count, [&](int i, DecodeTask &task) {
+        task.stream_id_ = sid;
+        task.data_ = jpeg.data();
+        task.data_len_ = (int)jpeg.size();
+        task.type_ = SdkImage::JPEG;
+        task.user_data_ = (void *)(long)i;
+    });
+    CHECK(backend->pool().size() == (size_t)count);
+
+    // DCT scaled decoding into another stream
+    const StreamId scaledSid = 2;
+    std::vector<FrameId> scaledFrames(count);
+    auto scaledDecoder = backend->createDecodeInterface([&](std::vector<std::shared_ptr<DecodeTask>> &tasks, DgError error) {
+        for(auto &task : tasks) scaledFrames[(long)task->user_data_] = task->frame_id_;
+        onDone((int)tasks.size(), error);
+    });
+    run<DecodeTask>("decode jpeg 1/4", scaledDecoder, evt, left, count, [&](int i, DecodeTask &task) {
+        task.stream_id_ = scaledSid;
+        task.data_ = jpeg.data();
+        task.data_len_ = (int)jpeg.size();
+        task.type_ = SdkImage::JPEG;
+        task.user_data_ = (void *)(long)i;
+        task.put(OptionKeys::jpeg_scale_(), 4);
+    });
+    auto full = backend->pool().get(sid, frames[0]);
+    auto quarter = backend->pool().get(scaledSid, scaledFrames[0]);
+    CHECK(quarter->size_ == cv::Size((full->size_.width + 3) / 4, (full->size_.height + 3) / 4));
+    LOG(ERROR) << "frame " << full->size_ << " " << full->mat_.total() * full->mat_.elemSize() << " bytes, 1/4 "
+               << quarter->size_ << " " << quarter->mat_.total() * quarter->mat_.elemSize() << " bytes";
+    scaledDecoder.reset();
+
+    // free half of scaled frames by releaser from threads, then remove stream with the rest frames
+    VegaTmPnt start("start");
+    #pragma omp parallel for
+    for(auto i = 0; i < count / 2; i++) {
+        releaser->release(scaledSid, scaledFrames[i]);
+    }
+    CHECK(releaser->removeStream(scaledSid) == DG_OK);
+    auto ms = VegaTmPnt("stop") - start;
+    auto st = releaser->stats();
+    LOG(ERROR) << "releaser free + remove: " << st.freed_ << " frames in " << st.batches_ << " batches, "
+               << ms << " ms";
+    CHECK(st.freed_ == count / 2 && st.outstanding_ == 0 && st.failed_ == 0);
+    CHECK(backend->pool().size() == (size_t)count);
+
+    // second round of each type reuses result buffers and buffers of threads
+    SdkImage types[] = {SdkImage::BGR, SdkImage::BGR, SdkImage::NV12, SdkImage::NV12, SdkImage::JPEG, SdkImage::JPEG};
+    const char *names[] = {"fetch bgr", "fetch bgr again", "fetch nv12", "fetch nv12 again", "fetch jpeg", "fetch jpeg again"};
+    for(auto t = 0; t < 6; t++) {
+        run<FetchFrameTask>(names[t], fetcher, evt, left, count, [&](int i, FetchFrameTask &task) {
+            task.stream_id_ = sid;
+            task.frame_id_ = frames[i];
+            task.type_ = types[t];
+            task.user_data_ = (void *)(long)i;
+        });
+    }
+    run<FetchFrameTask>("fetch nv12 320w", fetcher, evt, left, count, [&](int i, FetchFrameTask &task) {
+        task.stream_id_ = sid;
+        task.frame_id_ = frames[i];
+        task.type_ = SdkImage::NV12;
+        task.put(OptionKeys::fetch_width_(), 320);
+        task.user_data_ = (void *)(long)i;
+    });
+    // height keeps aspect ratio of frame, rounded to even rows of NV12
+    for(auto &data : fetched) {
+        CHECK(data.size_.width == 320) << data.size_;
+        CHECK(std::abs(data.size_.height * full->size_.width - 320 * full->size_.height) <= 2 * full->size_.width)
+                << data.size_ << " of frame " << full->size_;
+        CHECK(data.data_len_ == 320 * data.size_.height * 3 / 2 && data.size_.height % 2 == 0);
+    }
+    fetched.assign(count, FrameData());
+
+    // roi out of frame fails, though output size is asked
+    {
+        std::vector<std::shared_ptr<FetchFrameTask>> tasks{std::make_shared<FetchFrameTask>()};
+        tasks[0]->stream_id_ = sid;
+        tasks[0]->frame_id_ = frames[0];
+        tasks[0]->type_ = SdkImage::BGR;
+        tasks[0]->roi_ = cv::Rect(full->size_.width, 0, 16, 16);
+        tasks[0]->put(OptionKeys::fetch_width_(), 32);
+        CHECK(CpuImage::fetchSize(*tasks[0], cv::Size()) == cv::Size());
+        DgError fetchError = DG_OK;
+        left = 1;
+        evt.reset();
+        auto outside = backend->createFetchFrameInterface([&](std::vector<std::shared_ptr<FetchFrameTask>> &done, DgError error) {
+            fetchError = done[0]->error_;
+            left = 0;
+            evt.set();
+        });
+        CHECK(outside->execute(tasks) == DG_OK);
+        evt.wait();
+        CHECK(fetchError == DG_ERR_INVALID_PARAM) << fetchError;
+    }
+    // a frame held by a fetch task is freed after its callback, though releaser is dropped before
+    {
+        std::vector<std::shared_ptr<DecodeTask>> tasks{std::make_shared<DecodeTask>()};
+        tasks[0]->stream_id_ = sid;
+        tasks[0]->data_ = jpeg.data();
+        tasks[0]->data_len_ = (int)jpeg.size();
+        tasks[0]->type_ = SdkImage::JPEG;
+        tasks[0]->user_data_ = (void *)0L;
+        FrameId held = 0;
+        left = 1;
+        evt.reset();
+        auto once = backend->createDecodeInterface([&](std::vector<std::shared_ptr<DecodeTask>> &done, DgError error) {
+            held = done[0]->frame_id_;
+            onDone(1, error);
+        });
+        CHECK(once->execute(tasks) == DG_OK);
+        evt.wait();
+
+        auto handles = std::make_shared<FrameReleaser>([&](FreeFrameInterface::AsyncCallback cb) {
+            return backend->createFreeFrameInterface(cb);
+        });
+        auto frame = handles->handle(sid, held);
+        handles.reset();
+        std::atomic<bool> fetched{false};
+        TaskRefExecutable<FetchFrameTask> holder([&](FetchFrameInterface::AsyncCallback cb) {
+            return backend->createFetchFrameInterface(cb);
+        }, [&](std::vector<std::shared_ptr<FetchFrameTask>> &done, DgError error) {
+            CHECK(error == DG_OK && done[0]->result_.data_len_ > 0);
+            CHECK(backend->pool().get(sid, held)) << "Frame freed before callback";
+            fetched = true;
+        });
+        std::vector<std::shared_ptr<FetchFrameTask>> fetches{std::make_shared<FetchFrameTask>()};
+        frame.bind(*fetches[0], holder.refs());
+        fetches[0]->type_ = SdkImage::JPEG;
+        frame.reset();
+        CHECK(holder.execute(fetches) == DG_OK);
+        for(auto i = 0; i < 1000 && backend->pool().get(sid, held); i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        CHECK(fetched && !backend->pool().get(sid, held)) << "Frame " << held << " is not freed";
+        CHECK(holder.refs().size() == 0);
+    }
+
+    auto bst = backend->buffers().stats();
+    LOG(ERROR) << "result buffers: hit rate " << bst.hit_rate_ << ", " << bst.misses_ << " allocated, "
+               << bst.retained_bytes_ << " bytes retained, " << g_large.load() << " allocs >= "
+               << (LARGE >> 10) << "KB in all";
+
+    run<FreeFrameTask>("free", freer, evt, left, count / 2, [&](int i, FreeFrameTask &task) {
+        task.stream_id_ = sid;
+        task.frame_id_ = frames[i];
+    });
+
+    // remove stream with the rest frames
+    evt.reset();
+    std::vector<std::shared_ptr<RemoveStreamTask>> tasks{std::make_shared<RemoveStreamTask>()};
+    tasks[0]->stream_id_ = sid;
+    CHECK(remover->execute(tasks) == DG_OK);
+    evt.wait();
+    CHECK(backend->pool().size() == 0);
+
+    // interface is destroyed after its callback returns, or inside its own callback
+    {
+        auto threads = std::make_shared<ThreadPool>("lifetime");
+        threads->create(2);
+        std::atomic<int> state{0};
+        auto slow = std::make_shared<CpuExecutable<DecodeTask>>(threads, 4, [](DecodeTask &) { return DG_OK; },
+                [&](std::vector<std::shared_ptr<DecodeTask>> &, DgError) {
+                    state = 1;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                    state = 2;
+                });
+        std::vector<std::shared_ptr<DecodeTask>> batch{std::make_shared<DecodeTask>(), std::make_shared<DecodeTask>()};
+        CHECK(slow->execute(batch) == DG_OK);
+        while(state == 0) std::this_thread::yield();
+        slow.reset();
+        CHECK(state == 2) << "Destroyed while calling back";
+
+        std::shared_ptr<CpuExecutable<DecodeTask>> self;
+        self = std::make_shared<CpuExecutable<DecodeTask>>(threads, 4, [](DecodeTask &) { return DG_OK; },
+                [&](std::vector<std::shared_ptr<DecodeTask>> &, DgError) {
+                    self.reset();
+                    evt.set();
+                });
+        evt.reset();
+        auto iface = self.get();
+        CHECK(iface->execute(batch) == DG_OK);
+        evt.wait();
+    }
+
+    return 0;
+}
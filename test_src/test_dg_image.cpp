@@ -0,0 +1,127 @@
+//
+// Planes, strides and roi views of DgImage over padded buffers, and ImageAllocator padding alike
+//
+
+#include "dg_types.h"
+#include "vega_image_allocator.h"
+
+#include <vector>
+
+using namespace vega;
+
+static void fill(std::vector<uint8_t> &buf) {
+    for(size_t i = 0; i < buf.size(); i++) buf[i] = (uint8_t)(i * 7 + i / 251);
+}
+
+/**
+ * Each element of view plane equals that of image plane at roi offset
+ */
+static void checkView(const DgImage &img, const DgImage &view, const cv::Rect &roi) {
+    auto yuv420 = img.type_ == DgImageType::DG_IMAGE_YUV_SP420 || img.type_ == DgImageType::DG_IMAGE_YUV_I420;
+    for(auto p = 0; p < DgImage::planeCount(img.type_); p++) {
+        auto sub = (yuv420 && p > 0) ? 2 : 1;
+        auto whole = img.mat(p);
+        auto part = view.mat(p);
+        CHECK(part.step[0] == whole.step[0]) << "plane " << p << " stride " << part.step[0];
+        CHECK(part.cols == roi.width / sub && part.rows == roi.height / sub) << "plane " << p << " " << part.size();
+        auto bytes = part.cols * (int)part.elemSize();
+        for(auto y = 0; y < part.rows; y++) {
+            auto *a = part.ptr<uint8_t>(y);
+            auto *b = whole.ptr<uint8_t>(y + roi.y / sub) + (roi.x / sub) * whole.elemSize();
+            for(auto x = 0; x < bytes; x++) {
+                CHECK(a[x] == b[x]) << "plane " << p << " (" << x << ", " << y << ") differs";
+            }
+        }
+    }
+    auto &last = view.plane(DgImage::planeCount(view.type_) - 1);
+    CHECK(view.blob_.ptr == view.plane(0).ptr);
+    CHECK(view.blob_.ptr + view.blob_.size_ == last.ptr + (last.size_.height - 1) * last.stride_ + last.size_.width * CV_ELEM_SIZE(last.cv_type_))
+        << "blob of view does not end at its last element";
+}
+
+int main(int argc, char *argv[]) {
+    const cv::Size size(62, 37);
+    const auto stride = DgImage::alignedStride(DgImageType::DG_IMAGE_YUV_SP420, cv::Size(62, 36));
+    CHECK(stride == cv::Size(64, 36)) << stride;
+    CHECK(DgImage::alignedStride(DgImageType::DG_IMAGE_BGR_PACKAGE, size) == cv::Size(192, 38));
+
+    // allocator pads as alignedStride, types without planes are refused
+    {
+        ImageAllocator allocator(StrideRule(32, 4));
+        CHECK(allocator.stride(SdkImage::BGR, size) == DgImage::alignedStride(DgImageType::DG_IMAGE_BGR_PACKAGE, size, 32, 4));
+        DeviceImage img;
+        CHECK(allocator.allocate(SdkImage::NV12, size, img) == DG_OK);
+        CHECK(img.stride_ == cv::Size(64, 40) && img.bytes_ == 64u * 40 * 3 / 2);
+        CHECK(img.image().plane(1).ptr == img.data_.get() + 64 * 40);
+        CHECK(allocator.allocate(SdkImage::ARGB, size, img) == DG_ERR_NOT_SUPPORTED);
+        CHECK(allocator.allocate(SdkImage::JPEG, size, img) == DG_ERR_NOT_SUPPORTED);
+        CHECK(allocator.stride(SdkImage::ARGB, size) == cv::Size());
+    }
+
+    // NV12 of padded rows
+    {
+        cv::Size sz(62, 36);
+        std::vector<uint8_t> buf(stride.area() * 3 / 2);
+        fill(buf);
+        DgImage img;
+        img.create(buf.data(), sz, sz, DgImageType::DG_IMAGE_YUV_SP420, stride);
+        CHECK(DgImage::planeCount(img.type_) == 2);
+        CHECK(img.blob_.size_ == buf.size());
+        CHECK(img.plane(0).ptr == buf.data() && img.plane(0).stride_ == 64 && img.plane(0).size_ == sz);
+        CHECK(img.plane(1).ptr == buf.data() + 64 * 36 && img.plane(1).stride_ == 64);
+        CHECK(img.plane(1).size_ == cv::Size(31, 18) && img.plane(1).cv_type_ == CV_8UC2);
+        CHECK(img.mat(1).at<cv::Vec2b>(2, 3)[1] == buf[64 * 36 + 2 * 64 + 3 * 2 + 1]);
+
+        cv::Rect roi(5, 3, 21, 11);
+        auto view = img.view(roi);
+        CHECK(view.size_ == cv::Size(20, 10)) << view.size_;
+        checkView(img, view, cv::Rect(4, 2, 20, 10));
+    }
+
+    // I420, chroma rows are half of stride
+    {
+        cv::Size sz(62, 36);
+        std::vector<uint8_t> buf(stride.area() * 3 / 2);
+        fill(buf);
+        DgImage img;
+        img.create(buf.data(), sz, sz, DgImageType::DG_IMAGE_YUV_I420, stride);
+        CHECK(DgImage::planeCount(img.type_) == 3);
+        CHECK(img.plane(1).ptr == buf.data() + 64 * 36 && img.plane(1).stride_ == 32);
+        CHECK(img.plane(2).ptr == buf.data() + 64 * 36 * 5 / 4 && img.plane(2).stride_ == 32);
+        CHECK(img.plane(2).size_ == cv::Size(31, 18) && img.plane(2).cv_type_ == CV_8UC1);
+        CHECK(img.plane(2).ptr + 17 * 32 + 31 <= buf.data() + buf.size());
+        checkView(img, img.view(cv::Rect(10, 6, 30, 20)), cv::Rect(10, 6, 30, 20));
+    }
+
+    // BGR packed and planar, odd sizes are kept
+    {
+        auto bgrStride = DgImage::alignedStride(DgImageType::DG_IMAGE_BGR_PACKAGE, size);
+        std::vector<uint8_t> buf(bgrStride.area());
+        fill(buf);
+        DgImage img;
+        img.create(buf.data(), size, size, DgImageType::DG_IMAGE_BGR_PACKAGE, bgrStride);
+        CHECK(img.mat().step[0] == 192 && img.mat().size() == size);
+        checkView(img, img.view(cv::Rect(7, 5, 13, 9)), cv::Rect(7, 5, 13, 9));
+
+        std::vector<uint8_t> planar(64 * 38 * 3);
+        fill(planar);
+        img.create(planar.data(), size, size, DgImageType::DG_IMAGE_BGR_PLANAR, cv::Size(64, 38));
+        CHECK(img.plane(2).ptr == planar.data() + 64 * 38 * 2 && img.plane(2).stride_ == 64);
+        checkView(img, img.view(cv::Rect(1, 1, 33, 17)), cv::Rect(1, 1, 33, 17));
+    }
+
+    // fromMat keeps step of mat, constructor keeps its size as before
+    {
+        cv::Mat all(54, 64, CV_8UC1);
+        auto nv12 = DgImage::fromMat(all(cv::Rect(0, 0, 62, 54)), DgImageType::DG_IMAGE_YUV_SP420);
+        CHECK(nv12.size_ == cv::Size(62, 36) && nv12.plane(0).stride_ == 64) << nv12.size_;
+        CHECK(nv12.plane(1).ptr == all.data + 64 * 36);
+
+        cv::Mat bgr(20, 30, CV_8UC3);
+        DgImage img(bgr);
+        CHECK(img.size_ == cv::Size(30, 20) && img.blob_.size_ == 30 * 20 * 3);
+    }
+
+    LOG(ERROR) << "DgImage planes and views ok";
+    return 0;
+}
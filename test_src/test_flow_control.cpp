@@ -0,0 +1,179 @@
+//
+// Credits of FlowControlExecutable on an interface ending batches when told to: queued batches
+// are sent in order when credits come back or are added, and called back if never sent
+//
+
+#include "vega_interface.h"
+#include "vega_flow_control.h"
+
+#include <cstdlib>
+#include <deque>
+#include <thread>
+
+using namespace vega;
+
+using Tasks = std::vector<std::shared_ptr<DetectTask>>;
+
+/**
+ * Interface keeping batches until end() calls them back, or failing them at once
+ */
+class Gate : public Executable<DetectTask> {
+public:
+    explicit Gate(AsyncCallback callback) : callback_(callback) {}
+
+    int getBatchSize() override {
+        return 1;
+    }
+    DgError sendCommand(const std::string &cmd, const std::string &param, std::map<std::string, std::string> &result) override {
+        return DG_ERR_NOT_SUPPORTED;
+    }
+    using Executable<DetectTask>::execute;
+    DgError execute(Tasks &tasks) override {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if(fail_) return DG_ERR_FULL;
+        for(auto &task : tasks) sent_.push_back((long)task->user_data_);
+        held_.push_back(tasks);
+        return DG_OK;
+    }
+
+    /**
+     * Call back the oldest batch held
+     */
+    void end() {
+        Tasks tasks;
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            CHECK(!held_.empty());
+            tasks = held_.front();
+            held_.pop_front();
+        }
+        callback_(tasks, DG_OK);
+    }
+    size_t held() {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return held_.size();
+    }
+
+public:
+    AsyncCallback callback_;
+    std::mutex mtx_;
+    std::deque<Tasks> held_;
+    std::vector<long> sent_;    ///<! batches in order of sending
+    bool fail_ = false;
+};
+
+/**
+ * Flow control of a gate, with batches numbered by user_data_ and their callbacks recorded
+ */
+class Flow {
+public:
+    Flow(int credits, CreditPolicy policy, int maxQueued = -1) {
+        flow_ = std::make_shared<FlowControlExecutable<DetectTask>>([this](DetectInterface::AsyncCallback cb) {
+            gate_ = std::make_shared<Gate>(cb);
+            return gate_;
+        }, [this](Tasks &tasks, DgError error) {
+            char here;
+            std::lock_guard<std::mutex> lock(mtx_);
+            done_.push_back(std::make_pair((long)tasks[0]->user_data_, error));
+            stack_.push_back(&here);
+        }, credits, policy, 50, maxQueued);
+    }
+
+    DgError send(long k) {
+        Tasks tasks(1, std::make_shared<DetectTask>());
+        tasks[0]->user_data_ = (void *)k;
+        return flow_->execute(tasks);
+    }
+    std::vector<std::pair<long, DgError>> done() {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return done_;
+    }
+
+public:
+    std::shared_ptr<Gate> gate_;
+    std::mutex mtx_;
+    std::vector<std::pair<long, DgError>> done_;
+    std::vector<const char *> stack_;   ///<! a local of each callback
+    std::shared_ptr<FlowControlExecutable<DetectTask>> flow_;   ///<! calls back into done_ on destruction
+};
+
+int main(int argc, char *argv[]) {
+    // QUEUE keeps order, and adding credits sends queued batches at once
+    {
+        Flow f(1, CreditPolicy::QUEUE, 8);
+        for(auto k = 0; k < 5; k++) {
+            CHECK(f.send(k) == DG_OK);
+        }
+        auto st = f.flow_->stats();
+        CHECK(st.in_flight_ == 1 && st.queued_ == 4 && st.waits_ == 4 && st.peak_queued_ == 4);
+        f.gate_->end();
+        CHECK(f.gate_->sent_ == std::vector<long>({0, 1}));
+
+        f.flow_->setCredits(4);
+        st = f.flow_->stats();
+        CHECK(st.in_flight_ == 4 && st.queued_ == 0) << st.in_flight_ << " in flight, " << st.queued_ << " queued";
+        CHECK(f.send(5) == DG_OK);
+        CHECK(f.flow_->stats().queued_ == 1);
+        while(f.gate_->held() > 0) f.gate_->end();
+        CHECK(f.gate_->sent_ == std::vector<long>({0, 1, 2, 3, 4, 5}));
+        CHECK(f.done().size() == 6 && f.flow_->stats().batches_ == 6);
+
+        // 4 in flight and 8 queued
+        for(auto k = 0; k < 12; k++) {
+            CHECK(f.send(10 + k) == DG_OK);
+        }
+        CHECK(f.send(22) == DG_ERR_FULL && f.flow_->stats().rejected_ == 1);
+    }
+
+    // queued batches failing to send are called back one after another, not by recursion
+    {
+        const long n = 1000;
+        Flow f(1, CreditPolicy::QUEUE);
+        for(auto k = 0; k < n; k++) {
+            CHECK(f.send(k) == DG_OK);
+        }
+        f.gate_->fail_ = true;
+        f.gate_->end();
+        auto done = f.done();
+        CHECK((long)done.size() == n);
+        // credit of batch 0 is returned before its callback
+        CHECK(done[0].first == 1 && done[0].second == DG_ERR_FULL && done[n - 2].first == n - 1);
+        CHECK(done[n - 1].first == 0 && done[n - 1].second == DG_OK);
+        CHECK(f.flow_->stats().in_flight_ == 0 && f.flow_->stats().queued_ == 0);
+        auto depth = std::abs(f.stack_[n - 2] - f.stack_[0]);
+        CHECK(depth < 4096) << "Callbacks " << depth << " bytes deeper in stack";
+    }
+
+    // batches never sent are called back on destruction
+    {
+        Flow f(1, CreditPolicy::QUEUE);
+        for(auto k = 0; k < 3; k++) {
+            CHECK(f.send(k) == DG_OK);
+        }
+        f.flow_.reset();
+        auto done = f.done();
+        CHECK(done.size() == 2 && done[0].first == 1 && done[1].first == 2);
+        CHECK(done[0].second == DG_ERR_CANCELLED && done[1].second == DG_ERR_CANCELLED);
+    }
+
+    // BLOCK waits for credit returned by another thread, FAIL_FAST does not
+    {
+        Flow f(1, CreditPolicy::BLOCK);
+        CHECK(f.send(0) == DG_OK);
+        CHECK(f.send(1) == DG_ERR_TIME_OUT);
+        std::thread ender([&]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            f.gate_->end();
+        });
+        CHECK(f.send(2) == DG_OK);
+        ender.join();
+        auto st = f.flow_->stats();
+        CHECK(st.waits_ == 2 && st.rejected_ == 1 && st.max_wait_ms_ >= 5) << st.max_wait_ms_;
+
+        Flow ff(2, CreditPolicy::FAIL_FAST);
+        CHECK(ff.send(0) == DG_OK && ff.send(1) == DG_OK && ff.send(2) == DG_ERR_FULL);
+    }
+
+    LOG(ERROR) << "Flow control ok";
+    return 0;
+}
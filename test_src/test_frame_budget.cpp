@@ -0,0 +1,274 @@
+//
+// Frames kept by FrameBudgetExecutable on mock decode and free interfaces: frames of the batch
+// being called back and frames held by handles are never evicted, released ones go oldest first.
+// FrameReleaser batches frees by size and delay
+//
+
+#include "vega_interface.h"
+#include "vega_frame_budget.h"
+#include "vega_mock_device.h"
+
+#include <atomic>
+#include <future>
+#include <set>
+#include <thread>
+
+using namespace vega;
+
+using DecodeTasks = std::vector<std::shared_ptr<DecodeTask>>;
+
+static const StreamId SID = 1;
+
+/**
+ * Mock decoder numbering frames from 1, and the frames freed by its releaser
+ */
+class Pool {
+public:
+    Pool() {
+        decode_ = [this](DecodeInterface::AsyncCallback cb) {
+            return std::make_shared<MockExecutable<DecodeTask>>(8, MockLatency(), cb, [this](DecodeTask &task, std::mt19937 &) {
+                task.frame_id_ = ++next_;
+                task.size_ = cv::Size(64, 32);
+            });
+        };
+        auto free = [this](FreeFrameInterface::AsyncCallback cb) {
+            return std::make_shared<MockExecutable<FreeFrameTask>>(16, MockLatency(), cb, [this](FreeFrameTask &task, std::mt19937 &) {
+                std::lock_guard<std::mutex> lock(mtx_);
+                CHECK(freed_.insert(task.frame_id_).second) << "Frame " << task.frame_id_ << " freed twice";
+            });
+        };
+        releaser_ = std::make_shared<FrameReleaser>(free);
+    }
+
+    std::set<FrameId> freed() {
+        CHECK(releaser_->flush(SID, 1000) == DG_OK);
+        std::lock_guard<std::mutex> lock(mtx_);
+        return freed_;
+    }
+
+public:
+    DecodeInterface::Creator decode_;
+    std::atomic<FrameId> next_{0};
+    std::mutex mtx_;
+    std::set<FrameId> freed_;
+    std::shared_ptr<FrameReleaser> releaser_;   ///<! frees frames into freed_, destroyed first
+};
+
+/**
+ * Free interface calling back inside execute(), batch sizes are recorded
+ */
+class SyncFree : public Executable<FreeFrameTask> {
+public:
+    SyncFree(int batchSize, AsyncCallback callback) : batch_size_(batchSize), callback_(callback) {}
+
+    int getBatchSize() override {
+        return batch_size_;
+    }
+    DgError sendCommand(const std::string &cmd, const std::string &param, std::map<std::string, std::string> &result) override {
+        return DG_ERR_NOT_SUPPORTED;
+    }
+    using Executable<FreeFrameTask>::execute;
+    DgError execute(std::vector<std::shared_ptr<FreeFrameTask>> &tasks) override {
+        CHECK(++depth_ == 1) << "execute() re-entered from callback";
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            sizes_.push_back((int)tasks.size());
+        }
+        for(auto &task : tasks) task->error_ = DG_OK;
+        callback_(tasks, DG_OK);
+        --depth_;
+        return DG_OK;
+    }
+
+    std::vector<int> sizes() {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return sizes_;
+    }
+
+protected:
+    int batch_size_;
+    AsyncCallback callback_;
+    std::atomic<int> depth_{0};
+    std::mutex mtx_;
+    std::vector<int> sizes_;
+};
+
+/**
+ * Decode n packets of SID, onBatch is called back, and wait until budget is enforced after it
+ */
+class Decoder {
+public:
+    Decoder(Pool &pool, int maxFrames, BudgetPolicy policy) {
+        auto decode = pool.decode_;
+        auto creator = [this, decode](DecodeInterface::AsyncCallback cb) {
+            return decode([this, cb](DecodeTasks &tasks, DgError error) {
+                auto done = done_;
+                if(fail_ >= 0) {
+                    tasks[fail_]->error_ = DG_ERR_DECODE_FAIL;
+                    error = DG_ERR_DECODE_FAIL;
+                }
+                cb(tasks, error);
+                done->set_value();
+            });
+        };
+        budget_ = std::make_shared<FrameBudgetExecutable>(creator, pool.releaser_, [this](DecodeTasks &tasks, DgError error) {
+            CHECK(error == (fail_ >= 0 ? DG_ERR_DECODE_FAIL : DG_OK));
+            if(onBatch_) onBatch_(tasks);
+        }, 0, maxFrames, policy);
+    }
+
+    DecodeTasks decode(int n, std::function<void(DecodeTasks &)> onBatch = nullptr) {
+        DecodeTasks tasks;
+        for(auto i = 0; i < n; i++) {
+            auto task = std::make_shared<DecodeTask>();
+            task->stream_id_ = SID;
+            tasks.push_back(task);
+        }
+        onBatch_ = onBatch;
+        done_ = std::make_shared<std::promise<void>>();
+        auto done = done_->get_future();
+        CHECK(budget_->execute(tasks) == DG_OK);
+        done.wait();
+        return tasks;
+    }
+
+public:
+    std::shared_ptr<FrameBudgetExecutable> budget_;
+    std::function<void(DecodeTasks &)> onBatch_;
+    std::shared_ptr<std::promise<void>> done_;
+    int fail_ = -1;     ///<! task failed by decoder in each batch, -1 for none
+};
+
+int main(int argc, char *argv[]) {
+    // releases are sent in full batches by size, the rest after max delay or at once by flush
+    {
+        std::shared_ptr<SyncFree> free;
+        auto releaser = std::make_shared<FrameReleaser>([&](FreeFrameInterface::AsyncCallback cb) {
+            free = std::make_shared<SyncFree>(16, cb);
+            return free;
+        }, nullptr, 4, 50);
+        for(auto i = 1; i <= 10; i++) {
+            releaser->release(SID, i);
+        }
+        for(auto i = 0; i < 1000 && releaser->stats().freed_ < 8; i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        CHECK(free->sizes() == std::vector<int>({4, 4})) << free->sizes().size() << " batches";
+        CHECK(releaser->stats().pending_ == 2);
+        for(auto i = 0; i < 1000 && releaser->stats().freed_ < 10; i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        CHECK(free->sizes() == std::vector<int>({4, 4, 2})) << "rest is not sent after max delay";
+
+        releaser->release(SID, 11);
+        CHECK(releaser->flush(SID, 20) == DG_OK) << "flush waits for max delay";
+        CHECK(free->sizes().size() == 4 && releaser->stats().freed_ == 11);
+    }
+
+    // evict oldest released frames, 4 frames at most
+    {
+        Pool pool;
+        Decoder decoder(pool, 4, BudgetPolicy::EVICT_OLDEST);
+        auto &budget = *decoder.budget_;
+
+        FrameHandle held;
+        decoder.decode(3, [&](DecodeTasks &tasks) {
+            for(auto &task : tasks) {
+                CHECK(budget.contains(SID, task->frame_id_)) << "Frame " << task->frame_id_ << " not in pool on callback";
+            }
+            held = budget.handle(SID, 1);
+            CHECK(held && held.useCount() == 2);
+        });
+        CHECK(budget.stats().frames_ == 3 && budget.stats().in_use_ == 1);
+        CHECK(budget.usage(SID).bytes_ == 3 * 64 * 32 * 3 / 2) << budget.usage(SID).bytes_;
+
+        // released without handles, freed at once
+        CHECK(budget.release(SID, 2) == DG_OK);
+        CHECK(budget.release(SID, 2) == DG_ERR_NOT_EXIST);
+        CHECK(pool.freed() == std::set<FrameId>({2}));
+        CHECK(budget.stats().frames_ == 2);
+
+        // 6 frames after callback, frame 3 is the only one neither held nor in this batch
+        decoder.decode(4, [&](DecodeTasks &tasks) {
+            CHECK(budget.stats().frames_ == 6);
+            for(auto &task : tasks) {
+                CHECK(!task->getBool(OptionKeys::discard_frame_(), false));
+            }
+        });
+        auto st = budget.stats();
+        CHECK(st.frames_ == 5 && st.evicted_ == 1 && st.in_use_ == 1) << st.frames_ << " " << st.evicted_;
+        CHECK(pool.freed() == std::set<FrameId>({2, 3}));
+        CHECK(budget.contains(SID, 1) && !budget.contains(SID, 3));
+
+        // still over budget, next packet is discarded, then the oldest frame no longer held goes
+        held.reset();
+        auto skipped = decoder.decode(1, [&](DecodeTasks &tasks) {
+            CHECK(tasks[0]->getBool(OptionKeys::discard_frame_(), false));
+        });
+        CHECK(!skipped[0]->getBool(OptionKeys::discard_frame_(), false));
+        st = budget.stats();
+        CHECK(st.frames_ == 4 && st.evicted_ == 2 && st.skipped_ == 1 && st.in_use_ == 0) << st.frames_;
+        CHECK(pool.freed() == std::set<FrameId>({1, 2, 3}));
+        CHECK(st.peak_frames_ == 6);
+
+        // released while held, freed when the handle is gone
+        auto handle = budget.handle(SID, 4);
+        CHECK(budget.release(SID, 4) == DG_OK);
+        CHECK(budget.contains(SID, 4) && budget.stats().in_use_ == 1);
+        CHECK(!budget.handle(SID, 4));
+        handle.reset();
+        CHECK(!budget.contains(SID, 4) && budget.stats().frames_ == 3);
+        CHECK(pool.freed() == std::set<FrameId>({1, 2, 3, 4}));
+
+        std::map<std::string, std::string> result;
+        CHECK(budget.sendCommand("frame_budget", "", result) == DG_OK);
+        CHECK(result["frames"] == "3" && result["evicted"] == "2" && result["skipped"] == "1");
+    }
+
+    // skip decoding until frames are released, nothing is evicted
+    {
+        Pool pool;
+        Decoder decoder(pool, 2, BudgetPolicy::SKIP_DECODE);
+        auto &budget = *decoder.budget_;
+        decoder.decode(3);
+        CHECK(budget.stats().frames_ == 3 && budget.stats().evicted_ == 0);
+        auto tasks = decoder.decode(2, [&](DecodeTasks &tasks) {
+            CHECK(tasks[0]->getBool(OptionKeys::discard_frame_(), false) && tasks[1]->getBool(OptionKeys::discard_frame_(), false));
+        });
+        CHECK(budget.stats().frames_ == 3 && budget.stats().skipped_ == 2);
+        // cleared after callback, a reused task is not discarded for good
+        CHECK(!tasks[0]->getBool(OptionKeys::discard_frame_(), false) && !tasks[1]->getBool(OptionKeys::discard_frame_(), false));
+
+        CHECK(budget.release(SID, 1) == DG_OK);
+        tasks = decoder.decode(1);
+        CHECK(!tasks[0]->getBool(OptionKeys::discard_frame_(), false));
+        CHECK(budget.stats().frames_ == 3);
+        CHECK(pool.freed() == std::set<FrameId>({1}));
+    }
+
+    // frames decoded in a batch failed in part are owned, and evicted when released
+    {
+        Pool pool;
+        Decoder decoder(pool, 2, BudgetPolicy::EVICT_OLDEST);
+        auto &budget = *decoder.budget_;
+        decoder.fail_ = 1;
+        decoder.decode(3);
+        CHECK(budget.stats().frames_ == 2) << budget.stats().frames_;
+        CHECK(budget.contains(SID, 1) && !budget.contains(SID, 2) && budget.contains(SID, 3));
+        CHECK(budget.release(SID, 1) == DG_OK && budget.release(SID, 3) == DG_OK);
+        CHECK(pool.freed() == std::set<FrameId>({1, 3}));
+    }
+
+    // frames not released are freed with the budget
+    {
+        Pool pool;
+        {
+            Decoder decoder(pool, 0, BudgetPolicy::EVICT_OLDEST);
+            decoder.decode(5);
+        }
+        CHECK(pool.freed().size() == 5) << pool.freed().size();
+    }
+
+    LOG(ERROR) << "Frame budget ok";
+    return 0;
+}
@@ -0,0 +1,87 @@
+//
+// Chain of detect -> classify driven by completions on one station thread, and by futures
+//
+
+#include "vega_interface.h"
+#include "vega_future.h"
+#include "vega_mock_device.h"
+#include "vega_time_pnt.h"
+#include <zfz/zfz_event.hpp>
+
+#include <atomic>
+#include <iostream>
+
+using namespace vega;
+
+using DetectTasks = std::vector<std::shared_ptr<DetectTask>>;
+using ClassifierTasks = std::vector<std::shared_ptr<ClassifierTask>>;
+
+int main(int argc, char *argv[]) {
+    int frames = argc > 1 ? atoi(argv[1]) : 2000;
+    int batchSize = argc > 2 ? atoi(argv[2]) : 8;
+    CHECK(frames > 0 && batchSize > 0);
+
+    MockLatency latency;
+    latency.fixed_us_ = 1000;
+    latency.per_task_us_ = 100;
+
+    auto station = std::make_shared<DoableStation>("completion");
+    auto executor = stationExecutor(station);
+    auto detector = std::make_shared<FutureExecutable<DetectTask>>(
+            [&](DetectInterface::AsyncCallback cb) {
+                return std::make_shared<MockExecutable<DetectTask>>(batchSize, latency, cb);
+            }, executor);
+    auto classifier = std::make_shared<FutureExecutable<ClassifierTask>>(
+            [&](ClassifierInterface::AsyncCallback cb) {
+                return std::make_shared<MockExecutable<ClassifierTask>>(batchSize, latency, cb);
+            }, executor);
+
+    // all frames in flight at once, completions continue the chain on station thread
+    {
+        std::atomic<int> done{0};
+        zfz::Event evt;
+        VegaTmPnt start("start");
+        for(auto i = 0; i < frames; i += batchSize) {
+            DetectTasks detects;
+            for(auto j = i; j < frames && j < i + batchSize; j++) {
+                detects.push_back(std::make_shared<DetectTask>());
+            }
+            auto error = detector->execute(detects, [&](DetectTasks &detected, DgError error) {
+                CHECK(error == DG_OK);
+                ClassifierTasks classifies;
+                for(auto &task : detected) {
+                    VEGA_UNUSED(task);
+                    classifies.push_back(std::make_shared<ClassifierTask>());
+                }
+                auto err = classifier->execute(classifies, [&](ClassifierTasks &classified, DgError error) {
+                    CHECK(error == DG_OK);
+                    if((done += (int)classified.size()) == frames) evt.set();
+                });
+                CHECK(err == DG_OK);
+            });
+            CHECK(error == DG_OK);
+        }
+        evt.wait();
+        auto ms = VegaTmPnt("stop") - start;
+        LOG(ERROR) << "completion: " << frames << " frames in " << ms << " ms, " << frames * 1000 / ms << " frames/s";
+    }
+
+    // one batch at a time by futures
+    {
+        VegaTmPnt start("start");
+        for(auto i = 0; i < frames; i += batchSize) {
+            DetectTasks detects;
+            ClassifierTasks classifies;
+            for(auto j = i; j < frames && j < i + batchSize; j++) {
+                detects.push_back(std::make_shared<DetectTask>());
+                classifies.push_back(std::make_shared<ClassifierTask>());
+            }
+            CHECK(detector->executeFuture(detects).get() == DG_OK);
+            CHECK(classifier->executeFuture(classifies).get() == DG_OK);
+        }
+        auto ms = VegaTmPnt("stop") - start;
+        LOG(ERROR) << "future: " << frames << " frames in " << ms << " ms, " << frames * 1000 / ms << " frames/s";
+    }
+
+    return 0;
+}
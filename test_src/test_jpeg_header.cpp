@@ -0,0 +1,274 @@
+//
+// Headers of synthetic JPEG read by JpegHeader, routes of JpegLimits, and callbacks of JpegAdmissionExecutable
+// on mock decoders. Then for JPEG files given: headers, time of reading them against decoding, their routes,
+// and time of decoding at the DCT scale to a target size
+//
+
+#include "vega_interface.h"
+#include "vega_jpeg_header.h"
+#include "vega_mock_device.h"
+#include "vega_time_pnt.h"
+#include <opencv2/imgcodecs.hpp>
+
+#include <atomic>
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+using namespace vega;
+
+using Bytes = std::vector<uint8_t>;
+using DecodeTasks = std::vector<std::shared_ptr<DecodeTask>>;
+
+static void segment(Bytes &out, uint8_t marker, const Bytes &payload) {
+    auto len = payload.size() + 2;
+    out.push_back(0xFF);
+    out.push_back(marker);
+    out.push_back((uint8_t)(len >> 8));
+    out.push_back((uint8_t)len);
+    out.insert(out.end(), payload.begin(), payload.end());
+}
+
+/**
+ * JPEG of JFIF, optional EXIF orientation, DQT, a fill byte, SOF of components (id, H << 4 | V, table
+ * each), SOS and some entropy coded bytes
+ * @param orientation EXIF orientation, 0 for no APP1
+ * @param le EXIF in little endian
+ */
+static Bytes jpeg(uint8_t sof, int width, int height, const Bytes &components, int orientation = 0,
+                  bool le = true, int precision = 8) {
+    Bytes out = {0xFF, 0xD8};
+    segment(out, 0xE0, Bytes({'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0}));
+    if(orientation > 0) {
+        auto o = (uint8_t)orientation;
+        // IFD0 of 2 entries, orientation after another tag
+        Bytes exif = le ? Bytes({'E', 'x', 'i', 'f', 0, 0, 'I', 'I', 42, 0, 8, 0, 0, 0, 2, 0,
+                                 0x0F, 0x01, 2, 0, 4, 0, 0, 0, 0, 0, 0, 0,
+                                 0x12, 0x01, 3, 0, 1, 0, 0, 0, o, 0, 0, 0, 0, 0, 0, 0})
+                        : Bytes({'E', 'x', 'i', 'f', 0, 0, 'M', 'M', 0, 42, 0, 0, 0, 8, 0, 1,
+                                 0x01, 0x12, 0, 3, 0, 0, 0, 1, 0, o, 0, 0, 0, 0, 0, 0});
+        segment(out, 0xE1, exif);
+    }
+    Bytes dqt(65, 1);
+    dqt[0] = 0;
+    segment(out, 0xDB, dqt);
+    out.push_back(0xFF);
+    Bytes frame = {(uint8_t)precision, (uint8_t)(height >> 8), (uint8_t)height, (uint8_t)(width >> 8),
+                   (uint8_t)width, (uint8_t)(components.size() / 3)};
+    frame.insert(frame.end(), components.begin(), components.end());
+    segment(out, sof, frame);
+    segment(out, 0xDA, Bytes({1, 1, 0, 0, 63, 0}));
+    for(auto i = 0; i < 4096; i++) out.push_back((uint8_t)(i & 0x7F));
+    out.push_back(0xFF);
+    out.push_back(0xD9);
+    return out;
+}
+
+static const Bytes YUV420 = {1, 0x22, 0, 2, 0x11, 1, 3, 0x11, 1};
+static const Bytes YUV422 = {1, 0x21, 0, 2, 0x11, 1, 3, 0x11, 1};
+static const Bytes YUV444 = {1, 0x11, 0, 2, 0x11, 1, 3, 0x11, 1};
+static const Bytes CMYK = {1, 0x11, 0, 2, 0x11, 1, 3, 0x11, 1, 4, 0x11, 1};
+static const Bytes GRAY = {1, 0x11, 0};
+
+static JpegInfo parsed(const Bytes &data, DgError expect = DG_OK) {
+    JpegInfo info;
+    CHECK(JpegHeader::parse(data.data(), data.size(), info) == expect) << "Parse of " << data.size() << " bytes";
+    return info;
+}
+
+/**
+ * Orientation of both byte orders, progressive, 12 bits, CMYK, arithmetic and truncated headers
+ */
+static void checkHeaders() {
+    auto info = parsed(jpeg(0xC0, 1920, 1080, YUV420, 6, false));
+    CHECK(info.size_ == cv::Size(1920, 1080) && info.components_ == 3 && info.sampling_ == JpegSampling::YUV420);
+    CHECK(info.baseline() && info.orientation_ == 6 && info.orientedSize() == cv::Size(1080, 1920));
+
+    info = parsed(jpeg(0xC2, 4000, 3000, YUV422, 3, true));
+    CHECK(info.progressive_ && !info.baseline() && info.sampling_ == JpegSampling::YUV422);
+    CHECK(info.orientation_ == 3 && info.orientedSize() == info.size_);
+
+    info = parsed(jpeg(0xC1, 64, 48, GRAY, 0, true, 12));
+    CHECK(info.precision_ == 12 && info.sampling_ == JpegSampling::GRAY && !info.baseline() && info.orientation_ == 1);
+
+    info = parsed(jpeg(0xC0, 64, 48, CMYK));
+    CHECK(info.components_ == 4 && info.sampling_ == JpegSampling::OTHER && !info.baseline());
+
+    info = parsed(jpeg(0xC9, 64, 48, YUV444));
+    CHECK(info.arithmetic_ && !info.progressive_ && info.sampling_ == JpegSampling::YUV444 && !info.baseline());
+
+    // orientation out of range is ignored
+    CHECK(parsed(jpeg(0xC0, 64, 48, YUV420, 9)).orientation_ == 1);
+
+    auto whole = jpeg(0xC0, 1920, 1080, YUV420, 6);
+    for(auto len : {2, 20, 60, 100}) {
+        parsed(Bytes(whole.begin(), whole.begin() + len), DG_ERR_INVALID_IMAGE);
+    }
+    parsed(Bytes(whole.begin() + 1, whole.end()), DG_ERR_INVALID_IMAGE);
+}
+
+/**
+ * Images stay on device at full size unless scaling is enabled, or they're over max size or non-baseline
+ */
+static void checkRoutes() {
+    JpegInfo info;
+    info.size_ = cv::Size(1920, 1080);
+    info.components_ = 3;
+    info.precision_ = 8;
+    info.sampling_ = JpegSampling::YUV420;
+    JpegLimits limits;
+    limits.target_size_ = cv::Size(640, 360);
+    auto scale = 0;
+    CHECK(limits.route(info, scale) == JpegRoute::DEVICE && scale == 1) << "Offloaded without cpu_scale_";
+    CHECK(limits.route(info, scale, false) == JpegRoute::DEVICE && scale == 1);
+    limits.cpu_scale_ = true;
+    CHECK(limits.route(info, scale) == JpegRoute::CPU && scale == 2);
+    CHECK(limits.route(info, scale, false) == JpegRoute::DEVICE && scale == 1);
+    limits.device_scale_ = true;
+    CHECK(limits.route(info, scale) == JpegRoute::DEVICE && scale == 2);
+
+    limits = JpegLimits();
+    info.size_ = cv::Size(10000, 6000);
+    CHECK(limits.route(info, scale) == JpegRoute::CPU && scale == 2);
+    CHECK(limits.route(info, scale, false) == JpegRoute::REJECT);
+    info.size_ = cv::Size(1920, 1080);
+    info.progressive_ = true;
+    CHECK(limits.route(info, scale) == JpegRoute::CPU && scale == 1);
+    CHECK(limits.route(info, scale, false) == JpegRoute::DEVICE);
+}
+
+/**
+ * Interface refusing every batch
+ */
+class Refuse : public Executable<DecodeTask> {
+public:
+    DgError sendCommand(const std::string &cmd, const std::string &param, std::map<std::string, std::string> &result) override {
+        return DG_ERR_NOT_SUPPORTED;
+    }
+    using Executable<DecodeTask>::execute;
+    DgError execute(DecodeTasks &tasks) override {
+        return DG_ERR_FULL;
+    }
+};
+
+/**
+ * Each task is called back once with its error: groups sent to device and CPU, rejected tasks, and
+ * tasks of a group failing to send
+ */
+static void checkAdmission(bool refuseCpu) {
+    auto big = jpeg(0xC0, 4000, 3000, YUV420), small = jpeg(0xC0, 640, 480, YUV420);
+    auto progressive = jpeg(0xC2, 640, 480, YUV422), huge = jpeg(0xC0, 40000, 40000, YUV420);
+    Bytes junk = {1, 2, 3, 4, 5};
+    std::vector<Bytes *> images = {&small, &big, &progressive, &junk, &small, &huge, &big};
+    std::vector<DgError> expect = {DG_OK, DG_OK, DG_OK, DG_ERR_INVALID_IMAGE, DG_OK,
+                                   DG_ERR_IMAGE_EXCEEDS_CAPABILITY, DG_OK};
+    if(refuseCpu) expect[1] = expect[2] = expect[6] = DG_ERR_FULL;
+
+    std::mutex mtx;
+    std::vector<int> calls(images.size(), 0);
+    std::vector<DgError> errors(images.size(), DG_OK);
+    std::atomic<int> done{0};
+    JpegLimits limits;
+    limits.max_size_ = cv::Size(3840, 3840);
+    {
+        JpegAdmissionExecutable decoder([](DecodeInterface::AsyncCallback cb) {
+            return std::make_shared<MockExecutable<DecodeTask>>(8, MockLatency(), cb);
+        }, [&](DecodeTasks &tasks, DgError error) {
+            std::lock_guard<std::mutex> lock(mtx);
+            for(auto &task : tasks) {
+                auto k = (size_t)task->user_data_;
+                ++calls[k];
+                errors[k] = error != DG_OK ? error : task->error_;
+                ++done;
+            }
+        }, limits, [refuseCpu](DecodeInterface::AsyncCallback cb) -> std::shared_ptr<Executable<DecodeTask>> {
+            if(refuseCpu) return std::make_shared<Refuse>();
+            return std::make_shared<MockExecutable<DecodeTask>>(8, MockLatency(), cb);
+        });
+
+        DecodeTasks tasks;
+        for(size_t k = 0; k < images.size(); k++) {
+            auto task = std::make_shared<DecodeTask>();
+            task->type_ = SdkImage::JPEG;
+            task->data_ = images[k]->data();
+            task->data_len_ = (int)images[k]->size();
+            task->user_data_ = (void *)k;
+            tasks.push_back(task);
+        }
+        CHECK(decoder.execute(tasks) == DG_OK);
+        for(auto i = 0; i < 500 && done < (int)images.size(); i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        auto st = decoder.stats();
+        CHECK(st.images_ == 7 && st.invalid_ == 1 && st.rejected_ == 1 && st.cpu_ == 3 && st.scaled_ == 2);
+        // small on device, big 1/2 and progressive on CPU
+        CHECK(st.batches_ == 3) << st.batches_;
+        CHECK(tasks[1]->getInteger(OptionKeys::jpeg_scale_(), 1) == 2);
+        CHECK(tasks[2]->getInteger(OptionKeys::jpeg_route_(), -1) == (int)JpegRoute::CPU);
+    }
+    std::lock_guard<std::mutex> lock(mtx);
+    for(size_t k = 0; k < images.size(); k++) {
+        CHECK(calls[k] == 1) << "Task " << k << " called back " << calls[k] << " times";
+        CHECK(errors[k] == expect[k]) << "Task " << k << " error " << errors[k];
+    }
+}
+
+int main(int argc, char *argv[]) {
+    checkHeaders();
+    checkRoutes();
+    checkAdmission(false);
+    checkAdmission(true);
+    LOG(ERROR) << "JPEG headers, routes and admission ok";
+    if(argc < 2) {
+        LOG(ERROR) << "Usage: " << argv[0] << " [jpeg...]";
+        LOG(ERROR) << "  target size of env VEGA_TARGET_WIDTH/VEGA_TARGET_HEIGHT, default 1280x720";
+        LOG(ERROR) << "  routes by env VEGA_MAX_TEST_IMAGE_WIDTH/VEGA_MAX_TEST_IMAGE_HEIGHT";
+        return 0;
+    }
+    const char *routes[] = {"device", "cpu", "reject"};
+    auto limits = JpegLimits::fromEnv();
+    auto *tw = getenv("VEGA_TARGET_WIDTH");
+    auto *th = getenv("VEGA_TARGET_HEIGHT");
+    limits.target_size_ = cv::Size(tw ? atoi(tw) : 1280, th ? atoi(th) : 720);
+    limits.cpu_scale_ = true;
+    const int flags[] = {cv::IMREAD_COLOR, cv::IMREAD_COLOR, cv::IMREAD_REDUCED_COLOR_2, 0,
+                         cv::IMREAD_REDUCED_COLOR_4, 0, 0, 0, cv::IMREAD_REDUCED_COLOR_8};
+    const int rounds = 1000;
+    for(auto i = 1; i < argc; i++) {
+        std::ifstream ifs(argv[i], std::ios::binary);
+        std::vector<uint8_t> data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+        JpegInfo info;
+        auto error = JpegHeader::parse(data.data(), data.size(), info);
+        if(error != DG_OK) {
+            LOG(ERROR) << argv[i] << ": not JPEG, " << error;
+            continue;
+        }
+
+        VegaTmPnt start("start");
+        for(auto r = 0; r < rounds; r++) {
+            CHECK(JpegHeader::parse(data.data(), data.size(), info) == DG_OK);
+        }
+        auto parseUs = (VegaTmPnt("stop") - start) * 1000 / rounds;
+        start.mark();
+        auto img = cv::imdecode(data, cv::IMREAD_COLOR);
+        auto decodeUs = (VegaTmPnt("stop") - start) * 1000;
+        CHECK(!img.empty()) << "Decode " << argv[i] << " fail";
+        CHECK(img.cols == info.size_.width && img.rows == info.size_.height)
+            << "Decoded " << img.cols << "x" << img.rows << " of header " << info.size_;
+
+        auto scale = 1;
+        auto route = limits.route(info, scale);
+        start.mark();
+        auto scaled = cv::imdecode(data, flags[scale]);
+        auto scaledUs = (VegaTmPnt("stop") - start) * 1000;
+        CHECK(scaled.size() == info.scaledSize(scale)) << "Decoded " << scaled.size() << " of 1/" << scale;
+
+        LOG(ERROR) << argv[i] << ": " << info.size_ << ", " << info.components_ << " components, sampling "
+                   << (int)info.sampling_ << ", " << info.precision_ << " bits, "
+                   << (info.progressive_ ? "progressive" : "sequential") << ", orientation " << info.orientation_
+                   << ", route " << routes[(int)route] << " at 1/" << scale;
+        LOG(ERROR) << "  header " << parseUs << " us, decode " << decodeUs << " us, " << img.total() * 3
+                   << " bytes, decode 1/" << scale << " " << scaledUs << " us, " << scaled.total() * 3 << " bytes";
+    }
+    return 0;
+}
@@ -0,0 +1,287 @@
+//
+// Packets read by PacketInfo and dropped by LoadSheddingExecutable, on synthetic H.264/H.265 NAL units
+// and a mock decoder: I slices are keys, decoding resumes at keys or recovery points, RASL pictures
+// and temporal layers of H.265 resume where nothing dropped is referred to
+//
+
+#include "vega_interface.h"
+#include "vega_load_shed.h"
+#include "vega_mock_device.h"
+
+#include <algorithm>
+
+using namespace vega;
+
+using DecodeTasks = std::vector<std::shared_ptr<DecodeTask>>;
+using Packet = std::vector<uint8_t>;
+
+/**
+ * RBSP of a NAL unit, emulation prevention bytes are inserted by nal()
+ */
+class BitWriter {
+public:
+    BitWriter &bits(uint32_t v, int n) {
+        while(n-- > 0) {
+            if(used_ % 8 == 0) rbsp_.push_back(0);
+            rbsp_.back() |= ((v >> n) & 1) << (7 - used_ % 8);
+            ++used_;
+        }
+        return *this;
+    }
+    BitWriter &ue(uint32_t v) {
+        auto len = 0;
+        while((v + 1) >> (len + 1)) ++len;
+        return bits(0, len).bits(v + 1, len + 1);
+    }
+
+    /**
+     * Start code, header and escaped RBSP with stop bit
+     */
+    Packet nal(std::initializer_list<uint8_t> header) {
+        bits(1, 1);
+        Packet out(3, 0);
+        out.push_back(1);
+        for(auto b : header) out.push_back(b);
+        auto zeros = 0;
+        for(auto b : rbsp_) {
+            if(zeros >= 2 && b <= 3) {
+                out.push_back(3);
+                zeros = 0;
+            }
+            out.push_back(b);
+            zeros = b == 0 ? zeros + 1 : 0;
+        }
+        return out;
+    }
+
+protected:
+    Packet rbsp_;
+    int used_ = 0;
+};
+
+static Packet operator + (Packet a, const Packet &b) {
+    a.insert(a.end(), b.begin(), b.end());
+    return a;
+}
+
+/**
+ * H.264 slice of nal_ref_idc, NAL type and slice_type
+ */
+static Packet avc(int refIdc, int type, int sliceType, uint32_t firstMb = 0) {
+    return BitWriter().ue(firstMb).ue((uint32_t)sliceType).ue(0).bits(0x5, 4).nal({(uint8_t)(refIdc << 5 | type)});
+}
+/**
+ * H.265 first slice segment of NAL type, TemporalId and slice_type (0 B, 1 P, 2 I)
+ */
+static Packet hevc(int type, int tid, int sliceType, int extraBits = 0) {
+    BitWriter w;
+    w.bits(1, 1);
+    if(type >= 16 && type <= 23) w.bits(0, 1);
+    w.ue(0).bits(0x3, extraBits).ue((uint32_t)sliceType).bits(0x5, 4);
+    return w.nal({(uint8_t)(type << 1), (uint8_t)(tid + 1)});
+}
+static Packet hevcPps(int extraBits) {
+    return BitWriter().ue(0).ue(0).bits(0, 2).bits((uint32_t)extraBits, 3).bits(0x3, 2).nal({34 << 1, 1});
+}
+/**
+ * SEI of a recovery point
+ */
+static Packet recovery(bool h265) {
+    BitWriter w;
+    w.bits(6, 8).bits(1, 8).bits(0x80, 8);
+    return h265 ? w.nal({39 << 1, 1}) : w.nal({6});
+}
+
+/**
+ * Load shedding on a mock decoder, load is set by tests
+ */
+class Shedder {
+public:
+    Shedder() {
+        ShedWatermarks marks;
+        marks.recover_ms_ = 0;
+        decoder_ = std::make_shared<LoadSheddingExecutable>([](DecodeInterface::AsyncCallback cb) {
+            return std::make_shared<MockExecutable<DecodeTask>>(8, MockLatency(), cb);
+        }, [](DecodeTasks &tasks, DgError error) {
+            CHECK(error == DG_OK);
+        }, 0, marks);
+        decoder_->addProbe([this]() { return load_; });
+    }
+
+    /**
+     * @return whether packet is dropped
+     */
+    bool send(Packet &packet, SdkImage codec, StreamId sid) {
+        DecodeTasks tasks(1, std::make_shared<DecodeTask>());
+        auto &task = tasks[0];
+        task->stream_id_ = sid;
+        task->type_ = codec;
+        task->data_ = packet.data();
+        task->data_len_ = (int)packet.size();
+        CHECK(decoder_->execute(tasks) == DG_OK);
+        return task->getBool(OptionKeys::load_shed_(), false);
+    }
+
+    /**
+     * Set load and step level by end of stream packets until it reaches level
+     */
+    void settle(double load, ShedLevel level) {
+        load_ = load;
+        for(auto i = 0; i < 8 && decoder_->stats().level_ != level; i++) {
+            DecodeTasks tasks(1, std::make_shared<DecodeTask>());
+            tasks[0]->stream_id_ = 0;
+            tasks[0]->put(OptionKeys::video_eos_(), true);
+            CHECK(decoder_->execute(tasks) == DG_OK);
+        }
+        CHECK(decoder_->stats().level_ == level) << "Level " << (int)decoder_->stats().level_;
+    }
+
+public:
+    double load_ = 0;
+    std::shared_ptr<LoadSheddingExecutable> decoder_;
+};
+
+int main(int argc, char *argv[]) {
+    // emulation prevention
+    {
+        const uint8_t escaped[] = {0x00, 0x00, 0x03, 0x00, 0x80};
+        RbspReader r(escaped, escaped + sizeof(escaped));
+        CHECK(r.bits(32) == 0x80 && r.ok());
+        r.bits(1);
+        CHECK(!r.ok());
+
+        auto slice = avc(2, 1, 7, (1u << 23) - 1);
+        CHECK(std::search(slice.begin(), slice.end(), escaped, escaped + 3) != slice.end()) << "Not escaped";
+        auto info = PacketInfo::inspect(slice.data(), slice.size(), SdkImage::H264);
+        CHECK(info.slice_ && info.intra_ && !info.key_);
+    }
+
+    // H.264 packets
+    {
+        auto idr = avc(3, 5, 7);
+        auto info = PacketInfo::inspect(idr.data(), idr.size(), SdkImage::H264);
+        CHECK(info.slice_ && info.key_ && info.intra_ && info.reference_ && info.nal_type_ == 5);
+        auto p = avc(2, 1, 0);
+        info = PacketInfo::inspect(p.data(), p.size(), SdkImage::H264);
+        CHECK(info.slice_ && !info.key_ && !info.intra_ && info.reference_ && !info.recovery_);
+        // I and P slices of one picture
+        auto mixed = avc(2, 1, 2) + avc(2, 1, 0, 40);
+        CHECK(!PacketInfo::inspect(mixed.data(), mixed.size(), SdkImage::H264).intra_);
+        auto b = avc(0, 1, 1);
+        CHECK(!PacketInfo::inspect(b.data(), b.size(), SdkImage::H264).reference_);
+        auto point = recovery(false) + p;
+        CHECK(PacketInfo::inspect(point.data(), point.size(), SdkImage::H264).recovery_);
+    }
+
+    // H.265 packets, slice_type behind num_extra_slice_header_bits of PPS
+    {
+        auto cra = hevc(21, 0, 2);
+        auto info = PacketInfo::inspect(cra.data(), cra.size(), SdkImage::H265);
+        CHECK(info.key_ && info.intra_ && info.nal_type_ == 21 && info.extra_slice_header_bits_ == -1);
+        auto tsa = hevc(2, 1, 1);
+        info = PacketInfo::inspect(tsa.data(), tsa.size(), SdkImage::H265);
+        CHECK(!info.key_ && !info.intra_ && !info.reference_ && info.temporal_id_ == 1);
+
+        auto extra = hevc(1, 0, 2, 2);
+        CHECK(PacketInfo::inspect(extra.data(), extra.size(), SdkImage::H265, 2).intra_);
+        CHECK(!PacketInfo::inspect(extra.data(), extra.size(), SdkImage::H265, 0).intra_);
+        auto withPps = hevcPps(2) + extra;
+        info = PacketInfo::inspect(withPps.data(), withPps.size(), SdkImage::H265);
+        CHECK(info.intra_ && info.extra_slice_header_bits_ == 2);
+    }
+
+    // H.264: KEY_ONLY decodes I slices, resumes at recovery point
+    {
+        Shedder s;
+        auto idr = avc(3, 5, 7), i = avc(2, 1, 7), p = avc(2, 1, 0), b = avc(0, 1, 1);
+        auto point = recovery(false) + avc(2, 1, 0);
+        s.settle(0.95, ShedLevel::KEY_ONLY);
+        CHECK(s.send(p, SdkImage::H264, 1));
+        CHECK(!s.send(i, SdkImage::H264, 1)) << "I slice of open GOP dropped";
+        CHECK(s.send(b, SdkImage::H264, 1));
+        CHECK(!s.send(idr, SdkImage::H264, 1));
+
+        s.settle(0.75, ShedLevel::NON_REF);
+        CHECK(s.send(p, SdkImage::H264, 1)) << "P resumed without key";
+        CHECK(!s.send(point, SdkImage::H264, 1));
+        CHECK(s.send(b, SdkImage::H264, 1));
+        CHECK(!s.send(p, SdkImage::H264, 1));
+
+        s.settle(0, ShedLevel::NONE);
+        CHECK(!s.send(b, SdkImage::H264, 1));
+        auto st = s.decoder_->streamStats(1);
+        CHECK(st.packets_ == 9 && st.dropped_non_key_ == 3 && st.dropped_non_ref_ == 1 && !st.waiting_key_);
+    }
+
+    // H.265: temporal layers resume at TSA/STSA, RASL of CRA are dropped after resuming
+    {
+        Shedder s;
+        auto trail = hevc(1, 0, 1), trailN = hevc(0, 0, 0), layer1 = hevc(1, 1, 0), layer2 = hevc(1, 2, 0);
+        auto tsa1 = hevc(2, 1, 0), stsa1 = hevc(4, 1, 1), stsa2 = hevc(5, 2, 1), stsa3 = hevc(5, 3, 1), layer3 = hevc(1, 3, 0);
+        s.settle(0.75, ShedLevel::NON_REF);
+        CHECK(!s.send(trail, SdkImage::H265, 2));
+        CHECK(s.send(trailN, SdkImage::H265, 2));
+        CHECK(s.send(layer1, SdkImage::H265, 2));
+
+        s.settle(0, ShedLevel::NONE);
+        CHECK(s.send(layer1, SdkImage::H265, 2)) << "Layer 1 resumed mid GOP";
+        CHECK(s.send(stsa2, SdkImage::H265, 2)) << "Layer 2 resumed above a missing layer";
+        CHECK(!s.send(tsa1, SdkImage::H265, 2));
+        CHECK(!s.send(layer2, SdkImage::H265, 2));
+
+        // STSA switches to its own layer only
+        s.settle(0.75, ShedLevel::NON_REF);
+        CHECK(s.send(layer1, SdkImage::H265, 2));
+        s.settle(0, ShedLevel::NONE);
+        CHECK(!s.send(trail, SdkImage::H265, 2));
+        CHECK(!s.send(stsa1, SdkImage::H265, 2));
+        CHECK(s.send(layer2, SdkImage::H265, 2));
+        CHECK(!s.send(stsa2, SdkImage::H265, 2));
+        CHECK(s.send(layer3, SdkImage::H265, 2));
+        CHECK(!s.send(stsa3, SdkImage::H265, 2));
+        CHECK(!s.send(layer3, SdkImage::H265, 2));
+
+        auto pps = hevcPps(2), extra = hevc(1, 0, 2, 2), cra = hevc(21, 0, 2, 2);
+        auto rasl = hevc(8, 0, 0, 2), radl = hevc(7, 0, 1, 2), after = hevc(1, 0, 1, 2);
+        s.settle(0.95, ShedLevel::KEY_ONLY);
+        CHECK(!s.send(pps, SdkImage::H265, 2));
+        CHECK(!s.send(extra, SdkImage::H265, 2)) << "I slice after PPS of extra bits dropped";
+        CHECK(s.send(after, SdkImage::H265, 2));
+        s.settle(0, ShedLevel::NON_REF);
+        s.settle(0, ShedLevel::NONE);
+        CHECK(s.send(after, SdkImage::H265, 2));
+        CHECK(!s.send(cra, SdkImage::H265, 2));
+        CHECK(s.send(rasl, SdkImage::H265, 2)) << "RASL of CRA resumed at";
+        CHECK(!s.send(radl, SdkImage::H265, 2));
+        CHECK(s.send(rasl, SdkImage::H265, 2));
+        CHECK(!s.send(after, SdkImage::H265, 2));
+        CHECK(!s.send(rasl, SdkImage::H265, 2));
+        CHECK(!s.send(layer2, SdkImage::H265, 2)) << "Layers after IRAP not resumed";
+    }
+
+    // H.265: layers given up resume at IRAP of a stream without TSA/STSA
+    {
+        Shedder s;
+        auto trailN = hevc(0, 0, 0), layer1 = hevc(1, 1, 0), idr = hevc(19, 0, 2), cra = hevc(21, 0, 2);
+        auto rasl = hevc(8, 0, 0), trail = hevc(1, 0, 1);
+        s.settle(0.75, ShedLevel::NON_REF);
+        CHECK(s.send(trailN, SdkImage::H265, 3));
+        s.settle(0, ShedLevel::NONE);
+        CHECK(s.send(layer1, SdkImage::H265, 3));
+        CHECK(!s.send(idr, SdkImage::H265, 3));
+        CHECK(!s.send(layer1, SdkImage::H265, 3)) << "Layers after IDR not resumed";
+        CHECK(!s.send(layer1, SdkImage::H265, 3));
+
+        s.settle(0.75, ShedLevel::NON_REF);
+        CHECK(s.send(trailN, SdkImage::H265, 3));
+        s.settle(0, ShedLevel::NONE);
+        CHECK(!s.send(cra, SdkImage::H265, 3));
+        CHECK(s.send(rasl, SdkImage::H265, 3)) << "RASL of CRA resumed at";
+        CHECK(!s.send(layer1, SdkImage::H265, 3)) << "Layers after CRA not resumed";
+        CHECK(!s.send(trail, SdkImage::H265, 3));
+        CHECK(!s.send(rasl, SdkImage::H265, 3));
+    }
+
+    LOG(ERROR) << "Load shedding ok";
+    return 0;
+}
@@ -0,0 +1,120 @@
+//
+// Load test of a detect -> classify callback graph on mock devices, at multiples of a base frame rate
+//
+
+#include "vega_interface.h"
+#include "vega_batching.h"
+#include "vega_mock_device.h"
+#include "vega_time_pnt.h"
+#include <zfz/zfz_event.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+
+using namespace vega;
+
+using DetectTasks = std::vector<std::shared_ptr<DetectTask>>;
+using ClassifierTasks = std::vector<std::shared_ptr<ClassifierTask>>;
+
+/**
+ * Frame in flight, ends when all its boxes are classified
+ */
+struct Frame {
+    VegaTmPnt sent_;
+    std::atomic<int> left_{0};
+};
+
+int main(int argc, char *argv[]) {
+    if(argc < 2) {
+        LOG(ERROR) << "Usage: " << argv[0] << " <base_fps> [max_rate] [seconds] [completion_threads]";
+        return 2;
+    }
+    int baseFps = atoi(argv[1]);
+    int maxRate = argc > 2 ? atoi(argv[2]) : 10;
+    int seconds = argc > 3 ? atoi(argv[3]) : 2;
+    int completionThreads = argc > 4 ? atoi(argv[4]) : 2;
+    CHECK(baseFps > 0 && maxRate > 0 && seconds > 0 && completionThreads >= 0);
+
+    MockLatency detectLatency;
+    detectLatency.fixed_us_ = 4000;
+    detectLatency.per_task_us_ = 500;
+    detectLatency.jitter_us_ = 1000;
+    MockLatency classifyLatency;
+    classifyLatency.fixed_us_ = 2000;
+    classifyLatency.per_task_us_ = 200;
+    classifyLatency.jitter_us_ = 500;
+
+    for(auto rate = 1; rate <= maxRate; rate *= 2) {
+        auto fps = baseFps * rate;
+        auto total = fps * seconds;
+        std::vector<std::shared_ptr<Frame>> frames(total);
+        std::vector<double> latency(total);
+        std::atomic<int> done{0};
+        zfz::Event evt;
+        auto finish = [&](long idx) {
+            auto &frame = frames[idx];
+            latency[idx] = VegaTmPnt("done") - frame->sent_;
+            if(++done == total) evt.set();
+        };
+
+        auto classifier = std::make_shared<BatchingExecutable<ClassifierTask>>(
+                [&](ClassifierInterface::AsyncCallback cb) {
+                    return createMockClassifierInterface(16, classifyLatency, cb, completionThreads);
+                }, nullptr, 2000);
+        std::shared_ptr<MockExecutable<DetectTask>> mock;
+        auto detector = createMockDetectInterface(8, detectLatency, [&](DetectTasks &tasks, DgError error) {
+            CHECK(error == DG_OK);
+            for(auto &task : tasks) {
+                auto idx = (long)task->user_data_;
+                if(task->result_.empty()) {
+                    finish(idx);
+                    continue;
+                }
+                frames[idx]->left_ = (int)task->result_.size();
+                for(auto &box : task->result_) {
+                    auto ctask = std::make_shared<ClassifierTask>();
+                    ctask->stream_id_ = task->stream_id_;
+                    ctask->frame_id_ = task->frame_id_;
+                    ctask->roi_ = box.rect_;
+                    CHECK(classifier->submit(ctask, [&, idx](std::shared_ptr<ClassifierTask> &, DgError err) {
+                        CHECK(err == DG_OK);
+                        if(--frames[idx]->left_ == 0) finish(idx);
+                    }) == DG_OK);
+                }
+            }
+        }, completionThreads);
+        mock = std::dynamic_pointer_cast<MockExecutable<DetectTask>>(detector);
+
+        size_t peakQueued = 0;
+        VegaTmPnt start("start");
+        auto intv = std::chrono::microseconds(1000000 * 8 / fps);
+        auto next = std::chrono::steady_clock::now();
+        for(auto i = 0; i < total; i += 8) {
+            DetectTasks tasks;
+            for(auto j = i; j < total && j < i + 8; j++) {
+                frames[j] = std::make_shared<Frame>();
+                frames[j]->sent_.mark();
+                auto task = std::make_shared<DetectTask>();
+                task->stream_id_ = 0;
+                task->frame_id_ = j;
+                task->user_data_ = (void *)(long)j;
+                tasks.push_back(task);
+            }
+            CHECK(detector->execute(tasks) == DG_OK);
+            peakQueued = std::max(peakQueued, mock->queued());
+            next += intv;
+            std::this_thread::sleep_until(next);
+        }
+        evt.wait();
+        auto sec = (VegaTmPnt("stop") - start) / 1000;
+
+        std::sort(latency.begin(), latency.end());
+        LOG(ERROR) << rate << "x (" << fps << " fps): " << total / sec << " frames/s, latency p50 "
+                   << latency[total / 2] << " ms, p99 " << latency[(total - 1) * 99 / 100]
+                   << " ms, peak detect queue " << peakQueued << ", classify fill "
+                   << classifier->stats().fill_rate_;
+    }
+
+    return 0;
+}
@@ -0,0 +1,341 @@
+//
+// Throughput of concurrent decode streams of an Annex-B file, on a device or on the CPU stand-in,
+// optionally fetching each frame before it's freed. Prints a JSON line of each stream count.
+//
+
+#include "vega_interface.h"
+#include "vega_annexb.h"
+#include "vega_cpu_backend.h"
+#include "vega_frame_budget.h"
+#include "vega_load_shed.h"
+#include "vega_mock_device.h"
+#include "vega_pacer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+using namespace vega;
+
+#define SID0 100
+
+using Clock = Pacer::Clock;
+using DecodeTasks = std::vector<std::shared_ptr<DecodeTask>>;
+using FetchTasks = std::vector<std::shared_ptr<FetchFrameTask>>;
+
+/**
+ * Counters of a stream, latency_ and sent_ are by packet
+ */
+struct StreamRun {
+    StreamId sid_ = 0;
+    std::vector<Clock::time_point> sent_;
+    std::vector<double> latency_;       ///<! ms from execute() to callback, negative if no callback
+    std::atomic<long> decoded_{0};
+    std::atomic<long> discarded_{0};
+    std::atomic<long> failed_{0};
+    Clock::time_point last_;            ///<! last callback, guarded by mutex of run()
+};
+
+/**
+ * Interfaces of a backend
+ */
+struct Backend {
+    std::string name_;
+    std::shared_ptr<CpuBackend> cpu_;
+    DecodeInterface::Creator decode_;
+    FetchFrameInterface::Creator fetch_;
+    FreeFrameInterface::Creator free_;
+    RemoveStreamInterface::Creator remove_;
+};
+
+/**
+ * Device interfaces of decode_video, fetch_frame, delete_frame and delete_stream
+ */
+static Backend deviceBackend(int device) {
+    Backend b;
+    b.name_ = "device" + std::to_string(device);
+    b.decode_ = [device](DecodeInterface::AsyncCallback cb) {
+        return createDecodeInterface(device, "", Model::decode_video, nullptr, cb);
+    };
+    b.fetch_ = [device](FetchFrameInterface::AsyncCallback cb) {
+        return createFetchFrameInterface(device, "", Model::fetch_frame, nullptr, cb);
+    };
+    b.free_ = [device](FreeFrameInterface::AsyncCallback cb) {
+        return createFreeFrameInterface(device, "", Model::delete_frame, nullptr, cb);
+    };
+    b.remove_ = [device](RemoveStreamInterface::AsyncCallback cb) {
+        return createRemoveStreamInterface(device, "", Model::delete_stream, nullptr, cb);
+    };
+    return b;
+}
+
+/**
+ * CpuBackend with a mock video decoder, which takes decodeUs a packet in order like a
+ * hardware decoder, and keeps a synthetic NV12 frame of size in the pool of backend
+ */
+static Backend cpuBackend(int decodeUs, cv::Size size) {
+    Backend b;
+    b.name_ = "cpu";
+    b.cpu_ = std::make_shared<CpuBackend>();
+    auto frame = std::make_shared<CpuFrame>();
+    frame->type_ = SdkImage::NV12;
+    frame->size_ = size;
+    frame->mat_ = cv::Mat(size.height * 3 / 2, size.width, CV_8UC1, cv::Scalar(128));
+    auto cpu = b.cpu_;
+    b.decode_ = [cpu, frame, decodeUs, size](DecodeInterface::AsyncCallback cb) {
+        MockLatency latency;
+        latency.per_task_us_ = decodeUs;
+        return std::make_shared<MockExecutable<DecodeTask>>(8, latency, cb, [cpu, frame, size](DecodeTask &task, std::mt19937 &) {
+            if(task.data_ == nullptr || task.getBool(OptionKeys::discard_frame_(), false)) return;
+            task.size_ = size;
+            task.frame_id_ = cpu->pool().add(task.stream_id_, frame);
+        }, 1);
+    };
+    b.fetch_ = [cpu](FetchFrameInterface::AsyncCallback cb) {
+        return cpu->createFetchFrameInterface(cb);
+    };
+    b.free_ = [cpu](FreeFrameInterface::AsyncCallback cb) {
+        return cpu->createFreeFrameInterface(cb);
+    };
+    b.remove_ = [cpu](RemoveStreamInterface::AsyncCallback cb) {
+        return cpu->createRemoveStreamInterface(cb);
+    };
+    return b;
+}
+
+static double percentile(std::vector<double> &sorted, double p) {
+    if(sorted.empty()) return 0;
+    return sorted[(size_t)(p * (double)(sorted.size() - 1) + 0.5)];
+}
+
+/**
+ * Run streams paced at fps for frames packets each, JSON of results
+ */
+static std::string run(Backend &backend, std::vector<AccessUnit> &units, SdkImage codec,
+                       int streams, int fps, long frames, bool fetch, int shedInFlight) {
+    std::vector<std::shared_ptr<StreamRun>> runs;
+    for(auto i = 0; i < streams; i++) {
+        auto s = std::make_shared<StreamRun>();
+        s->sid_ = SID0 + i;
+        s->sent_.resize((size_t)frames);
+        s->latency_.assign((size_t)frames, -1);
+        runs.push_back(s);
+    }
+    std::mutex mtx;
+    std::map<int, long> errors, fetchErrors;
+    std::atomic<long> pending{0};
+
+    auto releaser = std::make_shared<FrameReleaser>(backend.free_, backend.remove_);
+    std::shared_ptr<FrameBudgetExecutable> decoder;
+    std::shared_ptr<TaskRefExecutable<FetchFrameTask>> fetcher;
+    if(fetch) {
+        // frames are held by fetch tasks, and freed after they are called back
+        fetcher = std::make_shared<TaskRefExecutable<FetchFrameTask>>(backend.fetch_, [&](FetchTasks &tasks, DgError error) {
+            for(auto &task : tasks) {
+                auto err = error != DG_OK ? error : task->error_;
+                if(err != DG_OK) {
+                    std::lock_guard<std::mutex> lock(mtx);
+                    ++fetchErrors[err];
+                }
+                --pending;
+            }
+        });
+    }
+    // packets dropped by load shedding are called back with discard_frame_, counted as discarded
+    std::shared_ptr<LoadSheddingExecutable> shedder;
+    auto decode = backend.decode_;
+    if(shedInFlight > 0) {
+        decode = [&](DecodeInterface::AsyncCallback cb) {
+            shedder = std::make_shared<LoadSheddingExecutable>(backend.decode_, cb, shedInFlight);
+            return shedder;
+        };
+    }
+    // budget without limit, only for occupancy of matrix pool
+    decoder = std::make_shared<FrameBudgetExecutable>(decode, releaser, [&](DecodeTasks &tasks, DgError error) {
+        auto now = Clock::now();
+        for(auto &task : tasks) {
+            auto &s = *runs[task->stream_id_ - SID0];
+            if(task->getBool(OptionKeys::video_eos_(), false)) {
+                --pending;
+                continue;
+            }
+            auto k = (long)task->user_data_;
+            s.latency_[k] = std::chrono::duration<double, std::milli>(now - s.sent_[k]).count();
+            auto err = error != DG_OK ? error : task->error_;
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                s.last_ = now;
+                if(err != DG_OK && err != DG_ON_GOING) ++errors[err];
+            }
+            if(err != DG_OK && err != DG_ON_GOING) {
+                ++s.failed_;
+            } else if(task->getBool(OptionKeys::discard_frame_(), false)) {
+                ++s.discarded_;
+            } else {
+                ++s.decoded_;
+                if(fetcher) {
+                    FetchTasks fetches;
+                    auto ftask = std::make_shared<FetchFrameTask>();
+                    ftask->stream_id_ = task->stream_id_;
+                    ftask->frame_id_ = task->frame_id_;
+                    ftask->type_ = SdkImage::JPEG;
+                    fetches.push_back(ftask);
+                    decoder->handle(task->stream_id_, task->frame_id_).bind(*ftask, fetcher->refs());
+                    ++pending;
+                    if(fetcher->execute(fetches) != DG_OK) {
+                        --pending;
+                    }
+                }
+                decoder->release(task->stream_id_, task->frame_id_);
+            }
+            --pending;
+        }
+    }, 0);
+
+    auto send = [&](StreamRun &s, long k, bool eos) {
+        DecodeTasks tasks;
+        auto task = std::make_shared<DecodeTask>();
+        if(eos) {
+            task->type_ = codec;
+        } else {
+            units[(size_t)k % units.size()].bind(*task, codec);
+        }
+        task->stream_id_ = s.sid_;
+        task->user_data_ = (void *)k;
+        task->put(OptionKeys::packet_index_(), k);
+        task->put(OptionKeys::video_eos_(), eos);
+        tasks.push_back(task);
+        if(!eos) s.sent_[k] = Clock::now();
+        ++pending;
+        auto error = decoder->execute(tasks);
+        if(error != DG_OK) {
+            --pending;
+            if(eos) return;
+            std::lock_guard<std::mutex> lock(mtx);
+            ++errors[error];
+            ++s.failed_;
+        }
+    };
+
+    // streams start spread over a frame interval, packets loop over the file
+    auto begin = Clock::now() + std::chrono::milliseconds(100);
+    {
+        Pacer pacer(1 + streams / 64);
+        std::vector<int> ids;
+        for(auto &s : runs) {
+            auto offset = std::chrono::microseconds(1000000L / fps * (s->sid_ - SID0) / streams);
+            auto *sp = s.get();
+            ids.push_back(pacer.add(fps, [&, sp](long k) {
+                send(*sp, k, false);
+                return k + 1 < frames;
+            }, begin + offset));
+        }
+        for(auto id : ids) pacer.join(id);
+        auto late = pacer.stats();
+        LOG(ERROR) << streams << " streams sent, pacing late mean " << late.mean_late_us_ << " us, max "
+                   << late.max_late_us_ << " us";
+    }
+    for(auto &s : runs) send(*s, frames, true);
+    for(auto i = 0; pending > 0 && i < 6000; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    if(pending > 0) {
+        LOG(ERROR) << pending << " callbacks missing";
+    }
+    for(auto &s : runs) {
+        decoder->removeStream(s->sid_);
+        if(shedder) shedder->removeStream(s->sid_);
+    }
+    auto pool = decoder->stats();
+    auto shed = shedder ? shedder->stats() : LoadSheddingExecutable::Stats();
+
+    std::ostringstream os;
+    std::vector<double> latency;
+    long decoded = 0, discarded = 0, failed = 0, lost = 0;
+    double fpsMin = 1e9, fpsSum = 0;
+    std::ostringstream per;
+    for(auto &s : runs) {
+        for(auto l : s->latency_) {
+            if(l >= 0) latency.push_back(l);
+            else ++lost;
+        }
+        decoded += s->decoded_;
+        discarded += s->discarded_;
+        failed += s->failed_;
+        // frames after the first over time from sending the first
+        auto done = s->decoded_ + s->discarded_;
+        auto secs = std::chrono::duration<double>(s->last_ - s->sent_[0]).count();
+        auto sfps = secs > 0 && done > 1 ? (double)(done - 1) / secs : 0;
+        fpsMin = std::min(fpsMin, sfps);
+        fpsSum += sfps;
+        per << (s.get() == runs.front().get() ? "" : ",") << "{\"sid\":" << s->sid_ << ",\"decoded\":" << s->decoded_
+            << ",\"discarded\":" << s->discarded_ << ",\"failed\":" << s->failed_ << ",\"fps\":" << sfps << "}";
+    }
+    std::sort(latency.begin(), latency.end());
+    auto codes = [](const std::map<int, long> &m) {
+        std::ostringstream c;
+        for(auto &it : m) c << (it.first == m.begin()->first ? "" : ",") << "\"" << it.first << "\":" << it.second;
+        return c.str();
+    };
+
+    os << "{\"backend\":\"" << backend.name_ << "\",\"streams\":" << streams << ",\"fps\":" << fps
+       << ",\"frames\":" << frames << ",\"fetch\":" << (fetch ? "true" : "false")
+       << ",\"decoded\":" << decoded << ",\"discarded\":" << discarded << ",\"failed\":" << failed << ",\"lost\":" << lost
+       << ",\"fps_min\":" << fpsMin << ",\"fps_mean\":" << fpsSum / streams
+       << ",\"latency_ms\":{\"p50\":" << percentile(latency, 0.5) << ",\"p90\":" << percentile(latency, 0.9)
+       << ",\"p99\":" << percentile(latency, 0.99) << ",\"max\":" << (latency.empty() ? 0 : latency.back()) << "}"
+       << ",\"errors\":{" << codes(errors) << "},\"fetch_errors\":{" << codes(fetchErrors) << "}"
+       << ",\"pool\":{\"peak_frames\":" << pool.peak_frames_ << ",\"peak_bytes\":" << pool.peak_bytes_
+       << ",\"frames_left\":" << pool.frames_ << "}"
+       << ",\"shed\":{\"dropped\":" << shed.dropped_ << ",\"changes\":" << shed.changes_ << "}"
+       << ",\"per_stream\":[" << per.str() << "]}";
+    decoder.reset();
+    fetcher.reset();
+    shedder.reset();
+    return os.str();
+}
+
+int main(int argc, char *argv[]) {
+    if(argc < 3) {
+        LOG(ERROR) << "Usage: " << argv[0] << " <device_id|cpu> <annexb_file> [streams=1,4,16,64] [fps=25] [seconds=10] "
+                   << "[fetch=0] [cpu_decode_us=1000] [shed_in_flight=0]";
+        LOG(ERROR) << "  annexb_file: H.264/H.265 elementary stream named *.h264, *.264, *.h265, *.265 or *.hevc";
+        LOG(ERROR) << "  shed_in_flight: packets in decoding at full load of load shedding, 0 to not shed";
+        return 2;
+    }
+    std::string path = argv[2];
+    auto ext = path.substr(path.rfind('.') + 1);
+    auto codec = (ext == "h265" || ext == "265" || ext == "hevc") ? SdkImage::H265 : SdkImage::H264;
+    std::vector<int> counts;
+    std::stringstream list(argc > 3 ? argv[3] : "1,4,16,64");
+    for(std::string item; std::getline(list, item, ',');) {
+        counts.push_back(atoi(item.c_str()));
+        CHECK(counts.back() > 0) << "Invalid stream count " << item;
+    }
+    int fps = argc > 4 ? atoi(argv[4]) : 25;
+    int seconds = argc > 5 ? atoi(argv[5]) : 10;
+    bool fetch = argc > 6 && atoi(argv[6]);
+    int decodeUs = argc > 7 ? atoi(argv[7]) : 1000;
+    int shedInFlight = argc > 8 ? atoi(argv[8]) : 0;
+    CHECK(fps > 0 && seconds > 0 && decodeUs >= 0 && shedInFlight >= 0);
+
+    std::vector<AccessUnit> units;
+    CHECK(splitAnnexBFile(path, codec, units) == DG_OK);
+    CHECK(!units.empty()) << "No access unit in " << path;
+
+    Backend backend;
+    if(std::string(argv[1]) == "cpu") {
+        backend = cpuBackend(decodeUs, cv::Size(1920, 1080));
+    } else {
+        SDKInit("");
+        backend = deviceBackend(atoi(argv[1]));
+    }
+    for(auto streams : counts) {
+        std::cout << run(backend, units, codec, streams, fps, (long)fps * seconds, fetch, shedInFlight) << std::endl;
+    }
+    backend = Backend();
+    if(std::string(argv[1]) != "cpu") SDKDestroy();
+    return 0;
+}
@@ -0,0 +1,67 @@
+//
+// MultiFetchExecutable on a mock fetch interface: crops of JPEG are split into fetch tasks
+// and gathered back in order, crops of raw types and resizing are refused
+//
+
+#include "vega_interface.h"
+#include "vega_multi_fetch.h"
+#include "vega_mock_device.h"
+
+#include <future>
+
+using namespace vega;
+
+using Tasks = std::vector<std::shared_ptr<MultiFetchFrameTask>>;
+
+int main(int argc, char *argv[]) {
+    std::shared_ptr<std::promise<DgError>> done;
+    auto fetcher = std::make_shared<MultiFetchExecutable>([](FetchFrameInterface::AsyncCallback cb) {
+        // size_ of each fetch tells its roi
+        return std::make_shared<MockExecutable<FetchFrameTask>>(3, MockLatency(), cb, [](FetchFrameTask &task, std::mt19937 &) {
+            task.result_.size_ = task.roi_.size();
+        });
+    }, [&](Tasks &tasks, DgError error) {
+        auto promise = done;
+        promise->set_value(error);
+    });
+    auto fetch = [&](Tasks &tasks) {
+        done = std::make_shared<std::promise<DgError>>();
+        auto future = done->get_future();
+        auto error = fetcher->execute(tasks);
+        return error == DG_OK ? future.get() : error;
+    };
+
+    // 2 tasks of 4 rois each in batches of 3, results in order of rois
+    Tasks tasks;
+    for(auto i = 0; i < 2; i++) {
+        auto task = std::make_shared<MultiFetchFrameTask>();
+        task->type_ = SdkImage::JPEG;
+        for(auto r = 0; r < 4; r++) {
+            task->rois_.push_back(cv::Rect(0, 0, 8 + i, 1 + r));
+        }
+        tasks.push_back(task);
+    }
+    CHECK(fetch(tasks) == DG_OK);
+    for(auto i = 0; i < 2; i++) {
+        CHECK(tasks[i]->result_.size() == 4);
+        for(auto r = 0; r < 4; r++) {
+            CHECK(tasks[i]->result_[r].size_ == cv::Size(8 + i, 1 + r)) << i << ":" << r;
+        }
+    }
+
+    // raw types are fetched whole, not cropped
+    auto raw = std::make_shared<MultiFetchFrameTask>();
+    raw->type_ = SdkImage::BGR;
+    Tasks raws{raw};
+    CHECK(fetch(raws) == DG_OK && raw->result_.size() == 1);
+    raw->rois_.push_back(cv::Rect(0, 0, 4, 4));
+    CHECK(fetch(raws) == DG_ERR_NOT_SUPPORTED);
+
+    // nor resized
+    tasks.resize(1);
+    tasks[0]->put(OptionKeys::fetch_width_(), 32);
+    CHECK(fetch(tasks) == DG_ERR_NOT_SUPPORTED);
+
+    LOG(ERROR) << "Multi fetch ok";
+    return 0;
+}
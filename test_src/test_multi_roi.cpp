@@ -0,0 +1,128 @@
+//
+// Crops per second of one JPEG snapshot per object, by a FetchFrameTask per roi vs one MultiFetchFrameTask per frame
+//
+
+#include "vega_interface.h"
+#include "vega_color.h"
+#include "vega_cpu_backend.h"
+#include "vega_image_allocator.h"
+#include "vega_time_pnt.h"
+#include <zfz/zfz_event.hpp>
+
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+using namespace vega;
+
+int main(int argc, char *argv[]) {
+    if(argc < 2) {
+        LOG(ERROR) << "Usage: " << argv[0] << " <jpeg> [rois] [frames] [threads]";
+        return 2;
+    }
+    std::ifstream ifs(argv[1], std::ios::binary);
+    CHECK(ifs.is_open()) << "File not exist: " << argv[1];
+    std::vector<uint8_t> jpeg((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    int roiCount = argc > 2 ? atoi(argv[2]) : 30;
+    int frameCount = argc > 3 ? atoi(argv[3]) : 20;
+    int threads = argc > 4 ? atoi(argv[4]) : 0;
+    CHECK(roiCount > 0 && frameCount > 0);
+
+    const StreamId sid = 1;
+    auto backend = std::make_shared<CpuBackend>(threads);
+    zfz::Event evt;
+    std::atomic<int> left{0};
+
+    // decode frames as NV12, like frames of a video decoder
+    std::vector<FrameId> frames(frameCount);
+    cv::Size size;
+    {
+        auto decoder = backend->createDecodeInterface([&](std::vector<std::shared_ptr<DecodeTask>> &tasks, DgError error) {
+            CHECK(error == DG_OK);
+            for(auto &task : tasks) frames[(long)task->user_data_] = task->frame_id_;
+            if((left -= (int)tasks.size()) == 0) evt.set();
+        });
+        cv::Mat bgr = cv::imdecode(jpeg, cv::IMREAD_COLOR);
+        CHECK(!bgr.empty()) << "Invalid jpeg " << argv[1];
+        size = cv::Size(bgr.cols & ~1, bgr.rows & ~1);
+        DgImage src;
+        src.create(bgr.data, size, size, DgImageType::DG_IMAGE_BGR_PACKAGE, cv::Size((int)bgr.step[0], bgr.rows));
+        ImageAllocator allocator;
+        DeviceImage nv12;
+        CHECK(allocator.allocate(SdkImage::NV12, size, nv12) == DG_OK);
+        auto planes = nv12.image();
+        CHECK(ColorConvert::convert(src, planes) == DG_OK);
+
+        left = frameCount;
+        for(auto i = 0; i < frameCount; i++) {
+            std::vector<std::shared_ptr<DecodeTask>> tasks{std::make_shared<DecodeTask>()};
+            auto &task = tasks[0];
+            task->stream_id_ = sid;
+            nv12.bind(*task);
+            task->user_data_ = (void *)(long)i;
+            CHECK(decoder->execute(tasks) == DG_OK);
+        }
+        evt.wait();
+    }
+
+    // objects on a grid
+    std::vector<cv::Rect> rois;
+    auto cols = (int)std::ceil(std::sqrt(roiCount));
+    auto rows = (roiCount + cols - 1) / cols;
+    cv::Size cell(size.width / cols, size.height / rows);
+    for(auto i = 0; i < roiCount; i++) {
+        rois.emplace_back((i % cols) * cell.width, (i / cols) * cell.height, cell.width, cell.height);
+    }
+    auto crops = frameCount * roiCount;
+
+    // a FetchFrameTask per roi
+    auto fetcher = backend->createFetchFrameInterface([&](std::vector<std::shared_ptr<FetchFrameTask>> &tasks, DgError error) {
+        CHECK(error == DG_OK);
+        if((left -= (int)tasks.size()) == 0) evt.set();
+    });
+    evt.reset();
+    left = crops;
+    VegaTmPnt start("start");
+    for(auto f = 0; f < frameCount; f++) {
+        std::vector<std::shared_ptr<FetchFrameTask>> tasks;
+        for(auto &roi : rois) {
+            auto task = std::make_shared<FetchFrameTask>();
+            task->stream_id_ = sid;
+            task->frame_id_ = frames[f];
+            task->type_ = SdkImage::JPEG;
+            task->roi_ = roi;
+            tasks.push_back(task);
+        }
+        CHECK(fetcher->execute(tasks) == DG_OK);
+    }
+    evt.wait();
+    auto single = VegaTmPnt("stop") - start;
+
+    // one MultiFetchFrameTask per frame
+    auto multiFetcher = backend->createMultiFetchFrameInterface([&](std::vector<std::shared_ptr<MultiFetchFrameTask>> &tasks, DgError error) {
+        CHECK(error == DG_OK);
+        for(auto &task : tasks) CHECK(task->result_.size() == (size_t)roiCount);
+        if((left -= (int)tasks.size()) == 0) evt.set();
+    });
+    evt.reset();
+    left = frameCount;
+    start.mark();
+    for(auto f = 0; f < frameCount; f++) {
+        std::vector<std::shared_ptr<MultiFetchFrameTask>> tasks{std::make_shared<MultiFetchFrameTask>()};
+        auto &task = tasks[0];
+        task->stream_id_ = sid;
+        task->frame_id_ = frames[f];
+        task->type_ = SdkImage::JPEG;
+        task->rois_ = rois;
+        CHECK(multiFetcher->execute(tasks) == DG_OK);
+    }
+    evt.wait();
+    auto multi = VegaTmPnt("stop") - start;
+
+    LOG(ERROR) << size.width << "x" << size.height << " NV12, " << roiCount << " rois x " << frameCount << " frames";
+    LOG(ERROR) << "roi per task:   " << crops * 1000 / single << " crops/s";
+    LOG(ERROR) << "rois per task:  " << crops * 1000 / multi << " crops/s, " << single / multi << "x";
+    return 0;
+}
@@ -0,0 +1,204 @@
+//
+// Micro benchmark of task options got by name and by OptionKey, and options shared by a batch.
+// Options put by key are formatted in place, so a reused task puts and gets them without allocation.
+//
+
+#include "vega_interface.h"
+#include "vega_batch_options.h"
+#include "vega_mock_device.h"
+#include "vega_option.h"
+#include "vega_time_pnt.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <future>
+#include <new>
+
+using namespace vega;
+
+static std::atomic<long> g_allocs{0};
+
+void *operator new(size_t sz) {
+    ++g_allocs;
+    auto p = malloc(sz ? sz : 1);
+    if(!p) throw std::bad_alloc();
+    return p;
+}
+void operator delete(void *p) noexcept {
+    free(p);
+}
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+template <typename _Fn>
+void run(const std::string &name, int count, _Fn fn) {
+    auto allocs = g_allocs.load();
+    VegaTmPnt start("start");
+    long sum = 0;
+    for(auto i = 0; i < count; i++) {
+        sum += fn(i);
+    }
+    VegaTmPnt stop("stop");
+    auto used = g_allocs.load() - allocs;
+    LOG(ERROR) << name << ": " << (double)used / count << " allocs/task, "
+               << (stop - start) * 1000000 / count << " ns/task (" << sum << ")";
+}
+
+int main(int argc, char *argv[]) {
+    int count = 1000000;
+    if(argc > 1) {
+        count = atoi(argv[1]);
+        CHECK(count > 0) << "Invalid count: " << count;
+    }
+
+    run("string keys", count, [](int i) {
+        DecodeTask task;
+        task.put(Option::video_eos_, false);
+        task.put(Option::discard_frame_, (i & 1) == 0);
+        task.put(Option::video_dec_mode_e_, 1);
+        task.put(Option::packet_index_, (long)i);
+        return (long)task.getBool(Option::discard_frame_, false) + task.getLongInt(Option::packet_index_, 0)
+               + task.getBool(Option::video_eos_, false);
+    });
+
+    run("option keys", count, [](int i) {
+        DecodeTask task;
+        task.put(OptionKeys::video_eos_(), false);
+        task.put(OptionKeys::discard_frame_(), (i & 1) == 0);
+        task.put(OptionKeys::video_dec_mode_e_(), 1);
+        task.put(OptionKeys::packet_index_(), (long)i);
+        return (long)task.getBool(OptionKeys::discard_frame_(), false) + task.getLongInt(OptionKeys::packet_index_(), 0)
+               + task.getBool(OptionKeys::video_eos_(), false);
+    });
+
+    {
+        DecodeTask task;
+        run("string keys, reused task", count, [&](int i) {
+            task.put(Option::video_eos_, false);
+            task.put(Option::discard_frame_, (i & 1) == 0);
+            task.put(Option::video_dec_mode_e_, 1);
+            task.put(Option::packet_index_, (long)i);
+            return (long)task.getBool(Option::discard_frame_, false) + task.getLongInt(Option::packet_index_, 0)
+                   + task.getBool(Option::video_eos_, false);
+        });
+    }
+    {
+        DecodeTask task;
+        run("option keys, reused task", count, [&](int i) {
+            task.put(OptionKeys::video_eos_(), false);
+            task.put(OptionKeys::discard_frame_(), (i & 1) == 0);
+            task.put(OptionKeys::video_dec_mode_e_(), 1);
+            task.put(OptionKeys::packet_index_(), (long)i);
+            return (long)task.getBool(OptionKeys::discard_frame_(), false) + task.getLongInt(OptionKeys::packet_index_(), 0)
+                   + task.getBool(OptionKeys::video_eos_(), false);
+        });
+    }
+
+    // putting again by key into a task and getting by key have no allocation
+    {
+        DecodeTask task;
+        task.put(OptionKeys::video_eos_(), false);
+        task.put(OptionKeys::packet_index_(), 1L);
+        auto allocs = g_allocs.load();
+        task.put(OptionKeys::video_eos_(), true);
+        task.put(OptionKeys::packet_index_(), 123456789L);
+        CHECK(task.getBool(OptionKeys::video_eos_(), false) && task.getLongInt(OptionKeys::packet_index_(), 0) == 123456789L);
+        CHECK(g_allocs.load() == allocs) << g_allocs.load() - allocs << " allocs";
+    }
+
+    // keys of equal names share one interned name, which outlives the string a key is built from
+    {
+        std::unique_ptr<OptionKey> key;
+        {
+            std::string name(Option::packet_index_);
+            key.reset(new OptionKey(name));
+        }
+        CHECK(&key->name() == &OptionKeys::packet_index_().name());
+        DecodeTask task;
+        task.put(*key, 7L);
+        CHECK(task.getLongInt(OptionKeys::packet_index_(), 0) == 7);
+    }
+
+    // values put by name or by key are got alike
+    {
+        DecodeTask task;
+        task.put(Option::video_eos_, true);
+        task.put(OptionKeys::packet_index_(), 123456789L);
+        task.put(OptionKeys::video_resize_ratio_(), 0.5f);
+        task.put(Option::data_type_, std::string("nv12"));
+        task.put(OptionKeys::bg_color_(), L'x');
+        CHECK(task.getBool(OptionKeys::video_eos_(), false) == task.getBool(Option::video_eos_, false));
+        CHECK(task.getLongInt(OptionKeys::packet_index_(), 0) == task.getLongInt(Option::packet_index_, 0));
+        CHECK(task.getFloat(OptionKeys::video_resize_ratio_(), 0) == task.getFloat(Option::video_resize_ratio_, 0));
+        CHECK(task.getString(OptionKeys::data_type_(), "") == "nv12");
+        CHECK(task.getWChar(OptionKeys::bg_color_(), 0) == L'x');
+        CHECK(task.getInteger(OptionKeys::jpeg_quality_(), -1) == -1);
+        CHECK(task.getLLInt(OptionKeys::packet_index_(), 0) == 123456789LL);
+
+        // values put by key are in the option map at once, formatted as put by name
+        auto &values = task.options();
+        CHECK(values.at(Option::video_eos_) == "1");
+        CHECK(values.at(Option::packet_index_) == "123456789");
+        CHECK(values.at(Option::video_resize_ratio_) == std::to_string(0.5f));
+        CHECK(values.at(Option::bg_color_) == "x");
+
+        // last put wins whether by name or by key
+        task.put(Option::packet_index_, 5);
+        CHECK(task.getLongInt(OptionKeys::packet_index_(), 0) == 5);
+        task.put(OptionKeys::packet_index_(), 6);
+        CHECK(task.getInteger(Option::packet_index_, 0) == 6);
+        CHECK(task.options().at(Option::packet_index_) == "6");
+        task.erase(Option::packet_index_);
+        CHECK(task.getLongInt(OptionKeys::packet_index_(), -1) == -1);
+        task.put(OptionKeys::face_store_stream_id_(), (StreamId)0xFFFFFFF0u);
+        CHECK(task.getLLInt(OptionKeys::face_store_stream_id_(), 0) == 0xFFFFFFF0LL);
+        CHECK(task.options().at(Option::face_store_stream_id_) == std::to_string((StreamId)0xFFFFFFF0u));
+    }
+
+    // batch options are read by interface as options of each task, task's own take precedence
+    {
+        std::promise<void> done;
+        MockExecutable<FaceAlignTransformTask> iface(8, MockLatency(), [&](std::vector<std::shared_ptr<FaceAlignTransformTask>> &tasks, DgError error) {
+            CHECK(error == DG_OK);
+            for(auto i = 0u; i < tasks.size(); i++) {
+                auto &task = *tasks[i];
+                CHECK(task.getBool(Option::face_align_, false));
+                CHECK(task.getLLInt(Option::face_store_stream_id_, 0) == (i == 0 ? 7 : 1100));
+                CHECK(task.getInteger(Option::transform_type_, -1) == 2);
+            }
+            done.set_value();
+        });
+        std::vector<std::shared_ptr<FaceAlignTransformTask>> tasks;
+        for(auto i = 0; i < 4; i++) {
+            tasks.push_back(std::make_shared<FaceAlignTransformTask>());
+        }
+        tasks[0]->put(Option::face_store_stream_id_, (StreamId)7);
+
+        BatchOptions options;
+        options.put(Option::face_align_, true);
+        options.put(Option::face_store_stream_id_, (StreamId)1100);
+        options.put(Option::transform_type_, 2);
+        std::vector<BatchOptions::Applied> applied;
+        CHECK(executeWithOptions(iface, tasks, options, &applied) == DG_OK);
+        done.get_future().wait();
+
+        // task's own value is kept
+        CHECK(applied.size() == tasks.size());
+        for(auto i = 0u; i < tasks.size(); i++) {
+            options.removeFrom(*tasks[i], applied[i]);
+            CHECK(tasks[i]->options().size() == (i == 0 ? 1u : 0u)) << tasks[i]->options().size() << " options left";
+        }
+
+        // nothing is recorded for a task having all options
+        auto full = std::make_shared<FaceAlignTransformTask>();
+        for(auto &kv : options.values()) {
+            full->put(kv.first, kv.second);
+        }
+        CHECK(options.applyTo(*full).empty());
+        CHECK(tasks[0]->getLLInt(Option::face_store_stream_id_, 0) == 7);
+        LOG(ERROR) << "batch options: " << options.values().size() << " options merged into " << tasks.size() << " tasks";
+    }
+
+    return 0;
+}
@@ -0,0 +1,76 @@
+//
+// Lateness of Pacer driving many streams, and drift of replaying with usleep after each call
+//
+
+#include "vega_pacer.h"
+#include "vega_time_pnt.h"
+
+#include <atomic>
+#include <thread>
+#include <unistd.h>
+
+using namespace vega;
+
+/**
+ * Busy for us, like execute() copying a packet
+ */
+static void work(int us) {
+    auto end = Pacer::Clock::now() + std::chrono::microseconds(us);
+    while(Pacer::Clock::now() < end) {
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int streams = argc > 1 ? atoi(argv[1]) : 200;
+    int fps = argc > 2 ? atoi(argv[2]) : 25;
+    int seconds = argc > 3 ? atoi(argv[3]) : 10;
+    int threads = argc > 4 ? atoi(argv[4]) : 2;
+    int workUs = argc > 5 ? atoi(argv[5]) : 20;
+    CHECK(streams > 0 && fps > 0 && seconds > 0 && threads > 0 && workUs >= 0);
+    long frames = (long)fps * seconds;
+
+    // usleep after each call, time of calls and oversleep add up
+    {
+        VegaTmPnt start("start");
+        for(long k = 0; k < frames; k++) {
+            work(workUs);
+            usleep(1000000 / fps);
+        }
+        auto ms = VegaTmPnt("stop") - start;
+        LOG(ERROR) << "usleep: " << frames << " frames in " << ms << " ms, " << frames * 1000 / ms << " fps of " << fps;
+    }
+
+    // all streams by pacer, spread over a frame interval
+    {
+        Pacer pacer(threads);
+        std::vector<int> ids;
+        auto begin = Pacer::Clock::now() + std::chrono::milliseconds(100);
+        VegaTmPnt start("start");
+        for(auto i = 0; i < streams; i++) {
+            auto offset = std::chrono::microseconds(1000000L / fps * i / streams);
+            ids.push_back(pacer.add(fps, [&](long k) {
+                work(workUs);
+                return k + 1 < frames;
+            }, begin + offset));
+        }
+        for(auto id : ids) pacer.join(id);
+        auto ms = VegaTmPnt("stop") - start - 100;
+        auto st = pacer.stats();
+        LOG(ERROR) << "pacer: " << streams << " streams by " << threads << " threads, " << st.calls_ << " calls in "
+                   << ms << " ms, " << st.calls_ * 1000 / ms / streams << " fps of " << fps;
+        LOG(ERROR) << "late mean " << st.mean_late_us_ << " us, max " << st.max_late_us_ << " us, "
+                   << st.behind_ << " behind a frame";
+        CHECK(st.calls_ == (long)streams * frames) << st.calls_ << " calls";
+
+        // ended and removed streams are dropped, their calls are still counted
+        auto removed = pacer.add(1000, [](long) { return true; });
+        pacer.remove(removed);
+        CHECK(pacer.join(removed, 1000));
+        for(auto i = 0; i < 1000 && pacer.size() > 0; i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        CHECK(pacer.size() == 0) << pacer.size() << " streams kept";
+        CHECK(pacer.stats().calls_ >= st.calls_);
+    }
+    return 0;
+}
@@ -0,0 +1,178 @@
+//
+// Milliseconds per batch of rois preprocessed by Preprocess in one pass, vs cv::cvtColor, cv::resize, normalization and cv::split
+// on the same threads, and their difference
+//
+
+#include "vega_color.h"
+#include "vega_preprocess.h"
+#include "vega_time_pnt.h"
+
+#include <cmath>
+#include <functional>
+
+using namespace vega;
+
+int main(int argc, char *argv[]) {
+    int roiCount = argc > 1 ? atoi(argv[1]) : 32;
+    int iterations = argc > 2 ? atoi(argv[2]) : 20;
+    int threads = argc > 3 ? atoi(argv[3]) : 0;
+    CHECK(roiCount > 0 && iterations > 0);
+#ifdef _OPENMP
+    if(threads <= 0) threads = omp_get_max_threads();
+#else
+    threads = 1;
+#endif
+    cv::setNumThreads(threads);
+
+    // synthetic 1080p frame of gradients, as BGR and NV12
+    cv::Size size(1920, 1080);
+    cv::Mat bgrMat(size, CV_8UC3), nv12Mat(size.height * 3 / 2, size.width, CV_8UC1);
+    for(auto y = 0; y < size.height; y++) {
+        for(auto x = 0; x < size.width; x++) {
+            bgrMat.at<cv::Vec3b>(y, x) = cv::Vec3b((uint8_t)(x * 255 / (size.width - 1)), (uint8_t)(y * 255 / (size.height - 1)),
+                                                   (uint8_t)((x + y) * 255 / (size.width + size.height - 2)));
+        }
+    }
+    DgImage bgr, nv12;
+    bgr.create(bgrMat.data, size, DgImageType::DG_IMAGE_BGR_PACKAGE);
+    nv12.create(nv12Mat.data, size, DgImageType::DG_IMAGE_YUV_SP420);
+    CHECK(ColorConvert::convert(bgr, nv12) == DG_OK);
+
+    // objects on a grid
+    std::vector<cv::Rect> rois;
+    auto cols = (int)std::ceil(std::sqrt(roiCount));
+    auto rows = (roiCount + cols - 1) / cols;
+    cv::Size cell(size.width / cols, size.height / rows);
+    for(auto i = 0; i < roiCount; i++) {
+        rois.emplace_back((i % cols) * cell.width, (i / cols) * cell.height, cell.width, cell.height);
+    }
+
+    PreprocessParams params;
+    params.size_ = cv::Size(128, 256);
+    params.rgb_ = true;
+    const float mean[3] = {123.675f, 116.28f, 103.53f}, scale[3] = {1 / 58.395f, 1 / 57.12f, 1 / 57.375f};
+    for(auto c = 0; c < 3; c++) {
+        params.mean_[c] = mean[c];
+        params.scale_[c] = scale[c];
+    }
+    params.threads_ = threads;
+    auto plane = (size_t)params.size_.area();
+    auto level = *std::max_element(scale, scale + 3);   // one pixel level in tensor
+    std::vector<float> fused(Preprocess::tensorSize(params, rois.size()));
+    std::vector<float> separate(fused.size());
+    std::vector<RoiScale> scales;
+
+    // resize, normalize and split of each roi of RGB image into content of its scale, padding the rest
+    auto reference = [&](const cv::Mat &rgb, const PreprocessParams &p, std::vector<float> &tensor) {
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(dynamic)
+#endif
+        for(auto i = 0; i < (int)rois.size(); i++) {
+            auto content = scales[i].content_;
+            cv::Mat resized, normalized;
+            cv::resize(rgb(rois[i]), resized, content, 0, 0, cv::INTER_LINEAR);
+            resized.convertTo(normalized, CV_32FC3);
+            normalized -= cv::Scalar(p.mean_[0], p.mean_[1], p.mean_[2]);
+            normalized = normalized.mul(cv::Scalar(p.scale_[0], p.scale_[1], p.scale_[2]));
+            std::vector<cv::Mat> planes;
+            for(auto c = 0; c < 3; c++) {
+                cv::Mat full(p.size_, CV_32FC1, tensor.data() + plane * (3 * i + c));
+                full.setTo(cv::Scalar((p.pad_ - p.mean_[c]) * p.scale_[c]));
+                planes.push_back(full(cv::Rect(cv::Point(), content)));
+            }
+            cv::split(normalized, planes);
+        }
+    };
+    auto maxDiff = [&]() {
+        float diff = 0;
+        for(auto i = 0u; i < fused.size(); i++) {
+            diff = std::max(diff, std::fabs(fused[i] - separate[i]));
+        }
+        return diff;
+    };
+    // ms of each iteration of fn
+    auto time = [&](std::function<void()> fn) {
+        fn();
+        VegaTmPnt start("start");
+        for(auto i = 0; i < iterations; i++) fn();
+        return (VegaTmPnt("stop") - start) / iterations;
+    };
+
+    LOG(ERROR) << size.width << "x" << size.height << ", " << roiCount << " rois to "
+               << params.size_.width << "x" << params.size_.height << " float NCHW, " << threads << " threads";
+
+    // NV12, chroma is sampled at nearest and coefficients are rounded to 1/64 unlike cv::cvtColor
+    auto onePass = time([&]() {
+        CHECK(Preprocess::run(nv12, rois, params, fused.data(), fused.size(), scales) == DG_OK);
+    });
+    auto opencv = time([&]() {
+        cv::Mat rgb;
+        cv::cvtColor(nv12Mat, rgb, cv::COLOR_YUV2RGB_NV12);
+        reference(rgb, params, separate);
+    });
+    auto diff = maxDiff();
+    LOG(ERROR) << "NV12 separate passes: " << opencv << " ms";
+    LOG(ERROR) << "NV12 fused:           " << onePass << " ms, " << opencv / onePass << "x, max diff " << diff / level << " levels";
+    CHECK(diff <= 4 * level) << "NV12 differs by " << diff / level << " levels";
+
+    // BGR, only rounding of cv::resize differs
+    onePass = time([&]() {
+        CHECK(Preprocess::run(bgr, rois, params, fused.data(), fused.size(), scales) == DG_OK);
+    });
+    opencv = time([&]() {
+        cv::Mat rgb;
+        cv::cvtColor(bgrMat, rgb, cv::COLOR_BGR2RGB);
+        reference(rgb, params, separate);
+    });
+    diff = maxDiff();
+    LOG(ERROR) << "BGR separate passes:  " << opencv << " ms";
+    LOG(ERROR) << "BGR fused:            " << onePass << " ms, " << opencv / onePass << "x, max diff " << diff / level << " levels";
+    CHECK(diff <= 2 * level) << "BGR differs by " << diff / level << " levels";
+
+    // keep ratio, padded right or bottom, and boxes on tensor back to image
+    cv::Mat rgb;
+    cv::cvtColor(bgrMat, rgb, cv::COLOR_BGR2RGB);
+    auto kept = params;
+    kept.keep_ratio_ = true;
+    kept.pad_ = 114;
+    CHECK(Preprocess::run(bgr, rois, kept, fused.data(), fused.size(), scales) == DG_OK);
+    reference(rgb, kept, separate);
+    diff = maxDiff();
+    CHECK(diff <= 2 * level) << "Kept ratio differs by " << diff / level << " levels";
+    for(auto i = 0u; i < rois.size(); i++) {
+        auto &s = scales[i];
+        CHECK(s.scale_x_ == s.scale_y_ && (s.content_.width == kept.size_.width || s.content_.height == kept.size_.height));
+        auto ratio = (float)rois[i].width / rois[i].height;
+        CHECK(std::fabs((float)s.content_.width / s.content_.height - ratio) <= (1 + ratio) / s.content_.height)
+                << s.content_ << " of roi " << rois[i];
+        BBoxf box;
+        box.rect_ = cv::Rect2f(0, 0, (float)s.content_.width, (float)s.content_.height);
+        box.confidence_ = 0.5f;
+        auto back = s.toImage(box);
+        CHECK(back.confidence_ == box.confidence_);
+        CHECK(std::fabs(back.rect_.x - rois[i].x) < 1e-3f && std::fabs(back.rect_.y - rois[i].y) < 1e-3f);
+        CHECK(std::fabs(back.rect_.width - rois[i].width) <= 1 / s.scale_x_ && std::fabs(back.rect_.height - rois[i].height) <= 1 / s.scale_y_)
+                << back.rect_ << " of roi " << rois[i];
+        auto center = s.toImage(cv::Rect(s.content_.width / 2, s.content_.height / 2, 2, 2));
+        CHECK(rois[i].contains(cv::Point((int)center.x, (int)center.y)));
+    }
+
+    // int8, values of float tensor rounded and saturated
+    auto quant = kept;
+    for(auto c = 0; c < 3; c++) quant.scale_[c] = scale[c] * 64;
+    std::vector<int8_t> int8(fused.size());
+    CHECK(Preprocess::run(bgr, rois, quant, int8.data(), int8.size(), scales) == DG_OK);
+    CHECK(Preprocess::run(bgr, rois, quant, fused.data(), fused.size(), scales) == DG_OK);
+    auto saturated = 0;
+    for(auto i = 0u; i < fused.size(); i++) {
+        auto q = std::min(std::max((int)std::floor(fused[i] + 0.5f), -128), 127);
+        CHECK(int8[i] == q) << "int8 " << (int)int8[i] << " of " << fused[i];
+        if(q != (int)std::floor(fused[i] + 0.5f)) saturated++;
+    }
+    CHECK(saturated > 0) << "No value saturated";
+    onePass = time([&]() {
+        CHECK(Preprocess::run(bgr, rois, quant, int8.data(), int8.size(), scales) == DG_OK);
+    });
+    LOG(ERROR) << "BGR fused int8:       " << onePass << " ms, " << saturated << " values saturated";
+    return 0;
+}
@@ -0,0 +1,132 @@
+//
+// Benchmark of live task latency under bulk load, with and without priority lanes
+//
+
+#include "vega_interface.h"
+#include "vega_batching.h"
+#include "vega_priority.h"
+#include "vega_mock_device.h"
+#include "vega_time_pnt.h"
+#include <zfz/zfz_event.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+
+using namespace vega;
+
+void report(const std::string &name, std::vector<double> &latency) {
+    std::sort(latency.begin(), latency.end());
+    auto pct = [&](double p) { return latency[(size_t)((latency.size() - 1) * p)]; };
+    LOG(ERROR) << name << ": latency p50 " << pct(0.5) << " ms, p99 " << pct(0.99) << " ms, max " << latency.back() << " ms";
+}
+
+/**
+ * Bulk tasks are all submitted at once, then live tasks are sent at given fps.
+ * submit(task, live, callback) sends a task.
+ */
+template <typename _Submit>
+void run(const std::string &name, int live, int fps, int bulk, _Submit submit) {
+    std::vector<double> liveLatency(live);
+    std::atomic<int> liveDone{0}, bulkDone{0};
+    zfz::Event liveEvt, bulkEvt;
+    VegaTmPnt start("start");
+    VegaTmPnt bulkEnd;
+
+    for(auto i = 0; i < bulk; i++) {
+        CHECK(submit(std::make_shared<DetectTask>(), false, [&](std::shared_ptr<DetectTask> &, DgError error) {
+            CHECK(error == DG_OK);
+            if(++bulkDone == bulk) {
+                bulkEnd.mark("bulk");
+                bulkEvt.set();
+            }
+        }) == DG_OK);
+    }
+
+    VegaTpAccumulator acc;
+    auto intv = std::chrono::microseconds(1000000 / fps);
+    auto next = std::chrono::steady_clock::now();
+    for(auto i = 0; i < live; i++) {
+        auto task = std::make_shared<DetectTask>();
+        task->tp_grp_ = std::make_shared<VegaTpGrp>(VEGA_TP_LEVEL_OUTLINE);
+        auto sent = std::make_shared<VegaTmPnt>("sent");
+        CHECK(submit(task, true, [&, i, sent](std::shared_ptr<DetectTask> &t, DgError error) {
+            CHECK(error == DG_OK);
+            liveLatency[i] = VegaTmPnt("done") - *sent;
+            t->tp_grp_->append("done", VEGA_TP_LEVEL_OUTLINE);
+            acc.push(t->tp_grp_);
+            if(++liveDone == live) liveEvt.set();
+        }) == DG_OK);
+        next += intv;
+        std::this_thread::sleep_until(next);
+    }
+    liveEvt.wait();
+    bulkEvt.wait();
+
+    report(name + " live", liveLatency);
+    LOG(ERROR) << name << " bulk: " << bulk / ((bulkEnd - start) / 1000) << " tasks/s";
+    std::vector<std::string> hdrs;
+    std::vector<double> avg;
+    acc.hdrs(hdrs);
+    acc.avg(avg);
+    for(auto i = 0u; i < hdrs.size(); i++) {
+        LOG(ERROR) << "  " << hdrs[i] << ": " << avg[i] << " ms";
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if(argc < 3) {
+        LOG(ERROR) << "Usage: " << argv[0] << " <live_fps> <bulk_tasks> [live_tasks] [batch_size] [starve_ms]";
+        return 2;
+    }
+    int fps = atoi(argv[1]);
+    int bulk = atoi(argv[2]);
+    int live = argc > 3 ? atoi(argv[3]) : 200;
+    int batchSize = argc > 4 ? atoi(argv[4]) : 8;
+    int starveMs = argc > 5 ? atoi(argv[5]) : 500;
+    CHECK(fps > 0 && bulk > 0 && live > 0 && batchSize > 0 && starveMs > 0);
+
+    MockLatency latency;
+    latency.fixed_us_ = 3000;
+    latency.per_task_us_ = 500;
+    auto creator = [&](DetectInterface::AsyncCallback cb) {
+        return std::make_shared<MockExecutable<DetectTask>>(batchSize, latency, cb);
+    };
+
+    // invalid lane is refused without calling back
+    {
+        std::atomic<int> calls{0};
+        auto detector = std::make_shared<PriorityExecutable<DetectTask>>(creator,
+                [&](std::vector<std::shared_ptr<DetectTask>> &, DgError) { ++calls; });
+        std::vector<std::shared_ptr<DetectTask>> tasks{std::make_shared<DetectTask>()};
+        CHECK(detector->execute(tasks, detector->lanes()) == DG_ERR_INVALID_PARAM);
+        CHECK(detector->execute(tasks, -1) == DG_ERR_INVALID_PARAM);
+        detector.reset();
+        CHECK(calls == 0);
+    }
+
+    // single queue, live tasks wait behind bulk
+    {
+        auto detector = std::make_shared<BatchingExecutable<DetectTask>>(creator, nullptr, 2000);
+        run("fifo", live, fps, bulk, [&](const std::shared_ptr<DetectTask> &task, bool,
+                BatchingExecutable<DetectTask>::TaskCallback cb) {
+            return detector->submit(task, cb);
+        });
+    }
+
+    // live tasks in lane 0, bulk in lane 1
+    {
+        auto detector = std::make_shared<PriorityExecutable<DetectTask>>(creator, nullptr, 2, 2000, starveMs);
+        run("priority", live, fps, bulk, [&](const std::shared_ptr<DetectTask> &task, bool isLive,
+                PriorityExecutable<DetectTask>::TaskCallback cb) {
+            return detector->submit(task, isLive ? 0 : 1, cb);
+        });
+        for(auto lane = 0; lane < detector->lanes(); lane++) {
+            auto st = detector->stats(lane);
+            LOG(ERROR) << "  lane " << lane << ": " << st.tasks_ << " tasks, avg wait " << st.wait_ms_ / st.tasks_
+                       << " ms, max wait " << st.max_wait_ms_ << " ms, promoted " << st.promoted_;
+        }
+    }
+
+    return 0;
+}
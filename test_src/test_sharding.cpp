@@ -0,0 +1,185 @@
+//
+// Benchmark of ShardedExecutable against round robin over instances of different speed
+//
+
+#include "vega_interface.h"
+#include "vega_sharding.h"
+#include "vega_mock_device.h"
+#include "vega_time_pnt.h"
+#include <zfz/zfz_event.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+
+using namespace vega;
+
+using Tasks = std::vector<std::shared_ptr<DetectTask>>;
+
+struct Result {
+    double seconds = 0;
+    std::vector<double> latency;    // ms
+};
+
+void report(const std::string &name, Result &r) {
+    std::sort(r.latency.begin(), r.latency.end());
+    auto pct = [&](double p) { return r.latency[(size_t)((r.latency.size() - 1) * p)]; };
+    LOG(ERROR) << name << ": " << r.latency.size() / r.seconds << " tasks/s"
+               << ", latency p50 " << pct(0.5) << " ms, p99 " << pct(0.99) << " ms, max " << r.latency.back() << " ms";
+}
+
+/**
+ * Instance i is (1 + i * slowdown) times slower than instance 0
+ */
+MockLatency latencyOf(int shard, int slowdown) {
+    MockLatency latency;
+    latency.fixed_us_ = 2000 * (1 + shard * slowdown);
+    latency.per_task_us_ = 250 * (1 + shard * slowdown);
+    return latency;
+}
+
+/**
+ * Send count batches of batchSize tasks at given fps
+ */
+template <typename _Send>
+void produce(int count, int fps, int batchSize, _Send send) {
+    auto intv = std::chrono::microseconds(1000000 / fps);
+    auto next = std::chrono::steady_clock::now();
+    for(auto i = 0; i < count; i++) {
+        Tasks tasks;
+        for(auto j = 0; j < batchSize; j++) {
+            auto task = std::make_shared<DetectTask>();
+            task->user_data_ = (void *)(long)(i * batchSize + j);
+            tasks.push_back(task);
+        }
+        send(i, tasks);
+        next += intv;
+        std::this_thread::sleep_until(next);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if(argc < 3) {
+        LOG(ERROR) << "Usage: " << argv[0] << " <shards> <fps> [slowdown] [batch_size] [count]";
+        return 2;
+    }
+    int shards = atoi(argv[1]);
+    int fps = atoi(argv[2]);
+    int slowdown = argc > 3 ? atoi(argv[3]) : 2;
+    int batchSize = argc > 4 ? atoi(argv[4]) : 4;
+    int count = argc > 5 ? atoi(argv[5]) : 1000;
+    CHECK(shards > 0 && fps > 0 && slowdown >= 0 && batchSize > 0 && count > 0);
+
+    int total = count * batchSize;
+
+    // round robin over instances
+    {
+        Result r;
+        std::vector<VegaTmPnt> sent(total);
+        r.latency.resize(total);
+        std::atomic<int> done{0};
+        zfz::Event evt;
+        auto callback = [&](Tasks &tasks, DgError) {
+            VegaTmPnt now("done");
+            for(auto &task : tasks) {
+                auto idx = (long)task->user_data_;
+                r.latency[idx] = now - sent[idx];
+            }
+            if((done += (int)tasks.size()) == total) evt.set();
+        };
+        std::vector<std::shared_ptr<MockExecutable<DetectTask>>> detectors;
+        for(auto s = 0; s < shards; s++) {
+            detectors.push_back(std::make_shared<MockExecutable<DetectTask>>(batchSize, latencyOf(s, slowdown), callback));
+        }
+
+        VegaTmPnt start("start");
+        produce(count, fps, batchSize, [&](int i, Tasks &tasks) {
+            for(auto &task : tasks) sent[(long)task->user_data_].mark();
+            CHECK(detectors[i % shards]->execute(tasks) == DG_OK);
+        });
+        evt.wait();
+        r.seconds = (VegaTmPnt("stop") - start) / 1000;
+        report("round robin", r);
+    }
+
+    // least loaded
+    {
+        Result r;
+        std::vector<VegaTmPnt> sent(total);
+        r.latency.resize(total);
+        std::atomic<int> done{0};
+        zfz::Event evt;
+        int created = 0;
+        auto detector = std::make_shared<ShardedExecutable<DetectTask>>(
+                [&](DetectInterface::AsyncCallback cb) {
+                    return std::make_shared<MockExecutable<DetectTask>>(batchSize, latencyOf(created++, slowdown), cb);
+                }, shards, [&](Tasks &tasks, DgError error) {
+                    CHECK(error == DG_OK);
+                    VegaTmPnt now("done");
+                    for(auto &task : tasks) {
+                        auto idx = (long)task->user_data_;
+                        r.latency[idx] = now - sent[idx];
+                    }
+                    if((done += (int)tasks.size()) == total) evt.set();
+                });
+
+        VegaTmPnt start("start");
+        produce(count, fps, batchSize, [&](int, Tasks &tasks) {
+            for(auto &task : tasks) sent[(long)task->user_data_].mark();
+            CHECK(detector->execute(tasks) == DG_OK);
+        });
+        evt.wait();
+        r.seconds = (VegaTmPnt("stop") - start) / 1000;
+        report("least loaded", r);
+        for(auto s = 0; s < shards; s++) {
+            auto st = detector->stats(s);
+            LOG(ERROR) << "  shard " << s << ": " << st.batches_ << " batches, latency " << st.latency_ms_ << " ms";
+        }
+    }
+
+    // stream affinity, batches mixing streams are split and joined
+    {
+        std::atomic<int> done{0};
+        zfz::Event evt;
+        int created = 0;
+        std::mutex mtx;
+        std::map<StreamId, std::set<int>> seen;
+        auto detector = std::make_shared<ShardedExecutable<DetectTask>>(
+                [&](DetectInterface::AsyncCallback cb) {
+                    int shard = created++;
+                    return std::make_shared<MockExecutable<DetectTask>>(batchSize, latencyOf(shard, slowdown),
+                            [&, cb, shard](Tasks &tasks, DgError error) {
+                                {
+                                    std::lock_guard<std::mutex> lock(mtx);
+                                    for(auto &task : tasks) seen[task->stream_id_].insert(shard);
+                                }
+                                cb(tasks, error);
+                            });
+                }, shards, [&](Tasks &tasks, DgError error) {
+                    CHECK(error == DG_OK);
+                    if((done += (int)tasks.size()) == total) evt.set();
+                }, ShardAffinity::STREAM);
+
+        produce(count, fps, batchSize, [&](int i, Tasks &tasks) {
+            for(auto j = 0; j < (int)tasks.size(); j++) {
+                tasks[j]->stream_id_ = (StreamId)((i + j) % (shards * 4));
+            }
+            CHECK(detector->execute(tasks) == DG_OK);
+        });
+        evt.wait();
+
+        for(auto &it : seen) {
+            CHECK(it.second.size() == 1) << "stream " << it.first << " on " << it.second.size() << " shards";
+        }
+        std::stringstream ss;
+        for(auto s = 0; s < shards; s++) {
+            ss << " " << detector->stats(s).streams_;
+        }
+        LOG(ERROR) << "stream affinity: " << seen.size() << " streams, pinned per shard" << ss.str();
+    }
+
+    return 0;
+}
@@ -3,6 +3,9 @@
 //
 
 #include "vega_interface.h"
+#include "vega_annexb.h"
+#include "vega_frame_handle.h"
+#include "vega_pacer.h"
 #include <sys/stat.h>
 #include <boost/algorithm/string.hpp>
 #include <zfz/zfz_event.hpp>
@@ -10,6 +13,7 @@
 #include <cstdlib>
 #include <iostream>
 #include <fstream>
+#include <iterator>
 #include "station/thread_pool.h"
 #include <sys/time.h>
 #include <signal.h>
@@ -18,19 +22,21 @@
 
 using namespace vega;
 
-std::shared_ptr<FetchFrameInterface> fetcher;
-std::shared_ptr<FreeFrameInterface> freer;
+std::shared_ptr<TaskRefExecutable<FetchFrameTask>> fetcher;
+std::shared_ptr<FrameReleaser> releaser;
 #define SID 100
 
-void fetchFrame(FrameId fid) {
+/**
+ * Frame is freed after fetch task is called back
+ */
+void fetchFrame(const FrameHandle &frame) {
     if(!fetcher) return;
 
-    LOG(ERROR) << "Fetch " << fid;
+    LOG(ERROR) << "Fetch " << frame.frameId();
     std::vector<std::shared_ptr<FetchFrameTask >> tasks;
 
     auto task = std::make_shared<FetchFrameTask >();
-    task->stream_id_ = SID;
-    task->frame_id_ = fid;
+    frame.bind(*task, fetcher->refs());
     task->type_ = SdkImage ::JPEG;
 
     tasks.push_back(task);
@@ -38,46 +44,52 @@ void fetchFrame(FrameId fid) {
     CHECK(err == DG_OK);
 
 }
-void deleteFrame(FrameId fid) {
-    if(!freer) return;
-
-    std::vector<std::shared_ptr<FreeFrameTask>> tasks;
-
-    auto task = std::make_shared<FreeFrameTask>();
-    task->stream_id_ = SID;
-    task->frame_id_ = fid;
-
-    tasks.push_back(task);
-    auto err = freer->execute(tasks);
-    CHECK(err == DG_OK);
-}
 
 int main(int argc, char *argv[]) {
     if(argc < 5) {
         LOG(ERROR) << "Arg count: " << argc;
-        LOG(ERROR) << "Usage: " << argv[0] << " <device_id> <image_list> <round> <fps> <jpegdir>";
+        LOG(ERROR) << "Usage: " << argv[0] << " <device_id> <image_list|annexb_file> <round> <fps> <jpegdir>";
+        LOG(ERROR) << "  annexb_file: H.264/H.265 elementary stream named *.h264, *.264, *.h265, *.265 or *.hevc";
         return 2;
     }
 
     int round = -1; // how many rounds
     int fps = 25;
     int device_id_ = 0;
-    std::vector<std::string> videoList;
+    std::vector<AccessUnit> packets;
 
     device_id_ = atoi(argv[1]);
     CHECK(device_id_ >= 0) << "Device ID: " << device_id_;
 
     std::string respath = argv[2];
-    auto vtype =ReadImageList::read_list(videoList, respath);
-    CHECK(!videoList.empty());
-    LOG(ERROR) << "Video list size: " << videoList.size();
+    auto ext = respath.substr(respath.find_last_of('.') + 1);
+    SdkImage vtype;
+    if(ext == "h264" || ext == "264" || ext == "h265" || ext == "265" || ext == "hevc") {
+        vtype = (ext == "h264" || ext == "264") ? SdkImage::H264 : SdkImage::H265;
+        CHECK(splitAnnexBFile(respath, vtype, packets) == DG_OK);
+    } else {
+        std::vector<std::string> videoList;
+        vtype = ReadImageList::read_list(videoList, respath);
+        for(auto &line : videoList) {
+            std::ifstream ifs(line, std::ios::binary);
+            CHECK(ifs.is_open()) << "File not exist: " << line;
+            auto bin = std::make_shared<std::vector<uint8_t>>((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+            AccessUnit packet;
+            packet.data_ = bin->data();
+            packet.len_ = bin->size();
+            packet.owner_ = bin;
+            packet.index_ = (long)packets.size();
+            packets.push_back(packet);
+        }
+    }
+    CHECK(!packets.empty());
+    LOG(ERROR) << "Packets: " << packets.size();
 
     round = atoi(argv[3]);
     CHECK(round > 0) << "Invalid Round: " << round;
 
     fps = atoi(argv[4]);
     CHECK(fps > 0) << "Invalid FPS: " << fps;
-    long intv = 1000000 / fps; // us of one frame
 
     std::string jpegDir;
     if(argc > 5) {
@@ -94,14 +106,14 @@ int main(int argc, char *argv[]) {
 
     SDKInit("");
 
-    freer = createFreeFrameInterface(
-            device_id_, "", Model::delete_frame, nullptr,
-            [&](std::vector<std::shared_ptr<FreeFrameTask >> &tasks, DgError error) {
-            });
-    CHECK(freer);
+    releaser = std::make_shared<FrameReleaser>([&](FreeFrameInterface::AsyncCallback cb) {
+        return createFreeFrameInterface(device_id_, "", Model::delete_frame, nullptr, cb);
+    });
 
-    fetcher = createFetchFrameInterface(
-            device_id_, "", Model::fetch_frame, nullptr,
+    fetcher = std::make_shared<TaskRefExecutable<FetchFrameTask>>(
+            [&](FetchFrameInterface::AsyncCallback cb) {
+                return createFetchFrameInterface(device_id_, "", Model::fetch_frame, nullptr, cb);
+            },
             [&](std::vector<std::shared_ptr<FetchFrameTask >> &tasks, DgError error) {
                 if(error == DG_OK) {
                     std::ofstream ofs;
@@ -109,10 +121,8 @@ int main(int argc, char *argv[]) {
                     ofs.open(path, std::ios::trunc | std::ios::binary);
                     CHECK(ofs.is_open());
                     ofs.write((const char *)tasks[0]->result_.data_.get(), tasks[0]->result_.data_len_);
-                    deleteFrame(tasks[0]->frame_id_);
                 }
             });
-    CHECK(fetcher);
 
     for(auto test_round = 0; test_round < round; test_round++) {
         LOG(ERROR) << "Start round " << test_round;
@@ -126,14 +136,10 @@ int main(int argc, char *argv[]) {
                     if(error != DG_OK) {
                         LOG(ERROR) << "Seq " << (long) tasks[0]->user_data_ << " failed: " << error;
                     }
-                    if(tasks[0]->data_) {
-                        delete [] tasks[0]->data_;
-                    }
-
                     if(tasks[0]->getBool(Option::video_eos_)) {
                         g_evt.set();
                     } else if(error == DG_OK && !tasks[0]->getBool(Option::discard_frame_)) {
-                        fetchFrame(tasks[0]->frame_id_);
+                        fetchFrame(releaser->handle(*tasks[0]));
                     }
 
                 });
@@ -141,37 +147,29 @@ int main(int argc, char *argv[]) {
 
         long seq = 0;
         bool needFetch = !jpegDir.empty() && test_round == 0;
-        for(auto &line : videoList) {
-            std::vector<std::shared_ptr<DecodeTask>> tasks;
-            auto task = std::make_shared<DecodeTask>();
-            /////////////////////////////////////////////////////////////
-            FILE* fp = fopen(line.c_str(), "rb");
-            CHECK(fp) << "File not exist: " << line;
-
-            fseek(fp,0L,SEEK_END);
-            auto sz = ftell(fp);
-            fseek(fp,0L,SEEK_SET);
-
-            auto bin = new char[sz];
-            fread(bin, 1, sz, fp);
-            fclose(fp);
-            /////////////////////////////////////////////////////////////
-
-            task->type_ = vtype;
-            task->stream_id_ = SID;
-            task->data_ = (uint8_t *)bin;
-            task->data_len_ = (int)sz;
-            task->user_data_ = (void *)seq;
-            task->put(Option::video_eos_, false);
-            task->put(Option::discard_frame_, !needFetch);
-            task->put(Option::video_dec_mode_e_,1);
-            //for cuda decoder
-            task->put(Option::packet_index_,seq++);
-
-            tasks.push_back(task);
-            decoder->execute(tasks);
-
-            usleep(intv);
+        if(!packets.empty()) {
+            // packets at absolute times of fps, late packets catch up instead of drifting
+            Pacer pacer;
+            auto id = pacer.add(fps, [&](long k) {
+                std::vector<std::shared_ptr<DecodeTask>> tasks;
+                auto task = std::make_shared<DecodeTask>();
+                // packet is not copied, task keeps it, packet_index_ is set for cuda decoder
+                packets[k].bind(*task, vtype);
+                task->stream_id_ = SID;
+                task->user_data_ = (void *)k;
+                task->put(Option::video_eos_, false);
+                task->put(Option::discard_frame_, !needFetch);
+                task->put(Option::video_dec_mode_e_,1);
+
+                tasks.push_back(task);
+                decoder->execute(tasks);
+                return k + 1 < (long)packets.size();
+            });
+            pacer.join(id);
+            auto st = pacer.stats(id);
+            LOG(ERROR) << "Paced " << st.calls_ << " packets, late mean " << st.mean_late_us_ << " us, max "
+                       << st.max_late_us_ << " us, " << st.behind_ << " behind a frame";
+            seq = (long)packets.size();
         }
 
 #if NEWCUDA
@@ -210,7 +208,7 @@ int main(int argc, char *argv[]) {
             }
             g_evt.reset();
         }
-        CHECK(rcv.load() == (long)videoList.size()+1);
+        CHECK(rcv.load() == (long)packets.size()+1);
 
         if(needFetch) {
             sleep(3); // sleep for a while to let fetcher and free done
@@ -219,7 +217,9 @@ int main(int argc, char *argv[]) {
     }
 
     fetcher.reset();
-    freer.reset();
+    LOG(ERROR) << "Frames released: " << releaser->stats().released_
+               << " in " << releaser->stats().batches_ << " batches";
+    releaser.reset();
 
     SDKDestroy();
     return 0;
@@ -3,6 +3,7 @@
 //
 
 #include "vega_interface.h"
+#include "vega_flow_control.h"
 #include <sys/stat.h>
 #include <boost/algorithm/string.hpp>
 #include <zfz/zfz_event.hpp>
@@ -24,7 +25,7 @@ vega::DoableStation  s_enc_video("EncVideo"), s_free_frame("FreeFrame");
 std::shared_ptr<vega::DecodeInterface> decoder;
 std::shared_ptr<vega::FetchFrameInterface > fetcher;
 std::shared_ptr<vega::FreeFrameInterface > freer;
-std::shared_ptr<vega::EncodeInterface> encoder;
+std::shared_ptr<vega::FlowControlExecutable<vega::EncodeTask>> encoder;
 
 using namespace vega;
 
@@ -175,16 +176,18 @@ void init()
             });
     CHECK(freer);
 
-    encoder = createEncodeInterface(
-            device_id_, "", Model::encode_video, nullptr,
+#if NEWCUDA
+    const int credits = 64;     // batches are pipelined
+#else
+    const int credits = 1;      // DO NOT send next batch tasks until previous ends
+#endif
+    encoder = std::make_shared<FlowControlExecutable<EncodeTask>>(
+            [=](EncodeInterface::AsyncCallback cb) {
+                return createEncodeInterface(device_id_, "", Model::encode_video, nullptr, cb);
+            },
             [=](std::vector<std::shared_ptr<EncodeTask>> &tasks, DgError error) {
                 LOGFULL << "Encode " << id << " done";
                 CHECK(error == DG_OK);
-#if !NEWCUDA
-                auto evt = (zfz::Event *)tasks[0]->user_data_;
-                CHECK(evt);
-                evt->set();
-#endif
 
                 auto fid = tasks[0]->frame_id_;
                 auto eos = tasks[0]->getBool("eos");
@@ -202,8 +205,7 @@ void init()
 				sendFree(fid, eos);
 				});
                 s_free_frame.put(doable);
-            });
-    CHECK(encoder);
+            }, credits, CreditPolicy::BLOCK);
 
 }
 
@@ -303,7 +305,6 @@ void sendFetch(FrameId fid , bool eos){
 }
 
 void sendEncode(FrameId fid, bool eos) {
-    zfz::Event event;
     std::vector<std::shared_ptr<EncodeTask>> encode_tasks;
     auto task = std::make_shared<EncodeTask>();
     task->type_ = h26x_type;       //H265 or H264
@@ -330,14 +331,9 @@ void sendEncode(FrameId fid, bool eos) {
     task->put("encoder_outtype", (int)vega::SdkImage::H264);
 #endif
 
-    task->user_data_ = &event;
     encode_tasks.push_back(task);
-    encoder->execute(encode_tasks);
-
-#if !NEWCUDA
-    event.wait();
-    event.reset();
-#endif
+    // waits until previous batch ends
+    CHECK(encoder->execute(encode_tasks) == DG_OK);
 }
 
 void sendFree(FrameId fid, bool eos) {